@@ -0,0 +1,92 @@
+#!/usr/bin/luajit
+--[[###########################################################################
+#                                                                             #
+# libloc - A library to determine the location of someone on the Internet     #
+#                                                                             #
+# Copyright (C) 2024 IPFire Development Team <info@ipfire.org>                #
+#                                                                             #
+# This library is free software; you can redistribute it and/or               #
+# modify it under the terms of the GNU Lesser General Public                  #
+# License as published by the Free Software Foundation; either                #
+# version 2.1 of the License, or (at your option) any later version.          #
+#                                                                             #
+# This library is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU           #
+# Lesser General Public License for more details.                             #
+#                                                                             #
+############################################################################--]]
+
+--[[
+	This example uses LuaJIT's FFI to call libloc directly, which allows
+	the JIT compiler to compile lookups into the calling code.
+
+	Usage: ffi.lua DATABASE ADDRESS...
+--]]
+
+local ffi = require("ffi")
+local bit = require("bit")
+
+ffi.cdef[[
+struct loc_database;
+
+struct loc_database_result {
+	uint32_t asn;
+	uint16_t country_code;
+	uint16_t flags;
+	uint32_t prefix;
+};
+
+struct loc_database* loc_database_open_path(const char* path);
+struct loc_database* loc_database_unref(struct loc_database* db);
+
+int loc_database_lookup_result(struct loc_database* db,
+	const char* address, struct loc_database_result* result);
+
+char* strerror(int errnum);
+]]
+
+local libloc = ffi.load("loc")
+
+-- See enum loc_network_flags
+local NETWORK_FLAG_ANYCAST = 4
+
+local function country_code(result)
+	if result.country_code == 0 then
+		return nil
+	end
+
+	return string.char(bit.rshift(result.country_code, 8), bit.band(result.country_code, 0xff))
+end
+
+if #arg < 1 then
+	io.stderr:write("Usage: " .. arg[0] .. " DATABASE ADDRESS...\n")
+	os.exit(2)
+end
+
+-- Open the database and free it when it is no longer being used
+local db = libloc.loc_database_open_path(arg[1])
+if db == nil then
+	error("Could not open " .. arg[1] .. ": " .. ffi.string(ffi.C.strerror(ffi.errno())))
+end
+
+db = ffi.gc(db, libloc.loc_database_unref)
+
+-- The result can be reused for every lookup
+local result = ffi.new("struct loc_database_result")
+
+for i = 2, #arg do
+	local r = libloc.loc_database_lookup_result(db, arg[i], result)
+
+	if r < 0 then
+		print(arg[i] .. ": invalid address")
+
+	elseif r > 0 then
+		print(arg[i] .. ": not found")
+
+	else
+		print(string.format("%s: country=%s asn=%d anycast=%s", arg[i],
+			country_code(result) or "-", result.asn,
+			tostring(bit.band(result.flags, NETWORK_FLAG_ANYCAST) ~= 0)))
+	end
+end
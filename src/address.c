@@ -23,12 +23,14 @@
 
 #include <libloc/address.h>
 #include <libloc/compat.h>
+#include <libloc/private.h>
 
 #define LOC_ADDRESS_BUFFERS				6
 #define LOC_ADDRESS_BUFFER_LENGTH		INET6_ADDRSTRLEN
 
-static char __loc_address_buffers[LOC_ADDRESS_BUFFERS][LOC_ADDRESS_BUFFER_LENGTH + 1];
-static int  __loc_address_buffer_idx = 0;
+// Each thread has its own buffers
+static __thread char __loc_address_buffers[LOC_ADDRESS_BUFFERS][LOC_ADDRESS_BUFFER_LENGTH + 1];
+static __thread int  __loc_address_buffer_idx = 0;
 
 static const char* __loc_address6_str(const struct in6_addr* address, char* buffer, size_t length) {
 	return inet_ntop(AF_INET6, address, buffer, length);
@@ -42,6 +44,13 @@ static const char* __loc_address4_str(const struct in6_addr* address, char* buff
 	return inet_ntop(AF_INET, &address4, buffer, length);
 }
 
+const char* loc_address_format(const struct in6_addr* address, char* buffer, size_t length) {
+	if (IN6_IS_ADDR_V4MAPPED(address))
+		return __loc_address4_str(address, buffer, length);
+	else
+		return __loc_address6_str(address, buffer, length);
+}
+
 const char* loc_address_str(const struct in6_addr* address) {
 	if (!address)
 		return NULL;
@@ -52,98 +61,240 @@ const char* loc_address_str(const struct in6_addr* address) {
 	// Prevent index from overflow
 	__loc_address_buffer_idx %= LOC_ADDRESS_BUFFERS;
 
-	if (IN6_IS_ADDR_V4MAPPED(address))
-		return __loc_address4_str(address, buffer, LOC_ADDRESS_BUFFER_LENGTH);
-	else
-		return __loc_address6_str(address, buffer, LOC_ADDRESS_BUFFER_LENGTH);
+	return loc_address_format(address, buffer, LOC_ADDRESS_BUFFER_LENGTH);
 }
 
-static void loc_address_from_address4(struct in6_addr* address,
-		const struct in_addr* address4) {
-	address->s6_addr32[0] = 0;
-	address->s6_addr32[1] = 0;
-	address->s6_addr32[2] = htonl(0xffff);
-	address->s6_addr32[3] = address4->s_addr;
+/*
+	Parses an IPv4 address in dotted quad notation. Like inet_pton(), this only
+	accepts exactly four decimal octets without any leading zeroes.
+*/
+static int loc_address_parse4(uint8_t* octets, const char* p, const char* end) {
+	unsigned int octet = 0;
+	unsigned int count = 0;
+	int digits = 0;
+
+	for (; p < end; p++) {
+		if (*p >= '0' && *p <= '9') {
+			// Leading zeroes are not allowed
+			if (digits && !octet)
+				return -EINVAL;
+
+			octet = octet * 10 + (*p - '0');
+			if (octet > 255)
+				return -EINVAL;
+
+			digits++;
+
+		} else if (*p == '.' && digits) {
+			if (count == 3)
+				return -EINVAL;
+
+			octets[count++] = octet;
+
+			octet = 0;
+			digits = 0;
+
+		} else {
+			return -EINVAL;
+		}
+	}
+
+	if (count < 3 || !digits)
+		return -EINVAL;
+
+	octets[count] = octet;
+
+	return 0;
 }
 
-int loc_address_parse(struct in6_addr* address, unsigned int* prefix, const char* string) {
-	char buffer[INET6_ADDRSTRLEN + 4];
+static inline int hex_digit_value(const char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+/*
+	Parses an IPv6 address with the same rules as inet_pton()
+*/
+static int loc_address_parse6(uint8_t* octets, const char* p, const char* end) {
+	uint8_t* o = octets;
+	uint8_t* compressed = NULL;
+	const char* group = NULL;
+	unsigned int value = 0;
+	unsigned int digits = 0;
+	int digit;
 	int r;
 
-	if (!address || !string) {
-		errno = EINVAL;
-		return 1;
-	}
+	memset(octets, 0, 16);
 
-	// Copy the string into the buffer
-	r = snprintf(buffer, sizeof(buffer) - 1, "%s", string);
-	if (r < 0)
-		return 1;
+	if (p == end)
+		return -EINVAL;
 
-	// Find /
-	char* p = strchr(buffer, '/');
-	if (p) {
-		// Terminate the IP address
-		*p++ = '\0';
+	// A leading colon must be part of ::
+	if (*p == ':') {
+		if (++p == end || *p != ':')
+			return -EINVAL;
 	}
 
-	int family = AF_UNSPEC;
+	group = p;
 
-	// Try parsing as an IPv6 address
-	r = inet_pton(AF_INET6, buffer, address);
-	switch (r) {
-		// This is not a valid IPv6 address
-		case 0:
-			break;
+	while (p < end) {
+		const char c = *p++;
+
+		digit = hex_digit_value(c);
+		if (digit >= 0) {
+			// Groups cannot have more than four digits
+			if (digits == 4)
+				return -EINVAL;
 
-		// This is a valid IPv6 address
-		case 1:
-			family = AF_INET6;
+			value = (value << 4) | digit;
+			digits++;
+			continue;
+		}
+
+		if (c == ':') {
+			group = p;
+
+			// This is ::
+			if (!digits) {
+				if (compressed)
+					return -EINVAL;
+
+				compressed = o;
+				continue;
+
+			// The address cannot end with a single colon
+			} else if (p == end) {
+				return -EINVAL;
+			}
+
+			if (o + 2 > octets + 16)
+				return -EINVAL;
+
+			*o++ = value >> 8;
+			*o++ = value & 0xff;
+
+			value = 0;
+			digits = 0;
+			continue;
+		}
+
+		// The last 32 bits might be written as an IPv4 address
+		if (c == '.' && o + 4 <= octets + 16) {
+			r = loc_address_parse4(o, group, end);
+			if (r)
+				return r;
+
+			o += 4;
+			digits = 0;
 			break;
+		}
 
-		// Unexpected error
-		default:
-			return 1;
+		return -EINVAL;
 	}
 
-	// Try parsing as an IPv4 address
-	if (!family) {
-		struct in_addr address4;
+	if (digits) {
+		if (o + 2 > octets + 16)
+			return -EINVAL;
 
-		r = inet_pton(AF_INET, buffer, &address4);
-		switch (r) {
-			// This was not a valid IPv4 address
-			case 0:
-				break;
+		*o++ = value >> 8;
+		*o++ = value & 0xff;
+	}
 
-			// This was a valid IPv4 address
-			case 1:
-				family = AF_INET;
+	// Expand ::
+	if (compressed) {
+		// :: must stand for at least one group
+		if (o == octets + 16)
+			return -EINVAL;
 
-				// Copy the result
-				loc_address_from_address4(address, &address4);
-				break;
+		const size_t length = o - compressed;
 
-			// Unexpected error
-			default:
-				return 1;
-		}
+		memmove(octets + 16 - length, compressed, length);
+		memset(compressed, 0, octets + 16 - length - compressed);
+
+		o = octets + 16;
 	}
 
-	// Invalid input
-	if (family == AF_UNSPEC) {
+	if (o != octets + 16)
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+	Parses an IPv4 or IPv6 address of the given length without copying it first.
+	IPv4 addresses will be mapped into IPv6 space.
+*/
+int loc_address_parse_length(struct in6_addr* address, const char* string, size_t length) {
+	struct in6_addr a;
+	int r;
+
+	// IPv6 addresses always have a colon, which cannot be part of an IPv4 address
+	if (memchr(string, ':', length)) {
+		r = loc_address_parse6(a.s6_addr, string, string + length);
+		if (r)
+			return r;
+
+	} else {
+		loc_address_reset(&a, AF_INET);
+
+		r = loc_address_parse4(a.s6_addr + 12, string, string + length);
+		if (r)
+			return r;
+	}
+
+	*address = a;
+
+	return 0;
+}
+
+/*
+	Parses an IPv4 or IPv6 address like the lookup functions of the database do.
+	IPv4 addresses will be mapped into IPv6 space.
+
+	This is meant for bindings which want to handle the address themselves,
+	so that they do not need to bring their own parser.
+*/
+LOC_EXPORT int loc_address_parse_fast(struct in6_addr* address, const char* string) {
+	if (!address || !string)
+		return -EINVAL;
+
+	return loc_address_parse_length(address, string, strlen(string));
+}
+
+int loc_address_parse(struct in6_addr* address, unsigned int* prefix, const char* string) {
+	int r;
+
+	if (!address || !string) {
 		errno = EINVAL;
 		return 1;
 	}
 
+	// Find /
+	const char* p = strchr(string, '/');
+
+	// Parse the address
+	r = loc_address_parse_length(address, string, (p) ? (size_t)(p - string) : strlen(string));
+	if (r) {
+		errno = -r;
+		return 1;
+	}
+
 	// Did the user request a prefix?
 	if (prefix) {
 		// Set the prefix to the default value
-		const unsigned int max_prefix = loc_address_family_bit_length(family);
+		const unsigned int max_prefix = loc_address_family_bit_length(loc_address_family(address));
 
 		// Parse the actual string
 		if (p) {
-			*prefix = strtol(p, NULL, 10);
+			*prefix = strtol(p + 1, NULL, 10);
 
 			// Check if prefix is within bounds
 			if (*prefix > max_prefix) {
@@ -159,3 +310,106 @@ int loc_address_parse(struct in6_addr* address, unsigned int* prefix, const char
 
 	return 0;
 }
+
+/*
+	Returns a bitmask with the lowest bits set as two words
+*/
+static inline void loc_address_host_bitmask(const unsigned int bits, uint64_t* hi, uint64_t* lo) {
+	// Shifting by 64 bits is undefined, so the full words are handled separately
+	if (bits >= 128) {
+		*hi = *lo = ~UINT64_C(0);
+
+	} else if (bits >= 64) {
+		*hi = (UINT64_C(1) << (bits - 64)) - 1;
+		*lo = ~UINT64_C(0);
+
+	} else {
+		*hi = 0;
+		*lo = (UINT64_C(1) << bits) - 1;
+	}
+}
+
+/*
+	Writes the smallest set of networks that covers all addresses from first
+	to last into prefixes, which has space for length elements. This does not
+	allocate any memory and LOC_ADDRESS_MAX_PREFIXES elements are always enough.
+
+	Returns the number of networks or a negative error code.
+*/
+int loc_address_summarize(const struct in6_addr* first, const struct in6_addr* last,
+		struct loc_address_prefix* prefixes, size_t length) {
+	uint64_t hi, lo;
+	uint64_t last_hi, last_lo;
+	uint64_t mask_hi, mask_lo;
+	uint64_t end_hi, end_lo;
+	unsigned int common;
+	unsigned int bits;
+	size_t count = 0;
+
+	const int family = loc_address_family(first);
+
+	// Both addresses must be of the same family
+	if (family != loc_address_family(last))
+		return -EINVAL;
+
+	// The range must not be empty
+	if (loc_address_cmp(first, last) > 0)
+		return -EINVAL;
+
+	// IPv4 addresses share their first 96 bits, so all arithmetic can happen in IPv6 space
+	const unsigned int offset = 128 - loc_address_family_bit_length(family);
+
+	loc_address_to_words(first, &hi, &lo);
+	loc_address_to_words(last, &last_hi, &last_lo);
+
+	for (;;) {
+		if (count >= length)
+			return -ENOBUFS;
+
+		// The network cannot have more host bits than the address has trailing zeroes
+		if (lo)
+			bits = __builtin_ctzll(lo);
+		else if (hi)
+			bits = 64 + __builtin_ctzll(hi);
+		else
+			bits = 128;
+
+		// It cannot reach beyond the first bit in which address and last differ
+		if (hi != last_hi)
+			common = __builtin_clzll(hi ^ last_hi);
+		else if (lo != last_lo)
+			common = 64 + __builtin_clzll(lo ^ last_lo);
+		else
+			common = 128;
+
+		if (bits > 128 - common)
+			bits = 128 - common;
+
+		loc_address_host_bitmask(bits, &mask_hi, &mask_lo);
+
+		// If the network ends after last, it has to be split in half once
+		if ((hi | mask_hi) > last_hi || ((hi | mask_hi) == last_hi && (lo | mask_lo) > last_lo))
+			loc_address_host_bitmask(--bits, &mask_hi, &mask_lo);
+
+		end_hi = hi | mask_hi;
+		end_lo = lo | mask_lo;
+
+		loc_address_from_words(&prefixes[count].address, hi, lo);
+		prefixes[count].prefix = 128 - offset - bits;
+		count++;
+
+		// Stop if we have reached the end
+		if (end_hi == last_hi && end_lo == last_lo)
+			break;
+
+		// The next network starts right after this one
+		hi = end_hi;
+		lo = end_lo + 1;
+
+		// Carry into the upper word if the lower word overflows
+		if (!lo)
+			hi++;
+	}
+
+	return count;
+}
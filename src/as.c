@@ -57,7 +57,7 @@ LOC_EXPORT int loc_as_new(struct loc_ctx* ctx, struct loc_as** as, uint32_t numb
 }
 
 LOC_EXPORT struct loc_as* loc_as_ref(struct loc_as* as) {
-	as->refcount++;
+	__atomic_add_fetch(&as->refcount, 1, __ATOMIC_RELAXED);
 
 	return as;
 }
@@ -73,7 +73,7 @@ static void loc_as_free(struct loc_as* as) {
 }
 
 LOC_EXPORT struct loc_as* loc_as_unref(struct loc_as* as) {
-	if (--as->refcount > 0)
+	if (__atomic_sub_fetch(&as->refcount, 1, __ATOMIC_ACQ_REL) > 0)
 		return NULL;
 
 	loc_as_free(as);
@@ -0,0 +1,153 @@
+/*
+	libloc - A library to determine the location of someone on the Internet
+
+	Copyright (C) 2024 IPFire Development Team <info@ipfire.org>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libloc/libloc.h>
+#include <libloc/address.h>
+
+/*
+	This benchmark measures the address arithmetic that is being used
+	in every lookup and whenever networks are being split or summarized.
+
+	Usage: bench-address [ADDRESSES]
+*/
+
+#define ROUNDS 16
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void random_addresses(struct in6_addr* addresses, unsigned int count, const int family) {
+	// Always generate the same addresses
+	srandom(1);
+
+	for (unsigned int i = 0; i < count; i++) {
+		for (unsigned int j = 0; j < 16; j++)
+			addresses[i].s6_addr[j] = random();
+
+		if (family == AF_INET) {
+			loc_address_reset(&addresses[i], AF_INET);
+			addresses[i].s6_addr32[3] = random();
+		}
+	}
+}
+
+static void report(const char* function, const int family, unsigned int count, double t) {
+	printf("%-28s %6s %10.2fns\n", function,
+		(family == AF_INET) ? "IPv4" : "IPv6", t * 1e9 / count / ROUNDS);
+}
+
+// Keeps the compiler from optimizing everything away
+static volatile unsigned long sink;
+
+static void bench(const struct in6_addr* addresses, unsigned int count, const int family) {
+	struct in6_addr address;
+	unsigned long sum = 0;
+	double t0;
+
+	t0 = now();
+	for (unsigned int round = 0; round < ROUNDS; round++)
+		for (unsigned int i = 1; i < count; i++)
+			sum += loc_address_cmp(&addresses[i - 1], &addresses[i]);
+	report("loc_address_cmp", family, count, now() - t0);
+
+	t0 = now();
+	for (unsigned int round = 0; round < ROUNDS; round++)
+		for (unsigned int i = 1; i < count; i++)
+			sum += loc_address_common_bits(&addresses[i - 1], &addresses[i]);
+	report("loc_address_common_bits", family, count, now() - t0);
+
+	t0 = now();
+	for (unsigned int round = 0; round < ROUNDS; round++)
+		for (unsigned int i = 0; i < count; i++)
+			sum += loc_address_bit_length(&addresses[i]);
+	report("loc_address_bit_length", family, count, now() - t0);
+
+	t0 = now();
+	for (unsigned int round = 0; round < ROUNDS; round++)
+		for (unsigned int i = 0; i < count; i++)
+			sum += loc_address_all_zeroes(&addresses[i]) + loc_address_all_ones(&addresses[i]);
+	report("loc_address_all_zeroes/ones", family, count, now() - t0);
+
+	t0 = now();
+	for (unsigned int round = 0; round < ROUNDS; round++)
+		for (unsigned int i = 0; i < count; i++) {
+			address = loc_prefix_to_bitmask(i % 129);
+			sum += address.s6_addr[i % 16];
+		}
+	report("loc_prefix_to_bitmask", family, count, now() - t0);
+
+	t0 = now();
+	for (unsigned int round = 0; round < ROUNDS; round++)
+		for (unsigned int i = 0; i < count; i++) {
+			address = addresses[i];
+			loc_address_increment(&address);
+			sum += address.s6_addr[15];
+		}
+	report("loc_address_increment", family, count, now() - t0);
+
+	t0 = now();
+	for (unsigned int round = 0; round < ROUNDS; round++)
+		for (unsigned int i = 0; i < count; i++) {
+			address = addresses[i];
+			loc_address_decrement(&address);
+			sum += address.s6_addr[15];
+		}
+	report("loc_address_decrement", family, count, now() - t0);
+
+	t0 = now();
+	for (unsigned int round = 0; round < ROUNDS; round++)
+		for (unsigned int i = 1; i < count; i++) {
+			loc_address_sub(&address, &addresses[i], &addresses[i - 1]);
+			sum += address.s6_addr[15];
+		}
+	report("loc_address_sub", family, count, now() - t0);
+
+	sink = sum;
+}
+
+int main(int argc, char** argv) {
+	struct in6_addr* addresses = NULL;
+	unsigned int count = 1000000;
+
+	if (argc > 1)
+		count = strtoul(argv[1], NULL, 10);
+
+	addresses = calloc(count, sizeof(*addresses));
+	if (!addresses)
+		exit(EXIT_FAILURE);
+
+	printf("%-28s %6s %12s\n", "FUNCTION", "FAMILY", "TIME/CALL");
+
+	random_addresses(addresses, count, AF_INET6);
+	bench(addresses, count, AF_INET6);
+
+	random_addresses(addresses, count, AF_INET);
+	bench(addresses, count, AF_INET);
+
+	free(addresses);
+
+	return EXIT_SUCCESS;
+}
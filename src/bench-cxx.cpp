@@ -0,0 +1,214 @@
+/*
+	libloc - A library to determine the location of someone on the Internet
+
+	Copyright (C) 2024 IPFire Development Team <info@ipfire.org>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <vector>
+
+#include <syslog.h>
+#include <arpa/inet.h>
+
+#include <libloc/libloc.hpp>
+
+extern "C" {
+#include <libloc/writer.h>
+}
+
+/*
+	This benchmark performs the same lookups and enumerations with the C API
+	and with the C++ interface and checks that both return the same results
+	in roughly the same time.
+
+	Without a database, a database of random networks will be used instead.
+
+	Usage: bench-cxx [DATABASE]
+*/
+
+#define NETWORKS 100000
+#define ADDRESSES 10000000
+
+static double now() {
+	return std::chrono::duration<double>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int write_database(struct loc_ctx* ctx, FILE* f) {
+	struct loc_writer* writer = NULL;
+	struct loc_network* network = NULL;
+	char string[INET_ADDRSTRLEN + 4];
+	int r;
+
+	// Always generate the same networks
+	srandom(1);
+
+	r = loc_writer_new(ctx, &writer, NULL, NULL);
+	if (r)
+		return r;
+
+	for (unsigned int i = 0; i < NETWORKS; i++) {
+		snprintf(string, sizeof(string), "%ld.%ld.%ld.0/%ld",
+			random() % 224, random() % 256, random() % 256, 8 + random() % 17);
+
+		r = loc_writer_add_network(writer, &network, string);
+		if (r == -EBUSY)
+			continue;
+		else if (r)
+			goto ERROR;
+
+		loc_network_set_country_code(network, (i % 2) ? "DE" : "FR");
+		loc_network_set_asn(network, 1 + random() % 16);
+		loc_network_unref(network);
+	}
+
+	r = loc_writer_write(writer, f, LOC_DATABASE_VERSION_UNSET);
+
+ERROR:
+	loc_writer_unref(writer);
+
+	return r;
+}
+
+static void report(const char* operation, size_t count, double t) {
+	printf("%-24s %10zu %11.3fs %10.1fns\n", operation, count, t, t * 1e9 / count);
+}
+
+int main(int argc, char** argv) {
+	loc::context ctx = loc::context::create();
+	FILE* f = NULL;
+
+	loc_set_log_priority(ctx.get(), LOG_ERR);
+
+	if (argc > 1) {
+		f = fopen(argv[1], "r");
+		if (!f) {
+			fprintf(stderr, "Could not open %s: %m\n", argv[1]);
+			return EXIT_FAILURE;
+		}
+	} else {
+		f = tmpfile();
+		if (!f)
+			return EXIT_FAILURE;
+
+		if (write_database(ctx.get(), f)) {
+			fprintf(stderr, "Could not write database: %m\n");
+			fclose(f);
+			return EXIT_FAILURE;
+		}
+	}
+
+	try {
+		loc::database db(ctx, f);
+		fclose(f);
+
+		// Always generate the same addresses
+		srandom(1);
+
+		std::vector<in6_addr> addresses(ADDRESSES);
+
+		for (auto& address : addresses) {
+			memset(&address, 0, sizeof(address));
+
+			address.s6_addr32[2] = htonl(0xffff);
+			address.s6_addr32[3] = random();
+		}
+
+		std::vector<loc::database::record> c_results(addresses.size());
+		std::vector<loc::database::record> cxx_results(addresses.size());
+
+		printf("%-24s %10s %12s %12s\n", "OPERATION", "COUNT", "TIME", "TIME/ITEM");
+
+		// Lookups with the C API
+		double t = now();
+
+		for (size_t i = 0; i < addresses.size(); i++) {
+			int r = loc_database_lookup_record(db.get(), &addresses[i], &c_results[i]);
+			if (r < 0)
+				return EXIT_FAILURE;
+			else if (r)
+				c_results[i] = loc_database_record();
+		}
+
+		report("C lookup", addresses.size(), now() - t);
+
+		// Lookups with the C++ interface
+		t = now();
+
+		db.lookup(addresses.data(), cxx_results.data(), addresses.size());
+
+		report("C++ lookup", addresses.size(), now() - t);
+
+		if (memcmp(c_results.data(), cxx_results.data(),
+				sizeof(*c_results.data()) * c_results.size()) != 0) {
+			fprintf(stderr, "Lookups returned different results\n");
+			return EXIT_FAILURE;
+		}
+
+		// Enumerate all networks with the C API
+		struct loc_database_enumerator* e = NULL;
+		struct loc_network* network = NULL;
+		size_t c_networks = 0;
+		uint64_t c_sum = 0;
+
+		t = now();
+
+		if (loc_database_enumerator_new(&e, db.get(), LOC_DB_ENUMERATE_NETWORKS, 0))
+			return EXIT_FAILURE;
+
+		for (;;) {
+			if (loc_database_enumerator_next_network(e, &network))
+				return EXIT_FAILURE;
+
+			if (!network)
+				break;
+
+			c_sum += loc_network_get_asn(network);
+			c_networks++;
+
+			loc_network_unref(network);
+		}
+
+		loc_database_enumerator_unref(e);
+
+		report("C enumeration", c_networks, now() - t);
+
+		// Enumerate all networks with the C++ interface
+		size_t cxx_networks = 0;
+		uint64_t cxx_sum = 0;
+
+		t = now();
+
+		for (const auto& n : db.networks()) {
+			cxx_sum += n.asn();
+			cxx_networks++;
+		}
+
+		report("C++ enumeration", cxx_networks, now() - t);
+
+		if (c_networks != cxx_networks || c_sum != cxx_sum) {
+			fprintf(stderr, "Enumerations returned different results\n");
+			return EXIT_FAILURE;
+		}
+
+	} catch (const std::exception& e) {
+		fprintf(stderr, "%s\n", e.what());
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,338 @@
+/*
+	libloc - A library to determine the location of someone on the Internet
+
+	Copyright (C) 2024 IPFire Development Team <info@ipfire.org>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include <libloc/libloc.h>
+#include <libloc/database.h>
+#include <libloc/network.h>
+#include <libloc/writer.h>
+
+/*
+	This benchmark exports all flattened networks of a database using a
+	different number of threads, each enumerating one partition, and checks
+	that the concatenated output is identical.
+
+	Without a database, a database of random networks will be used instead.
+
+	Usage: bench-enumerator [DATABASE]
+*/
+
+#define NETWORKS 500000
+
+static const unsigned int THREADS[] = { 1, 2, 4, 8, 16, 0 };
+
+struct partition {
+	struct loc_database* db;
+	unsigned int partition;
+	unsigned int partitions;
+
+	// Output
+	char* buffer;
+	size_t length;
+	size_t size;
+	int r;
+};
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int write_database(struct loc_ctx* ctx, FILE* f) {
+	struct loc_writer* writer = NULL;
+	struct loc_network* network = NULL;
+	const char* country_codes[] = { "DE", "FR", "US", "XX", };
+	char address[INET6_ADDRSTRLEN];
+	char string[INET6_ADDRSTRLEN + 4];
+	struct in6_addr a;
+	int r;
+
+	// Always generate the same networks
+	srandom(1);
+
+	r = loc_writer_new(ctx, &writer, NULL, NULL);
+	if (r)
+		return r;
+
+	for (unsigned int i = 0; i < NETWORKS; i++) {
+		// Two thirds of all networks are IPv4
+		if (i % 3) {
+			snprintf(string, sizeof(string), "%ld.%ld.%ld.0/%ld",
+				random() % 224, random() % 256, random() % 256, 8 + random() % 17);
+		} else {
+			memset(&a, 0, sizeof(a));
+
+			a.s6_addr[0] = 0x20;
+			a.s6_addr[1] = random() % 16;
+
+			for (unsigned int j = 2; j < 8; j++)
+				a.s6_addr[j] = random() % 256;
+
+			inet_ntop(AF_INET6, &a, address, sizeof(address));
+
+			snprintf(string, sizeof(string), "%s/%ld", address, 16 + random() % 33);
+		}
+
+		r = loc_writer_add_network(writer, &network, string);
+		switch (r) {
+			case 0:
+				break;
+
+			// Skip any duplicates
+			case -EBUSY:
+				continue;
+
+			default:
+				goto ERROR;
+		}
+
+		loc_network_set_country_code(network, country_codes[random() % 4]);
+		loc_network_set_asn(network, 1 + random() % 16);
+		loc_network_unref(network);
+	}
+
+	r = loc_writer_write(writer, f, LOC_DATABASE_VERSION_UNSET);
+
+ERROR:
+	loc_writer_unref(writer);
+
+	return r;
+}
+
+static int append(struct partition* p, const char* s) {
+	const size_t length = strlen(s);
+
+	if (p->length + length + 1 > p->size) {
+		size_t size = (p->size) ? p->size * 2 : 65536;
+
+		while (size < p->length + length + 1)
+			size *= 2;
+
+		char* buffer = realloc(p->buffer, size);
+		if (!buffer)
+			return -ENOMEM;
+
+		p->buffer = buffer;
+		p->size = size;
+	}
+
+	memcpy(p->buffer + p->length, s, length);
+	p->length += length;
+	p->buffer[p->length++] = '\n';
+
+	return 0;
+}
+
+static void* export_partition(void* data) {
+	struct loc_database_enumerator* enumerator = NULL;
+	struct loc_network* network = NULL;
+	struct partition* p = data;
+
+	p->r = loc_database_enumerator_new(&enumerator, p->db,
+		LOC_DB_ENUMERATE_NETWORKS, LOC_DB_ENUMERATOR_FLAGS_FLATTEN);
+	if (p->r)
+		return NULL;
+
+	p->r = loc_database_enumerator_set_partition(enumerator, p->partition, p->partitions);
+	if (p->r)
+		goto ERROR;
+
+	for (;;) {
+		p->r = loc_database_enumerator_next_network(enumerator, &network);
+		if (p->r || !network)
+			break;
+
+		p->r = append(p, loc_network_str(network));
+		loc_network_unref(network);
+		if (p->r)
+			break;
+	}
+
+ERROR:
+	loc_database_enumerator_unref(enumerator);
+
+	return NULL;
+}
+
+static int export(struct loc_database* db, unsigned int threads,
+		char** buffer, size_t* length, double* t) {
+	struct partition* partitions = NULL;
+	pthread_t* workers = NULL;
+	size_t offset = 0;
+	double t0;
+	int r = 0;
+
+	partitions = calloc(threads, sizeof(*partitions));
+	workers = calloc(threads, sizeof(*workers));
+	if (!partitions || !workers) {
+		r = -ENOMEM;
+		goto ERROR;
+	}
+
+	t0 = now();
+
+	for (unsigned int i = 0; i < threads; i++) {
+		partitions[i].db = db;
+		partitions[i].partition = i;
+		partitions[i].partitions = threads;
+
+		r = -pthread_create(&workers[i], NULL, export_partition, &partitions[i]);
+		if (r) {
+			threads = i;
+			break;
+		}
+	}
+
+	for (unsigned int i = 0; i < threads; i++) {
+		pthread_join(workers[i], NULL);
+
+		if (partitions[i].r && !r)
+			r = partitions[i].r;
+	}
+
+	*t = now() - t0;
+
+	if (r)
+		goto ERROR;
+
+	// Concatenate all partitions
+	*length = 0;
+
+	for (unsigned int i = 0; i < threads; i++)
+		*length += partitions[i].length;
+
+	*buffer = malloc(*length + 1);
+	if (!*buffer) {
+		r = -ENOMEM;
+		goto ERROR;
+	}
+
+	for (unsigned int i = 0; i < threads; i++) {
+		if (partitions[i].length)
+			memcpy(*buffer + offset, partitions[i].buffer, partitions[i].length);
+
+		offset += partitions[i].length;
+	}
+
+ERROR:
+	if (partitions) {
+		for (unsigned int i = 0; i < threads; i++) {
+			if (partitions[i].buffer)
+				free(partitions[i].buffer);
+		}
+
+		free(partitions);
+	}
+	if (workers)
+		free(workers);
+
+	return r;
+}
+
+int main(int argc, char** argv) {
+	struct loc_database* db = NULL;
+	struct loc_ctx* ctx = NULL;
+	char* reference = NULL;
+	size_t reference_length = 0;
+	char* buffer = NULL;
+	size_t length = 0;
+	FILE* f = NULL;
+	double t1 = 0;
+	double t;
+	int r = 1;
+
+	if (loc_new(&ctx))
+		exit(EXIT_FAILURE);
+
+	loc_set_log_priority(ctx, LOG_ERR);
+
+	if (argc > 1) {
+		f = fopen(argv[1], "r");
+		if (!f) {
+			fprintf(stderr, "Could not open %s: %m\n", argv[1]);
+			goto ERROR;
+		}
+	} else {
+		f = tmpfile();
+		if (!f)
+			goto ERROR;
+
+		r = write_database(ctx, f);
+		if (r) {
+			fprintf(stderr, "Could not write database: %m\n");
+			goto ERROR;
+		}
+	}
+
+	r = loc_database_new(ctx, &db, f);
+	if (r) {
+		fprintf(stderr, "Could not open database: %m\n");
+		goto ERROR;
+	}
+
+	printf("%8s %12s %8s\n", "THREADS", "TIME", "SPEEDUP");
+
+	for (const unsigned int* threads = THREADS; *threads; threads++) {
+		r = export(db, *threads, &buffer, &length, &t);
+		if (r) {
+			fprintf(stderr, "Could not export: %s\n", strerror(-r));
+			goto ERROR;
+		}
+
+		if (!reference) {
+			reference = buffer;
+			reference_length = length;
+			t1 = t;
+		} else {
+			// The output must not depend on the number of threads
+			if (length != reference_length || memcmp(reference, buffer, length) != 0) {
+				fprintf(stderr, "Output with %u threads differs\n", *threads);
+				r = 1;
+				goto ERROR;
+			}
+
+			free(buffer);
+		}
+
+		buffer = NULL;
+
+		printf("%8u %11.3fs %7.2fx\n", *threads, t, t1 / t);
+	}
+
+ERROR:
+	if (buffer)
+		free(buffer);
+	if (reference)
+		free(reference);
+	if (db)
+		loc_database_unref(db);
+	if (f)
+		fclose(f);
+	loc_unref(ctx);
+
+	return (r) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,236 @@
+/*
+	libloc - A library to determine the location of someone on the Internet
+
+	Copyright (C) 2024 IPFire Development Team <info@ipfire.org>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include <libloc/libloc.h>
+#include <libloc/address.h>
+#include <libloc/database.h>
+#include <libloc/network.h>
+#include <libloc/writer.h>
+
+/*
+	This benchmark parses and looks up random addresses
+	in a randomly generated database.
+
+	Usage: bench-lookup [ADDRESSES]
+*/
+
+#define NETWORKS 100000
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void random_address(struct in6_addr* address) {
+	memset(address, 0, sizeof(*address));
+
+	// Two thirds of all addresses are IPv4
+	if (random() % 3) {
+		loc_address_reset(address, AF_INET);
+		address->s6_addr32[3] = random();
+
+	} else {
+		address->s6_addr[0] = 0x20;
+		address->s6_addr[1] = random() % 16;
+
+		for (unsigned int i = 2; i < 16; i++)
+			address->s6_addr[i] = random();
+	}
+}
+
+static int write_database(struct loc_ctx* ctx, FILE* f) {
+	struct loc_writer* writer = NULL;
+	struct loc_network* network = NULL;
+	char string[INET6_ADDRSTRLEN + 4];
+	struct in6_addr address;
+	int r;
+
+	r = loc_writer_new(ctx, &writer, NULL, NULL);
+	if (r)
+		return r;
+
+	for (unsigned int i = 0; i < NETWORKS; i++) {
+		random_address(&address);
+
+		snprintf(string, sizeof(string), "%s/%ld", loc_address_str(&address),
+			IN6_IS_ADDR_V4MAPPED(&address) ? 8 + random() % 17 : 16 + random() % 33);
+
+		r = loc_writer_add_network(writer, &network, string);
+		switch (r) {
+			case 0:
+				break;
+
+			// Skip any duplicates
+			case -EBUSY:
+				continue;
+
+			default:
+				goto ERROR;
+		}
+
+		loc_network_set_asn(network, 1 + random() % 65536);
+		loc_network_unref(network);
+	}
+
+	r = loc_writer_write(writer, f, LOC_DATABASE_VERSION_UNSET);
+
+ERROR:
+	loc_writer_unref(writer);
+
+	return r;
+}
+
+static void report(const char* operation, unsigned int count, double t) {
+	printf("%-28s %10u %11.3fs %10.0fns\n", operation, count, t, t * 1e9 / count);
+}
+
+static int callback(const char* string, size_t length, struct loc_network* network, void* data) {
+	unsigned int* found = data;
+
+	if (network)
+		(*found)++;
+
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	struct loc_database* db = NULL;
+	struct loc_network* network = NULL;
+	struct loc_ctx* ctx = NULL;
+	struct in6_addr address;
+	struct in_addr address4;
+	char** strings = NULL;
+	char* buffer = NULL;
+	unsigned int count = 1000000;
+	unsigned int found = 0;
+	size_t length = 0;
+	FILE* f = NULL;
+	double t0;
+	int r = 1;
+
+	if (argc > 1)
+		count = strtoul(argv[1], NULL, 10);
+
+	if (loc_new(&ctx))
+		exit(EXIT_FAILURE);
+
+	loc_set_log_priority(ctx, LOG_ERR);
+
+	// Always generate the same data
+	srandom(1);
+
+	f = tmpfile();
+	if (!f)
+		goto ERROR;
+
+	r = write_database(ctx, f);
+	if (r) {
+		fprintf(stderr, "Could not write database: %m\n");
+		goto ERROR;
+	}
+
+	r = loc_database_new(ctx, &db, f);
+	if (r) {
+		fprintf(stderr, "Could not open database: %m\n");
+		goto ERROR;
+	}
+
+	strings = calloc(count, sizeof(*strings));
+	buffer = malloc(count * (INET6_ADDRSTRLEN + 1));
+	if (!strings || !buffer) {
+		r = 1;
+		goto ERROR;
+	}
+
+	// Generate random addresses
+	for (unsigned int i = 0; i < count; i++) {
+		random_address(&address);
+
+		strings[i] = strdup(loc_address_str(&address));
+		if (!strings[i]) {
+			r = 1;
+			goto ERROR;
+		}
+
+		length += sprintf(buffer + length, "%s\n", strings[i]);
+	}
+
+	printf("%-28s %10s %12s %12s\n", "OPERATION", "ADDRESSES", "TIME", "TIME/CALL");
+
+	t0 = now();
+	for (unsigned int i = 0; i < count; i++) {
+		if (inet_pton(AF_INET6, strings[i], &address) != 1)
+			inet_pton(AF_INET, strings[i], &address4);
+	}
+	report("inet_pton", count, now() - t0);
+
+	t0 = now();
+	for (unsigned int i = 0; i < count; i++) {
+		r = loc_address_parse(&address, NULL, strings[i]);
+		if (r)
+			goto ERROR;
+	}
+	report("loc_address_parse", count, now() - t0);
+
+	t0 = now();
+	for (unsigned int i = 0; i < count; i++) {
+		r = loc_database_lookup_from_string(db, strings[i], &network);
+		if (r)
+			goto ERROR;
+
+		if (network)
+			loc_network_unref(network);
+	}
+	report("lookup from string", count, now() - t0);
+
+	t0 = now();
+	r = loc_database_lookup_from_buffer(db, buffer, length, callback, &found);
+	if (r)
+		goto ERROR;
+	report("lookup from buffer", count, now() - t0);
+
+	printf("\n%u of %u addresses were found\n", found, count);
+
+ERROR:
+	if (strings) {
+		for (unsigned int i = 0; i < count; i++) {
+			if (strings[i])
+				free(strings[i]);
+		}
+
+		free(strings);
+	}
+	if (buffer)
+		free(buffer);
+	if (db)
+		loc_database_unref(db);
+	if (f)
+		fclose(f);
+	loc_unref(ctx);
+
+	return (r) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
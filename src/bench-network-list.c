@@ -0,0 +1,283 @@
+/*
+	libloc - A library to determine the location of someone on the Internet
+
+	Copyright (C) 2024 IPFire Development Team <info@ipfire.org>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include <libloc/libloc.h>
+#include <libloc/network.h>
+#include <libloc/network-list.h>
+
+/*
+	This benchmark measures the bulk operations of network lists.
+
+	Inserting networks one at a time in random order is quadratic,
+	so those operations only run on a tenth of all networks.
+
+	Usage: bench-network-list [NETWORKS]
+*/
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int make_random_networks(struct loc_ctx* ctx,
+		struct loc_network** networks, unsigned int count) {
+	struct in6_addr address;
+	int r;
+
+	// Always generate the same networks
+	srandom(1);
+
+	for (unsigned int i = 0; i < count; i++) {
+		memset(&address, 0, sizeof(address));
+
+		address.s6_addr[0] = 0x20;
+		address.s6_addr[1] = random() % 16;
+
+		for (unsigned int j = 2; j < 8; j++)
+			address.s6_addr[j] = random() % 256;
+
+		r = loc_network_new(ctx, &networks[i], &address, 16 + random() % 33);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
+static int cmp_networks(const void* p1, const void* p2) {
+	struct loc_network* n1 = *(struct loc_network**)p1;
+	struct loc_network* n2 = *(struct loc_network**)p2;
+
+	return loc_network_cmp(n1, n2);
+}
+
+static void report(const char* operation, unsigned int count, double t) {
+	printf("%-28s %10u %11.3fs\n", operation, count, t);
+}
+
+static int bench_push(struct loc_ctx* ctx, const char* operation,
+		struct loc_network** networks, unsigned int count) {
+	struct loc_network_list* list = NULL;
+	double t0;
+	int r;
+
+	r = loc_network_list_new(ctx, &list);
+	if (r)
+		return r;
+
+	t0 = now();
+
+	for (unsigned int i = 0; i < count; i++) {
+		r = loc_network_list_push(list, networks[i]);
+		if (r)
+			goto ERROR;
+	}
+
+	report(operation, count, now() - t0);
+
+ERROR:
+	loc_network_list_unref(list);
+
+	return r;
+}
+
+static int bench_append(struct loc_ctx* ctx, struct loc_network** networks, unsigned int count) {
+	struct loc_network_list* list = NULL;
+	double t0;
+	int r;
+
+	r = loc_network_list_new(ctx, &list);
+	if (r)
+		return r;
+
+	t0 = now();
+
+	for (unsigned int i = 0; i < count; i++) {
+		r = loc_network_list_append(list, networks[i]);
+		if (r)
+			goto ERROR;
+	}
+
+	r = loc_network_list_sort(list);
+	if (r)
+		goto ERROR;
+
+	report("append + sort (random)", count, now() - t0);
+
+ERROR:
+	loc_network_list_unref(list);
+
+	return r;
+}
+
+static int bench_merge(struct loc_ctx* ctx, const char* operation,
+		struct loc_network** networks, unsigned int count, int push) {
+	struct loc_network_list* lists[2] = { NULL, NULL };
+	double t0;
+	int r;
+
+	for (unsigned int i = 0; i < 2; i++) {
+		r = loc_network_list_new(ctx, &lists[i]);
+		if (r)
+			goto ERROR;
+	}
+
+	// Split the (sorted) networks into two interleaved lists
+	for (unsigned int i = 0; i < count; i++) {
+		r = loc_network_list_push(lists[i % 2], networks[i]);
+		if (r)
+			goto ERROR;
+	}
+
+	t0 = now();
+
+	if (push) {
+		for (unsigned int i = 1; i < count; i += 2) {
+			r = loc_network_list_push(lists[0], networks[i]);
+			if (r)
+				goto ERROR;
+		}
+	} else {
+		r = loc_network_list_merge(lists[0], lists[1]);
+		if (r)
+			goto ERROR;
+	}
+
+	report(operation, count, now() - t0);
+
+ERROR:
+	for (unsigned int i = 0; i < 2; i++) {
+		if (lists[i])
+			loc_network_list_unref(lists[i]);
+	}
+
+	return r;
+}
+
+static int bench_pop_first(struct loc_ctx* ctx, struct loc_network** networks, unsigned int count) {
+	struct loc_network_list* list = NULL;
+	struct loc_network* network = NULL;
+	double t0;
+	int r;
+
+	r = loc_network_list_new(ctx, &list);
+	if (r)
+		return r;
+
+	for (unsigned int i = 0; i < count; i++) {
+		r = loc_network_list_push(list, networks[i]);
+		if (r)
+			goto ERROR;
+	}
+
+	t0 = now();
+
+	while ((network = loc_network_list_pop_first(list)))
+		loc_network_unref(network);
+
+	report("pop first", count, now() - t0);
+
+ERROR:
+	loc_network_list_unref(list);
+
+	return r;
+}
+
+int main(int argc, char** argv) {
+	struct loc_network** networks = NULL;
+	struct loc_network** sorted = NULL;
+	struct loc_ctx* ctx = NULL;
+	unsigned int count = 1000000;
+	int r = 1;
+
+	if (argc > 1)
+		count = strtoul(argv[1], NULL, 10);
+
+	if (loc_new(&ctx))
+		exit(EXIT_FAILURE);
+
+	loc_set_log_priority(ctx, LOG_ERR);
+
+	networks = calloc(count, sizeof(*networks));
+	sorted = calloc(count, sizeof(*sorted));
+	if (!networks || !sorted)
+		goto ERROR;
+
+	r = make_random_networks(ctx, networks, count);
+	if (r) {
+		fprintf(stderr, "Could not create networks: %m\n");
+		goto ERROR;
+	}
+
+	// Keep another copy in order
+	memcpy(sorted, networks, count * sizeof(*sorted));
+	qsort(sorted, count, sizeof(*sorted), cmp_networks);
+
+	printf("%-28s %10s %12s\n", "OPERATION", "NETWORKS", "TIME");
+
+	r = bench_push(ctx, "push (in order)", sorted, count);
+	if (r)
+		goto ERROR;
+
+	r = bench_push(ctx, "push (random)", networks, count / 10);
+	if (r)
+		goto ERROR;
+
+	r = bench_append(ctx, networks, count);
+	if (r)
+		goto ERROR;
+
+	r = bench_merge(ctx, "merge", sorted, count, 0);
+	if (r)
+		goto ERROR;
+
+	r = bench_merge(ctx, "merge (push one by one)", sorted, count / 10, 1);
+	if (r)
+		goto ERROR;
+
+	r = bench_pop_first(ctx, sorted, count);
+	if (r)
+		goto ERROR;
+
+ERROR:
+	if (r)
+		fprintf(stderr, "Benchmark failed: %s\n", strerror(-r));
+
+	if (networks) {
+		for (unsigned int i = 0; i < count; i++) {
+			if (networks[i])
+				loc_network_unref(networks[i]);
+		}
+
+		free(networks);
+	}
+	if (sorted)
+		free(sorted);
+	loc_unref(ctx);
+
+	return (r) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
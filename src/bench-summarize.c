@@ -0,0 +1,284 @@
+/*
+	libloc - A library to determine the location of someone on the Internet
+
+	Copyright (C) 2024 IPFire Development Team <info@ipfire.org>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#include <libloc/libloc.h>
+#include <libloc/address.h>
+#include <libloc/database.h>
+#include <libloc/network.h>
+#include <libloc/network-list.h>
+
+/*
+	This benchmark splits all gaps between the IPv6 networks of a database
+	into networks, once creating a network object for each of them and once
+	only writing them into a buffer.
+
+	Without a database, a table of random networks will be used instead.
+
+	Usage: bench-summarize [DATABASE]
+*/
+
+#define NETWORKS 100000
+
+// Summarizing into a buffer is fast enough to be repeated
+#define ROUNDS 10
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int add_random_networks(struct loc_ctx* ctx, struct loc_network_list* list) {
+	struct loc_network* network = NULL;
+	struct in6_addr address;
+	int r;
+
+	// Always generate the same networks
+	srandom(1);
+
+	for (unsigned int i = 0; i < NETWORKS; i++) {
+		memset(&address, 0, sizeof(address));
+
+		// Spread all networks across 2000::/4
+		address.s6_addr[0] = 0x20 + random() % 16;
+
+		for (unsigned int j = 1; j < 8; j++)
+			address.s6_addr[j] = random();
+
+		r = loc_network_new(ctx, &network, &address, 24 + random() % 25);
+		if (r)
+			return r;
+
+		r = loc_network_list_append(list, network);
+		loc_network_unref(network);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
+static int add_database_networks(struct loc_ctx* ctx, struct loc_network_list* list, const char* path) {
+	struct loc_database_enumerator* enumerator = NULL;
+	struct loc_database* db = NULL;
+	struct loc_network* network = NULL;
+	FILE* f = NULL;
+	int r;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -errno;
+
+	r = loc_database_new(ctx, &db, f);
+	if (r)
+		goto ERROR;
+
+	r = loc_database_enumerator_new(&enumerator, db, LOC_DB_ENUMERATE_NETWORKS, 0);
+	if (r)
+		goto ERROR;
+
+	r = loc_database_enumerator_set_family(enumerator, AF_INET6);
+	if (r)
+		goto ERROR;
+
+	for (;;) {
+		r = loc_database_enumerator_next_network(enumerator, &network);
+		if (r || !network)
+			break;
+
+		r = loc_network_list_append(list, network);
+		loc_network_unref(network);
+		if (r)
+			break;
+	}
+
+ERROR:
+	if (enumerator)
+		loc_database_enumerator_unref(enumerator);
+	if (db)
+		loc_database_unref(db);
+	fclose(f);
+
+	return r;
+}
+
+/*
+	Returns the gaps between all ranges
+*/
+static struct loc_network_range* find_gaps(const struct loc_network_range* ranges,
+		size_t count, size_t* gaps) {
+	struct loc_network_range* gap = NULL;
+	struct in6_addr start;
+
+	// There is at most one more gap than there are ranges
+	gap = calloc(count + 1, sizeof(*gap));
+	if (!gap)
+		return NULL;
+
+	loc_address_reset(&start, AF_INET6);
+
+	*gaps = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		if (loc_address_cmp(&ranges[i].first, &start) > 0) {
+			gap[*gaps].first = start;
+			gap[*gaps].last  = ranges[i].first;
+			loc_address_decrement(&gap[*gaps].last);
+			(*gaps)++;
+		}
+
+		// Nothing can follow the end of the address space
+		if (loc_address_all_ones(&ranges[i].last))
+			return gap;
+
+		start = ranges[i].last;
+		loc_address_increment(&start);
+	}
+
+	// Everything after the last network
+	gap[*gaps].first = start;
+	loc_address_reset_last(&gap[*gaps].last, AF_INET6);
+	(*gaps)++;
+
+	return gap;
+}
+
+static void report(const char* operation, size_t count, double t) {
+	printf("%-28s %10zu %11.3fs %10.1fns\n", operation, count, t, t * 1e9 / count);
+}
+
+static int bench_list(struct loc_ctx* ctx, const struct loc_network_range* gaps, size_t count) {
+	struct loc_network_list* list = NULL;
+	double t0;
+	int r;
+
+	r = loc_network_list_new(ctx, &list);
+	if (r)
+		return r;
+
+	t0 = now();
+
+	for (size_t i = 0; i < count; i++) {
+		r = loc_network_list_summarize(ctx, &gaps[i].first, &gaps[i].last, &list);
+		if (r) {
+			r = -errno;
+			goto ERROR;
+		}
+	}
+
+	report("loc_network_list_summarize", loc_network_list_size(list), now() - t0);
+
+ERROR:
+	loc_network_list_unref(list);
+
+	return r;
+}
+
+static int bench_buffer(const struct loc_network_range* gaps, size_t count) {
+	struct loc_address_prefix prefixes[LOC_ADDRESS_MAX_PREFIXES];
+	size_t networks = 0;
+	double t0;
+	int r;
+
+	t0 = now();
+
+	for (unsigned int round = 0; round < ROUNDS; round++) {
+		for (size_t i = 0; i < count; i++) {
+			r = loc_address_summarize(&gaps[i].first, &gaps[i].last,
+				prefixes, LOC_ADDRESS_MAX_PREFIXES);
+			if (r < 0)
+				return r;
+
+			networks += r;
+		}
+	}
+
+	report("loc_address_summarize", networks, now() - t0);
+
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	struct loc_network_list* list = NULL;
+	struct loc_network_range* ranges = NULL;
+	struct loc_network_range* gaps = NULL;
+	struct loc_ctx* ctx = NULL;
+	size_t count = 0;
+	size_t num_gaps = 0;
+	int r;
+
+	if (loc_new(&ctx))
+		exit(EXIT_FAILURE);
+
+	loc_set_log_priority(ctx, LOG_ERR);
+
+	r = loc_network_list_new(ctx, &list);
+	if (r)
+		goto ERROR;
+
+	if (argc > 1)
+		r = add_database_networks(ctx, list, argv[1]);
+	else
+		r = add_random_networks(ctx, list);
+	if (r) {
+		fprintf(stderr, "Could not load networks: %s\n", strerror(-r));
+		goto ERROR;
+	}
+
+	r = loc_network_list_ranges(list, &ranges, &count);
+	if (r)
+		goto ERROR;
+
+	gaps = find_gaps(ranges, count, &num_gaps);
+	if (!gaps) {
+		r = -ENOMEM;
+		goto ERROR;
+	}
+
+	printf("%zu networks, %zu gaps\n\n", loc_network_list_size(list), num_gaps);
+	printf("%-28s %10s %12s %12s\n", "OPERATION", "NETWORKS", "TIME", "TIME/NETWORK");
+
+	r = bench_list(ctx, gaps, num_gaps);
+	if (r)
+		goto ERROR;
+
+	r = bench_buffer(gaps, num_gaps);
+	if (r)
+		goto ERROR;
+
+ERROR:
+	if (r)
+		fprintf(stderr, "Benchmark failed: %s\n", strerror(-r));
+
+	if (gaps)
+		free(gaps);
+	if (ranges)
+		free(ranges);
+	if (list)
+		loc_network_list_unref(list);
+	loc_unref(ctx);
+
+	return (r) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
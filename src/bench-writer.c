@@ -0,0 +1,224 @@
+/*
+	libloc - A library to determine the location of someone on the Internet
+
+	Copyright (C) 2024 IPFire Development Team <info@ipfire.org>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include <libloc/libloc.h>
+#include <libloc/network.h>
+#include <libloc/writer.h>
+
+/*
+	This benchmark writes the same randomly generated database using
+	a different number of threads and checks that the output is identical.
+
+	Usage: bench-writer [NETWORKS]
+*/
+
+static const unsigned int THREADS[] = { 1, 2, 4, 8, 16, 0 };
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int add_random_networks(struct loc_writer* writer, unsigned int count) {
+	struct loc_network* network = NULL;
+	const char* country_codes[] = { "DE", "FR", "US", "XX", };
+	char address[INET6_ADDRSTRLEN];
+	char string[INET6_ADDRSTRLEN + 4];
+	struct in6_addr a;
+	int r;
+
+	// Always generate the same networks
+	srandom(1);
+
+	for (unsigned int i = 0; i < count; i++) {
+		// Two thirds of all networks are IPv4
+		if (i % 3) {
+			snprintf(string, sizeof(string), "%ld.%ld.%ld.0/%ld",
+				random() % 224, random() % 256, random() % 256, 8 + random() % 17);
+		} else {
+			memset(&a, 0, sizeof(a));
+
+			a.s6_addr[0] = 0x20;
+			a.s6_addr[1] = random() % 16;
+
+			for (unsigned int j = 2; j < 8; j++)
+				a.s6_addr[j] = random() % 256;
+
+			inet_ntop(AF_INET6, &a, address, sizeof(address));
+
+			snprintf(string, sizeof(string), "%s/%ld", address, 16 + random() % 33);
+		}
+
+		r = loc_writer_add_network(writer, &network, string);
+		switch (r) {
+			case 0:
+				break;
+
+			// Skip any duplicates
+			case -EBUSY:
+				continue;
+
+			default:
+				return r;
+		}
+
+		loc_network_set_country_code(network, country_codes[random() % 4]);
+		loc_network_set_asn(network, (random() % 2) ? 1 : random() % 16);
+
+		if (random() % 8 == 0)
+			loc_network_set_flag(network, LOC_NETWORK_FLAG_ANYCAST);
+
+		loc_network_unref(network);
+	}
+
+	return 0;
+}
+
+static int write_database(struct loc_ctx* ctx, FILE* f,
+		unsigned int count, unsigned int threads, double* t) {
+	struct loc_writer* writer = NULL;
+	double t0;
+	int r;
+
+	r = loc_writer_new(ctx, &writer, NULL, NULL);
+	if (r)
+		return r;
+
+	r = loc_writer_set_threads(writer, threads);
+	if (r)
+		goto ERROR;
+
+	r = add_random_networks(writer, count);
+	if (r)
+		goto ERROR;
+
+	t0 = now();
+
+	r = loc_writer_write(writer, f, LOC_DATABASE_VERSION_UNSET);
+	if (r)
+		goto ERROR;
+
+	*t = now() - t0;
+
+ERROR:
+	loc_writer_unref(writer);
+
+	return r;
+}
+
+static int compare_files(FILE* f1, FILE* f2) {
+	char buffer1[4096];
+	char buffer2[4096];
+	size_t bytes1;
+	size_t bytes2;
+
+	rewind(f1);
+	rewind(f2);
+
+	for (off_t offset = 0;; offset += bytes1) {
+		bytes1 = fread(buffer1, 1, sizeof(buffer1), f1);
+		bytes2 = fread(buffer2, 1, sizeof(buffer2), f2);
+
+		// Ignore the creation timestamp
+		if (offset == 0 && bytes1 >= 16 && bytes2 >= 16) {
+			memset(buffer1 + 8, 0, 8);
+			memset(buffer2 + 8, 0, 8);
+		}
+
+		if (bytes1 != bytes2 || memcmp(buffer1, buffer2, bytes1) != 0)
+			return 1;
+
+		if (!bytes1)
+			break;
+	}
+
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	struct loc_ctx* ctx = NULL;
+	FILE* reference = NULL;
+	FILE* f = NULL;
+	unsigned int count = 1000000;
+	double t1 = 0;
+	double t;
+	int r;
+
+	if (argc > 1)
+		count = strtoul(argv[1], NULL, 10);
+
+	r = loc_new(&ctx);
+	if (r)
+		exit(EXIT_FAILURE);
+
+	loc_set_log_priority(ctx, LOG_ERR);
+
+	printf("Writing %u random networks\n\n", count);
+	printf("%8s %12s %8s\n", "THREADS", "TIME", "SPEEDUP");
+
+	for (const unsigned int* threads = THREADS; *threads; threads++) {
+		f = tmpfile();
+		if (!f) {
+			fprintf(stderr, "Could not open file for writing: %m\n");
+			r = 1;
+			goto ERROR;
+		}
+
+		r = write_database(ctx, f, count, *threads, &t);
+		if (r) {
+			fprintf(stderr, "Could not write database: %m\n");
+			goto ERROR;
+		}
+
+		if (!reference) {
+			reference = f;
+			t1 = t;
+		} else {
+			// The output must not depend on the number of threads
+			if (compare_files(reference, f)) {
+				fprintf(stderr, "Output with %u threads differs\n", *threads);
+				r = 1;
+				goto ERROR;
+			}
+
+			fclose(f);
+		}
+
+		f = NULL;
+
+		printf("%8u %11.3fs %7.2fx\n", *threads, t, t1 / t);
+	}
+
+ERROR:
+	if (f)
+		fclose(f);
+	if (reference)
+		fclose(reference);
+	loc_unref(ctx);
+
+	return (r) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
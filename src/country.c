@@ -71,7 +71,7 @@ LOC_EXPORT int loc_country_new(struct loc_ctx* ctx, struct loc_country** country
 }
 
 LOC_EXPORT struct loc_country* loc_country_ref(struct loc_country* country) {
-	country->refcount++;
+	__atomic_add_fetch(&country->refcount, 1, __ATOMIC_RELAXED);
 
 	return country;
 }
@@ -87,7 +87,7 @@ static void loc_country_free(struct loc_country* country) {
 }
 
 LOC_EXPORT struct loc_country* loc_country_unref(struct loc_country* country) {
-	if (--country->refcount > 0)
+	if (__atomic_sub_fetch(&country->refcount, 1, __ATOMIC_ACQ_REL) > 0)
 		return NULL;
 
 	loc_country_free(country);
@@ -17,6 +17,9 @@
 #include <arpa/inet.h>
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -24,6 +27,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
@@ -67,6 +71,9 @@ struct loc_database {
 
 	FILE* f;
 
+	// Flags
+	int flags;
+
 	enum loc_database_version version;
 	time_t created_at;
 	off_t vendor;
@@ -81,6 +88,18 @@ struct loc_database {
 	char* data;
 	ssize_t length;
 
+	// Page hashes
+	const unsigned char* page_hashes;
+	size_t num_pages;
+	off_t pages_offset;
+
+	// Signatures of the page hashes
+	struct loc_database_signature page_signature1;
+	struct loc_database_signature page_signature2;
+
+	// Pages that have been verified (when verifying on demand)
+	uint8_t* verified_pages;
+
 	struct loc_stringpool* pool;
 
 	// ASes in the database
@@ -94,6 +113,9 @@ struct loc_database {
 
 	// Countries
 	struct loc_database_objects country_objects;
+
+	// The node where all IPv4 addresses start
+	off_t ipv4_root;
 };
 
 #define MAX_STACK_DEPTH 256
@@ -104,6 +126,15 @@ struct loc_node_stack {
 	int depth;
 };
 
+/*
+	A subtree of the network tree that does not have any networks above it
+*/
+struct loc_database_subtree {
+	struct in6_addr address;
+	off_t offset;
+	int depth;
+};
+
 struct loc_database_enumerator {
 	struct loc_ctx* ctx;
 	struct loc_database* db;
@@ -120,6 +151,9 @@ struct loc_database_enumerator {
 	// Flatten output?
 	int flatten;
 
+	// Aggregate output?
+	int aggregate;
+
 	// Index of the AS we are looking at
 	unsigned int as_index;
 
@@ -132,13 +166,32 @@ struct loc_database_enumerator {
 	int network_stack_depth;
 	unsigned int* networks_visited;
 
+	// Partition
+	struct loc_database_subtree* subtrees;
+	size_t num_subtrees;
+	size_t subtree_index;
+
 	// For subnet search and bogons
-	struct loc_network_list* stack;
-	struct loc_network_list* subnets;
+	struct loc_network_value_list stack;
+	struct loc_network_value_list subnets;
+	struct loc_network_value_list excluded;
+
+	// For aggregation
+	struct loc_network_value pending;
+	struct in6_addr pending_last;
+	int has_pending;
+	struct loc_network_value aggregated[LOC_ADDRESS_MAX_PREFIXES];
+	int aggregated_count;
+	int aggregated_index;
 
 	// For bogons
 	struct in6_addr gap6_start;
 	struct in6_addr gap4_start;
+	int gap6_done;
+	int gap4_done;
+	struct loc_address_prefix bogons[LOC_ADDRESS_MAX_PREFIXES];
+	int bogons_count;
+	int bogons_index;
 };
 
 /*
@@ -166,6 +219,83 @@ static inline int __loc_database_check_boundaries(struct loc_database* db,
 	return 0;
 }
 
+/*
+	Hashes the n-th page and compares the result with its signed hash
+*/
+static int loc_database_verify_page(struct loc_database* db, EVP_MD_CTX* mdctx, size_t page) {
+	const char* p = db->data + db->pages_offset + page * LOC_DATABASE_PAGE_SIZE;
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	int r;
+
+	r = EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL);
+	if (r == 1)
+		r = EVP_DigestUpdate(mdctx, p, LOC_DATABASE_PAGE_SIZE);
+	if (r == 1)
+		r = EVP_DigestFinal_ex(mdctx, digest, NULL);
+
+	if (r != 1) {
+		ERROR(db->ctx, "Could not hash page %zu: %s\n", page,
+			ERR_error_string(ERR_get_error(), NULL));
+		return -1;
+	}
+
+	if (memcmp(digest, db->page_hashes + page * LOC_DATABASE_PAGE_HASH_LENGTH,
+			LOC_DATABASE_PAGE_HASH_LENGTH) != 0) {
+		ERROR(db->ctx, "Page %zu does not match its hash\n", page);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+	Verifies all pages that hold the given data unless that has happened before
+*/
+static int loc_database_check_pages(struct loc_database* db, const char* p, const size_t length) {
+	const ssize_t offset = p - db->data - db->pages_offset;
+	EVP_MD_CTX* mdctx = NULL;
+	int r = 0;
+
+	// Data that is not covered by any page hashes cannot be trusted
+	if (offset < 0 || offset + length > db->num_pages * LOC_DATABASE_PAGE_SIZE) {
+		ERROR(db->ctx, "Data at %p is not covered by any page hashes\n", p);
+		errno = EBADMSG;
+		return 0;
+	}
+
+	const size_t first = offset / LOC_DATABASE_PAGE_SIZE;
+	const size_t last = (offset + length - 1) / LOC_DATABASE_PAGE_SIZE;
+
+	for (size_t page = first; page <= last; page++) {
+		if (__atomic_load_n(&db->verified_pages[page], __ATOMIC_ACQUIRE))
+			continue;
+
+		if (!mdctx) {
+			mdctx = EVP_MD_CTX_new();
+			if (!mdctx) {
+				errno = ENOMEM;
+				return 0;
+			}
+		}
+
+		r = loc_database_verify_page(db, mdctx, page);
+		if (r)
+			break;
+
+		__atomic_store_n(&db->verified_pages[page], 1, __ATOMIC_RELEASE);
+	}
+
+	if (mdctx)
+		EVP_MD_CTX_free(mdctx);
+
+	if (r) {
+		errno = EBADMSG;
+		return 0;
+	}
+
+	return 1;
+}
+
 /*
 	Returns a pointer to the n-th object
 */
@@ -181,6 +311,10 @@ static inline char* loc_database_object(struct loc_database* db,
 	if (!__loc_database_check_boundaries(db, object, length))
 		return NULL;
 
+	// Verify the object if we are verifying on demand
+	if (db->verified_pages && !loc_database_check_pages(db, object, length))
+		return NULL;
+
 	return object;
 }
 
@@ -304,6 +438,65 @@ static int loc_database_read_signature(struct loc_database* db,
 	return 0;
 }
 
+static int loc_database_read_page_hashes_v1(struct loc_database* db,
+		const struct loc_database_header_v1* header) {
+	const struct loc_database_page_signatures_v1* signatures = NULL;
+	int r;
+
+	const off_t hashes_offset = be32toh(header->page_hashes_offset);
+	const size_t hashes_length = be32toh(header->page_hashes_length);
+
+	// Older databases don't have any page hashes
+	if (!hashes_offset)
+		return 0;
+
+	const char* hashes = db->data + hashes_offset;
+
+	// Check if the page hashes are part of the mapped area
+	if (!__loc_database_check_boundaries(db, hashes, hashes_length))
+		return 1;
+
+	// The first page follows the header
+	db->pages_offset = (LOC_DATABASE_MAGIC_SIZE + sizeof(*header) + LOC_DATABASE_PAGE_SIZE - 1)
+		/ LOC_DATABASE_PAGE_SIZE * LOC_DATABASE_PAGE_SIZE;
+	db->num_pages = hashes_length / LOC_DATABASE_PAGE_HASH_LENGTH;
+
+	// All pages must be located before the page hashes
+	if (db->pages_offset + (off_t)(db->num_pages * LOC_DATABASE_PAGE_SIZE) > hashes_offset) {
+		ERROR(db->ctx, "Page hashes cover %zu page(s) which overlap with the hashes\n",
+			db->num_pages);
+		errno = EINVAL;
+		return 1;
+	}
+
+	// Read the signatures
+	signatures = (const struct loc_database_page_signatures_v1*)
+		(db->data + be32toh(header->page_signatures_offset));
+
+	if (be32toh(header->page_signatures_length) < sizeof(*signatures)
+			|| !loc_database_check_boundaries(db, signatures)) {
+		ERROR(db->ctx, "Could not read page signatures\n");
+		errno = EINVAL;
+		return 1;
+	}
+
+	r = loc_database_read_signature(db, &db->page_signature1,
+		signatures->signature1, be16toh(signatures->signature1_length));
+	if (r)
+		return r;
+
+	r = loc_database_read_signature(db, &db->page_signature2,
+		signatures->signature2, be16toh(signatures->signature2_length));
+	if (r)
+		return r;
+
+	DEBUG(db->ctx, "Database has hashes for %zu page(s)\n", db->num_pages);
+
+	db->page_hashes = (const unsigned char*)hashes;
+
+	return 0;
+}
+
 static int loc_database_read_header_v1(struct loc_database* db) {
 	const struct loc_database_header_v1* header =
 		(const struct loc_database_header_v1*)(db->data + LOC_DATABASE_MAGIC_SIZE);
@@ -381,6 +574,11 @@ static int loc_database_read_header_v1(struct loc_database* db) {
 	if (r)
 		return r;
 
+	// Read page hashes
+	r = loc_database_read_page_hashes_v1(db, header);
+	if (r)
+		return r;
+
 	return 0;
 }
 
@@ -421,6 +619,47 @@ static int loc_database_clone_handle(struct loc_database* db, FILE* f) {
 	return 0;
 }
 
+static int __loc_database_node_is_leaf(const struct loc_database_network_node_v1* node) {
+	return (node->network != htobe32(0xffffffff));
+}
+
+/*
+	All IPv4 addresses live in ::ffff:0:0/96, so every lookup of an IPv4 address
+	would walk down the same 96 nodes first. We find the node at the end of that
+	path once, so that lookups can start from there.
+
+	This is only possible if there is no network along the path that could match.
+*/
+static void loc_database_find_ipv4_root(struct loc_database* db) {
+	const struct loc_database_network_node_v1* node = NULL;
+	struct in6_addr address;
+	off_t node_index = 0;
+
+	db->ipv4_root = 0;
+
+	loc_address_reset(&address, AF_INET);
+
+	for (unsigned int level = 0; level < 96; level++) {
+		node = (const struct loc_database_network_node_v1*)loc_database_object(db,
+			&db->network_node_objects, sizeof(*node), node_index);
+		if (!node || __loc_database_node_is_leaf(node))
+			return;
+
+		if (loc_address_get_bit(&address, level))
+			node_index = be32toh(node->one);
+		else
+			node_index = be32toh(node->zero);
+
+		// The tree ends here
+		if (node_index <= 0 || (size_t)node_index >= db->network_node_objects.count)
+			return;
+	}
+
+	DEBUG(db->ctx, "Found IPv4 root at node %jd\n", (intmax_t)node_index);
+
+	db->ipv4_root = node_index;
+}
+
 static int loc_database_open(struct loc_database* db, FILE* f) {
 	int r;
 
@@ -446,6 +685,8 @@ static int loc_database_open(struct loc_database* db, FILE* f) {
 	if (r)
 		return r;
 
+	loc_database_find_ipv4_root(db);
+
 	clock_t end = clock();
 
 	INFO(db->ctx, "Opened database in %.4fms\n",
@@ -466,6 +707,9 @@ static void loc_database_free(struct loc_database* db) {
 			ERROR(db->ctx, "Could not unmap the database: %m\n");
 	}
 
+	if (db->verified_pages)
+		free(db->verified_pages);
+
 	// Free the stringpool
 	if (db->pool)
 		loc_stringpool_unref(db->pool);
@@ -515,176 +759,539 @@ ERROR:
 }
 
 LOC_EXPORT struct loc_database* loc_database_ref(struct loc_database* db) {
-	db->refcount++;
+	__atomic_add_fetch(&db->refcount, 1, __ATOMIC_RELAXED);
 
 	return db;
 }
 
 LOC_EXPORT struct loc_database* loc_database_unref(struct loc_database* db) {
-	if (--db->refcount > 0)
+	if (__atomic_sub_fetch(&db->refcount, 1, __ATOMIC_ACQ_REL) > 0)
 		return NULL;
 
 	loc_database_free(db);
 	return NULL;
 }
 
-LOC_EXPORT int loc_database_verify(struct loc_database* db, FILE* f) {
-	size_t bytes_read = 0;
+LOC_EXPORT int loc_database_get_flags(struct loc_database* db) {
+	return db->flags;
+}
 
-	// Cannot do this when no signature is available
-	if (!db->signature1.data && !db->signature2.data) {
-		DEBUG(db->ctx, "No signature available to verify\n");
-		return 1;
-	}
+LOC_EXPORT int loc_database_set_flags(struct loc_database* db, int flags) {
+	db->flags = flags;
 
-	// Start the stopwatch
-	clock_t start = clock();
+	return 0;
+}
 
-	// Load public key
-	EVP_PKEY* pkey = PEM_read_PUBKEY(f, NULL, NULL, NULL);
-	if (!pkey) {
-		ERROR(db->ctx, "Could not parse public key: %s\n",
-			ERR_error_string(ERR_get_error(), NULL));
+/*
+	Copies the header and clears all signatures as they have been
+	cleared when the database was signed.
+*/
+static void loc_database_unsigned_header_v1(struct loc_database* db,
+		struct loc_database_header_v1* header) {
+	memcpy(header, db->data + LOC_DATABASE_MAGIC_SIZE, sizeof(*header));
+
+	// Clear signatures
+	memset(header->signature1, '\0', sizeof(header->signature1));
+	header->signature1_length = 0;
+	memset(header->signature2, '\0', sizeof(header->signature2));
+	header->signature2_length = 0;
+}
 
-		return -1;
-	}
+/*
+	Verifies a signature over the magic, the header and the page hashes
+*/
+static int loc_database_verify_page_signature(struct loc_database* db,
+		EVP_PKEY* pkey, const struct loc_database_signature* signature) {
+	struct loc_database_header_v1 header;
+	int r;
 
-	int r = 0;
+	if (!signature->length)
+		return 1;
+
+	loc_database_unsigned_header_v1(db, &header);
 
 	EVP_MD_CTX* mdctx = EVP_MD_CTX_new();
+	if (!mdctx)
+		return -ENOMEM;
 
-	// Initialise hash function
 	r = EVP_DigestVerifyInit(mdctx, NULL, NULL, NULL, pkey);
-	if (r != 1) {
-		ERROR(db->ctx, "Error initializing signature validation: %s\n",
-			ERR_error_string(ERR_get_error(), NULL));
-		r = 1;
+	if (r != 1)
+		goto ERROR;
 
-		goto CLEANUP;
-	}
+	r = EVP_DigestVerifyUpdate(mdctx, db->data, LOC_DATABASE_MAGIC_SIZE);
+	if (r != 1)
+		goto ERROR;
 
-	// Reset file to start
-	rewind(db->f);
+	r = EVP_DigestVerifyUpdate(mdctx, &header, sizeof(header));
+	if (r != 1)
+		goto ERROR;
 
-	// Read magic
-	struct loc_database_magic magic;
-	bytes_read = fread(&magic, 1, sizeof(magic), db->f);
-	if (bytes_read < sizeof(magic)) {
-		ERROR(db->ctx, "Could not read header: %m\n");
-		r = 1;
-		goto CLEANUP;
-	}
+	r = EVP_DigestVerifyUpdate(mdctx, db->page_hashes,
+		db->num_pages * LOC_DATABASE_PAGE_HASH_LENGTH);
+	if (r != 1)
+		goto ERROR;
 
-	hexdump(db->ctx, &magic, sizeof(magic));
+	hexdump(db->ctx, signature->data, signature->length);
 
-	// Feed magic into the hash
-	r = EVP_DigestVerifyUpdate(mdctx, &magic, sizeof(magic));
-	if (r != 1) {
-		ERROR(db->ctx, "%s\n", ERR_error_string(ERR_get_error(), NULL));
-		r = 1;
+	r = EVP_DigestVerifyFinal(mdctx,
+		(const unsigned char*)signature->data, signature->length);
+	if (r < 0)
+		goto ERROR;
 
-		goto CLEANUP;
+	EVP_MD_CTX_free(mdctx);
+
+	// Return zero if the signature is valid
+	return (r == 1) ? 0 : 1;
+
+ERROR:
+	ERROR(db->ctx, "Error verifying the page hashes: %s\n",
+		ERR_error_string(ERR_get_error(), NULL));
+	EVP_MD_CTX_free(mdctx);
+
+	return -1;
+}
+
+static int loc_database_verify_page_signatures(struct loc_database* db, EVP_PKEY* pkey) {
+	int r;
+
+	// Check first signature
+	r = loc_database_verify_page_signature(db, pkey, &db->page_signature1);
+	if (r <= 0) {
+		if (r == 0)
+			DEBUG(db->ctx, "The first signature of the page hashes is valid\n");
+
+		return r;
 	}
 
-	// Read the header
-	struct loc_database_header_v1 header_v1;
+	// Check second signature only when the first one was invalid
+	r = loc_database_verify_page_signature(db, pkey, &db->page_signature2);
+	if (r == 0)
+		DEBUG(db->ctx, "The second signature of the page hashes is valid\n");
 
-	switch (db->version) {
-		case LOC_DATABASE_VERSION_1:
-			bytes_read = fread(&header_v1, 1, sizeof(header_v1), db->f);
-			if (bytes_read < sizeof(header_v1)) {
-				ERROR(db->ctx, "Could not read header\n");
-				r = 1;
+	return r;
+}
 
-				goto CLEANUP;
-			}
+// Pages are handed out to the workers in batches of 1 MiB
+#define LOC_DATABASE_VERIFY_BATCH 256
 
-			// Clear signatures
-			memset(header_v1.signature1, '\0', sizeof(header_v1.signature1));
-			header_v1.signature1_length = 0;
-			memset(header_v1.signature2, '\0', sizeof(header_v1.signature2));
-			header_v1.signature2_length = 0;
+static int loc_database_verify_batch(void* data, size_t batch) {
+	struct loc_database* db = data;
+	int r = 0;
 
-			hexdump(db->ctx, &header_v1, sizeof(header_v1));
+	EVP_MD_CTX* mdctx = EVP_MD_CTX_new();
+	if (!mdctx)
+		return -ENOMEM;
 
-			// Feed header into the hash
-			r = EVP_DigestVerifyUpdate(mdctx, &header_v1, sizeof(header_v1));
-			if (r != 1) {
-				ERROR(db->ctx, "%s\n", ERR_error_string(ERR_get_error(), NULL));
-				r = 1;
+	const size_t first = batch * LOC_DATABASE_VERIFY_BATCH;
 
-				goto CLEANUP;
-			}
+	for (size_t page = first; page < first + LOC_DATABASE_VERIFY_BATCH; page++) {
+		if (page >= db->num_pages)
 			break;
 
-		default:
-			ERROR(db->ctx, "Cannot compute hash for database with format %u\n",
-				db->version);
-			r = -EINVAL;
-			goto CLEANUP;
+		r = loc_database_verify_page(db, mdctx, page);
+		if (r)
+			break;
 	}
 
-	// Walk through the file in chunks of 64kB
-	char buffer[64 * 1024];
+	EVP_MD_CTX_free(mdctx);
 
-	while (!feof(db->f)) {
-		bytes_read = fread(buffer, 1, sizeof(buffer), db->f);
+	return r;
+}
 
-		hexdump(db->ctx, buffer, bytes_read);
+/*
+	Verifies all pages using all available processors
+*/
+static int loc_database_verify_pages(struct loc_database* db) {
+	int r;
 
-		r = EVP_DigestVerifyUpdate(mdctx, buffer, bytes_read);
-		if (r != 1) {
-			ERROR(db->ctx, "%s\n", ERR_error_string(ERR_get_error(), NULL));
-			r = 1;
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads < 1)
+		threads = 1;
 
-			goto CLEANUP;
-		}
-	}
+	const size_t batches = (db->num_pages + LOC_DATABASE_VERIFY_BATCH - 1) / LOC_DATABASE_VERIFY_BATCH;
 
-	int sig1_valid = 0;
-	int sig2_valid = 0;
+	// We are going to read all pages
+	r = madvise(db->data + db->pages_offset, db->num_pages * LOC_DATABASE_PAGE_SIZE, MADV_WILLNEED);
+	if (r)
+		DEBUG(db->ctx, "madvise() failed: %m\n");
 
-	// Check first signature
-	if (db->signature1.length) {
-		hexdump(db->ctx, db->signature1.data, db->signature1.length);
+	DEBUG(db->ctx, "Verifying %zu page(s) using up to %ld thread(s)\n", db->num_pages, threads);
 
-		r = EVP_DigestVerifyFinal(mdctx,
-			(unsigned char*)db->signature1.data, db->signature1.length);
+	return loc_run_parallel(db->ctx, threads, batches, loc_database_verify_batch, db);
+}
 
-		if (r == 0) {
-			DEBUG(db->ctx, "The first signature is invalid\n");
-		} else if (r == 1) {
-			DEBUG(db->ctx, "The first signature is valid\n");
-			sig1_valid = 1;
-		} else {
-			ERROR(db->ctx, "Error verifying the first signature: %s\n",
-				ERR_error_string(ERR_get_error(), NULL));
-			r = -1;
-			goto CLEANUP;
-		}
-	}
+/*
+	Successful verifications can be remembered in a cache directory so that
+	they don't have to be repeated every time the database is being opened.
+	This is disabled unless LOC_DATABASE_FLAGS_CACHE_VERIFICATION is set.
+
+	A record is bound to the device, inode, size, mtime and ctime of the
+	database file, a hash of its header and a hash of the public key. All of
+	these can be computed by anyone, so the record is only as trustworthy as
+	the place where it is stored: it will only be used if the cache directory
+	and the record are owned by root or by the current user and are not
+	writable by anybody else. The database file itself is never written to.
+
+	Anyone who can write to the database file can restore its mtime after
+	modifying it, but not its ctime which is always set by the kernel. Such a
+	change will therefore invalidate the record. This does not protect against
+	anyone who can set the system clock or write to the underlying device.
+*/
+#define LOC_DATABASE_VERIFIED_VERSION 2
 
-	// Check second signature only when the first one was invalid
-	if (db->signature2.length) {
-		hexdump(db->ctx, db->signature2.data, db->signature2.length);
+// Don't trust any timestamps that might not have changed on a modification
+#define LOC_DATABASE_VERIFIED_MIN_AGE 2
 
-		r = EVP_DigestVerifyFinal(mdctx,
-			(unsigned char*)db->signature2.data, db->signature2.length);
+struct loc_database_verified {
+	uint32_t version;
+	uint32_t padding;
 
-		if (r == 0) {
-			DEBUG(db->ctx, "The second signature is invalid\n");
-		} else if (r == 1) {
-			DEBUG(db->ctx, "The second signature is valid\n");
-			sig2_valid = 1;
-		} else {
-			ERROR(db->ctx, "Error verifying the second signature: %s\n",
-				ERR_error_string(ERR_get_error(), NULL));
-			r = -1;
-			goto CLEANUP;
-		}
-	}
+	// The file
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime;
+	int64_t mtime_nsec;
+	int64_t ctime;
+	int64_t ctime_nsec;
 
-	clock_t end = clock();
+	// A hash of the magic and the header (including all signatures)
+	unsigned char header[LOC_DATABASE_PAGE_HASH_LENGTH];
+
+	// A hash of the public key
+	unsigned char key[LOC_DATABASE_PAGE_HASH_LENGTH];
+};
+
+static const char* loc_database_cache_dir(void) {
+	const char* path = secure_getenv("LOC_CACHE_DIR");
+	if (path)
+		return path;
+
+	return LIBLOC_DEFAULT_CACHE_PATH;
+}
+
+/*
+	Returns true if nobody but root or the current user can have written this
+*/
+static int loc_database_cache_is_trusted(const struct stat* st) {
+	if (st->st_uid != 0 && st->st_uid != geteuid())
+		return 0;
+
+	return !(st->st_mode & (S_IWGRP|S_IWOTH));
+}
+
+static int loc_database_cache_path(struct loc_database* db,
+		const struct loc_database_verified* verified, char* path, size_t length) {
+	const char* dir = loc_database_cache_dir();
+	struct stat st;
+	int r;
+
+	// Check the cache directory
+	r = stat(dir, &st);
+	if (r) {
+		DEBUG(db->ctx, "Could not access cache directory %s: %m\n", dir);
+		return 1;
+	}
+
+	if (!S_ISDIR(st.st_mode) || !loc_database_cache_is_trusted(&st)) {
+		DEBUG(db->ctx, "Ignoring untrusted cache directory %s\n", dir);
+		return 1;
+	}
+
+	r = snprintf(path, length, "%s/verified-%" PRIu64 "-%" PRIu64,
+		dir, verified->dev, verified->ino);
+	if (r < 0 || (size_t)r >= length)
+		return 1;
+
+	return 0;
+}
+
+static int loc_database_make_verified(struct loc_database* db,
+		EVP_PKEY* pkey, struct loc_database_verified* verified) {
+	unsigned char* key = NULL;
+	struct stat st;
+	int length;
+	int r;
+
+	memset(verified, 0, sizeof(*verified));
+
+	r = fstat(fileno(db->f), &st);
+	if (r)
+		return -errno;
+
+	// The cache can only be used with files that have not recently been changed
+	if (time(NULL) - st.st_ctim.tv_sec < LOC_DATABASE_VERIFIED_MIN_AGE)
+		return 1;
+
+	verified->version    = LOC_DATABASE_VERIFIED_VERSION;
+	verified->dev        = st.st_dev;
+	verified->ino        = st.st_ino;
+	verified->size       = st.st_size;
+	verified->mtime      = st.st_mtim.tv_sec;
+	verified->mtime_nsec = st.st_mtim.tv_nsec;
+	verified->ctime      = st.st_ctim.tv_sec;
+	verified->ctime_nsec = st.st_ctim.tv_nsec;
+
+	switch (db->version) {
+		case LOC_DATABASE_VERSION_1:
+			r = EVP_Digest(db->data, LOC_DATABASE_MAGIC_SIZE + sizeof(struct loc_database_header_v1),
+				verified->header, NULL, EVP_sha256(), NULL);
+			if (r != 1)
+				return -1;
+			break;
+
+		default:
+			return 1;
+	}
+
+	// Hash the public key
+	length = i2d_PUBKEY(pkey, &key);
+	if (length < 0)
+		return -1;
+
+	r = EVP_Digest(key, length, verified->key, NULL, EVP_sha256(), NULL);
+	OPENSSL_free(key);
+	if (r != 1)
+		return -1;
+
+	return 0;
+}
+
+/*
+	Returns true if the database has been verified with this key before
+*/
+static int loc_database_verified_before(struct loc_database* db,
+		const struct loc_database_verified* verified) {
+	struct loc_database_verified cached;
+	char path[PATH_MAX];
+	struct stat st;
+	ssize_t length;
+	int fd;
+
+	if (loc_database_cache_path(db, verified, path, sizeof(path)))
+		return 0;
+
+	fd = open(path, O_RDONLY|O_NOFOLLOW|O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+
+	// Ignore any records that might have been written by somebody else
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || !loc_database_cache_is_trusted(&st)) {
+		DEBUG(db->ctx, "Ignoring untrusted cache file %s\n", path);
+		close(fd);
+		return 0;
+	}
+
+	length = read(fd, &cached, sizeof(cached));
+	close(fd);
+
+	if (length != sizeof(cached))
+		return 0;
+
+	return memcmp(&cached, verified, sizeof(cached)) == 0;
+}
+
+static void loc_database_remember_verified(struct loc_database* db,
+		const struct loc_database_verified* verified) {
+	char tmp[PATH_MAX];
+	char path[PATH_MAX];
+	ssize_t length;
+	int fd;
+	int r;
+
+	if (loc_database_cache_path(db, verified, path, sizeof(path)))
+		return;
+
+	r = snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+	if (r < 0 || (size_t)r >= sizeof(tmp))
+		return;
+
+	// Write the record to a temporary file and move it into place
+	fd = mkostemp(tmp, O_CLOEXEC);
+	if (fd < 0) {
+		DEBUG(db->ctx, "Could not store verification result: %m\n");
+		return;
+	}
+
+	length = write(fd, verified, sizeof(*verified));
+	if (length == sizeof(*verified))
+		r = fchmod(fd, 0644);
+	else
+		r = -1;
+
+	if (close(fd))
+		r = -1;
+
+	if (!r)
+		r = rename(tmp, path);
+
+	if (r) {
+		DEBUG(db->ctx, "Could not store verification result: %m\n");
+		unlink(tmp);
+	}
+}
+
+static int loc_database_verify_paged(struct loc_database* db, EVP_PKEY* pkey) {
+	int r;
+
+	// Start the stopwatch
+	clock_t start = clock();
+
+	// Check if the page hashes have been signed
+	r = loc_database_verify_page_signatures(db, pkey);
+	if (r)
+		return r;
+
+	// Check all pages
+	r = loc_database_verify_pages(db);
+	if (r)
+		return r;
+
+	clock_t end = clock();
+	INFO(db->ctx, "Verified %zu page(s) in %.4fms\n", db->num_pages,
+		(double)(end - start) / CLOCKS_PER_SEC * 1000);
+
+	return 0;
+}
+
+static int loc_database_verify_linear(struct loc_database* db, EVP_PKEY* pkey) {
+	const char* data = db->data;
+	size_t length = db->length;
+	int r;
+
+	// Start the stopwatch
+	clock_t start = clock();
+
+	EVP_MD_CTX* mdctx = EVP_MD_CTX_new();
+
+	// Initialise hash function
+	r = EVP_DigestVerifyInit(mdctx, NULL, NULL, NULL, pkey);
+	if (r != 1) {
+		ERROR(db->ctx, "Error initializing signature validation: %s\n",
+			ERR_error_string(ERR_get_error(), NULL));
+		r = 1;
+
+		goto CLEANUP;
+	}
+
+	// We are going to read the entire file
+	r = madvise(db->data, db->length, MADV_WILLNEED);
+	if (r)
+		DEBUG(db->ctx, "madvise() failed: %m\n");
+
+	// Check if the file is large enough
+	if (length < sizeof(struct loc_database_magic)) {
+		ERROR(db->ctx, "Could not read header\n");
+		r = 1;
+		goto CLEANUP;
+	}
+
+	hexdump(db->ctx, data, sizeof(struct loc_database_magic));
+
+	// Feed magic into the hash
+	r = EVP_DigestVerifyUpdate(mdctx, data, sizeof(struct loc_database_magic));
+	if (r != 1) {
+		ERROR(db->ctx, "%s\n", ERR_error_string(ERR_get_error(), NULL));
+		r = 1;
+
+		goto CLEANUP;
+	}
+
+	data   += sizeof(struct loc_database_magic);
+	length -= sizeof(struct loc_database_magic);
+
+	// Read the header
+	struct loc_database_header_v1 header_v1;
+
+	switch (db->version) {
+		case LOC_DATABASE_VERSION_1:
+			if (length < sizeof(header_v1)) {
+				ERROR(db->ctx, "Could not read header\n");
+				r = 1;
+
+				goto CLEANUP;
+			}
+
+			// Copy the header so that we can clear the signatures
+			loc_database_unsigned_header_v1(db, &header_v1);
+
+			hexdump(db->ctx, &header_v1, sizeof(header_v1));
+
+			// Feed header into the hash
+			r = EVP_DigestVerifyUpdate(mdctx, &header_v1, sizeof(header_v1));
+			if (r != 1) {
+				ERROR(db->ctx, "%s\n", ERR_error_string(ERR_get_error(), NULL));
+				r = 1;
+
+				goto CLEANUP;
+			}
+
+			data   += sizeof(header_v1);
+			length -= sizeof(header_v1);
+			break;
+
+		default:
+			ERROR(db->ctx, "Cannot compute hash for database with format %u\n",
+				db->version);
+			r = -EINVAL;
+			goto CLEANUP;
+	}
+
+	hexdump(db->ctx, data, length);
+
+	// Feed the rest of the file straight from the mapped memory
+	r = EVP_DigestVerifyUpdate(mdctx, data, length);
+	if (r != 1) {
+		ERROR(db->ctx, "%s\n", ERR_error_string(ERR_get_error(), NULL));
+		r = 1;
+
+		goto CLEANUP;
+	}
+
+	int sig1_valid = 0;
+	int sig2_valid = 0;
+
+	// Check first signature
+	if (db->signature1.length) {
+		hexdump(db->ctx, db->signature1.data, db->signature1.length);
+
+		r = EVP_DigestVerifyFinal(mdctx,
+			(unsigned char*)db->signature1.data, db->signature1.length);
+
+		if (r == 0) {
+			DEBUG(db->ctx, "The first signature is invalid\n");
+		} else if (r == 1) {
+			DEBUG(db->ctx, "The first signature is valid\n");
+			sig1_valid = 1;
+		} else {
+			ERROR(db->ctx, "Error verifying the first signature: %s\n",
+				ERR_error_string(ERR_get_error(), NULL));
+			r = -1;
+			goto CLEANUP;
+		}
+	}
+
+	// Check second signature only when the first one was invalid
+	if (db->signature2.length) {
+		hexdump(db->ctx, db->signature2.data, db->signature2.length);
+
+		r = EVP_DigestVerifyFinal(mdctx,
+			(unsigned char*)db->signature2.data, db->signature2.length);
+
+		if (r == 0) {
+			DEBUG(db->ctx, "The second signature is invalid\n");
+		} else if (r == 1) {
+			DEBUG(db->ctx, "The second signature is valid\n");
+			sig2_valid = 1;
+		} else {
+			ERROR(db->ctx, "Error verifying the second signature: %s\n",
+				ERR_error_string(ERR_get_error(), NULL));
+			r = -1;
+			goto CLEANUP;
+		}
+	}
+
+	clock_t end = clock();
 	INFO(db->ctx, "Signature checked in %.4fms\n",
 		(double)(end - start) / CLOCKS_PER_SEC * 1000);
 
@@ -697,6 +1304,105 @@ LOC_EXPORT int loc_database_verify(struct loc_database* db, FILE* f) {
 CLEANUP:
 	// Cleanup
 	EVP_MD_CTX_free(mdctx);
+
+	return r;
+}
+
+
+LOC_EXPORT int loc_database_verify(struct loc_database* db, FILE* f) {
+	struct loc_database_verified verified;
+	int cacheable;
+	int r;
+
+	// Cannot do this when no signature is available
+	if (!db->signature1.data && !db->signature2.data) {
+		DEBUG(db->ctx, "No signature available to verify\n");
+		return 1;
+	}
+
+	// Load public key
+	EVP_PKEY* pkey = PEM_read_PUBKEY(f, NULL, NULL, NULL);
+	if (!pkey) {
+		ERROR(db->ctx, "Could not parse public key: %s\n",
+			ERR_error_string(ERR_get_error(), NULL));
+
+		return -1;
+	}
+
+	// Check if we have verified this database before
+	if (db->flags & LOC_DATABASE_FLAGS_CACHE_VERIFICATION)
+		cacheable = !loc_database_make_verified(db, pkey, &verified);
+	else
+		cacheable = 0;
+
+	if (cacheable && loc_database_verified_before(db, &verified)) {
+		DEBUG(db->ctx, "The database has been verified before\n");
+		r = 0;
+		goto CLEANUP;
+	}
+
+	// Verify page by page if we can
+	if (db->page_hashes)
+		r = loc_database_verify_paged(db, pkey);
+	else
+		r = loc_database_verify_linear(db, pkey);
+
+	// Remember the result
+	if (r == 0 && cacheable)
+		loc_database_remember_verified(db, &verified);
+
+CLEANUP:
+	EVP_PKEY_free(pkey);
+
+	return r;
+}
+
+LOC_EXPORT int loc_database_verify_on_demand(struct loc_database* db, FILE* f) {
+	const struct loc_database_header_v1* header =
+		(const struct loc_database_header_v1*)(db->data + LOC_DATABASE_MAGIC_SIZE);
+	int r;
+
+	// We can only do this if the database has page hashes
+	if (!db->page_hashes) {
+		DEBUG(db->ctx, "Database has no page hashes\n");
+		errno = ENOTSUP;
+		return -ENOTSUP;
+	}
+
+	// Load public key
+	EVP_PKEY* pkey = PEM_read_PUBKEY(f, NULL, NULL, NULL);
+	if (!pkey) {
+		ERROR(db->ctx, "Could not parse public key: %s\n",
+			ERR_error_string(ERR_get_error(), NULL));
+
+		return -1;
+	}
+
+	// Check if the page hashes have been signed
+	r = loc_database_verify_page_signatures(db, pkey);
+	if (r)
+		goto CLEANUP;
+
+	// From now on, all pages will be verified when they are being accessed
+	if (!db->verified_pages) {
+		db->verified_pages = calloc(db->num_pages, sizeof(*db->verified_pages));
+		if (!db->verified_pages) {
+			r = -ENOMEM;
+			goto CLEANUP;
+		}
+	}
+
+	// The string pool is not being accessed through any objects so we verify it now
+	const char* pool = db->data + be32toh(header->pool_offset);
+	const size_t pool_length = be32toh(header->pool_length);
+
+	if (pool_length && !loc_database_check_pages(db, pool, pool_length))
+		r = 1;
+
+	// Walk to the IPv4 root again so that all nodes on the way are being verified
+	loc_database_find_ipv4_root(db);
+
+CLEANUP:
 	EVP_PKEY_free(pkey);
 
 	return r;
@@ -805,8 +1511,8 @@ LOC_EXPORT int loc_database_get_as(struct loc_database* db, struct loc_as** as,
 }
 
 // Returns the network at position pos
-static int loc_database_fetch_network(struct loc_database* db, struct loc_network** network,
-		struct in6_addr* address, unsigned int prefix, off_t pos) {
+static int loc_database_fetch_network_value(struct loc_database* db,
+		struct loc_network_value* value, const struct in6_addr* address, unsigned int prefix, off_t pos) {
 	struct loc_database_network_v1* network_v1 = NULL;
 	int r;
 
@@ -825,9 +1531,11 @@ static int loc_database_fetch_network(struct loc_database* db, struct loc_networ
 			network_v1 = (struct loc_database_network_v1*)loc_database_object(db,
 				&db->network_objects, sizeof(*network_v1), pos);
 			if (!network_v1)
-				return 1;
+				return (errno == EBADMSG) ? -EBADMSG : 1;
 
-			r = loc_network_new_from_database_v1(db->ctx, network, address, prefix, network_v1);
+			r = loc_network_value_from_database_v1(value, address, prefix, network_v1);
+			if (r)
+				ERROR(db->ctx, "Could not import network at position %jd: %m\n", (intmax_t)pos);
 			break;
 
 		default:
@@ -835,14 +1543,25 @@ static int loc_database_fetch_network(struct loc_database* db, struct loc_networ
 			return 1;
 	}
 
-	if (r == 0)
-		DEBUG(db->ctx, "Got network %s\n", loc_network_str(*network));
-
 	return r;
 }
 
-static int __loc_database_node_is_leaf(const struct loc_database_network_node_v1* node) {
-	return (node->network != htobe32(0xffffffff));
+static int loc_database_fetch_network(struct loc_database* db, struct loc_network** network,
+		struct in6_addr* address, unsigned int prefix, off_t pos) {
+	struct loc_network_value value;
+	int r;
+
+	r = loc_database_fetch_network_value(db, &value, address, prefix, pos);
+	if (r)
+		return r;
+
+	r = loc_network_new_from_value(db->ctx, network, &value);
+	if (r)
+		return r;
+
+	DEBUG(db->ctx, "Got network %s\n", loc_network_str(*network));
+
+	return 0;
 }
 
 static int __loc_database_lookup_handle_leaf(struct loc_database* db, const struct in6_addr* address,
@@ -885,7 +1604,7 @@ static int __loc_database_lookup(struct loc_database* db, const struct in6_addr*
 	node_v1 = (struct loc_database_network_node_v1*)loc_database_object(db,
 		&db->network_node_objects, sizeof(*node_v1), node_index);
 	if (!node_v1)
-		return 1;
+		return (errno == EBADMSG) ? -EBADMSG : 1;
 
 	// Follow the path
 	int bit = loc_address_get_bit(address, level);
@@ -938,7 +1657,16 @@ LOC_EXPORT int loc_database_lookup(struct loc_database* db,
 	clock_t start = clock();
 #endif
 
-	int r = __loc_database_lookup(db, address, network, &network_address, 0, 0);
+	int r;
+
+	// Start IPv4 lookups further down the tree
+	if (db->ipv4_root && IN6_IS_ADDR_V4MAPPED(address)) {
+		loc_address_reset(&network_address, AF_INET);
+
+		r = __loc_database_lookup(db, address, network, &network_address, db->ipv4_root, 96);
+	} else {
+		r = __loc_database_lookup(db, address, network, &network_address, 0, 0);
+	}
 
 #ifdef ENABLE_DEBUG
 	clock_t end = clock();
@@ -962,6 +1690,574 @@ LOC_EXPORT int loc_database_lookup_from_string(struct loc_database* db,
 	return loc_database_lookup(db, &address, network);
 }
 
+/*
+	Checks whether address is a bogon, which means that it is not part of any
+	network with a country code. All networks that could contain the address
+	are on the path to it, so that this only has to walk down the tree once.
+
+	Returns 1 if the address is a bogon, 0 if it is not, or a negative error code.
+*/
+LOC_EXPORT int loc_database_is_bogon(struct loc_database* db, const struct in6_addr* address) {
+	const struct loc_database_network_node_v1* node = NULL;
+	const struct loc_database_network_v1* network = NULL;
+	unsigned int level = 0;
+	off_t node_index = 0;
+
+	// IPv4 addresses can only be part of IPv4 networks
+	const unsigned int min_level = IN6_IS_ADDR_V4MAPPED(address) ? 96 : 0;
+
+	// Start IPv4 lookups further down the tree
+	if (min_level && db->ipv4_root) {
+		node_index = db->ipv4_root;
+		level = 96;
+	}
+
+	for (;;) {
+		node = (const struct loc_database_network_node_v1*)loc_database_object(db,
+			&db->network_node_objects, sizeof(*node), node_index);
+		if (!node)
+			return -errno;
+
+		// The address is not a bogon if this network has a country code
+		if (level >= min_level && __loc_database_node_is_leaf(node)) {
+			const off_t network_index = be32toh(node->network);
+
+			if ((size_t)network_index >= db->network_objects.count)
+				return -ERANGE;
+
+			network = (const struct loc_database_network_v1*)loc_database_object(db,
+				&db->network_objects, sizeof(*network), network_index);
+			if (!network)
+				return -errno;
+
+			if (*network->country_code)
+				return 0;
+		}
+
+		// There are no more bits to follow
+		if (level >= 128)
+			break;
+
+		// Follow the path
+		if (loc_address_get_bit(address, level))
+			node_index = be32toh(node->one);
+		else
+			node_index = be32toh(node->zero);
+
+		// The tree ends here
+		if (node_index <= 0)
+			break;
+
+		// Check boundaries
+		if ((size_t)node_index >= db->network_node_objects.count)
+			return -ERANGE;
+
+		level++;
+	}
+
+	return 1;
+}
+
+static int loc_database_is_space(const char c) {
+	switch (c) {
+		case ' ':
+		case '\t':
+		case '\r':
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+	Looks up all addresses in a buffer with one address per line and calls
+	callback for each of them with the network that was found. Empty lines are
+	skipped. If an address could not be parsed or was not found, network will
+	be NULL.
+
+	This is a lot faster than calling loc_database_lookup_from_string() for each
+	line, because the buffer does not have to be split into strings first.
+*/
+LOC_EXPORT int loc_database_lookup_from_buffer(struct loc_database* db,
+		const char* buffer, size_t length, loc_database_lookup_callback callback, void* data) {
+	struct loc_network* network = NULL;
+	struct in6_addr address;
+	const char* end = buffer + length;
+	const char* line = buffer;
+	const char* eol = NULL;
+	const char* p = NULL;
+	int r;
+
+	if (!buffer || !callback) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+
+	while (line < end) {
+		// Find the end of the line
+		eol = memchr(line, '\n', end - line);
+		if (!eol)
+			eol = end;
+
+		p = eol;
+
+		// Strip any surrounding whitespace
+		while (line < p && loc_database_is_space(*line))
+			line++;
+
+		while (p > line && loc_database_is_space(*(p - 1)))
+			p--;
+
+		// Skip empty lines
+		if (line == p)
+			goto NEXT;
+
+		// Parse the address
+		r = loc_address_parse_length(&address, line, p - line);
+		if (r) {
+			DEBUG(db->ctx, "Could not parse '%.*s'\n", (int)(p - line), line);
+
+		// Lookup the address
+		} else {
+			r = loc_database_lookup(db, &address, &network);
+			if (r)
+				return r;
+		}
+
+		// Pass on the result
+		r = callback(line, p - line, network, data);
+
+		if (network) {
+			loc_network_unref(network);
+			network = NULL;
+		}
+
+		if (r)
+			return r;
+
+NEXT:
+		line = eol + 1;
+	}
+
+	return 0;
+}
+
+/*
+	Fills record with the network at position pos, which is at the given depth
+	of the tree on the path to address
+*/
+static int loc_database_fetch_record(struct loc_database* db, struct loc_database_record* record,
+		const struct in6_addr* address, unsigned int depth, off_t pos) {
+	const struct loc_database_network_v1* network = NULL;
+
+	if ((size_t)pos >= db->network_objects.count)
+		return -ERANGE;
+
+	network = (const struct loc_database_network_v1*)loc_database_object(db,
+		&db->network_objects, sizeof(*network), pos);
+	if (!network)
+		return -errno;
+
+	// Clear any bits below the prefix
+	const struct in6_addr bitmask = loc_prefix_to_bitmask(depth);
+
+	record->address = loc_address_and(address, &bitmask);
+	record->prefix  = depth;
+	record->asn     = be32toh(network->asn);
+	record->flags   = be16toh(network->flags);
+
+	loc_country_code_copy(record->country_code, network->country_code);
+	record->country_code[2] = '\0';
+
+	// IPv4 prefixes do not include the mapping
+	if (IN6_IS_ADDR_V4MAPPED(&record->address))
+		record->prefix -= 96;
+
+	return 0;
+}
+
+/*
+	Looks up address like loc_database_lookup(), but fills record instead of
+	creating a new network object.
+
+	Returns 0 if a network was found, 1 if not, or a negative error code.
+*/
+LOC_EXPORT int loc_database_lookup_record(struct loc_database* db,
+		const struct in6_addr* address, struct loc_database_record* record) {
+	const struct loc_database_network_node_v1* node = NULL;
+	unsigned int level = 0;
+	unsigned int depth = 0;
+	off_t node_index = 0;
+	off_t network_index = -1;
+
+	// Start IPv4 lookups further down the tree
+	if (db->ipv4_root && IN6_IS_ADDR_V4MAPPED(address)) {
+		node_index = db->ipv4_root;
+		level = 96;
+	}
+
+	for (;;) {
+		node = (const struct loc_database_network_node_v1*)loc_database_object(db,
+			&db->network_node_objects, sizeof(*node), node_index);
+		if (!node)
+			return -errno;
+
+		// Remember the most specific network on the path
+		if (__loc_database_node_is_leaf(node)) {
+			network_index = be32toh(node->network);
+			depth = level;
+		}
+
+		// There are no more bits to follow
+		if (level >= 128)
+			break;
+
+		// Follow the path
+		if (loc_address_get_bit(address, level))
+			node_index = be32toh(node->one);
+		else
+			node_index = be32toh(node->zero);
+
+		// The tree ends here
+		if (node_index <= 0)
+			break;
+
+		// Check boundaries
+		if ((size_t)node_index >= db->network_node_objects.count)
+			return -ERANGE;
+
+		level++;
+	}
+
+	// Nothing found
+	if (network_index < 0)
+		return 1;
+
+	return loc_database_fetch_record(db, record, address, depth, network_index);
+}
+
+/*
+	Opens the database at path with its own context.
+
+	Returns NULL and sets errno if the database could not be opened.
+*/
+LOC_EXPORT struct loc_database* loc_database_open_path(const char* path) {
+	struct loc_database* db = NULL;
+	struct loc_ctx* ctx = NULL;
+	FILE* f = NULL;
+	int r;
+
+	if (!path) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	r = loc_new(&ctx);
+	if (r) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	f = fopen(path, "r");
+	if (!f) {
+		ERROR(ctx, "Could not open %s: %s\n", path, strerror(errno));
+		goto ERROR;
+	}
+
+	// The database keeps its own copy of the file descriptor
+	r = loc_database_new(ctx, &db, f);
+	if (r)
+		db = NULL;
+
+ERROR:
+	r = errno;
+
+	if (f)
+		fclose(f);
+	loc_unref(ctx);
+
+	errno = r;
+
+	return db;
+}
+
+/*
+	Looks up address (as a string) and stores the matching network in result.
+	The result is cleared first, so it can be used even if nothing was found.
+
+	Returns 0 if a network was found, 1 if not, or a negative error code.
+*/
+LOC_EXPORT int loc_database_lookup_result(struct loc_database* db,
+		const char* address, struct loc_database_result* result) {
+	struct loc_database_record record;
+	struct in6_addr a;
+	int r;
+
+	memset(result, 0, sizeof(*result));
+
+	r = loc_address_parse(&a, NULL, address);
+	if (r)
+		return -errno;
+
+	r = loc_database_lookup_record(db, &a, &record);
+	if (r)
+		return r;
+
+	result->asn = record.asn;
+	result->flags = record.flags;
+	result->prefix = record.prefix;
+
+	if (*record.country_code)
+		result->country_code = ((unsigned char)record.country_code[0] << 8)
+			| (unsigned char)record.country_code[1];
+
+	return 0;
+}
+
+/*
+	Filters of loc_database_walk() in a form that can be checked
+	without allocating any memory
+*/
+struct loc_database_walk_filter {
+	int family;
+
+	// One bit for each country code from AA to ZZ
+	uint8_t countries[(LOC_COUNTRY_CODES + 7) / 8];
+	int has_countries;
+
+	// Sorted AS numbers
+	uint32_t* asns;
+	size_t num_asns;
+	int has_asns;
+
+	uint32_t flags;
+};
+
+static int loc_database_asn_cmp(const void* p1, const void* p2) {
+	const uint32_t asn1 = *(const uint32_t*)p1;
+	const uint32_t asn2 = *(const uint32_t*)p2;
+
+	if (asn1 > asn2)
+		return 1;
+	else if (asn1 < asn2)
+		return -1;
+
+	return 0;
+}
+
+static int loc_database_walk_filter_init(struct loc_database_walk_filter* filter,
+		int family, struct loc_country_list* countries, struct loc_as_list* asns, uint32_t flags) {
+	struct loc_country* country = NULL;
+	struct loc_as* as = NULL;
+	int i;
+
+	memset(filter, 0, sizeof(*filter));
+
+	filter->family = family;
+	filter->flags  = flags;
+
+	// An empty list is still a filter, it just never matches
+	filter->has_countries = !!countries;
+	filter->has_asns      = !!asns;
+
+	// Mark all countries in the bitmap
+	if (countries) {
+		for (size_t j = 0; j < loc_country_list_size(countries); j++) {
+			country = loc_country_list_get(countries, j);
+			if (!country)
+				continue;
+
+			i = loc_country_code_index(loc_country_get_code(country));
+			if (i >= 0)
+				filter->countries[i / 8] |= 1 << (i % 8);
+
+			loc_country_unref(country);
+		}
+	}
+
+	// Copy all AS numbers into a sorted array
+	if (asns && !loc_as_list_empty(asns)) {
+		filter->asns = calloc(loc_as_list_size(asns), sizeof(*filter->asns));
+		if (!filter->asns)
+			return -errno;
+
+		for (size_t j = 0; j < loc_as_list_size(asns); j++) {
+			as = loc_as_list_get(asns, j);
+			if (!as)
+				continue;
+
+			filter->asns[filter->num_asns++] = loc_as_get_number(as);
+			loc_as_unref(as);
+		}
+
+		qsort(filter->asns, filter->num_asns, sizeof(*filter->asns), loc_database_asn_cmp);
+	}
+
+	return 0;
+}
+
+static int loc_database_walk_filter_match(const struct loc_database_walk_filter* filter,
+		const struct loc_database_record* record) {
+	int i;
+
+	// If family is set, it must match
+	if (filter->family) {
+		if (IN6_IS_ADDR_V4MAPPED(&record->address) != (filter->family == AF_INET))
+			return 0;
+	}
+
+	// Match if no filter criteria is configured
+	if (!filter->has_countries && !filter->has_asns && !filter->flags)
+		return 1;
+
+	// Check if the country code matches
+	if (filter->has_countries) {
+		i = loc_country_code_index(record->country_code);
+
+		if (i >= 0 && (filter->countries[i / 8] & (1 << (i % 8))))
+			return 1;
+	}
+
+	// Check if the ASN matches
+	if (filter->asns) {
+		if (bsearch(&record->asn, filter->asns, filter->num_asns,
+				sizeof(*filter->asns), loc_database_asn_cmp))
+			return 1;
+	}
+
+	// Check if flags match
+	if (filter->flags & record->flags)
+		return 1;
+
+	// Not a match
+	return 0;
+}
+
+/*
+	Calls callback for every network in the database that matches the filters,
+	in the same order as the enumerator would return them. Other than the
+	enumerator, this does not create any objects, but passes a record that is
+	only valid during the callback.
+
+	The filters work like the ones of the enumerator: family, if set, must
+	match, and a network matches if it matches any of the countries, ASNs or
+	flags, or if none of them are set. An empty list counts as set.
+
+	Returns 0 when all networks have been walked, the first non-zero value
+	returned by callback, or a negative error code.
+*/
+LOC_EXPORT int loc_database_walk(struct loc_database* db, int family,
+		struct loc_country_list* countries, struct loc_as_list* asns, uint32_t flags,
+		loc_database_walk_callback callback, void* data) {
+	const struct loc_database_network_node_v1* node = NULL;
+	struct loc_database_walk_filter filter;
+	struct loc_node_stack stack[MAX_STACK_DEPTH];
+	struct loc_database_record record;
+	struct in6_addr address = IN6ADDR_ANY_INIT;
+	int depth = 0;
+	off_t skip = 0;
+	int r;
+
+	if (!callback)
+		return -EINVAL;
+
+	switch (family) {
+		case AF_UNSPEC:
+		case AF_INET6:
+		case AF_INET:
+			break;
+
+		default:
+			return -EINVAL;
+	}
+
+	// The database has no networks
+	if (!db->network_node_objects.count)
+		return 0;
+
+	r = loc_database_walk_filter_init(&filter, family, countries, asns, flags);
+	if (r)
+		goto ERROR;
+
+	// Start with the root node
+	stack[0].offset = 0;
+	stack[0].i      = 0;
+	stack[0].depth  = 0;
+
+	// Only walk the IPv4 subtree for IPv4 networks, and skip it for IPv6
+	if (db->ipv4_root) {
+		switch (family) {
+			case AF_INET:
+				loc_address_reset(&address, AF_INET);
+
+				stack[0].offset = db->ipv4_root;
+				stack[0].i      = loc_address_get_bit(&address, 95);
+				stack[0].depth  = 96;
+				break;
+
+			case AF_INET6:
+				skip = db->ipv4_root;
+				break;
+		}
+	}
+
+	while (depth >= 0) {
+		const struct loc_node_stack n = stack[depth--];
+
+		// Mark the bits on the path
+		if (n.depth > 0)
+			loc_address_set_bit(&address, n.depth - 1, n.i);
+
+		node = (const struct loc_database_network_node_v1*)loc_database_object(db,
+			&db->network_node_objects, sizeof(*node), n.offset);
+		if (!node) {
+			r = -errno;
+			goto ERROR;
+		}
+
+		if (__loc_database_node_is_leaf(node)) {
+			r = loc_database_fetch_record(db, &record, &address, n.depth, be32toh(node->network));
+			if (r)
+				goto ERROR;
+
+			if (loc_database_walk_filter_match(&filter, &record)) {
+				r = callback(&record, data);
+				if (r)
+					goto ERROR;
+			}
+		}
+
+		// Push the edges so that the zero side will be visited first
+		const off_t edges[2] = { be32toh(node->one), be32toh(node->zero) };
+
+		for (unsigned int i = 0; i < 2; i++) {
+			if (edges[i] <= 0 || edges[i] == skip)
+				continue;
+
+			if ((size_t)edges[i] >= db->network_node_objects.count) {
+				r = -ERANGE;
+				goto ERROR;
+			}
+
+			// There is never more than one node per level waiting on the stack
+			if (depth + 1 >= MAX_STACK_DEPTH) {
+				r = -ENOBUFS;
+				goto ERROR;
+			}
+
+			stack[++depth].offset = edges[i];
+			stack[depth].i        = !i;
+			stack[depth].depth    = n.depth + 1;
+		}
+	}
+
+ERROR:
+	if (filter.asns)
+		free(filter.asns);
+
+	return r;
+}
+
 // Returns the country at position pos
 static int loc_database_fetch_country(struct loc_database* db,
 		struct loc_country** country, off_t pos) {
@@ -1077,12 +2373,13 @@ static void loc_database_enumerator_free(struct loc_database_enumerator* enumera
 	if (enumerator->networks_visited)
 		free(enumerator->networks_visited);
 
-	// Free subnet/bogons stack
-	if (enumerator->stack)
-		loc_network_list_unref(enumerator->stack);
+	if (enumerator->subtrees)
+		free(enumerator->subtrees);
 
-	if (enumerator->subnets)
-		loc_network_list_unref(enumerator->subnets);
+	// Free subnet/bogons stack
+	loc_network_value_list_free(&enumerator->stack);
+	loc_network_value_list_free(&enumerator->subnets);
+	loc_network_value_list_free(&enumerator->excluded);
 
 	free(enumerator);
 }
@@ -1102,8 +2399,11 @@ LOC_EXPORT int loc_database_enumerator_new(struct loc_database_enumerator** enum
 	e->mode = mode;
 	e->refcount = 1;
 
+	// Aggregate output? This only works on flattened networks.
+	e->aggregate = (flags & LOC_DB_ENUMERATOR_FLAGS_AGGREGATE);
+
 	// Flatten output?
-	e->flatten = (flags & LOC_DB_ENUMERATOR_FLAGS_FLATTEN);
+	e->flatten = (flags & LOC_DB_ENUMERATOR_FLAGS_FLATTEN) || e->aggregate;
 
 	// Initialise graph search
 	e->network_stack_depth = 1;
@@ -1114,11 +2414,6 @@ LOC_EXPORT int loc_database_enumerator_new(struct loc_database_enumerator** enum
 		goto ERROR;
 	}
 
-	// Allocate stack
-	r = loc_network_list_new(e->ctx, &e->stack);
-	if (r)
-		goto ERROR;
-
 	// Initialize bogon search
 	loc_address_reset(&e->gap6_start, AF_INET6);
 	loc_address_reset(&e->gap4_start, AF_INET);
@@ -1207,11 +2502,223 @@ LOC_EXPORT int loc_database_enumerator_set_flag(
 
 LOC_EXPORT int loc_database_enumerator_set_family(
 		struct loc_database_enumerator* enumerator, int family) {
+	switch (family) {
+		case AF_UNSPEC:
+		case AF_INET:
+		case AF_INET6:
+			break;
+
+		default:
+			errno = EINVAL;
+			return -EINVAL;
+	}
+
 	enumerator->family = family;
 
 	return 0;
 }
 
+/*
+	Counts the networks in the subtree below each node. The writer stores all
+	nodes in breadth-first order, so that children always come after their parent.
+*/
+static int loc_database_count_networks(struct loc_database* db, uint32_t** counts) {
+	const struct loc_database_network_node_v1* node = NULL;
+	const size_t count = db->network_node_objects.count;
+	uint32_t* c = NULL;
+
+	c = calloc(count, sizeof(*c));
+	if (!c)
+		return -ENOMEM;
+
+	for (size_t i = count; i-- > 0;) {
+		node = (const struct loc_database_network_node_v1*)loc_database_object(db,
+			&db->network_node_objects, sizeof(*node), i);
+		if (!node) {
+			free(c);
+			return -errno;
+		}
+
+		if (__loc_database_node_is_leaf(node))
+			c[i]++;
+
+		const size_t zero = be32toh(node->zero);
+		const size_t one  = be32toh(node->one);
+
+		if (zero > i && zero < count)
+			c[i] += c[zero];
+
+		if (one > i && one < count)
+			c[i] += c[one];
+	}
+
+	*counts = c;
+
+	return 0;
+}
+
+/*
+	Replaces the subtree at index i by the subtrees of its children that have any networks
+*/
+static size_t loc_database_split_subtree(struct loc_database* db, const uint32_t* counts,
+		struct loc_database_subtree* subtrees, size_t num_subtrees, size_t i,
+		const struct loc_database_network_node_v1* node) {
+	struct loc_database_subtree children[2];
+	size_t num_children = 0;
+
+	const off_t offsets[] = { be32toh(node->zero), be32toh(node->one) };
+
+	for (unsigned int bit = 0; bit < 2; bit++) {
+		if (offsets[bit] <= 0 || (size_t)offsets[bit] >= db->network_node_objects.count)
+			continue;
+
+		// Skip anything empty
+		if (!counts[offsets[bit]])
+			continue;
+
+		children[num_children].address = subtrees[i].address;
+		children[num_children].offset  = offsets[bit];
+		children[num_children].depth   = subtrees[i].depth + 1;
+
+		loc_address_set_bit(&children[num_children].address, subtrees[i].depth, bit);
+		num_children++;
+	}
+
+	// Make space
+	memmove(subtrees + i + num_children, subtrees + i + 1,
+		(num_subtrees - i - 1) * sizeof(*subtrees));
+
+	memcpy(subtrees + i, children, num_children * sizeof(*subtrees));
+
+	return num_subtrees - 1 + num_children;
+}
+
+/*
+	Restricts the enumerator to one of a number of partitions of the network tree
+
+	The tree is split into subtrees that do not have any networks above them, so
+	that every partition can be enumerated (and flattened) independently. Each
+	partition receives a contiguous run of subtrees with about the same number of
+	networks. Enumerating all partitions in order returns the same networks in
+	the same order as enumerating the entire database at once.
+
+	When aggregating, networks can only be merged within the same partition, so
+	that there might be a few more networks where partitions meet.
+
+	Each partition needs its own enumerator, which can then run in its own thread.
+	This has to be called before the first network is being fetched.
+*/
+LOC_EXPORT int loc_database_enumerator_set_partition(struct loc_database_enumerator* enumerator,
+		unsigned int partition, unsigned int partitions) {
+	const struct loc_database_network_node_v1* node = NULL;
+	struct loc_database_subtree* subtrees = NULL;
+	struct loc_database* db = enumerator->db;
+	size_t num_subtrees = 0;
+	uint32_t* counts = NULL;
+	size_t count = 0;
+	int r;
+
+	if (!partitions || partition >= partitions)
+		return -EINVAL;
+
+	// Only networks can be partitioned
+	if (enumerator->mode != LOC_DB_ENUMERATE_NETWORKS)
+		return -ENOTSUP;
+
+	// Check if the enumeration has already started
+	if (enumerator->subtrees || (db->network_node_objects.count && enumerator->networks_visited[0]))
+		return -EBUSY;
+
+	// Nothing to do for an empty database
+	if (!db->network_node_objects.count)
+		return 0;
+
+	r = loc_database_count_networks(db, &counts);
+	if (r)
+		return r;
+
+	const uint64_t total = counts[0];
+
+	// Split the tree into more subtrees than partitions for a better balance
+	const size_t max_subtrees = (size_t)64 * partitions;
+
+	subtrees = calloc(max_subtrees + 1, sizeof(*subtrees));
+	if (!subtrees) {
+		r = -ENOMEM;
+		goto ERROR;
+	}
+
+	// Start with the entire tree
+	if (total)
+		num_subtrees = 1;
+
+	while (num_subtrees < max_subtrees) {
+		ssize_t largest = -1;
+
+		// Find the largest subtree that has no network at its root
+		for (size_t i = 0; i < num_subtrees; i++) {
+			if (largest >= 0 && counts[subtrees[i].offset] <= counts[subtrees[largest].offset])
+				continue;
+
+			node = (const struct loc_database_network_node_v1*)loc_database_object(db,
+				&db->network_node_objects, sizeof(*node), subtrees[i].offset);
+			if (!node) {
+				r = -errno;
+				goto ERROR;
+			}
+
+			if (!__loc_database_node_is_leaf(node))
+				largest = i;
+		}
+
+		// Stop if nothing can be split any more or all subtrees are small enough
+		if (largest < 0 || (uint64_t)counts[subtrees[largest].offset] * 16 * partitions <= total)
+			break;
+
+		node = (const struct loc_database_network_node_v1*)loc_database_object(db,
+			&db->network_node_objects, sizeof(*node), subtrees[largest].offset);
+		if (!node) {
+			r = -errno;
+			goto ERROR;
+		}
+
+		num_subtrees = loc_database_split_subtree(db, counts,
+			subtrees, num_subtrees, largest, node);
+	}
+
+	// Keep all subtrees whose middle falls into this partition
+	uint64_t before = 0;
+
+	for (size_t i = 0; i < num_subtrees; i++) {
+		const uint64_t networks = counts[subtrees[i].offset];
+
+		if ((before + networks / 2) * partitions / total == partition)
+			subtrees[count++] = subtrees[i];
+
+		before += networks;
+	}
+
+	DEBUG(enumerator->ctx, "Partition %u/%u has %zu of %zu subtree(s)\n",
+		partition, partitions, count, num_subtrees);
+
+	enumerator->subtrees = subtrees;
+	enumerator->num_subtrees = count;
+	enumerator->subtree_index = 0;
+
+	// Start with the first subtree
+	enumerator->network_stack_depth = 0;
+
+	subtrees = NULL;
+
+ERROR:
+	if (subtrees)
+		free(subtrees);
+	if (counts)
+		free(counts);
+
+	return r;
+}
+
 LOC_EXPORT int loc_database_enumerator_next_as(
 		struct loc_database_enumerator* enumerator, struct loc_as** as) {
 	*as = NULL;
@@ -1280,11 +2787,13 @@ static int loc_database_enumerator_stack_push_node(
 	return 0;
 }
 
-static int loc_database_enumerator_match_network(
-		struct loc_database_enumerator* enumerator, struct loc_network* network) {
+static int loc_database_enumerator_match_value(
+		struct loc_database_enumerator* enumerator, const struct loc_network_value* value) {
+	char country_code[3] = "\0\0";
+
 	// If family is set, it must match
-	if (enumerator->family && loc_network_address_family(network) != enumerator->family) {
-		DEBUG(enumerator->ctx, "Filtered network %p because of family not matching\n", network);
+	if (enumerator->family && loc_address_family(&value->address) != enumerator->family) {
+		DEBUG(enumerator->ctx, "Filtered network %p because of family not matching\n", value);
 		return 0;
 	}
 
@@ -1294,27 +2803,25 @@ static int loc_database_enumerator_match_network(
 
 	// Check if the country code matches
 	if (enumerator->countries && !loc_country_list_empty(enumerator->countries)) {
-		const char* country_code = loc_network_get_country_code(network);
+		loc_country_code_copy(country_code, value->country_code);
 
 		if (loc_country_list_contains_code(enumerator->countries, country_code)) {
-			DEBUG(enumerator->ctx, "Matched network %p because of its country code\n", network);
+			DEBUG(enumerator->ctx, "Matched network %p because of its country code\n", value);
 			return 1;
 		}
 	}
 
 	// Check if the ASN matches
 	if (enumerator->asns && !loc_as_list_empty(enumerator->asns)) {
-		uint32_t asn = loc_network_get_asn(network);
-
-		if (loc_as_list_contains_number(enumerator->asns, asn)) {
-			DEBUG(enumerator->ctx, "Matched network %p because of its ASN\n", network);
+		if (loc_as_list_contains_number(enumerator->asns, value->asn)) {
+			DEBUG(enumerator->ctx, "Matched network %p because of its ASN\n", value);
 			return 1;
 		}
 	}
 
 	// Check if flags match
-	if (enumerator->flags && loc_network_has_flag(network, enumerator->flags)) {
-		DEBUG(enumerator->ctx, "Matched network %p because of its flags\n", network);
+	if (enumerator->flags && (value->flags & enumerator->flags)) {
+		DEBUG(enumerator->ctx, "Matched network %p because of its flags\n", value);
 		return 1;
 	}
 
@@ -1322,30 +2829,48 @@ static int loc_database_enumerator_match_network(
 	return 0;
 }
 
-static int __loc_database_enumerator_next_network(
-		struct loc_database_enumerator* enumerator, struct loc_network** network, int filter) {
-	// Return top element from the stack
-	while (1) {
-		*network = loc_network_list_pop_first(enumerator->stack);
+/*
+	Continues the search with the next subtree of the partition
+*/
+static int loc_database_enumerator_next_subtree(struct loc_database_enumerator* enumerator) {
+	if (enumerator->subtree_index >= enumerator->num_subtrees)
+		return 0;
 
-		// Stack is empty
-		if (!*network)
-			break;
+	const struct loc_database_subtree* subtree =
+		&enumerator->subtrees[enumerator->subtree_index++];
+
+	enumerator->network_address = subtree->address;
+
+	// Put the root of the subtree on the stack
+	enumerator->network_stack_depth = 1;
+	enumerator->network_stack[1].offset = subtree->offset;
+	enumerator->network_stack[1].depth  = subtree->depth;
+	enumerator->network_stack[1].i      = (subtree->depth > 0) ?
+		loc_address_get_bit(&subtree->address, subtree->depth - 1) : 0;
+
+	return 1;
+}
+
+/*
+	Fetches the next network into value. found is set to zero when there are
+	no more networks.
+*/
+static int __loc_database_enumerator_next_value(struct loc_database_enumerator* enumerator,
+		struct loc_network_value* value, int* found, int filter) {
+	*found = 1;
 
+	// Return top element from the stack
+	while (loc_network_value_list_pop_first(&enumerator->stack, value)) {
 		// Return everything if filter isn't enabled, or only return matches
-		if (!filter || loc_database_enumerator_match_network(enumerator, *network))
+		if (!filter || loc_database_enumerator_match_value(enumerator, value))
 			return 0;
-
-		// Throw away anything that doesn't match
-		loc_network_unref(*network);
-		*network = NULL;
 	}
 
 	DEBUG(enumerator->ctx, "Called with a stack of %d nodes\n",
 		enumerator->network_stack_depth);
 
 	// Perform DFS
-	while (enumerator->network_stack_depth > 0) {
+	while (enumerator->network_stack_depth > 0 || loc_database_enumerator_next_subtree(enumerator)) {
 		DEBUG(enumerator->ctx, "Stack depth: %d\n", enumerator->network_stack_depth);
 
 		// Get object from top of the stack
@@ -1390,8 +2915,8 @@ static int __loc_database_enumerator_next_network(
 
 			DEBUG(enumerator->ctx, "Node has a network at %jd\n", (intmax_t)network_index);
 
-			// Fetch the network object
-			r = loc_database_fetch_network(enumerator->db, network,
+			// Fetch the network
+			r = loc_database_fetch_network_value(enumerator->db, value,
 				&enumerator->network_address, node->depth, network_index);
 
 			// Break on any errors
@@ -1399,181 +2924,269 @@ static int __loc_database_enumerator_next_network(
 				return r;
 
 			// Return all networks when the filter is disabled, or check for match
-			if (!filter || loc_database_enumerator_match_network(enumerator, *network))
+			if (!filter || loc_database_enumerator_match_value(enumerator, value))
 				return 0;
-
-			// Does not seem to be a match, so we cleanup and move on
-			loc_network_unref(*network);
-			*network = NULL;
 		}
 	}
 
 	// Reached the end of the search
+	*found = 0;
+
 	return 0;
 }
 
-static int __loc_database_enumerator_next_network_flattened(
-		struct loc_database_enumerator* enumerator, struct loc_network** network) {
-	// Fetch the next network
-	int r = __loc_database_enumerator_next_network(enumerator, network, 1);
-	if (r)
-		return r;
-
-	// End if we could not read another network
-	if (!*network)
-		return 0;
-
-	struct loc_network* subnet = NULL;
+static int __loc_database_enumerator_next_value_flattened(
+		struct loc_database_enumerator* enumerator, struct loc_network_value* value, int* found) {
+	struct loc_network_value subnet;
+	int has_subnet;
+	int r;
 
-	// Create a list with all subnets
-	if (!enumerator->subnets) {
-		r = loc_network_list_new(enumerator->ctx, &enumerator->subnets);
+	for (;;) {
+		// Fetch the next network
+		r = __loc_database_enumerator_next_value(enumerator, value, found, 1);
 		if (r)
 			return r;
-	}
 
-	// Search all subnets from the database
-	while (1) {
-		// Fetch the next network in line
-		r = __loc_database_enumerator_next_network(enumerator, &subnet, 0);
-		if (r) {
-			loc_network_unref(subnet);
-			loc_network_list_clear(enumerator->subnets);
+		// End if we could not read another network
+		if (!*found)
+			return 0;
 
-			return r;
-		}
+		// Search all subnets from the database
+		for (;;) {
+			// Fetch the next network in line
+			r = __loc_database_enumerator_next_value(enumerator, &subnet, &has_subnet, 0);
+			if (r)
+				goto ERROR;
 
-		// End if we did not receive another subnet
-		if (!subnet)
-			break;
+			// End if we did not receive another subnet
+			if (!has_subnet)
+				break;
 
-		// Collect all subnets in a list
-		if (loc_network_is_subnet(*network, subnet)) {
-			r = loc_network_list_push(enumerator->subnets, subnet);
-			if (r) {
-				loc_network_unref(subnet);
-				loc_network_list_clear(enumerator->subnets);
+			// Collect all subnets in a list
+			if (loc_network_value_is_subnet(value, &subnet)) {
+				r = loc_network_value_list_push(&enumerator->subnets, &subnet);
+				if (r)
+					goto ERROR;
 
-				return r;
+				continue;
 			}
 
-			loc_network_unref(subnet);
-			continue;
+			// If this is not a subnet, we push it back onto the stack and break
+			r = loc_network_value_list_push(&enumerator->stack, &subnet);
+			if (r)
+				goto ERROR;
+
+			break;
 		}
 
-		// If this is not a subnet, we push it back onto the stack and break
-		r = loc_network_list_push(enumerator->stack, subnet);
-		if (r) {
-			loc_network_unref(subnet);
-			loc_network_list_clear(enumerator->subnets);
+		DEBUG(enumerator->ctx, "Found %zu subnet(s)\n", enumerator->subnets.size);
 
-			return r;
-		}
+		// We can return the network if it has no subnets
+		if (!enumerator->subnets.size)
+			return 0;
 
-		loc_network_unref(subnet);
-		break;
-	}
+		// Break the network into smaller parts without the subnets
+		r = loc_network_value_list_append_excluded(&enumerator->excluded, value, &enumerator->subnets);
+		if (r)
+			goto ERROR;
 
-	DEBUG(enumerator->ctx, "Found %zu subnet(s)\n",
-		loc_network_list_size(enumerator->subnets));
+		r = loc_network_value_list_merge(&enumerator->excluded, &enumerator->subnets);
+		if (r)
+			goto ERROR;
 
-	// We can abort here if the network has no subnets
-	if (loc_network_list_empty(enumerator->subnets)) {
-		loc_network_list_clear(enumerator->subnets);
+		// Push the parts and all subnets onto the stack
+		r = loc_network_value_list_merge(&enumerator->stack, &enumerator->excluded);
+		if (r)
+			goto ERROR;
 
-		return 0;
-	}
+		loc_network_value_list_clear(&enumerator->subnets);
+		loc_network_value_list_clear(&enumerator->excluded);
 
-	// If the network has any subnets, we will break it into smaller parts
-	// without the subnets.
-	struct loc_network_list* excluded = loc_network_exclude_list(*network, enumerator->subnets);
-	if (!excluded) {
-		loc_network_list_clear(enumerator->subnets);
-		return 1;
+		// Drop the network and restart the whole process again to pick the next network
 	}
 
-	// Merge subnets onto the stack
-	r = loc_network_list_merge(enumerator->stack, enumerator->subnets);
-	if (r) {
-		loc_network_list_clear(enumerator->subnets);
-		loc_network_list_unref(excluded);
+ERROR:
+	loc_network_value_list_clear(&enumerator->subnets);
+	loc_network_value_list_clear(&enumerator->excluded);
 
-		return r;
+	return r;
+}
+
+/*
+	Splits the pending range into the smallest possible number of networks
+	which will be returned next
+*/
+static int __loc_database_enumerator_flush_aggregate(struct loc_database_enumerator* enumerator) {
+	struct loc_address_prefix prefixes[LOC_ADDRESS_MAX_PREFIXES];
+	const struct in6_addr last = loc_network_value_last_address(&enumerator->pending);
+	int r;
+
+	enumerator->has_pending = 0;
+	enumerator->aggregated_index = 0;
+
+	// The range is just the pending network
+	if (loc_address_cmp(&enumerator->pending_last, &last) == 0) {
+		enumerator->aggregated[0] = enumerator->pending;
+		enumerator->aggregated_count = 1;
+
+		return 0;
 	}
 
-	// Push excluded list onto the stack
-	r = loc_network_list_merge(enumerator->stack, excluded);
-	if (r) {
-		loc_network_list_clear(enumerator->subnets);
-		loc_network_list_unref(excluded);
+	DEBUG(enumerator->ctx, "Aggregating %s - %s\n",
+		loc_address_str(&enumerator->pending.address),
+		loc_address_str(&enumerator->pending_last));
 
+	r = loc_address_summarize(&enumerator->pending.address,
+		&enumerator->pending_last, prefixes, LOC_ADDRESS_MAX_PREFIXES);
+	if (r < 0)
 		return r;
-	}
 
-	loc_network_list_clear(enumerator->subnets);
-	loc_network_list_unref(excluded);
+	// The value stores the prefix in IPv6 space
+	const unsigned int offset = 128 - loc_address_family_bit_length(
+		loc_address_family(&enumerator->pending.address));
+
+	for (int i = 0; i < r; i++) {
+		enumerator->aggregated[i] = enumerator->pending;
+
+		enumerator->aggregated[i].address = prefixes[i].address;
+		enumerator->aggregated[i].prefix  = prefixes[i].prefix + offset;
+	}
 
-	// Drop the network and restart the whole process again to pick the next network
-	loc_network_unref(*network);
+	enumerator->aggregated_count = r;
 
-	return __loc_database_enumerator_next_network_flattened(enumerator, network);
+	return 0;
 }
 
 /*
-	This function finds all bogons (i.e. gaps) between the input networks
+	Merges adjacent flattened networks with the same properties
 */
-static int __loc_database_enumerator_next_bogon(
-		struct loc_database_enumerator* enumerator, struct loc_network** bogon) {
+static int __loc_database_enumerator_next_value_aggregated(
+		struct loc_database_enumerator* enumerator, struct loc_network_value* value, int* found) {
+	struct loc_network_value next;
+	struct in6_addr address;
+	int has_next;
 	int r;
 
-	// Return top element from the stack
-	while (1) {
-		*bogon = loc_network_list_pop_first(enumerator->stack);
+	for (;;) {
+		// Return any networks of the previous range first
+		if (enumerator->aggregated_index < enumerator->aggregated_count) {
+			*value = enumerator->aggregated[enumerator->aggregated_index++];
+			*found = 1;
 
-		// Stack is empty
-		if (!*bogon)
-			break;
+			return 0;
+		}
 
-		// Return result
-		return 0;
+		// Fetch the next network
+		r = __loc_database_enumerator_next_value_flattened(enumerator, &next, &has_next);
+		if (r)
+			return r;
+
+		// Return the last range at the end
+		if (!has_next) {
+			if (!enumerator->has_pending) {
+				*found = 0;
+				return 0;
+			}
+
+			r = __loc_database_enumerator_flush_aggregate(enumerator);
+			if (r)
+				return r;
+
+			continue;
+		}
+
+		if (enumerator->has_pending) {
+			address = enumerator->pending_last;
+			loc_address_increment(&address);
+
+			// Extend the range if the network follows immediately and has the same properties.
+			// Ranges never span IPv6 and IPv4-mapped networks.
+			if (loc_address_cmp(&address, &next.address) == 0
+					&& loc_address_family(&enumerator->pending.address) == loc_address_family(&next.address)
+					&& loc_network_value_properties_cmp(&enumerator->pending, &next) == 0) {
+				enumerator->pending_last = loc_network_value_last_address(&next);
+				continue;
+			}
+
+			r = __loc_database_enumerator_flush_aggregate(enumerator);
+			if (r)
+				return r;
+		}
+
+		// Start a new range
+		enumerator->pending = next;
+		enumerator->pending_last = loc_network_value_last_address(&next);
+		enumerator->has_pending = 1;
 	}
+}
 
-	struct loc_network* network = NULL;
+/*
+	Splits the gap first - last into networks which will be returned as bogons
+*/
+static int __loc_database_enumerator_add_gap(struct loc_database_enumerator* enumerator,
+		const struct in6_addr* first, const struct in6_addr* last) {
+	int r;
+
+	DEBUG(enumerator->ctx, "Found gap %s - %s\n", loc_address_str(first), loc_address_str(last));
+
+	r = loc_address_summarize(first, last, enumerator->bogons, LOC_ADDRESS_MAX_PREFIXES);
+	if (r < 0) {
+		ERROR(enumerator->ctx, "Could not summarize gap: %s\n", strerror(-r));
+		errno = -r;
+		return 1;
+	}
+
+	enumerator->bogons_count = r;
+	enumerator->bogons_index = 0;
+
+	return 0;
+}
+
+/*
+	This function finds the next gap between the input networks
+*/
+static int __loc_database_enumerator_next_gap(struct loc_database_enumerator* enumerator) {
+	struct loc_network_value network;
 	struct in6_addr* gap_start = NULL;
 	struct in6_addr gap_end = IN6ADDR_ANY_INIT;
+	struct in6_addr first;
+	int* gap_done = NULL;
+	int has_network;
+	int r;
+
+	enumerator->bogons_count = 0;
+	enumerator->bogons_index = 0;
 
 	while (1) {
-		r = __loc_database_enumerator_next_network(enumerator, &network, 1);
+		r = __loc_database_enumerator_next_value(enumerator, &network, &has_network, 1);
 		if (r)
 			return r;
 
 		// We have read the last network
-		if (!network)
+		if (!has_network)
 			goto FINISH;
 
-		const char* country_code = loc_network_get_country_code(network);
-
 		/*
 			Skip anything that does not have a country code
 
 			Even if a network is part of the routing table, and the database provides
 			an ASN, this does not mean that this is a legitimate announcement.
 		*/
-		if (country_code && !*country_code) {
-			loc_network_unref(network);
+		if (!*network.country_code)
 			continue;
-		}
 
 		// Determine the network family
-		int family = loc_network_address_family(network);
+		int family = loc_address_family(&network.address);
 
 		switch (family) {
 			case AF_INET6:
 				gap_start = &enumerator->gap6_start;
+				gap_done  = &enumerator->gap6_done;
 				break;
 
 			case AF_INET:
 				gap_start = &enumerator->gap4_start;
+				gap_done  = &enumerator->gap4_done;
 				break;
 
 			default:
@@ -1582,91 +3195,121 @@ static int __loc_database_enumerator_next_bogon(
 				return 1;
 		}
 
-		const struct in6_addr* first_address = loc_network_get_first_address(network);
-		const struct in6_addr* last_address = loc_network_get_last_address(network);
+		const struct in6_addr* first_address = &network.address;
+		const struct in6_addr last = loc_network_value_last_address(&network);
+		const struct in6_addr* last_address = &last;
 
 		// Skip if this network is a subnet of a former one
-		if (loc_address_cmp(gap_start, last_address) >= 0) {
-			loc_network_unref(network);
+		if (*gap_done || loc_address_cmp(gap_start, last_address) >= 0)
 			continue;
-		}
 
-		// Search where the gap could end
-		gap_end = *first_address;
-		loc_address_decrement(&gap_end);
+		// There is a gap if the network starts after the gap
+		int found = (loc_address_cmp(gap_start, first_address) < 0);
 
-		// There is a gap
-		if (loc_address_cmp(gap_start, &gap_end) <= 0) {
-			r = loc_network_list_summarize(enumerator->ctx,
-				gap_start, &gap_end, &enumerator->stack);
-			if (r) {
-				loc_network_unref(network);
-				return r;
-			}
+		if (found) {
+			first = *gap_start;
+			gap_end = *first_address;
+			loc_address_decrement(&gap_end);
 		}
 
+		// Nothing can follow a network at the end of the address space
+		if (loc_address_all_ones(last_address))
+			*gap_done = 1;
+
 		// The gap now starts after this network
 		*gap_start = *last_address;
 		loc_address_increment(gap_start);
 
-		loc_network_unref(network);
+		if (found)
+			return __loc_database_enumerator_add_gap(enumerator, &first, &gap_end);
+	}
+
+FINISH:
+	// Everything after the last IPv4 network
+	if (!enumerator->gap4_done && !loc_address_all_zeroes(&enumerator->gap4_start)) {
+		first = enumerator->gap4_start;
+
+		// There is nothing left to do for this family
+		enumerator->gap4_done = 1;
 
-		// Try to return something
-		*bogon = loc_network_list_pop_first(enumerator->stack);
-		if (*bogon)
-			break;
+		r = loc_address_reset_last(&gap_end, AF_INET);
+		if (r)
+			return r;
+
+		if (loc_address_cmp(&first, &gap_end) <= 0)
+			return __loc_database_enumerator_add_gap(enumerator, &first, &gap_end);
 	}
 
-	return 0;
+	// Everything after the last IPv6 network
+	if (!enumerator->gap6_done && !loc_address_all_zeroes(&enumerator->gap6_start)) {
+		first = enumerator->gap6_start;
+
+		// There is nothing left to do for this family
+		enumerator->gap6_done = 1;
 
-FINISH:
-	if (!loc_address_all_zeroes(&enumerator->gap6_start)) {
 		r = loc_address_reset_last(&gap_end, AF_INET6);
 		if (r)
 			return r;
 
-		if (loc_address_cmp(&enumerator->gap6_start, &gap_end) <= 0) {
-			r = loc_network_list_summarize(enumerator->ctx,
-				&enumerator->gap6_start, &gap_end, &enumerator->stack);
-			if (r)
-				return r;
-		}
-
-		// Reset start
-		loc_address_reset(&enumerator->gap6_start, AF_INET6);
+		if (loc_address_cmp(&first, &gap_end) <= 0)
+			return __loc_database_enumerator_add_gap(enumerator, &first, &gap_end);
 	}
 
-	if (!loc_address_all_zeroes(&enumerator->gap4_start)) {
-		r = loc_address_reset_last(&gap_end, AF_INET);
+	return 0;
+}
+
+/*
+	This function returns all bogons (i.e. gaps) between the input networks
+*/
+static int __loc_database_enumerator_next_bogon(
+		struct loc_database_enumerator* enumerator, struct loc_network** bogon) {
+	struct loc_address_prefix* next = NULL;
+	int r;
+
+	*bogon = NULL;
+
+	// Find the next gap once all networks of the previous one have been returned
+	if (enumerator->bogons_index >= enumerator->bogons_count) {
+		r = __loc_database_enumerator_next_gap(enumerator);
 		if (r)
 			return r;
 
-		if (loc_address_cmp(&enumerator->gap4_start, &gap_end) <= 0) {
-			r = loc_network_list_summarize(enumerator->ctx,
-				&enumerator->gap4_start, &gap_end, &enumerator->stack);
-			if (r)
-				return r;
-		}
-
-		// Reset start
-		loc_address_reset(&enumerator->gap4_start, AF_INET);
+		// There are no gaps left
+		if (!enumerator->bogons_count)
+			return 0;
 	}
 
-	// Try to return something
-	*bogon = loc_network_list_pop_first(enumerator->stack);
+	next = &enumerator->bogons[enumerator->bogons_index++];
 
-	return 0;
+	return loc_network_new(enumerator->ctx, bogon, &next->address, next->prefix);
 }
 
 LOC_EXPORT int loc_database_enumerator_next_network(
 		struct loc_database_enumerator* enumerator, struct loc_network** network) {
+	struct loc_network_value value;
+	int found = 0;
+	int r;
+
+	*network = NULL;
+
 	switch (enumerator->mode) {
 		case LOC_DB_ENUMERATE_NETWORKS:
+			// Aggregate output?
+			if (enumerator->aggregate)
+				r = __loc_database_enumerator_next_value_aggregated(enumerator, &value, &found);
+
 			// Flatten output?
-			if (enumerator->flatten)
-				return __loc_database_enumerator_next_network_flattened(enumerator, network);
+			else if (enumerator->flatten)
+				r = __loc_database_enumerator_next_value_flattened(enumerator, &value, &found);
+
+			else
+				r = __loc_database_enumerator_next_value(enumerator, &value, &found, 1);
+
+			if (r || !found)
+				return r;
 
-			return __loc_database_enumerator_next_network(enumerator, network, 1);
+			// Only create an object for the network that is being returned
+			return loc_network_new_from_value(enumerator->ctx, network, &value);
 
 		case LOC_DB_ENUMERATE_BOGONS:
 			return __loc_database_enumerator_next_bogon(enumerator, network);
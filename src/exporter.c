@@ -0,0 +1,939 @@
+/*
+	libloc - A library to determine the location of someone on the Internet
+
+	Copyright (C) 2024 IPFire Development Team <info@ipfire.org>
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+	Lesser General Public License for more details.
+*/
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include <libloc/libloc.h>
+#include <libloc/as.h>
+#include <libloc/as-list.h>
+#include <libloc/compat.h>
+#include <libloc/country.h>
+#include <libloc/country-list.h>
+#include <libloc/database.h>
+#include <libloc/exporter.h>
+#include <libloc/network.h>
+#include <libloc/private.h>
+
+// All families in the order in which they are written
+static const int loc_exporter_families[] = { AF_INET6, AF_INET };
+
+#define LOC_EXPORTER_FAMILIES (sizeof(loc_exporter_families) / sizeof(*loc_exporter_families))
+
+enum loc_exporter_target_type {
+	LOC_EXPORTER_TARGET_COUNTRY,
+	LOC_EXPORTER_TARGET_ASN,
+	LOC_EXPORTER_TARGET_FLAG,
+};
+
+/*
+	Something that networks are being exported for
+*/
+struct loc_exporter_target {
+	enum loc_exporter_target_type type;
+
+	// The name of the set (e.g. "DE" or "AS204867")
+	char name[16];
+
+	char country_code[3];
+	uint32_t asn;
+	enum loc_network_flags flag;
+};
+
+/*
+	The file that is being written for a target
+*/
+struct loc_exporter_output {
+	const struct loc_exporter_target* target;
+	int family;
+
+	// The name of the set including the family (e.g. "DEv4")
+	char tag[24];
+
+	FILE* f;
+
+	// The buffer if we are writing to memory
+	char* buffer;
+	size_t length;
+
+	// The length of the header that will be written again in the end
+	long header_length;
+
+	// The number of networks that have been written
+	size_t networks;
+};
+
+struct loc_exporter_asn_route {
+	uint32_t asn;
+	struct loc_exporter_output* output;
+};
+
+/*
+	Finds all outputs of a family that a network has to be written to
+*/
+struct loc_exporter_routes {
+	int family;
+
+	// Indexed by country code
+	struct loc_exporter_output* countries[LOC_COUNTRY_CODES];
+
+	// Sorted by ASN
+	struct loc_exporter_asn_route* asns;
+	size_t num_asns;
+
+	struct loc_exporter_output** flags;
+	size_t num_flags;
+};
+
+struct loc_exporter {
+	struct loc_ctx* ctx;
+	int refcount;
+
+	struct loc_database* db;
+	enum loc_exporter_format format;
+
+	struct loc_exporter_target* targets;
+	size_t num_targets;
+	size_t max_targets;
+
+	// Indices of all targets sorted by name
+	size_t* sorted;
+};
+
+LOC_EXPORT int loc_exporter_new(struct loc_ctx* ctx, struct loc_exporter** exporter,
+		struct loc_database* db, enum loc_exporter_format format) {
+	switch (format) {
+		case LOC_EXPORTER_FORMAT_LIST:
+		case LOC_EXPORTER_FORMAT_IPSET:
+		case LOC_EXPORTER_FORMAT_NFTABLES:
+		case LOC_EXPORTER_FORMAT_XT_GEOIP:
+			break;
+
+		default:
+			errno = EINVAL;
+			return -EINVAL;
+	}
+
+	struct loc_exporter* e = calloc(1, sizeof(*e));
+	if (!e)
+		return -errno;
+
+	e->ctx = loc_ref(ctx);
+	e->refcount = 1;
+
+	e->db = loc_database_ref(db);
+	e->format = format;
+
+	DEBUG(e->ctx, "Exporter allocated at %p\n", e);
+	*exporter = e;
+
+	return 0;
+}
+
+LOC_EXPORT struct loc_exporter* loc_exporter_ref(struct loc_exporter* exporter) {
+	__atomic_add_fetch(&exporter->refcount, 1, __ATOMIC_RELAXED);
+
+	return exporter;
+}
+
+static void loc_exporter_free(struct loc_exporter* exporter) {
+	DEBUG(exporter->ctx, "Releasing exporter at %p\n", exporter);
+
+	if (exporter->targets)
+		free(exporter->targets);
+	if (exporter->sorted)
+		free(exporter->sorted);
+
+	loc_database_unref(exporter->db);
+	loc_unref(exporter->ctx);
+	free(exporter);
+}
+
+LOC_EXPORT struct loc_exporter* loc_exporter_unref(struct loc_exporter* exporter) {
+	if (__atomic_sub_fetch(&exporter->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+		return exporter;
+
+	loc_exporter_free(exporter);
+	return NULL;
+}
+
+/*
+	Searches for a target by name. Returns 1 if it exists, otherwise 0 and
+	stores the position in the sorted index where it would have to be inserted.
+*/
+static int loc_exporter_find_target(struct loc_exporter* exporter, const char* name, size_t* pos) {
+	size_t lo = 0;
+	size_t hi = exporter->num_targets;
+	int r;
+
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+
+		r = strcmp(exporter->targets[exporter->sorted[mid]].name, name);
+		if (r == 0)
+			return 1;
+
+		if (r < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*pos = lo;
+
+	return 0;
+}
+
+/*
+	Adds a new target which keeps the order in which targets have been added,
+	and inserts it into the sorted index at pos
+*/
+static struct loc_exporter_target* loc_exporter_add_target(struct loc_exporter* exporter,
+		size_t pos, enum loc_exporter_target_type type, const char* name) {
+	struct loc_exporter_target* targets = NULL;
+	struct loc_exporter_target* target = NULL;
+	size_t* sorted = NULL;
+
+	// Grow both arrays if they are full
+	if (exporter->num_targets == exporter->max_targets) {
+		const size_t max_targets = (exporter->max_targets) ? exporter->max_targets * 2 : 16;
+
+		targets = reallocarray(exporter->targets, max_targets, sizeof(*targets));
+		if (!targets)
+			return NULL;
+
+		exporter->targets = targets;
+
+		sorted = reallocarray(exporter->sorted, max_targets, sizeof(*sorted));
+		if (!sorted)
+			return NULL;
+
+		exporter->sorted = sorted;
+		exporter->max_targets = max_targets;
+	}
+
+	sorted = exporter->sorted;
+
+	memmove(&sorted[pos + 1], &sorted[pos], (exporter->num_targets - pos) * sizeof(*sorted));
+	sorted[pos] = exporter->num_targets;
+
+	target = &exporter->targets[exporter->num_targets++];
+	memset(target, 0, sizeof(*target));
+
+	target->type = type;
+	snprintf(target->name, sizeof(target->name), "%s", name);
+
+	return target;
+}
+
+/*
+	Adds a country to export. The special country codes A1, A2, A3 and XD
+	export all networks with the corresponding flag.
+*/
+LOC_EXPORT int loc_exporter_add_country(struct loc_exporter* exporter, const char* country_code) {
+	struct loc_exporter_target* target = NULL;
+	size_t pos = 0;
+
+	// Check if this is a special country
+	int flag = loc_country_special_code_to_flag(country_code);
+	if (flag < 0)
+		return -errno;
+
+	if (!flag && !loc_country_code_is_valid(country_code)) {
+		ERROR(exporter->ctx, "Invalid country code: %s\n", country_code);
+		errno = EINVAL;
+		return -EINVAL;
+	}
+
+	// Skip anything we already export
+	if (loc_exporter_find_target(exporter, country_code, &pos))
+		return 0;
+
+	target = loc_exporter_add_target(exporter, pos, (flag) ?
+		LOC_EXPORTER_TARGET_FLAG : LOC_EXPORTER_TARGET_COUNTRY, country_code);
+	if (!target)
+		return -errno;
+
+	if (flag)
+		target->flag = flag;
+	else
+		loc_country_code_copy(target->country_code, country_code);
+
+	return 0;
+}
+
+LOC_EXPORT int loc_exporter_add_asn(struct loc_exporter* exporter, uint32_t asn) {
+	struct loc_exporter_target* target = NULL;
+	size_t pos = 0;
+	char name[16];
+
+	snprintf(name, sizeof(name), "AS%u", asn);
+
+	// Skip anything we already export
+	if (loc_exporter_find_target(exporter, name, &pos))
+		return 0;
+
+	target = loc_exporter_add_target(exporter, pos, LOC_EXPORTER_TARGET_ASN, name);
+	if (!target)
+		return -errno;
+
+	target->asn = asn;
+
+	return 0;
+}
+
+static const char* loc_exporter_suffix(struct loc_exporter* exporter, int family) {
+	switch (exporter->format) {
+		case LOC_EXPORTER_FORMAT_LIST:
+			return "networks";
+
+		case LOC_EXPORTER_FORMAT_IPSET:
+			return "ipset";
+
+		case LOC_EXPORTER_FORMAT_NFTABLES:
+			return "set";
+
+		case LOC_EXPORTER_FORMAT_XT_GEOIP:
+			return (family == AF_INET6) ? "iv6" : "iv4";
+	}
+
+	return NULL;
+}
+
+/*
+	Returns the smallest power of two that keeps the hash filled to at most
+	three quarters, so that lookups won't have to search any linked lists.
+	The minimum is 64.
+*/
+static size_t loc_exporter_ipset_hashsize(size_t networks) {
+	size_t hashsize = 64;
+
+	while (hashsize * 3 < networks * 4)
+		hashsize <<= 1;
+
+	return hashsize;
+}
+
+static int loc_exporter_write_header(struct loc_exporter* exporter,
+		struct loc_exporter_output* output, FILE* f) {
+	int r = 0;
+
+	switch (exporter->format) {
+		case LOC_EXPORTER_FORMAT_IPSET:
+			// This must have a fixed size, because we will write the header again in the end
+			r = fprintf(f, "create %s hash:net family inet%s hashsize %8zu maxelem 1048576 -exist\n"
+				"flush %s\n", output->tag, (output->family == AF_INET6) ? "6" : "",
+				loc_exporter_ipset_hashsize(output->networks), output->tag);
+			break;
+
+		case LOC_EXPORTER_FORMAT_NFTABLES:
+			r = fprintf(f, "define %s = {\n", output->tag);
+			break;
+
+		case LOC_EXPORTER_FORMAT_LIST:
+		case LOC_EXPORTER_FORMAT_XT_GEOIP:
+			break;
+	}
+
+	if (r < 0)
+		return -errno;
+
+	return 0;
+}
+
+static int loc_exporter_write_footer(struct loc_exporter* exporter,
+		struct loc_exporter_output* output) {
+	switch (exporter->format) {
+		case LOC_EXPORTER_FORMAT_NFTABLES:
+			if (fputs("}\n", output->f) == EOF)
+				return -errno;
+			break;
+
+		case LOC_EXPORTER_FORMAT_LIST:
+		case LOC_EXPORTER_FORMAT_IPSET:
+		case LOC_EXPORTER_FORMAT_XT_GEOIP:
+			break;
+	}
+
+	return 0;
+}
+
+static int loc_exporter_open_output(struct loc_exporter* exporter,
+		struct loc_exporter_output* output, const struct loc_exporter_target* target,
+		int family, const char* directory) {
+	char path[PATH_MAX];
+	int r;
+
+	output->target = target;
+	output->family = family;
+
+	// xt_geoip stores the family in the suffix
+	if (exporter->format == LOC_EXPORTER_FORMAT_XT_GEOIP)
+		r = snprintf(output->tag, sizeof(output->tag), "%s", target->name);
+	else
+		r = snprintf(output->tag, sizeof(output->tag), "%sv%c",
+			target->name, (family == AF_INET6) ? '6' : '4');
+	if (r < 0)
+		return -errno;
+
+	// Open the file in the directory
+	if (directory) {
+		r = snprintf(path, sizeof(path), "%s/%s.%s",
+			directory, output->tag, loc_exporter_suffix(exporter, family));
+		if (r < 0)
+			return -errno;
+		else if ((size_t)r >= sizeof(path)) {
+			errno = ENAMETOOLONG;
+			return -ENAMETOOLONG;
+		}
+
+		output->f = fopen(path, "w");
+		if (!output->f) {
+			ERROR(exporter->ctx, "Could not open %s: %s\n", path, strerror(errno));
+			return -errno;
+		}
+
+	// Otherwise write to memory
+	} else {
+		output->f = open_memstream(&output->buffer, &output->length);
+		if (!output->f)
+			return -errno;
+	}
+
+	r = loc_exporter_write_header(exporter, output, output->f);
+	if (r)
+		return r;
+
+	output->header_length = ftell(output->f);
+
+	return 0;
+}
+
+/*
+	Finishes the output and copies it to f if it was written to memory
+*/
+static int loc_exporter_close_output(struct loc_exporter* exporter,
+		struct loc_exporter_output* output, FILE* f) {
+	size_t offset = 0;
+	int r;
+
+	r = loc_exporter_write_footer(exporter, output);
+	if (r)
+		return r;
+
+	// ipset files get the header again with a better hash size
+	if (exporter->format == LOC_EXPORTER_FORMAT_IPSET) {
+		// Replace the header while copying the buffer
+		if (f) {
+			offset = output->header_length;
+
+		// If the file isn't seekable, we won't try writing the header again
+		} else if (fseek(output->f, 0, SEEK_SET) == 0) {
+			r = loc_exporter_write_header(exporter, output, output->f);
+			if (r)
+				return r;
+		}
+	}
+
+	r = fclose(output->f);
+	output->f = NULL;
+	if (r)
+		return -errno;
+
+	// We are done if we have been writing to a file
+	if (!f)
+		return 0;
+
+	if (offset) {
+		r = loc_exporter_write_header(exporter, output, f);
+		if (r)
+			return r;
+	}
+
+	if (output->length > offset) {
+		if (!fwrite(output->buffer + offset, output->length - offset, 1, f))
+			return -errno;
+	}
+
+	return 0;
+}
+
+static void loc_exporter_free_output(struct loc_exporter_output* output) {
+	if (output->f)
+		fclose(output->f);
+
+	if (output->buffer)
+		free(output->buffer);
+}
+
+static int loc_exporter_write_network(struct loc_exporter* exporter,
+		struct loc_exporter_output* output, const struct loc_network_value* value,
+		const char* string) {
+	struct in6_addr last_address;
+	int r = 0;
+
+	switch (exporter->format) {
+		case LOC_EXPORTER_FORMAT_LIST:
+			r = fprintf(output->f, "%s\n", string);
+			break;
+
+		case LOC_EXPORTER_FORMAT_IPSET:
+			r = fprintf(output->f, "add %s %s\n", output->tag, string);
+			break;
+
+		case LOC_EXPORTER_FORMAT_NFTABLES:
+			r = fprintf(output->f, "\t%s,\n", string);
+			break;
+
+		// Write the first and last address of the network in network byte order
+		case LOC_EXPORTER_FORMAT_XT_GEOIP:
+			last_address = loc_network_value_last_address(value);
+
+			if (IN6_IS_ADDR_V4MAPPED(&value->address)) {
+				if (!fwrite(&value->address.s6_addr32[3], sizeof(uint32_t), 1, output->f))
+					return -errno;
+
+				if (!fwrite(&last_address.s6_addr32[3], sizeof(uint32_t), 1, output->f))
+					return -errno;
+			} else {
+				if (!fwrite(&value->address, sizeof(value->address), 1, output->f))
+					return -errno;
+
+				if (!fwrite(&last_address, sizeof(last_address), 1, output->f))
+					return -errno;
+			}
+			break;
+	}
+
+	if (r < 0)
+		return -errno;
+
+	output->networks++;
+
+	return 0;
+}
+
+static int loc_exporter_asn_route_cmp(const void* p1, const void* p2) {
+	const struct loc_exporter_asn_route* route1 = p1;
+	const struct loc_exporter_asn_route* route2 = p2;
+
+	if (route1->asn < route2->asn)
+		return -1;
+	else if (route1->asn > route2->asn)
+		return 1;
+
+	return 0;
+}
+
+static int loc_exporter_routes_init(struct loc_exporter_routes* routes, int family,
+		struct loc_exporter_output* outputs, size_t num_outputs) {
+	const struct loc_exporter_target* target = NULL;
+
+	memset(routes, 0, sizeof(*routes));
+
+	routes->family = family;
+
+	routes->asns = calloc(num_outputs, sizeof(*routes->asns));
+	if (!routes->asns)
+		return -errno;
+
+	routes->flags = calloc(num_outputs, sizeof(*routes->flags));
+	if (!routes->flags)
+		return -errno;
+
+	for (size_t i = 0; i < num_outputs; i++) {
+		target = outputs[i].target;
+
+		switch (target->type) {
+			case LOC_EXPORTER_TARGET_COUNTRY:
+				routes->countries[loc_country_code_index(target->country_code)] = &outputs[i];
+				break;
+
+			case LOC_EXPORTER_TARGET_ASN:
+				routes->asns[routes->num_asns].asn = target->asn;
+				routes->asns[routes->num_asns++].output = &outputs[i];
+				break;
+
+			case LOC_EXPORTER_TARGET_FLAG:
+				routes->flags[routes->num_flags++] = &outputs[i];
+				break;
+		}
+	}
+
+	qsort(routes->asns, routes->num_asns, sizeof(*routes->asns), loc_exporter_asn_route_cmp);
+
+	return 0;
+}
+
+static void loc_exporter_routes_free(struct loc_exporter_routes* routes) {
+	if (routes->asns)
+		free(routes->asns);
+
+	if (routes->flags)
+		free(routes->flags);
+}
+
+/*
+	Writes the network to all outputs that it belongs to
+*/
+static int loc_exporter_route(struct loc_exporter* exporter,
+		const struct loc_exporter_routes* all_routes, size_t num_routes,
+		struct loc_network* network) {
+	const struct loc_exporter_routes* routes = NULL;
+	const struct loc_exporter_asn_route* route = NULL;
+	struct loc_exporter_output* output = NULL;
+	struct loc_network_value value;
+	char string[LOC_NETWORK_STRING_LENGTH] = "";
+	int r;
+
+	loc_network_to_value(network, &value);
+
+	const int family = IN6_IS_ADDR_V4MAPPED(&value.address) ? AF_INET : AF_INET6;
+
+	// Find the outputs of the family
+	for (size_t i = 0; i < num_routes; i++) {
+		if (all_routes[i].family == family) {
+			routes = &all_routes[i];
+			break;
+		}
+	}
+
+	// We don't export this family
+	if (!routes)
+		return 0;
+
+	// Format the network only once
+	if (exporter->format != LOC_EXPORTER_FORMAT_XT_GEOIP) {
+		r = loc_network_value_format(&value, string, sizeof(string));
+		if (r)
+			return r;
+	}
+
+	// Write matching countries
+	r = loc_country_code_index(value.country_code);
+	if (r >= 0) {
+		output = routes->countries[r];
+
+		if (output) {
+			r = loc_exporter_write_network(exporter, output, &value, string);
+			if (r)
+				return r;
+		}
+	}
+
+	// Write matching ASNs
+	if (routes->num_asns) {
+		const struct loc_exporter_asn_route key = { .asn = value.asn };
+
+		route = bsearch(&key, routes->asns, routes->num_asns,
+			sizeof(*routes->asns), loc_exporter_asn_route_cmp);
+		if (route) {
+			r = loc_exporter_write_network(exporter, route->output, &value, string);
+			if (r)
+				return r;
+		}
+	}
+
+	// Write matching flags
+	if (value.flags) {
+		for (size_t i = 0; i < routes->num_flags; i++) {
+			output = routes->flags[i];
+
+			if (!(value.flags & output->target->flag))
+				continue;
+
+			r = loc_exporter_write_network(exporter, output, &value, string);
+			if (r)
+				return r;
+		}
+	}
+
+	return 0;
+}
+
+/*
+	Creates an enumerator that returns all networks that belong to a country
+	or an AS that is being exported. Networks with flags are only exported if
+	they also match one of those, unless only special countries are exported.
+*/
+static int loc_exporter_create_enumerator(struct loc_exporter* exporter,
+		struct loc_database_enumerator** enumerator, int family) {
+	struct loc_database_enumerator* e = NULL;
+	struct loc_country_list* countries = NULL;
+	struct loc_country* country = NULL;
+	struct loc_as_list* asns = NULL;
+	struct loc_as* as = NULL;
+	int flags = 0;
+	int r;
+
+	// Merge any neighbours with the same properties to keep the sets small
+	r = loc_database_enumerator_new(&e, exporter->db,
+		LOC_DB_ENUMERATE_NETWORKS, LOC_DB_ENUMERATOR_FLAGS_AGGREGATE);
+	if (r)
+		goto ERROR;
+
+	r = loc_database_enumerator_set_family(e, family);
+	if (r)
+		goto ERROR;
+
+	for (size_t i = 0; i < exporter->num_targets; i++) {
+		const struct loc_exporter_target* target = &exporter->targets[i];
+
+		switch (target->type) {
+			case LOC_EXPORTER_TARGET_COUNTRY:
+				if (!countries) {
+					r = loc_country_list_new(exporter->ctx, &countries);
+					if (r)
+						goto ERROR;
+				}
+
+				r = loc_country_new(exporter->ctx, &country, target->country_code);
+				if (r)
+					goto ERROR;
+
+				r = loc_country_list_append(countries, country);
+				loc_country_unref(country);
+				if (r)
+					goto ERROR;
+				break;
+
+			case LOC_EXPORTER_TARGET_ASN:
+				if (!asns) {
+					r = loc_as_list_new(exporter->ctx, &asns);
+					if (r)
+						goto ERROR;
+				}
+
+				r = loc_as_new(exporter->ctx, &as, target->asn);
+				if (r)
+					goto ERROR;
+
+				r = loc_as_list_append(asns, as);
+				loc_as_unref(as);
+				if (r)
+					goto ERROR;
+				break;
+
+			case LOC_EXPORTER_TARGET_FLAG:
+				flags |= target->flag;
+				break;
+		}
+	}
+
+	if (countries) {
+		r = loc_database_enumerator_set_countries(e, countries);
+		if (r)
+			goto ERROR;
+	}
+
+	if (asns) {
+		r = loc_database_enumerator_set_asns(e, asns);
+		if (r)
+			goto ERROR;
+	}
+
+	if (flags && !countries && !asns) {
+		r = loc_database_enumerator_set_flag(e, flags);
+		if (r)
+			goto ERROR;
+	}
+
+	*enumerator = loc_database_enumerator_ref(e);
+
+ERROR:
+	if (countries)
+		loc_country_list_unref(countries);
+	if (asns)
+		loc_as_list_unref(asns);
+	if (e)
+		loc_database_enumerator_unref(e);
+
+	return r;
+}
+
+/*
+	Exports all networks of family for all countries and ASes that have been
+	added to the exporter. If family is AF_UNSPEC, all families are exported
+	in one pass through the database.
+
+	If directory is set, one file per family, country and AS will be created in it.
+	Otherwise all output will be written to f one after the other, starting
+	with IPv6.
+*/
+/*
+	Every output in a directory is an open file. Only use up to half of the
+	file descriptors that we may have so that many targets cannot run into
+	EMFILE and there are some left for everything else.
+*/
+static size_t loc_exporter_max_open_outputs(void) {
+	struct rlimit limit;
+	int r;
+
+	r = getrlimit(RLIMIT_NOFILE, &limit);
+	if (r || limit.rlim_cur == RLIM_INFINITY)
+		return SIZE_MAX;
+
+	if (limit.rlim_cur < 4)
+		return 1;
+
+	return limit.rlim_cur / 2;
+}
+
+/*
+	Writes the given targets for all given families in one walk through the database
+*/
+static int loc_exporter_export_pass(struct loc_exporter* exporter,
+		const int* families, size_t num_families, size_t first, size_t num_targets,
+		const char* directory, FILE* f) {
+	struct loc_exporter_routes routes[LOC_EXPORTER_FAMILIES];
+	struct loc_database_enumerator* enumerator = NULL;
+	struct loc_exporter_output* outputs = NULL;
+	struct loc_network* network = NULL;
+	size_t num_outputs = 0;
+	int r;
+
+	memset(routes, 0, sizeof(routes));
+
+	num_outputs = num_families * num_targets;
+
+	outputs = calloc(num_outputs, sizeof(*outputs));
+	if (!outputs && num_outputs) {
+		r = -errno;
+		goto ERROR;
+	}
+
+	// Open all outputs, one block of targets per family
+	for (size_t i = 0; i < num_families; i++) {
+		struct loc_exporter_output* block = &outputs[i * num_targets];
+
+		for (size_t j = 0; j < num_targets; j++) {
+			r = loc_exporter_open_output(exporter, &block[j],
+				&exporter->targets[first + j], families[i], directory);
+			if (r)
+				goto ERROR;
+		}
+
+		r = loc_exporter_routes_init(&routes[i], families[i], block, num_targets);
+		if (r)
+			goto ERROR;
+	}
+
+	r = loc_exporter_create_enumerator(exporter, &enumerator,
+		(num_families == 1) ? families[0] : AF_UNSPEC);
+	if (r)
+		goto ERROR;
+
+	// Walk through all networks once
+	for (;;) {
+		r = loc_database_enumerator_next_network(enumerator, &network);
+		if (r)
+			goto ERROR;
+
+		// End of enumeration
+		if (!network)
+			break;
+
+		r = loc_exporter_route(exporter, routes, num_families, network);
+		loc_network_unref(network);
+		if (r)
+			goto ERROR;
+	}
+
+	// Finish all outputs
+	for (size_t i = 0; i < num_outputs; i++) {
+		r = loc_exporter_close_output(exporter, &outputs[i], f);
+		if (r)
+			goto ERROR;
+	}
+
+ERROR:
+	if (enumerator)
+		loc_database_enumerator_unref(enumerator);
+
+	for (size_t i = 0; i < LOC_EXPORTER_FAMILIES; i++)
+		loc_exporter_routes_free(&routes[i]);
+
+	if (outputs) {
+		for (size_t i = 0; i < num_outputs; i++)
+			loc_exporter_free_output(&outputs[i]);
+
+		free(outputs);
+	}
+
+	return r;
+}
+
+LOC_EXPORT int loc_exporter_export(struct loc_exporter* exporter, int family,
+		const char* directory, FILE* f) {
+	size_t num_families = 0;
+	const int* families = NULL;
+	size_t max_outputs;
+	size_t num_targets;
+	int r;
+
+	switch (family) {
+		case AF_UNSPEC:
+			families = loc_exporter_families;
+			num_families = LOC_EXPORTER_FAMILIES;
+			break;
+
+		case AF_INET6:
+		case AF_INET:
+			families = &family;
+			num_families = 1;
+			break;
+
+		default:
+			errno = EINVAL;
+			return -EINVAL;
+	}
+
+	// We need somewhere to write to
+	if (!directory && !f) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+
+	DEBUG(exporter->ctx, "Exporting %zu set(s) for family %d\n", exporter->num_targets, family);
+
+	// Buffers in memory don't need any file descriptors, so write everything at once
+	if (!directory)
+		return loc_exporter_export_pass(exporter, families, num_families,
+			0, exporter->num_targets, NULL, f);
+
+	max_outputs = loc_exporter_max_open_outputs();
+
+	// Otherwise write one family at a time and don't open too many files at once
+	for (size_t i = 0; i < num_families; i++) {
+		for (size_t first = 0; first < exporter->num_targets; first += num_targets) {
+			num_targets = exporter->num_targets - first;
+			if (num_targets > max_outputs)
+				num_targets = max_outputs;
+
+			r = loc_exporter_export_pass(exporter, &families[i], 1,
+				first, num_targets, directory, NULL);
+			if (r)
+				return r;
+		}
+	}
+
+	return 0;
+}
@@ -15,7 +15,9 @@
 */
 
 #include <arpa/inet.h>
+#include <errno.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
@@ -106,13 +108,13 @@ LOC_EXPORT struct loc_ctx* loc_ref(struct loc_ctx* ctx) {
 	if (!ctx)
 		return NULL;
 
-	ctx->refcount++;
+	__atomic_add_fetch(&ctx->refcount, 1, __ATOMIC_RELAXED);
 
 	return ctx;
 }
 
 LOC_EXPORT struct loc_ctx* loc_unref(struct loc_ctx* ctx) {
-	if (--ctx->refcount > 0)
+	if (__atomic_sub_fetch(&ctx->refcount, 1, __ATOMIC_ACQ_REL) > 0)
 		return NULL;
 
 	INFO(ctx, "context %p released\n", ctx);
@@ -140,3 +142,91 @@ LOC_EXPORT int loc_get_log_priority(struct loc_ctx* ctx) {
 LOC_EXPORT void loc_set_log_priority(struct loc_ctx* ctx, int priority) {
 	ctx->log.priority = priority;
 }
+
+struct loc_parallel_job {
+	int (*callback)(void* data, size_t job);
+	void* data;
+
+	size_t num_jobs;
+
+	// The next job that will be processed
+	size_t next;
+
+	// The first error that happened
+	int r;
+};
+
+static void* loc_parallel_worker(void* data) {
+	struct loc_parallel_job* job = data;
+	size_t i;
+	int r;
+
+	for (;;) {
+		// Stop if any other worker has failed
+		if (__atomic_load_n(&job->r, __ATOMIC_RELAXED))
+			break;
+
+		// Fetch the next job
+		i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+		if (i >= job->num_jobs)
+			break;
+
+		r = job->callback(job->data, i);
+		if (r) {
+			// Store the first error
+			int e = 0;
+			__atomic_compare_exchange_n(&job->r, &e, r, 0,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+	Calls callback for every job from 0 to num_jobs - 1 using up to the given
+	number of threads (including the calling one) and returns the first error
+*/
+int loc_run_parallel(struct loc_ctx* ctx, unsigned int threads, size_t num_jobs,
+		int (*callback)(void* data, size_t job), void* data) {
+	struct loc_parallel_job job = {
+		.callback = callback,
+		.data     = data,
+		.num_jobs = num_jobs,
+	};
+	pthread_t* workers = NULL;
+	unsigned int started = 0;
+	int r;
+
+	// Don't start more threads than there is work
+	if (threads > num_jobs)
+		threads = num_jobs;
+
+	// Start the additional workers
+	if (threads > 1) {
+		workers = calloc(threads - 1, sizeof(*workers));
+		if (!workers)
+			return -ENOMEM;
+
+		for (; started < threads - 1; started++) {
+			r = pthread_create(&workers[started], NULL, loc_parallel_worker, &job);
+			if (r) {
+				ERROR(ctx, "Could not launch worker thread: %s\n", strerror(r));
+				break;
+			}
+		}
+	}
+
+	// Do some work in this thread, too
+	loc_parallel_worker(&job);
+
+	// Wait for all workers to finish
+	for (unsigned int i = 0; i < started; i++)
+		pthread_join(workers[i], NULL);
+
+	if (workers)
+		free(workers);
+
+	return job.r;
+}
@@ -17,10 +17,20 @@
 #ifndef LIBLOC_ADDRESS_H
 #define LIBLOC_ADDRESS_H
 
+#include <netinet/in.h>
+
+int loc_address_parse_fast(struct in6_addr* address, const char* string);
+
 #ifdef LIBLOC_PRIVATE
 
 #include <errno.h>
-#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef HAVE_ENDIAN_H
+#  include <endian.h>
+#endif
 
 #include <libloc/compat.h>
 
@@ -29,7 +39,23 @@
 */
 
 const char* loc_address_str(const struct in6_addr* address);
+const char* loc_address_format(const struct in6_addr* address, char* buffer, size_t length);
 int loc_address_parse(struct in6_addr* address, unsigned int* prefix, const char* string);
+int loc_address_parse_length(struct in6_addr* address, const char* string, size_t length);
+
+/*
+	A network as a plain address and prefix (relative to its address family)
+*/
+struct loc_address_prefix {
+	struct in6_addr address;
+	unsigned int prefix;
+};
+
+// Any range can be covered by at most two networks per prefix length
+#define LOC_ADDRESS_MAX_PREFIXES 256
+
+int loc_address_summarize(const struct in6_addr* first, const struct in6_addr* last,
+	struct loc_address_prefix* prefixes, size_t length);
 
 static inline int loc_address_family(const struct in6_addr* address) {
 	if (IN6_IS_ADDR_V4MAPPED(address))
@@ -66,44 +92,61 @@ static inline int loc_address_valid_prefix(const struct in6_addr* address, unsig
 	return 0;
 }
 
-static inline int loc_address_cmp(const struct in6_addr* a1, const struct in6_addr* a2) {
-	for (unsigned int i = 0; i < 16; i++) {
-		if (a1->s6_addr[i] > a2->s6_addr[i])
-			return 1;
+/*
+	Loads an address as two 64 bit words in host byte order
+*/
+static inline void loc_address_to_words(const struct in6_addr* address, uint64_t* hi, uint64_t* lo) {
+	uint64_t words[2];
 
-		else if (a1->s6_addr[i] < a2->s6_addr[i])
-			return -1;
-	}
+	memcpy(words, address->s6_addr, sizeof(words));
 
-	return 0;
+	*hi = be64toh(words[0]);
+	*lo = be64toh(words[1]);
 }
 
-#define foreach_octet_in_address(octet, address) \
-	for (octet = (IN6_IS_ADDR_V4MAPPED(address) ? 12 : 0); octet <= 15; octet++)
+static inline void loc_address_from_words(struct in6_addr* address, uint64_t hi, uint64_t lo) {
+	const uint64_t words[2] = { htobe64(hi), htobe64(lo) };
 
-#define foreach_octet_in_address_reverse(octet, address) \
-	for (octet = 15; octet >= (IN6_IS_ADDR_V4MAPPED(address) ? 12 : 0); octet--)
+	memcpy(address->s6_addr, words, sizeof(words));
+}
 
-static inline int loc_address_all_zeroes(const struct in6_addr* address) {
-	int octet = 0;
+/*
+	Returns the IPv4 part of an address in host byte order
+*/
+static inline uint32_t loc_address_to_ipv4(const struct in6_addr* address) {
+	return be32toh(address->s6_addr32[3]);
+}
 
-	foreach_octet_in_address(octet, address) {
-		if (address->s6_addr[octet])
-			return 0;
-	}
+static inline int loc_address_cmp(const struct in6_addr* a1, const struct in6_addr* a2) {
+	uint64_t hi1, lo1;
+	uint64_t hi2, lo2;
 
-	return 1;
+	loc_address_to_words(a1, &hi1, &lo1);
+	loc_address_to_words(a2, &hi2, &lo2);
+
+	if (hi1 != hi2)
+		return (hi1 > hi2) ? 1 : -1;
+
+	if (lo1 != lo2)
+		return (lo1 > lo2) ? 1 : -1;
+
+	return 0;
 }
 
-static inline int loc_address_all_ones(const struct in6_addr* address) {
-	int octet = 0;
+static inline int loc_address_all_zeroes(const struct in6_addr* address) {
+	if (IN6_IS_ADDR_V4MAPPED(address))
+		return !address->s6_addr32[3];
 
-	foreach_octet_in_address(octet, address) {
-		if (address->s6_addr[octet] < 255)
-			return 0;
-	}
+	return !(address->s6_addr32[0] | address->s6_addr32[1]
+		| address->s6_addr32[2] | address->s6_addr32[3]);
+}
+
+static inline int loc_address_all_ones(const struct in6_addr* address) {
+	if (IN6_IS_ADDR_V4MAPPED(address))
+		return address->s6_addr32[3] == 0xffffffff;
 
-	return 1;
+	return (address->s6_addr32[0] & address->s6_addr32[1]
+		& address->s6_addr32[2] & address->s6_addr32[3]) == 0xffffffff;
 }
 
 static inline int loc_address_get_bit(const struct in6_addr* address, unsigned int i) {
@@ -116,82 +159,87 @@ static inline void loc_address_set_bit(struct in6_addr* address, unsigned int i,
 
 static inline struct in6_addr loc_prefix_to_bitmask(const unsigned int prefix) {
 	struct in6_addr bitmask;
+	uint64_t hi = 0;
+	uint64_t lo = 0;
 
-	for (unsigned int i = 0; i < 16; i++)
-		bitmask.s6_addr[i] = 0;
+	// Shifting by 64 bits is undefined, so the full words are handled separately
+	if (prefix >= 128) {
+		hi = lo = ~UINT64_C(0);
 
-	for (int i = prefix, j = 0; i > 0; i -= 8, j++) {
-		if (i >= 8)
-			bitmask.s6_addr[j] = 0xff;
-		else
-			bitmask.s6_addr[j] = 0xff << (8 - i);
+	} else if (prefix >= 64) {
+		hi = ~UINT64_C(0);
+
+		if (prefix > 64)
+			lo = ~UINT64_C(0) << (128 - prefix);
+
+	} else if (prefix) {
+		hi = ~UINT64_C(0) << (64 - prefix);
 	}
 
+	loc_address_from_words(&bitmask, hi, lo);
+
 	return bitmask;
 }
 
+/*
+	Returns the position of the last bit that is set, counted from the start of
+	the address family, or zero if no bit is set at all.
+*/
 static inline unsigned int loc_address_bit_length(const struct in6_addr* address) {
-	unsigned int bitlength = 0;
-	int trailing_zeroes;
+	uint64_t hi, lo;
 
-	int octet = 0;
-
-	// Initialize the bit length
-	if (IN6_IS_ADDR_V4MAPPED(address))
-		bitlength = 32;
-	else
-		bitlength = 128;
+	if (IN6_IS_ADDR_V4MAPPED(address)) {
+		const uint32_t a4 = loc_address_to_ipv4(address);
 
-	// Walk backwards until we find the first one
-	foreach_octet_in_address_reverse(octet, address) {
 		// __builtin_ctz does not support zero as input
-		if (!address->s6_addr[octet]) {
-			bitlength -= 8;
-			continue;
-		}
+		if (!a4)
+			return 0;
 
-		// Count all trailing zeroes
-		trailing_zeroes = __builtin_ctz(address->s6_addr[octet]);
+		return 32 - __builtin_ctz(a4);
+	}
 
-		// We only have one byte
-		if (trailing_zeroes > 8)
-			trailing_zeroes = 8;
+	loc_address_to_words(address, &hi, &lo);
 
-		// Remove any trailing zeroes from the total length
-		bitlength -= trailing_zeroes;
+	if (lo)
+		return 128 - __builtin_ctzll(lo);
 
-		if (trailing_zeroes < 8)
-			return bitlength;
-	}
+	if (hi)
+		return 64 - __builtin_ctzll(hi);
 
 	return 0;
 }
 
 static inline int loc_address_common_bits(const struct in6_addr* a1, const struct in6_addr* a2) {
-	int bits = 0;
+	uint64_t hi1, lo1;
+	uint64_t hi2, lo2;
+
+	const int v4mapped = IN6_IS_ADDR_V4MAPPED(a1);
 
 	// Both must be of the same family
-	if (IN6_IS_ADDR_V4MAPPED(a1) && !IN6_IS_ADDR_V4MAPPED(a2))
+	if (v4mapped != IN6_IS_ADDR_V4MAPPED(a2))
 		return -EINVAL;
 
-	else if (!IN6_IS_ADDR_V4MAPPED(a1) && IN6_IS_ADDR_V4MAPPED(a2))
-		return -EINVAL;
+	if (v4mapped) {
+		const uint32_t x = loc_address_to_ipv4(a1) ^ loc_address_to_ipv4(a2);
 
-	// Walk through both addresses octet by octet
-	for (unsigned int i = (IN6_IS_ADDR_V4MAPPED(a1) ? 12 : 0); i <= 15; i++) {
-		// Fast path if the entire octet matches
-		if (a1->s6_addr[i] == a2->s6_addr[i]) {
-			bits += 8;
-
-		// Otherwise we XOR the octets and count the leading zeroes
-		// (where both octets have been identical).
-		} else {
-			bits += __builtin_clz(a1->s6_addr[i] ^ a2->s6_addr[i]) - 24;
-			break;
-		}
+		// __builtin_clz does not support zero as input
+		if (!x)
+			return 32;
+
+		return __builtin_clz(x);
 	}
 
-	return bits;
+	loc_address_to_words(a1, &hi1, &lo1);
+	loc_address_to_words(a2, &hi2, &lo2);
+
+	// Count the leading zeroes of the first word that is different
+	if (hi1 != hi2)
+		return __builtin_clzll(hi1 ^ hi2);
+
+	if (lo1 != lo2)
+		return 64 + __builtin_clzll(lo1 ^ lo2);
+
+	return 128;
 }
 
 static inline int loc_address_reset(struct in6_addr* address, int family) {
@@ -258,6 +306,9 @@ static inline struct in6_addr loc_address_or(
 
 static inline int loc_address_sub(struct in6_addr* result,
 		const struct in6_addr* address1, const struct in6_addr* address2) {
+	uint64_t hi1, lo1;
+	uint64_t hi2, lo2;
+
 	int family1 = loc_address_family(address1);
 	int family2 = loc_address_family(address2);
 
@@ -272,51 +323,62 @@ static inline int loc_address_sub(struct in6_addr* result,
 	if (r)
 		return r;
 
-	int octet = 0;
-	int remainder = 0;
+	if (family1 == AF_INET) {
+		result->s6_addr32[3] = htobe32(
+			loc_address_to_ipv4(address1) - loc_address_to_ipv4(address2));
 
-	foreach_octet_in_address_reverse(octet, address1) {
-		int x = address1->s6_addr[octet] - address2->s6_addr[octet] + remainder;
+		return 0;
+	}
 
-		// Store remainder for the next iteration
-		remainder = (x >> 8);
+	loc_address_to_words(address1, &hi1, &lo1);
+	loc_address_to_words(address2, &hi2, &lo2);
 
-		result->s6_addr[octet] = x & 0xff;
-	}
+	// Borrow from the upper word if the lower word underflows
+	loc_address_from_words(result, hi1 - hi2 - (lo1 < lo2), lo1 - lo2);
 
 	return 0;
 }
 
 static inline void loc_address_increment(struct in6_addr* address) {
+	uint64_t hi, lo;
+
 	// Prevent overflow when everything is ones
 	if (loc_address_all_ones(address))
 		return;
 
-	int octet = 0;
-	foreach_octet_in_address_reverse(octet, address) {
-		if (address->s6_addr[octet] < 255) {
-			address->s6_addr[octet]++;
-			break;
-		} else {
-			address->s6_addr[octet] = 0;
-		}
+	if (IN6_IS_ADDR_V4MAPPED(address)) {
+		address->s6_addr32[3] = htobe32(loc_address_to_ipv4(address) + 1);
+		return;
 	}
+
+	loc_address_to_words(address, &hi, &lo);
+
+	// Carry into the upper word if the lower word overflows
+	if (!++lo)
+		hi++;
+
+	loc_address_from_words(address, hi, lo);
 }
 
 static inline void loc_address_decrement(struct in6_addr* address) {
-	// Prevent underflow when everything is ones
+	uint64_t hi, lo;
+
+	// Prevent underflow when everything is zeroes
 	if (loc_address_all_zeroes(address))
 		return;
 
-	int octet = 0;
-	foreach_octet_in_address_reverse(octet, address) {
-		if (address->s6_addr[octet] > 0) {
-			address->s6_addr[octet]--;
-			break;
-		} else {
-			address->s6_addr[octet] = 255;
-		}
+	if (IN6_IS_ADDR_V4MAPPED(address)) {
+		address->s6_addr32[3] = htobe32(loc_address_to_ipv4(address) - 1);
+		return;
 	}
+
+	loc_address_to_words(address, &hi, &lo);
+
+	// Borrow from the upper word if the lower word underflows
+	if (!lo--)
+		hi--;
+
+	loc_address_from_words(address, hi, lo);
 }
 
 static inline int loc_address_get_octet(const struct in6_addr* address, const unsigned int i) {
@@ -39,6 +39,9 @@
 #  define reallocarray(ptr, nmemb, size) realloc(ptr, nmemb * size)
 #endif
 
+#define st_mtim st_mtimespec
+#define st_ctim st_ctimespec
+
 #endif
 
 #endif
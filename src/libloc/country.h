@@ -58,6 +58,22 @@ static inline int loc_country_code_cmp(const char* cc1, const char* cc2) {
 	return memcmp(cc1, cc2, 2);
 }
 
+// The number of country codes from AA to ZZ
+#define LOC_COUNTRY_CODES (26 * 26)
+
+/*
+	Returns a unique index for country codes from AA to ZZ, or -1
+*/
+static inline int loc_country_code_index(const char* country_code) {
+	if (country_code[0] < 'A' || country_code[0] > 'Z')
+		return -1;
+
+	if (country_code[1] < 'A' || country_code[1] > 'Z')
+		return -1;
+
+	return (country_code[0] - 'A') * 26 + (country_code[1] - 'A');
+}
+
 #endif
 
 #endif
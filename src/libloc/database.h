@@ -24,15 +24,26 @@
 #include <libloc/libloc.h>
 #include <libloc/network.h>
 #include <libloc/as.h>
+#include <libloc/as-list.h>
 #include <libloc/country.h>
 #include <libloc/country-list.h>
 
 struct loc_database;
+
+enum loc_database_flags {
+	// Remember successful verifications in the cache directory
+	LOC_DATABASE_FLAGS_CACHE_VERIFICATION = (1 << 0),
+};
+
 int loc_database_new(struct loc_ctx* ctx, struct loc_database** database, FILE* f);
 struct loc_database* loc_database_ref(struct loc_database* db);
 struct loc_database* loc_database_unref(struct loc_database* db);
 
+int loc_database_get_flags(struct loc_database* db);
+int loc_database_set_flags(struct loc_database* db, int flags);
+
 int loc_database_verify(struct loc_database* db, FILE* f);
+int loc_database_verify_on_demand(struct loc_database* db, FILE* f);
 
 time_t loc_database_created_at(struct loc_database* db);
 const char* loc_database_get_vendor(struct loc_database* db);
@@ -47,6 +58,62 @@ int loc_database_lookup(struct loc_database* db,
 int loc_database_lookup_from_string(struct loc_database* db,
 		const char* string, struct loc_network** network);
 
+typedef int (*loc_database_lookup_callback)(
+	const char* string, size_t length, struct loc_network* network, void* data);
+
+int loc_database_lookup_from_buffer(struct loc_database* db,
+		const char* buffer, size_t length, loc_database_lookup_callback callback, void* data);
+
+int loc_database_is_bogon(struct loc_database* db, const struct in6_addr* address);
+
+/*
+	A network as it is stored in the database. IPv4 networks are stored as
+	IPv4-mapped IPv6 addresses, but their prefix is relative to IPv4.
+*/
+struct loc_database_record {
+	struct in6_addr address;
+	unsigned int prefix;
+	char country_code[3];
+	uint32_t asn;
+	uint32_t flags;
+};
+
+int loc_database_lookup_record(struct loc_database* db,
+		const struct in6_addr* address, struct loc_database_record* record);
+
+typedef int (*loc_database_walk_callback)(const struct loc_database_record* record, void* data);
+
+/*
+	Networks match if they match any of the countries, ASNs or flags, or if
+	none of them are given. The same applies to the filters of the enumerator.
+
+	NULL means that a list is not used as a filter at all, whereas an empty
+	list is a filter that never matches. So passing only an empty list of
+	countries returns no networks.
+*/
+
+int loc_database_walk(struct loc_database* db, int family,
+		struct loc_country_list* countries, struct loc_as_list* asns, uint32_t flags,
+		loc_database_walk_callback callback, void* data);
+
+/*
+	A flat interface for foreign function interfaces like the one of LuaJIT
+
+	It only uses plain pointers and structs, so that no reference counted
+	objects are created for a lookup. Country codes are stored as an integer
+	of both characters ('D' << 8 | 'E'), or zero if there is none.
+*/
+struct loc_database_result {
+	uint32_t asn;
+	uint16_t country_code;
+	uint16_t flags;
+	uint32_t prefix;
+};
+
+struct loc_database* loc_database_open_path(const char* path);
+int loc_database_lookup_result(struct loc_database* db,
+		const char* address, struct loc_database_result* result);
+
 int loc_database_get_country(struct loc_database* db,
 		struct loc_country** country, const char* code);
 
@@ -58,7 +125,8 @@ enum loc_database_enumerator_mode {
 };
 
 enum loc_database_enumerator_flags {
-	LOC_DB_ENUMERATOR_FLAGS_FLATTEN = (1 << 0),
+	LOC_DB_ENUMERATOR_FLAGS_FLATTEN   = (1 << 0),
+	LOC_DB_ENUMERATOR_FLAGS_AGGREGATE = (1 << 1),
 };
 
 struct loc_database_enumerator;
@@ -77,6 +145,8 @@ int loc_database_enumerator_set_asns(
 	struct loc_database_enumerator* enumerator, struct loc_as_list* asns);
 int loc_database_enumerator_set_flag(struct loc_database_enumerator* enumerator, enum loc_network_flags flag);
 int loc_database_enumerator_set_family(struct loc_database_enumerator* enumerator, int family);
+int loc_database_enumerator_set_partition(struct loc_database_enumerator* enumerator,
+	unsigned int partition, unsigned int partitions);
 int loc_database_enumerator_next_as(
 	struct loc_database_enumerator* enumerator, struct loc_as** as);
 int loc_database_enumerator_next_network(
@@ -0,0 +1,46 @@
+/*
+	libloc - A library to determine the location of someone on the Internet
+
+	Copyright (C) 2024 IPFire Development Team <info@ipfire.org>
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+	Lesser General Public License for more details.
+*/
+
+#ifndef LIBLOC_EXPORTER_H
+#define LIBLOC_EXPORTER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <libloc/libloc.h>
+#include <libloc/database.h>
+
+enum loc_exporter_format {
+	LOC_EXPORTER_FORMAT_LIST     = 1,
+	LOC_EXPORTER_FORMAT_IPSET    = 2,
+	LOC_EXPORTER_FORMAT_NFTABLES = 3,
+	LOC_EXPORTER_FORMAT_XT_GEOIP = 4,
+};
+
+struct loc_exporter;
+
+int loc_exporter_new(struct loc_ctx* ctx, struct loc_exporter** exporter,
+	struct loc_database* db, enum loc_exporter_format format);
+struct loc_exporter* loc_exporter_ref(struct loc_exporter* exporter);
+struct loc_exporter* loc_exporter_unref(struct loc_exporter* exporter);
+
+int loc_exporter_add_country(struct loc_exporter* exporter, const char* country_code);
+int loc_exporter_add_asn(struct loc_exporter* exporter, uint32_t asn);
+
+int loc_exporter_export(struct loc_exporter* exporter, int family,
+	const char* directory, FILE* f);
+
+#endif
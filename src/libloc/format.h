@@ -36,6 +36,9 @@ enum loc_database_version {
 #define LOC_DATABASE_PAGE_SIZE		4096
 #define LOC_SIGNATURE_MAX_LENGTH	2048
 
+// Pages are hashed using SHA-256
+#define LOC_DATABASE_PAGE_HASH_LENGTH	32
+
 struct loc_database_magic {
 	char magic[7];
 
@@ -82,8 +85,33 @@ struct loc_database_header_v1 {
 	char signature1[LOC_SIGNATURE_MAX_LENGTH];
 	char signature2[LOC_SIGNATURE_MAX_LENGTH];
 
+	/*
+		Signed databases carry a hash of every page following the header
+		up to the start of the page hashes. The page hashes are signed
+		separately so that pages can be verified independently.
+
+		Readers that don't know about this ignore it and simply verify
+		the signatures above.
+	*/
+
+	// Tells us where the page hashes start
+	uint32_t page_hashes_offset;
+	uint32_t page_hashes_length;
+
+	// Tells us where the signatures of the page hashes are
+	uint32_t page_signatures_offset;
+	uint32_t page_signatures_length;
+
 	// Add some padding for future extensions
-	char padding[32];
+	char padding[16];
+};
+
+struct loc_database_page_signatures_v1 {
+	// Signatures over the magic, the header (without any signatures) and the page hashes
+	uint16_t signature1_length;
+	uint16_t signature2_length;
+	char signature1[LOC_SIGNATURE_MAX_LENGTH];
+	char signature2[LOC_SIGNATURE_MAX_LENGTH];
 };
 
 struct loc_database_network_node_v1 {
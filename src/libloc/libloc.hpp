@@ -0,0 +1,380 @@
+/*
+	libloc - A library to determine the location of someone on the Internet
+
+	Copyright (C) 2024 IPFire Development Team <info@ipfire.org>
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+	Lesser General Public License for more details.
+*/
+
+#ifndef LIBLOC_HPP
+#define LIBLOC_HPP
+
+/*
+	A header-only C++17 interface to libloc
+
+	All objects own a reference to the underlying C object which is released
+	when they go out of scope. They can be moved, but not copied. All functions
+	are inline and directly call the C API, so that they don't add any overhead.
+
+	Errors are reported as std::system_error.
+*/
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <iterator>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#endif
+
+extern "C" {
+#include <libloc/libloc.h>
+#include <libloc/database.h>
+#include <libloc/network.h>
+}
+
+namespace loc {
+
+namespace detail {
+
+[[noreturn]] inline void throw_error(int error, const char* what) {
+	throw std::system_error(error, std::generic_category(), what);
+}
+
+// Returns an empty view instead of crashing on NULL
+inline std::string_view view(const char* s) noexcept {
+	return (s) ? std::string_view(s) : std::string_view();
+}
+
+/*
+	Owns one reference to a C object
+*/
+template <typename T, T* (*Unref)(T*)>
+class handle {
+	public:
+		handle() noexcept = default;
+
+		// Takes ownership of an existing reference
+		explicit handle(T* p) noexcept : p_(p) {}
+
+		handle(const handle&) = delete;
+		handle& operator=(const handle&) = delete;
+
+		handle(handle&& other) noexcept : p_(std::exchange(other.p_, nullptr)) {}
+
+		handle& operator=(handle&& other) noexcept {
+			if (this != &other) {
+				reset();
+				p_ = std::exchange(other.p_, nullptr);
+			}
+
+			return *this;
+		}
+
+		~handle() {
+			reset();
+		}
+
+		void reset() noexcept {
+			if (p_)
+				Unref(p_);
+
+			p_ = nullptr;
+		}
+
+		T* get() const noexcept {
+			return p_;
+		}
+
+		// Gives up ownership of the reference
+		T* release() noexcept {
+			return std::exchange(p_, nullptr);
+		}
+
+		explicit operator bool() const noexcept {
+			return p_ != nullptr;
+		}
+
+	protected:
+		T* p_ = nullptr;
+};
+
+} // namespace detail
+
+class context : public detail::handle<loc_ctx, loc_unref> {
+	public:
+		using handle::handle;
+
+		static context create() {
+			loc_ctx* ctx = nullptr;
+
+			if (loc_new(&ctx))
+				detail::throw_error(ENOMEM, "Could not create context");
+
+			return context(ctx);
+		}
+};
+
+class network : public detail::handle<loc_network, loc_network_unref> {
+	public:
+		using handle::handle;
+
+		// Returns the network in CIDR notation
+		std::string_view str() const {
+			const char* s = loc_network_str(p_);
+			if (!s)
+				detail::throw_error(errno, "Could not format network");
+
+			return s;
+		}
+
+		int family() const noexcept {
+			return loc_network_address_family(p_);
+		}
+
+		unsigned int prefix() const noexcept {
+			return loc_network_prefix(p_);
+		}
+
+		const in6_addr& first_address() const noexcept {
+			return *loc_network_get_first_address(p_);
+		}
+
+		const in6_addr& last_address() const noexcept {
+			return *loc_network_get_last_address(p_);
+		}
+
+		// The view is valid as long as the network exists
+		std::string_view country_code() const noexcept {
+			return detail::view(loc_network_get_country_code(p_));
+		}
+
+		uint32_t asn() const noexcept {
+			return loc_network_get_asn(p_);
+		}
+
+		bool has_flag(uint32_t flag) const noexcept {
+			return loc_network_has_flag(p_, flag);
+		}
+};
+
+/*
+	Enumerates networks in a database
+
+	It can be used in a range-based for loop which returns all networks
+	that match the filters one after the other.
+*/
+class network_enumerator : public detail::handle<loc_database_enumerator, loc_database_enumerator_unref> {
+	public:
+		using handle::handle;
+
+		class iterator {
+			public:
+				using iterator_category = std::input_iterator_tag;
+				using value_type        = loc::network;
+				using difference_type   = std::ptrdiff_t;
+				using pointer           = const loc::network*;
+				using reference         = const loc::network&;
+
+				iterator() noexcept = default;
+
+				explicit iterator(loc_database_enumerator* e) : e_(e) {
+					++*this;
+				}
+
+				reference operator*() const noexcept {
+					return network_;
+				}
+
+				pointer operator->() const noexcept {
+					return &network_;
+				}
+
+				iterator& operator++() {
+					loc_network* n = nullptr;
+
+					if (loc_database_enumerator_next_network(e_, &n))
+						detail::throw_error(errno, "Could not fetch network");
+
+					network_ = loc::network(n);
+
+					// We have reached the end
+					if (!n)
+						e_ = nullptr;
+
+					return *this;
+				}
+
+				bool operator==(const iterator& other) const noexcept {
+					return e_ == other.e_;
+				}
+
+				bool operator!=(const iterator& other) const noexcept {
+					return e_ != other.e_;
+				}
+
+			private:
+				loc_database_enumerator* e_ = nullptr;
+				loc::network network_;
+		};
+
+		iterator begin() const {
+			return iterator(p_);
+		}
+
+		iterator end() const noexcept {
+			return iterator();
+		}
+
+		network_enumerator& set_family(int family) {
+			if (loc_database_enumerator_set_family(p_, family))
+				detail::throw_error(errno, "Could not set family");
+
+			return *this;
+		}
+
+		network_enumerator& set_flag(enum loc_network_flags flag) {
+			if (loc_database_enumerator_set_flag(p_, flag))
+				detail::throw_error(errno, "Could not set flag");
+
+			return *this;
+		}
+
+		network_enumerator& set_partition(unsigned int partition, unsigned int partitions) {
+			int r = loc_database_enumerator_set_partition(p_, partition, partitions);
+			if (r)
+				detail::throw_error(-r, "Could not set partition");
+
+			return *this;
+		}
+};
+
+class database : public detail::handle<loc_database, loc_database_unref> {
+	public:
+		using handle::handle;
+
+		// The result of a lookup, see struct loc_database_record
+		using record = loc_database_record;
+
+		explicit database(const char* path) : handle(loc_database_open_path(path)) {
+			if (!p_)
+				detail::throw_error(errno, "Could not open database");
+		}
+
+		database(const context& ctx, FILE* f) {
+			if (loc_database_new(ctx.get(), &p_, f))
+				detail::throw_error(errno, "Could not open database");
+		}
+
+		bool verify(FILE* key) const noexcept {
+			return loc_database_verify(p_, key) == 0;
+		}
+
+		time_t created_at() const noexcept {
+			return loc_database_created_at(p_);
+		}
+
+		// These views point into the database and are valid as long as it is open
+		std::string_view vendor() const noexcept {
+			return detail::view(loc_database_get_vendor(p_));
+		}
+
+		std::string_view description() const noexcept {
+			return detail::view(loc_database_get_description(p_));
+		}
+
+		std::string_view license() const noexcept {
+			return detail::view(loc_database_get_license(p_));
+		}
+
+		// Returns the network or an empty object if nothing was found
+		loc::network lookup(const in6_addr& address) const {
+			loc_network* n = nullptr;
+
+			if (loc_database_lookup(p_, &address, &n))
+				detail::throw_error(errno, "Could not lookup address");
+
+			return loc::network(n);
+		}
+
+		loc::network lookup(const char* address) const {
+			loc_network* n = nullptr;
+
+			if (loc_database_lookup_from_string(p_, address, &n))
+				detail::throw_error(errno, "Could not lookup address");
+
+			return loc::network(n);
+		}
+
+		// Fills record without creating a network and returns true if something was found
+		bool lookup(const in6_addr& address, record& result) const {
+			int r = loc_database_lookup_record(p_, &address, &result);
+			if (r < 0)
+				detail::throw_error(-r, "Could not lookup address");
+
+			return r == 0;
+		}
+
+		/*
+			Looks up count addresses and stores the results at the same index.
+			Results of addresses that could not be found are cleared.
+
+			Returns the number of addresses that have been found.
+		*/
+		std::size_t lookup(const in6_addr* addresses, record* results, std::size_t count) const {
+			std::size_t found = 0;
+
+			for (std::size_t i = 0; i < count; i++) {
+				if (lookup(addresses[i], results[i]))
+					found++;
+				else
+					results[i] = record();
+			}
+
+			return found;
+		}
+
+#ifdef __cpp_lib_span
+		std::size_t lookup(std::span<const in6_addr> addresses, std::span<record> results) const {
+			if (results.size() < addresses.size())
+				detail::throw_error(EINVAL, "Not enough space for all results");
+
+			return lookup(addresses.data(), results.data(), addresses.size());
+		}
+#endif
+
+		bool is_bogon(const in6_addr& address) const {
+			int r = loc_database_is_bogon(p_, &address);
+			if (r < 0)
+				detail::throw_error(-r, "Could not check address");
+
+			return r;
+		}
+
+		network_enumerator networks(int flags = 0) const {
+			loc_database_enumerator* e = nullptr;
+
+			if (loc_database_enumerator_new(&e, p_, LOC_DB_ENUMERATE_NETWORKS, flags))
+				detail::throw_error(errno, "Could not create enumerator");
+
+			return network_enumerator(e);
+		}
+};
+
+} // namespace loc
+
+#endif /* LIBLOC_HPP */
@@ -29,11 +29,15 @@ void loc_network_list_clear(struct loc_network_list* list);
 void loc_network_list_dump(struct loc_network_list* list);
 struct loc_network* loc_network_list_get(struct loc_network_list* list, size_t index);
 int loc_network_list_push(struct loc_network_list* list, struct loc_network* network);
+int loc_network_list_append(struct loc_network_list* list, struct loc_network* network);
+int loc_network_list_sort(struct loc_network_list* list);
 struct loc_network* loc_network_list_pop(struct loc_network_list* list);
 struct loc_network* loc_network_list_pop_first(struct loc_network_list* list);
 int loc_network_list_remove(struct loc_network_list* list, struct loc_network* network);
 int loc_network_list_contains(struct loc_network_list* list, struct loc_network* network);
 int loc_network_list_merge(struct loc_network_list* self, struct loc_network_list* other);
+struct loc_network_list* loc_network_list_exclude(
+	struct loc_network_list* list, struct loc_network_list* excluded);
 
 void loc_network_list_remove_with_prefix_smaller_than(
 	struct loc_network_list* list, const unsigned int prefix);
@@ -45,6 +49,40 @@ void loc_network_list_remove_with_prefix_smaller_than(
 int loc_network_list_summarize(struct loc_ctx* ctx,
 	const struct in6_addr* first, const struct in6_addr* last, struct loc_network_list** list);
 
+struct loc_network_range {
+	struct in6_addr first;
+	struct in6_addr last;
+};
+
+int loc_network_list_ranges(struct loc_network_list* list,
+	struct loc_network_range** ranges, size_t* count);
+int loc_network_list_append_excluded(struct loc_network_list* list, struct loc_network* network,
+	const struct loc_network_range* ranges, const size_t count);
+
+/*
+	A sorted list of network values which are stored inline
+*/
+struct loc_network_value_list {
+	// The allocated array
+	struct loc_network_value* buffer;
+	size_t buffer_size;
+
+	// The first element, which moves forward when popping from the front
+	size_t head;
+	size_t size;
+};
+
+void loc_network_value_list_free(struct loc_network_value_list* list);
+void loc_network_value_list_clear(struct loc_network_value_list* list);
+int loc_network_value_list_push(struct loc_network_value_list* list,
+	const struct loc_network_value* value);
+int loc_network_value_list_pop_first(struct loc_network_value_list* list,
+	struct loc_network_value* value);
+int loc_network_value_list_merge(struct loc_network_value_list* self,
+	const struct loc_network_value_list* other);
+int loc_network_value_list_append_excluded(struct loc_network_value_list* list,
+	const struct loc_network_value* value, const struct loc_network_value_list* excluded);
+
 #endif /* LOC_PRIVATE */
 
 #endif
@@ -39,8 +39,12 @@ int loc_network_tree_dump(struct loc_network_tree* tree);
 int loc_network_tree_add_network(struct loc_network_tree* tree, struct loc_network* network);
 
 size_t loc_network_tree_count_nodes(struct loc_network_tree* tree);
+size_t loc_network_tree_count_networks(struct loc_network_tree* tree);
 
-int loc_network_tree_cleanup(struct loc_network_tree* tree);
+int loc_network_tree_cleanup(struct loc_network_tree* tree, unsigned int threads);
+
+int loc_network_tree_aggregate(struct loc_network_tree* tree, struct loc_network_tree** aggregated);
+int loc_network_tree_cmp_lookups(struct loc_network_tree* tree, struct loc_network_tree* other);
 
 /*
 	Nodes
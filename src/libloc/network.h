@@ -55,6 +55,7 @@ uint32_t loc_network_get_asn(struct loc_network* network);
 int loc_network_set_asn(struct loc_network* network, uint32_t asn);
 
 int loc_network_has_flag(struct loc_network* network, uint32_t flag);
+uint32_t loc_network_get_flags(struct loc_network* network);
 int loc_network_set_flag(struct loc_network* network, uint32_t flag);
 
 int loc_network_cmp(struct loc_network* self, struct loc_network* other);
@@ -70,12 +71,44 @@ char* loc_network_reverse_pointer(struct loc_network* network, const char* suffi
 
 #ifdef LIBLOC_PRIVATE
 
+// The longest possible string of a network (e.g. "ffff:...:ffff/128")
+#define LOC_NETWORK_STRING_LENGTH (INET6_ADDRSTRLEN + 4)
+
+/*
+	A compact network that is not reference-counted and can be stored
+	inline in arrays. IPv4 networks are stored as IPv4-mapped IPv6 networks.
+*/
+struct loc_network_value {
+	struct in6_addr address;
+	uint32_t asn;
+	uint16_t flags;
+	char country_code[2];
+	uint8_t prefix;
+};
+
+void loc_network_value_init(struct loc_network_value* value,
+	const struct in6_addr* address, unsigned int prefix);
+void loc_network_to_value(struct loc_network* network, struct loc_network_value* value);
+int loc_network_new_from_value(struct loc_ctx* ctx, struct loc_network** network,
+	const struct loc_network_value* value);
+
+struct in6_addr loc_network_value_last_address(const struct loc_network_value* value);
+int loc_network_value_format(const struct loc_network_value* value, char* buffer, size_t length);
+int loc_network_value_cmp(const struct loc_network_value* self, const struct loc_network_value* other);
+int loc_network_value_is_subnet(const struct loc_network_value* self,
+	const struct loc_network_value* other);
+int loc_network_value_subnets(const struct loc_network_value* value,
+	struct loc_network_value* subnet1, struct loc_network_value* subnet2);
+int loc_network_value_properties_cmp(const struct loc_network_value* self,
+	const struct loc_network_value* other);
+
 int loc_network_properties_cmp(struct loc_network* self, struct loc_network* other);
+int loc_network_copy_properties(struct loc_network* self, struct loc_network* other);
 unsigned int loc_network_raw_prefix(struct loc_network* network);
 
 int loc_network_to_database_v1(struct loc_network* network, struct loc_database_network_v1* dbobj);
-int loc_network_new_from_database_v1(struct loc_ctx* ctx, struct loc_network** network,
-		struct in6_addr* address, unsigned int prefix, const struct loc_database_network_v1* dbobj);
+int loc_network_value_from_database_v1(struct loc_network_value* value,
+	const struct in6_addr* address, unsigned int prefix, const struct loc_database_network_v1* dbobj);
 
 int loc_network_merge(struct loc_network** n, struct loc_network* n1, struct loc_network* n2);
 
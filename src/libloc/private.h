@@ -56,6 +56,9 @@ void loc_log(struct loc_ctx *ctx,
 	int priority, const char *file, int line, const char *fn,
 	const char *format, ...) __attribute__((format(printf, 6, 7)));
 
+int loc_run_parallel(struct loc_ctx* ctx, unsigned int threads, size_t num_jobs,
+	int (*callback)(void* data, size_t job), void* data);
+
 
 static inline void hexdump(struct loc_ctx* ctx, const void* addr, size_t len) {
 	char buffer_hex[16 * 3 + 6];
@@ -64,6 +67,10 @@ static inline void hexdump(struct loc_ctx* ctx, const void* addr, size_t len) {
 	unsigned int i = 0;
 	unsigned char* p = (unsigned char*)addr;
 
+	// Don't format anything if nobody is going to see it
+	if (loc_get_log_priority(ctx) < LOG_DEBUG)
+		return;
+
 	DEBUG(ctx, "Dumping %zu byte(s)\n", len);
 
 	if (!len)
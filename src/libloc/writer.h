@@ -27,12 +27,23 @@
 
 struct loc_writer;
 
+enum loc_writer_flags {
+	// Rewrite the network tree into the smallest set of networks
+	LOC_WRITER_FLAGS_AGGREGATE = (1 << 0),
+};
+
 int loc_writer_new(struct loc_ctx* ctx, struct loc_writer** writer,
     FILE* fkey1, FILE* fkey2);
 
 struct loc_writer* loc_writer_ref(struct loc_writer* writer);
 struct loc_writer* loc_writer_unref(struct loc_writer* writer);
 
+unsigned int loc_writer_get_threads(struct loc_writer* writer);
+int loc_writer_set_threads(struct loc_writer* writer, unsigned int threads);
+
+int loc_writer_get_flags(struct loc_writer* writer);
+int loc_writer_set_flags(struct loc_writer* writer, int flags);
+
 const char* loc_writer_get_vendor(struct loc_writer* writer);
 int loc_writer_set_vendor(struct loc_writer* writer, const char* vendor);
 const char* loc_writer_get_description(struct loc_writer* writer);
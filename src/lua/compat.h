@@ -51,6 +51,8 @@ static inline void luaL_newlib(lua_State* L, const luaL_Reg* l) {
   luaL_setfuncs(L, l, 0);
 }
 
+#define lua_rawlen lua_objlen
+
 #endif /* Lua < 5.2 */
 
 #endif /* LUA_LOCATION_COMPAT_H */
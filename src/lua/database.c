@@ -20,7 +20,11 @@
 #include <lua.h>
 #include <lauxlib.h>
 
+#include <libloc/address.h>
+#include <libloc/as-list.h>
+#include <libloc/country-list.h>
 #include <libloc/database.h>
+#include <libloc/exporter.h>
 
 #include "location.h"
 #include "as.h"
@@ -205,6 +209,148 @@ static int Database_lookup(lua_State* L) {
 	return r;
 }
 
+/*
+	Looks up an address without creating a network object
+
+	Returns 0 if nothing was found, 1 if record has been filled,
+	or raises an error if the address could not be looked up.
+*/
+static int lookup_record(lua_State* L, Database* self,
+		const char* string, struct loc_database_record* record) {
+	struct in6_addr address;
+	int r;
+
+	// Parse the address
+	r = loc_address_parse_fast(&address, string);
+	if (r)
+		return luaL_error(L, "Could not lookup address %s: %s\n", string, strerror(-r));
+
+	// Perform lookup
+	r = loc_database_lookup_record(self->db, &address, record);
+	if (r < 0)
+		return luaL_error(L, "Could not lookup address %s: %s\n", string, strerror(-r));
+
+	return (r == 0);
+}
+
+/*
+	Returns the country code, ASN and flags of the network an address belongs to.
+
+	If a table is passed, the values will be stored in it instead and the
+	table will be returned, so that it can be reused for the next lookup.
+*/
+static int Database_lookup_values(lua_State* L) {
+	struct loc_database_record record;
+
+	Database* self = luaL_checkdatabase(L, 1);
+
+	// Require a string
+	const char* address = luaL_checkstring(L, 2);
+
+	// Nothing found
+	if (!lookup_record(L, self, address, &record)) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	const int has_table = lua_istable(L, 3);
+
+	// Country Code
+	if (*record.country_code)
+		lua_pushstring(L, record.country_code);
+	else
+		lua_pushnil(L);
+
+	// ASN
+	if (record.asn)
+		lua_pushnumber(L, record.asn);
+	else
+		lua_pushnil(L);
+
+	// Flags
+	lua_pushnumber(L, record.flags);
+
+	if (!has_table)
+		return 3;
+
+	// Store everything in the table
+	lua_setfield(L, 3, "flags");
+	lua_setfield(L, 3, "asn");
+	lua_setfield(L, 3, "country_code");
+
+	lua_pushvalue(L, 3);
+
+	return 1;
+}
+
+/*
+	Looks up all addresses of a table at once and returns three tables
+	with the country codes, ASNs and flags at the same index as the address.
+
+	Any values that are unknown are set to false, so that the tables have
+	no holes. Existing tables can be passed to be filled again.
+*/
+static int Database_lookup_many(lua_State* L) {
+	struct loc_database_record record;
+	int found;
+
+	Database* self = luaL_checkdatabase(L, 1);
+
+	// Require a table
+	luaL_checktype(L, 2, LUA_TTABLE);
+
+	const int length = lua_rawlen(L, 2);
+
+	lua_settop(L, 5);
+
+	// Use the given tables or create new ones
+	for (int i = 3; i <= 5; i++) {
+		if (lua_isnil(L, i)) {
+			lua_createtable(L, length, 0);
+			lua_replace(L, i);
+		} else {
+			luaL_checktype(L, i, LUA_TTABLE);
+		}
+	}
+
+	for (int i = 1; i <= length; i++) {
+		lua_rawgeti(L, 2, i);
+
+		const char* address = lua_tostring(L, -1);
+		if (!address)
+			return luaL_error(L, "Address %d is not a string\n", i);
+
+		found = lookup_record(L, self, address, &record);
+		lua_pop(L, 1);
+
+		// Country Code
+		if (found && *record.country_code)
+			lua_pushstring(L, record.country_code);
+		else
+			lua_pushboolean(L, 0);
+
+		lua_rawseti(L, 3, i);
+
+		// ASN
+		if (found && record.asn)
+			lua_pushnumber(L, record.asn);
+		else
+			lua_pushboolean(L, 0);
+
+		lua_rawseti(L, 4, i);
+
+		// Flags
+		if (found)
+			lua_pushnumber(L, record.flags);
+		else
+			lua_pushboolean(L, 0);
+
+		lua_rawseti(L, 5, i);
+	}
+
+	return 3;
+}
+
 static int Database_verify(lua_State* L) {
 	FILE* f = NULL;
 	int r;
@@ -277,29 +423,377 @@ static int DatabaseEnumerator_next_network(lua_State* L) {
 	return r;
 }
 
+/*
+	Returns the next network as plain values (network, country code, ASN, flags)
+	instead of creating a network object
+*/
+static int DatabaseEnumerator_next_network_values(lua_State* L) {
+	struct loc_network* network = NULL;
+	int r;
+
+	DatabaseEnumerator* self = luaL_checkdatabaseenumerator(L, lua_upvalueindex(1));
+
+	// Fetch the next network
+	r = loc_database_enumerator_next_network(self->e, &network);
+	if (r)
+		return luaL_error(L, "Could not fetch network: %s\n", strerror(errno));
+
+	// If we have received no network, we have reached the end
+	if (!network) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	// Network
+	const char* string = loc_network_str(network);
+	if (!string) {
+		loc_network_unref(network);
+
+		return luaL_error(L, "Could not format network: %s\n", strerror(errno));
+	}
+
+	lua_pushstring(L, string);
+
+	// Country Code
+	const char* country_code = loc_network_get_country_code(network);
+
+	if (country_code && *country_code)
+		lua_pushstring(L, country_code);
+	else
+		lua_pushnil(L);
+
+	// ASN
+	uint32_t asn = loc_network_get_asn(network);
+
+	if (asn)
+		lua_pushnumber(L, asn);
+	else
+		lua_pushnil(L);
+
+	// Flags
+	lua_pushnumber(L, loc_network_get_flags(network));
+
+	loc_network_unref(network);
+
+	return 4;
+}
+
+static int DatabaseEnumerator_set_countries(lua_State* L,
+		struct loc_database_enumerator* e, int i) {
+	struct loc_country_list* countries = NULL;
+	struct loc_country* country = NULL;
+	int r;
+
+	luaL_checktype(L, i, LUA_TTABLE);
+
+	r = loc_country_list_new(ctx, &countries);
+	if (r)
+		return luaL_error(L, "Could not create country list: %s\n", strerror(-r));
+
+	const int length = lua_rawlen(L, i);
+
+	for (int j = 1; j <= length; j++) {
+		lua_rawgeti(L, i, j);
+
+		const char* code = lua_tostring(L, -1);
+
+		r = (code) ? loc_country_new(ctx, &country, code) : -EINVAL;
+		if (r) {
+			loc_country_list_unref(countries);
+			return luaL_error(L, "Invalid country code: %s\n", (code) ? code : "(null)");
+		}
+
+		lua_pop(L, 1);
+
+		r = loc_country_list_append(countries, country);
+		loc_country_unref(country);
+
+		if (r) {
+			loc_country_list_unref(countries);
+			return luaL_error(L, "Could not append country: %s\n", strerror(-r));
+		}
+	}
+
+	r = loc_database_enumerator_set_countries(e, countries);
+	loc_country_list_unref(countries);
+
+	if (r)
+		return luaL_error(L, "Could not set countries: %s\n", strerror(errno));
+
+	return 0;
+}
+
+static int DatabaseEnumerator_set_asns(lua_State* L,
+		struct loc_database_enumerator* e, int i) {
+	struct loc_as_list* asns = NULL;
+	struct loc_as* as = NULL;
+	int r;
+
+	luaL_checktype(L, i, LUA_TTABLE);
+
+	r = loc_as_list_new(ctx, &asns);
+	if (r)
+		return luaL_error(L, "Could not create AS list: %s\n", strerror(-r));
+
+	const int length = lua_rawlen(L, i);
+
+	for (int j = 1; j <= length; j++) {
+		lua_rawgeti(L, i, j);
+
+		if (!lua_isnumber(L, -1)) {
+			loc_as_list_unref(asns);
+			return luaL_error(L, "ASNs must be numbers\n");
+		}
+
+		r = loc_as_new(ctx, &as, lua_tonumber(L, -1));
+		lua_pop(L, 1);
+
+		if (r) {
+			loc_as_list_unref(asns);
+			return luaL_error(L, "Could not create AS: %s\n", strerror(-r));
+		}
+
+		r = loc_as_list_append(asns, as);
+		loc_as_unref(as);
+
+		if (r) {
+			loc_as_list_unref(asns);
+			return luaL_error(L, "Could not append AS: %s\n", strerror(-r));
+		}
+	}
+
+	r = loc_database_enumerator_set_asns(e, asns);
+	loc_as_list_unref(asns);
+
+	if (r)
+		return luaL_error(L, "Could not set ASNs: %s\n", strerror(errno));
+
+	return 0;
+}
+
+/*
+	Lists all networks. An optional table can be passed to filter them:
+
+		country_codes - A list of country codes
+		asns          - A list of AS numbers
+		flags         - Only networks with any of these flags
+		family        - Only networks of this family
+		flatten       - Don't return any overlapping networks
+		aggregate     - Merge neighbouring networks with the same properties
+		values        - Return plain values instead of network objects
+
+	The filters are applied while walking through the database, so that
+	networks that don't match are never created.
+*/
 static int Database_list_networks(lua_State* L) {
 	DatabaseEnumerator* e = NULL;
+	int flags = 0;
+	int values = 0;
 	int r;
 
 	Database* self = luaL_checkdatabase(L, 1);
 
+	// Check the filters
+	lua_settop(L, 2);
+
+	const int has_filters = !lua_isnil(L, 2);
+
+	if (has_filters) {
+		luaL_checktype(L, 2, LUA_TTABLE);
+
+		lua_getfield(L, 2, "flatten");
+		if (lua_toboolean(L, -1))
+			flags |= LOC_DB_ENUMERATOR_FLAGS_FLATTEN;
+		lua_pop(L, 1);
+
+		lua_getfield(L, 2, "aggregate");
+		if (lua_toboolean(L, -1))
+			flags |= LOC_DB_ENUMERATOR_FLAGS_AGGREGATE;
+		lua_pop(L, 1);
+
+		lua_getfield(L, 2, "values");
+		values = lua_toboolean(L, -1);
+		lua_pop(L, 1);
+	}
+
 	// Allocate a new enumerator
 	e = lua_newuserdata(L, sizeof(*e));
+	e->e = NULL;
+
 	luaL_setmetatable(L, "location.DatabaseEnumerator");
 
 	// Create a new enumerator
-	r = loc_database_enumerator_new(&e->e, self->db, LOC_DB_ENUMERATE_NETWORKS, 0);
+	r = loc_database_enumerator_new(&e->e, self->db, LOC_DB_ENUMERATE_NETWORKS, flags);
 	if (r)
 		return luaL_error(L, "Could not create enumerator: %s\n", strerror(errno));
 
+	if (has_filters) {
+		// Country Codes
+		lua_getfield(L, 2, "country_codes");
+		if (!lua_isnil(L, -1))
+			DatabaseEnumerator_set_countries(L, e->e, lua_gettop(L));
+		lua_pop(L, 1);
+
+		// ASNs
+		lua_getfield(L, 2, "asns");
+		if (!lua_isnil(L, -1))
+			DatabaseEnumerator_set_asns(L, e->e, lua_gettop(L));
+		lua_pop(L, 1);
+
+		// Flags
+		lua_getfield(L, 2, "flags");
+		if (!lua_isnil(L, -1)) {
+			r = loc_database_enumerator_set_flag(e->e, luaL_checknumber(L, -1));
+			if (r)
+				return luaL_error(L, "Could not set flags: %s\n", strerror(-r));
+		}
+		lua_pop(L, 1);
+
+		// Family
+		lua_getfield(L, 2, "family");
+		if (!lua_isnil(L, -1)) {
+			r = loc_database_enumerator_set_family(e->e, luaL_checknumber(L, -1));
+			if (r)
+				return luaL_error(L, "Could not set family: %s\n", strerror(-r));
+		}
+		lua_pop(L, 1);
+	}
+
 	// Push the closure onto the stack
-	lua_pushcclosure(L, DatabaseEnumerator_next_network, 1);
+	if (values)
+		lua_pushcclosure(L, DatabaseEnumerator_next_network_values, 1);
+	else
+		lua_pushcclosure(L, DatabaseEnumerator_next_network, 1);
 
 	return 1;
 }
 
+static int Database_add_export_objects(lua_State* L, struct loc_exporter* exporter) {
+	int r = 0;
+
+	// Country Codes
+	lua_getfield(L, 2, "country_codes");
+
+	if (lua_istable(L, -1)) {
+		const int length = lua_rawlen(L, -1);
+
+		for (int j = 1; j <= length && !r; j++) {
+			lua_rawgeti(L, -1, j);
+
+			const char* code = lua_tostring(L, -1);
+
+			r = (code) ? loc_exporter_add_country(exporter, code) : -EINVAL;
+			lua_pop(L, 1);
+		}
+	}
+
+	lua_pop(L, 1);
+
+	// ASNs
+	lua_getfield(L, 2, "asns");
+
+	if (lua_istable(L, -1)) {
+		const int length = lua_rawlen(L, -1);
+
+		for (int j = 1; j <= length && !r; j++) {
+			lua_rawgeti(L, -1, j);
+
+			r = (lua_isnumber(L, -1)) ? loc_exporter_add_asn(exporter, lua_tonumber(L, -1)) : -EINVAL;
+			lua_pop(L, 1);
+		}
+	}
+
+	lua_pop(L, 1);
+
+	return r;
+}
+
+/*
+	Exports networks in the same formats as "location export". The options are:
+
+		format        - One of the EXPORT_FORMAT_* constants
+		family        - AF_INET or AF_INET6, or all families in one pass if not set
+		country_codes - A list of country codes including A1, A2, A3 and XD
+		asns          - A list of AS numbers
+		directory     - Writes one file for each country and AS into this directory
+
+	Without a directory, the output is returned as a string.
+*/
+static int Database_export(lua_State* L) {
+	struct loc_exporter* exporter = NULL;
+	const char* directory = NULL;
+	char* buffer = NULL;
+	size_t length = 0;
+	FILE* f = NULL;
+	int format;
+	int family;
+	int r;
+
+	Database* self = luaL_checkdatabase(L, 1);
+
+	luaL_checktype(L, 2, LUA_TTABLE);
+
+	lua_getfield(L, 2, "format");
+	format = luaL_checknumber(L, -1);
+	lua_pop(L, 1);
+
+	lua_getfield(L, 2, "family");
+	family = luaL_optnumber(L, -1, AF_UNSPEC);
+	lua_pop(L, 1);
+
+	// The string remains referenced by the table
+	lua_getfield(L, 2, "directory");
+	directory = lua_tostring(L, -1);
+	lua_pop(L, 1);
+
+	r = loc_exporter_new(ctx, &exporter, self->db, format);
+	if (r)
+		return luaL_error(L, "Could not create exporter: %s\n", strerror(-r));
+
+	r = Database_add_export_objects(L, exporter);
+	if (r)
+		goto ERROR;
+
+	// Collect the output in memory if we don't write to a directory
+	if (!directory) {
+		f = open_memstream(&buffer, &length);
+		if (!f) {
+			r = -errno;
+			goto ERROR;
+		}
+	}
+
+	r = loc_exporter_export(exporter, family, directory, f);
+
+	if (f)
+		fclose(f);
+
+	if (r)
+		goto ERROR;
+
+	loc_exporter_unref(exporter);
+
+	if (buffer) {
+		lua_pushlstring(L, buffer, length);
+		free(buffer);
+	} else {
+		lua_pushboolean(L, 1);
+	}
+
+	return 1;
+
+ERROR:
+	loc_exporter_unref(exporter);
+
+	if (buffer)
+		free(buffer);
+
+	return luaL_error(L, "Could not export: %s\n", strerror(-r));
+}
+
 static const struct luaL_Reg database_functions[] = {
 	{ "created_at", Database_created_at },
+	{ "export", Database_export },
 	{ "get_as", Database_get_as },
 	{ "get_description", Database_get_description },
 	{ "get_country", Database_get_country },
@@ -307,6 +801,8 @@ static const struct luaL_Reg database_functions[] = {
 	{ "get_vendor", Database_get_vendor },
 	{ "open", Database_open },
 	{ "lookup", Database_lookup },
+	{ "lookup_many", Database_lookup_many },
+	{ "lookup_values", Database_lookup_values },
 	{ "list_networks", Database_list_networks },
 	{ "verify", Database_verify },
 	{ "__gc", Database_gc },
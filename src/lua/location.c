@@ -17,12 +17,14 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 
 #include <lua.h>
 #include <lauxlib.h>
 #include <lualib.h>
 
 #include <libloc/libloc.h>
+#include <libloc/exporter.h>
 #include <libloc/network.h>
 
 #include "location.h"
@@ -156,5 +158,25 @@ int luaopen_location(lua_State* L) {
 	lua_pushnumber(L, LOC_NETWORK_FLAG_DROP);
 	lua_setfield(L, -2, "NETWORK_FLAG_DROP");
 
+	// Add families
+	lua_pushnumber(L, AF_INET);
+	lua_setfield(L, -2, "AF_INET");
+
+	lua_pushnumber(L, AF_INET6);
+	lua_setfield(L, -2, "AF_INET6");
+
+	// Add export formats
+	lua_pushnumber(L, LOC_EXPORTER_FORMAT_LIST);
+	lua_setfield(L, -2, "EXPORT_FORMAT_LIST");
+
+	lua_pushnumber(L, LOC_EXPORTER_FORMAT_IPSET);
+	lua_setfield(L, -2, "EXPORT_FORMAT_IPSET");
+
+	lua_pushnumber(L, LOC_EXPORTER_FORMAT_NFTABLES);
+	lua_setfield(L, -2, "EXPORT_FORMAT_NFTABLES");
+
+	lua_pushnumber(L, LOC_EXPORTER_FORMAT_XT_GEOIP);
+	lua_setfield(L, -2, "EXPORT_FORMAT_XT_GEOIP");
+
 	return 1;
 }
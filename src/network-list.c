@@ -16,6 +16,7 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include <libloc/address.h>
@@ -27,27 +28,56 @@ struct loc_network_list {
 	struct loc_ctx* ctx;
 	int refcount;
 
-	struct loc_network** elements;
-	size_t elements_size;
+	// The allocated array
+	struct loc_network** buffer;
+	size_t buffer_size;
 
+	// The first element, which moves forward when popping from the front
+	struct loc_network** elements;
 	size_t size;
+
+	// Set when networks have been appended out of order
+	int unsorted;
 };
 
-static int loc_network_list_grow(struct loc_network_list* list) {
-	size_t size = list->elements_size * 2;
+/*
+	Makes sure that count more networks can be added to the end of the list
+*/
+static int loc_network_list_grow(struct loc_network_list* list, size_t count) {
+	const size_t head = list->elements - list->buffer;
+
+	// Nothing to do if there is enough space left
+	if (head + list->size + count <= list->buffer_size)
+		return 0;
+
+	// Reclaim any space at the front first
+	if (head) {
+		memmove(list->buffer, list->elements, list->size * sizeof(*list->elements));
+		list->elements = list->buffer;
+
+		if (list->size + count <= list->buffer_size)
+			return 0;
+	}
+
+	size_t size = list->buffer_size * 2;
 	if (size < 1024)
 		size = 1024;
 
+	if (size < list->size + count - list->buffer_size)
+		size = list->size + count - list->buffer_size;
+
 	DEBUG(list->ctx, "Growing network list %p by %zu to %zu\n",
-		list, size, list->elements_size + size);
+		list, size, list->buffer_size + size);
 
-	struct loc_network** elements = reallocarray(list->elements,
-			list->elements_size + size, sizeof(*list->elements));
-	if (!elements)
-		return 1;
+	struct loc_network** buffer = reallocarray(list->buffer,
+			list->buffer_size + size, sizeof(*list->buffer));
+	if (!buffer)
+		return -ENOMEM;
 
-	list->elements = elements;
-	list->elements_size += size;
+	list->buffer = buffer;
+	list->buffer_size += size;
+
+	list->elements = list->buffer;
 
 	return 0;
 }
@@ -99,17 +129,20 @@ LOC_EXPORT int loc_network_list_empty(struct loc_network_list* list) {
 }
 
 LOC_EXPORT void loc_network_list_clear(struct loc_network_list* list) {
-	if (!list->elements)
+	if (!list->buffer)
 		return;
 
 	for (unsigned int i = 0; i < list->size; i++)
 		loc_network_unref(list->elements[i]);
 
-	free(list->elements);
-	list->elements = NULL;
-	list->elements_size = 0;
+	free(list->buffer);
+	list->buffer = NULL;
+	list->buffer_size = 0;
 
+	list->elements = NULL;
 	list->size = 0;
+
+	list->unsorted = 0;
 }
 
 LOC_EXPORT void loc_network_list_dump(struct loc_network_list* list) {
@@ -137,6 +170,21 @@ static off_t loc_network_list_find(struct loc_network_list* list,
 	if (loc_network_list_empty(list))
 		return 0;
 
+	// Search through all networks if the list is not in order
+	if (list->unsorted) {
+		for (size_t i = 0; i < list->size; i++) {
+			if (loc_network_cmp(network, list->elements[i]) == 0) {
+				*found = 1;
+
+				return i;
+			}
+		}
+
+		*found = 0;
+
+		return list->size;
+	}
+
 	off_t lo = 0;
 	off_t hi = list->size - 1;
 	int result;
@@ -210,6 +258,12 @@ static off_t loc_network_list_find(struct loc_network_list* list,
 
 LOC_EXPORT int loc_network_list_push(struct loc_network_list* list, struct loc_network* network) {
 	int found = 0;
+	int r;
+
+	// Bring the list back into order first
+	r = loc_network_list_sort(list);
+	if (r)
+		return r;
 
 	off_t index = loc_network_list_find(list, network, &found);
 
@@ -221,19 +275,17 @@ LOC_EXPORT int loc_network_list_push(struct loc_network_list* list, struct loc_n
 		list, network, (intmax_t)index);
 
 	// Check if we have space left
-	if (list->size >= list->elements_size) {
-		int r = loc_network_list_grow(list);
-		if (r)
-			return r;
-	}
+	r = loc_network_list_grow(list, 1);
+	if (r)
+		return r;
+
+	// Move all elements out of the way
+	memmove(list->elements + index + 1, list->elements + index,
+		(list->size - index) * sizeof(*list->elements));
 
 	// The list is now larger
 	list->size++;
 
-	// Move all elements out of the way
-	for (unsigned int i = list->size - 1; i > index; i--)
-		list->elements[i] = list->elements[i - 1];
-
 	// Add the new element at the right place
 	list->elements[index] = loc_network_ref(network);
 
@@ -249,6 +301,10 @@ LOC_EXPORT struct loc_network* loc_network_list_pop(struct loc_network_list* lis
 
 	struct loc_network* network = list->elements[--list->size];
 
+	// Start from the beginning of the buffer again
+	if (!list->size)
+		list->elements = list->buffer;
+
 	DEBUG(list->ctx, "%p: Popping network %p from stack\n", list, network);
 
 	return network;
@@ -263,14 +319,16 @@ LOC_EXPORT struct loc_network* loc_network_list_pop_first(struct loc_network_lis
 
 	struct loc_network* network = list->elements[0];
 
-	// Move all elements to the top of the stack
-	for (unsigned int i = 0; i < list->size - 1; i++) {
-		list->elements[i] = list->elements[i+1];
-	}
+	// Advance the head instead of moving all other elements
+	list->elements++;
 
 	// The list is shorter now
 	--list->size;
 
+	// Start from the beginning of the buffer again
+	if (!list->size)
+		list->elements = list->buffer;
+
 	DEBUG(list->ctx, "%p: Popping network %p from stack\n", list, network);
 
 	return network;
@@ -278,6 +336,12 @@ LOC_EXPORT struct loc_network* loc_network_list_pop_first(struct loc_network_lis
 
 int loc_network_list_remove(struct loc_network_list* list, struct loc_network* network) {
 	int found = 0;
+	int r;
+
+	// Bring the list back into order first
+	r = loc_network_list_sort(list);
+	if (r)
+		return r;
 
 	// Find the network on the list
 	off_t index = loc_network_list_find(list, network, &found);
@@ -290,8 +354,8 @@ int loc_network_list_remove(struct loc_network_list* list, struct loc_network* n
 	loc_network_unref(list->elements[index]);
 
 	// Move all other elements back
-	for (unsigned int i = index; i < list->size - 1; i++)
-		list->elements[i] = list->elements[i+1];
+	memmove(list->elements + index, list->elements + index + 1,
+		(list->size - index - 1) * sizeof(*list->elements));
 
 	// The list is shorter now
 	--list->size;
@@ -307,22 +371,380 @@ LOC_EXPORT int loc_network_list_contains(struct loc_network_list* list, struct l
 	return found;
 }
 
+/*
+	Appends a network to the end of the list without keeping the list in order.
+
+	This is much faster than pushing many networks one at a time. The list keeps
+	the order in which networks have been appended until loc_network_list_sort()
+	is called, or until any other function requires the list to be in order.
+*/
+LOC_EXPORT int loc_network_list_append(struct loc_network_list* list, struct loc_network* network) {
+	int r;
+
+	r = loc_network_list_grow(list, 1);
+	if (r)
+		return r;
+
+	// Remember if the list is no longer in order
+	if (list->size && loc_network_cmp(list->elements[list->size - 1], network) >= 0)
+		list->unsorted = 1;
+
+	list->elements[list->size++] = loc_network_ref(network);
+
+	return 0;
+}
+
+/*
+	A stable merge sort, so that the first one of any duplicates remains first
+*/
+static void loc_network_list_sort_elements(struct loc_network** elements,
+		struct loc_network** tmp, const size_t size) {
+	if (size < 2)
+		return;
+
+	const size_t half = size / 2;
+
+	// Sort both halves
+	loc_network_list_sort_elements(elements, tmp, half);
+	loc_network_list_sort_elements(elements + half, tmp, size - half);
+
+	// Nothing to do if both halves are already in order
+	if (loc_network_cmp(elements[half - 1], elements[half]) <= 0)
+		return;
+
+	// Move the first half out of the way
+	memcpy(tmp, elements, half * sizeof(*tmp));
+
+	size_t i = 0;
+	size_t j = half;
+	size_t k = 0;
+
+	while (i < half && j < size) {
+		if (loc_network_cmp(elements[j], tmp[i]) < 0)
+			elements[k++] = elements[j++];
+		else
+			elements[k++] = tmp[i++];
+	}
+
+	// Copy whatever is left of the first half
+	while (i < half)
+		elements[k++] = tmp[i++];
+}
+
+/*
+	Brings the list back into order after networks have been appended
+	and drops any duplicates.
+*/
+LOC_EXPORT int loc_network_list_sort(struct loc_network_list* list) {
+	struct loc_network** tmp = NULL;
+	size_t size = 0;
+
+	// Nothing to do if the list is in order
+	if (!list->unsorted)
+		return 0;
+
+	tmp = reallocarray(NULL, list->size / 2 + 1, sizeof(*tmp));
+	if (!tmp)
+		return -ENOMEM;
+
+	loc_network_list_sort_elements(list->elements, tmp, list->size);
+	free(tmp);
+
+	// Drop any duplicates
+	for (size_t i = 0; i < list->size; i++) {
+		if (size && loc_network_cmp(list->elements[size - 1], list->elements[i]) == 0) {
+			loc_network_unref(list->elements[i]);
+			continue;
+		}
+
+		list->elements[size++] = list->elements[i];
+	}
+
+	DEBUG(list->ctx, "%p: Sorted %zu network(s), dropped %zu duplicate(s)\n",
+		list, size, list->size - size);
+
+	list->size = size;
+	list->unsorted = 0;
+
+	return 0;
+}
+
+/*
+	Adds all networks from other to self. Networks that already are on self are kept.
+*/
 LOC_EXPORT int loc_network_list_merge(
 		struct loc_network_list* self, struct loc_network_list* other) {
+	struct loc_network** buffer = NULL;
+	size_t i = 0;
+	size_t j = 0;
+	size_t k = 0;
 	int r;
 
-	for (unsigned int i = 0; i < other->size; i++) {
-		r = loc_network_list_push(self, other->elements[i]);
+	// If any of the lists is not in order, we append everything and sort again
+	if (self->unsorted || other->unsorted) {
+		for (i = 0; i < other->size; i++) {
+			r = loc_network_list_append(self, other->elements[i]);
+			if (r)
+				return r;
+		}
+
+		return loc_network_list_sort(self);
+	}
+
+	// Nothing to do if other is empty
+	if (loc_network_list_empty(other))
+		return 0;
+
+	// If all networks go after the last network, we simply append them
+	if (loc_network_list_empty(self) ||
+			loc_network_cmp(self->elements[self->size - 1], other->elements[0]) < 0) {
+		r = loc_network_list_grow(self, other->size);
 		if (r)
 			return r;
+
+		for (i = 0; i < other->size; i++)
+			self->elements[self->size++] = loc_network_ref(other->elements[i]);
+
+		return 0;
 	}
 
+	// Otherwise merge both lists into a new buffer
+	buffer = reallocarray(NULL, self->size + other->size, sizeof(*buffer));
+	if (!buffer)
+		return -ENOMEM;
+
+	while (i < self->size && j < other->size) {
+		r = loc_network_cmp(self->elements[i], other->elements[j]);
+
+		if (r < 0) {
+			buffer[k++] = self->elements[i++];
+
+		} else if (r > 0) {
+			buffer[k++] = loc_network_ref(other->elements[j++]);
+
+		// Skip any networks that are on both lists
+		} else {
+			buffer[k++] = self->elements[i++];
+			j++;
+		}
+	}
+
+	while (i < self->size)
+		buffer[k++] = self->elements[i++];
+
+	while (j < other->size)
+		buffer[k++] = loc_network_ref(other->elements[j++]);
+
+	free(self->buffer);
+
+	self->buffer = buffer;
+	self->buffer_size = self->size + other->size;
+
+	self->elements = self->buffer;
+	self->size = k;
+
 	return 0;
 }
 
+/*
+	Converts all networks on the list into a sorted array of disjoint address ranges.
+	Networks that overlap or are adjacent to each other are joined into one range.
+*/
+int loc_network_list_ranges(struct loc_network_list* list,
+		struct loc_network_range** ranges, size_t* count) {
+	struct loc_network_range* range = NULL;
+	struct in6_addr next;
+	int r;
+
+	*ranges = NULL;
+	*count = 0;
+
+	// The list must be in order
+	r = loc_network_list_sort(list);
+	if (r)
+		return r;
+
+	// Nothing to do for an empty list
+	if (loc_network_list_empty(list))
+		return 0;
+
+	*ranges = reallocarray(NULL, list->size, sizeof(**ranges));
+	if (!*ranges)
+		return -ENOMEM;
+
+	for (size_t i = 0; i < list->size; i++) {
+		const struct in6_addr* first = loc_network_get_first_address(list->elements[i]);
+		const struct in6_addr* last  = loc_network_get_last_address(list->elements[i]);
+
+		// Extend the previous range if this network overlaps or follows right after it
+		if (range) {
+			next = range->last;
+			loc_address_increment(&next);
+
+			if (loc_address_cmp(first, &next) <= 0) {
+				if (loc_address_cmp(last, &range->last) > 0)
+					range->last = *last;
+
+				continue;
+			}
+		}
+
+		range = &(*ranges)[(*count)++];
+
+		range->first = *first;
+		range->last  = *last;
+	}
+
+	DEBUG(list->ctx, "%p: Converted %zu network(s) into %zu range(s)\n",
+		list, list->size, *count);
+
+	return 0;
+}
+
+/*
+	Appends the smallest set of networks that covers all addresses from first
+	to last. All networks will inherit the properties of network.
+*/
+static int loc_network_list_append_range(struct loc_network_list* list,
+		struct loc_network* network, const struct in6_addr* first, const struct in6_addr* last) {
+	struct loc_address_prefix prefixes[LOC_ADDRESS_MAX_PREFIXES];
+	struct loc_network_value value;
+	struct loc_network* subnet = NULL;
+	int count;
+	int r;
+
+	count = loc_address_summarize(first, last, prefixes, LOC_ADDRESS_MAX_PREFIXES);
+	if (count < 0)
+		return count;
+
+	// Copy all properties
+	loc_network_to_value(network, &value);
+
+	// The value stores the prefix in IPv6 space
+	const unsigned int offset = 128 - loc_address_family_bit_length(loc_address_family(first));
+
+	for (int i = 0; i < count; i++) {
+		value.address = prefixes[i].address;
+		value.prefix  = prefixes[i].prefix + offset;
+
+		r = loc_network_new_from_value(list->ctx, &subnet, &value);
+		if (r)
+			return r;
+
+		r = loc_network_list_append(list, subnet);
+		loc_network_unref(subnet);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
+/*
+	Appends all parts of network to list that are not covered by any of the ranges
+*/
+int loc_network_list_append_excluded(struct loc_network_list* list, struct loc_network* network,
+		const struct loc_network_range* ranges, const size_t count) {
+	const struct in6_addr* first = loc_network_get_first_address(network);
+	const struct in6_addr* last  = loc_network_get_last_address(network);
+	struct in6_addr start = *first;
+	struct in6_addr end;
+	size_t lo = 0;
+	size_t hi = count;
+	int r;
+
+	// Find the first range that does not end before the network
+	while (lo < hi) {
+		size_t i = lo + (hi - lo) / 2;
+
+		if (loc_address_cmp(&ranges[i].last, first) < 0)
+			lo = i + 1;
+		else
+			hi = i;
+	}
+
+	for (size_t i = lo; i < count; i++) {
+		// Stop if the range starts after the network
+		if (loc_address_cmp(&ranges[i].first, last) > 0)
+			break;
+
+		// Add the gap before this range
+		if (loc_address_cmp(&ranges[i].first, &start) > 0) {
+			end = ranges[i].first;
+			loc_address_decrement(&end);
+
+			r = loc_network_list_append_range(list, network, &start, &end);
+			if (r)
+				return r;
+		}
+
+		// We are done if this range covers the rest of the network
+		if (loc_address_cmp(&ranges[i].last, last) >= 0)
+			return 0;
+
+		start = ranges[i].last;
+		loc_address_increment(&start);
+	}
+
+	// Add whatever is left
+	return loc_network_list_append_range(list, network, &start, last);
+}
+
+/*
+	Returns a new list with all networks on list without any addresses on excluded
+*/
+LOC_EXPORT struct loc_network_list* loc_network_list_exclude(
+		struct loc_network_list* list, struct loc_network_list* excluded) {
+	struct loc_network_list* result = NULL;
+	struct loc_network_range* ranges = NULL;
+	size_t count = 0;
+	int r;
+
+	r = loc_network_list_new(list->ctx, &result);
+	if (r)
+		goto ERROR;
+
+	r = loc_network_list_sort(list);
+	if (r)
+		goto ERROR;
+
+	r = loc_network_list_ranges(excluded, &ranges, &count);
+	if (r)
+		goto ERROR;
+
+	for (size_t i = 0; i < list->size; i++) {
+		r = loc_network_list_append_excluded(result, list->elements[i], ranges, count);
+		if (r)
+			goto ERROR;
+	}
+
+	// Networks on list might overlap
+	r = loc_network_list_sort(result);
+	if (r)
+		goto ERROR;
+
+ERROR:
+	if (ranges)
+		free(ranges);
+
+	if (r) {
+		ERROR(list->ctx, "Could not exclude networks: %s\n", strerror(-r));
+
+		if (result)
+			loc_network_list_unref(result);
+
+		errno = -r;
+		return NULL;
+	}
+
+	return result;
+}
+
 int loc_network_list_summarize(struct loc_ctx* ctx,
 		const struct in6_addr* first, const struct in6_addr* last, struct loc_network_list** list) {
-	int bits;
+	struct loc_address_prefix prefixes[LOC_ADDRESS_MAX_PREFIXES];
+	struct loc_network* network = NULL;
+	int count;
 	int r;
 
 	if (!list) {
@@ -342,29 +764,22 @@ int loc_network_list_summarize(struct loc_ctx* ctx,
 		return 1;
 	}
 
-	// Check if the last address is larger than the first address
-	if (loc_address_cmp(first, last) >= 0) {
-		ERROR(ctx, "The first address must be smaller than the last address\n");
+	// Check if the last address is not smaller than the first address
+	if (loc_address_cmp(first, last) > 0) {
+		ERROR(ctx, "The first address must not be larger than the last address\n");
 		errno = EINVAL;
 		return 1;
 	}
 
-	struct loc_network* network = NULL;
-	struct in6_addr start = *first;
-
-	while (loc_address_cmp(&start, last) <= 0) {
-		// Count how many leading bits the IP addresses have in common
-		bits = loc_address_common_bits(&start, last);
-		if (bits < 0)
-			return bits;
-
-		// If the start and end address don't have any bits in common, we try
-		// to cut the subnet into halves and try again...
-		else if (bits == 0)
-			bits = 1;
+	count = loc_address_summarize(first, last, prefixes, LOC_ADDRESS_MAX_PREFIXES);
+	if (count < 0) {
+		errno = -count;
+		return 1;
+	}
 
+	for (int i = 0; i < count; i++) {
 		// Create a network
-		r = loc_network_new(ctx, &network, &start, bits);
+		r = loc_network_new(ctx, &network, &prefixes[i].address, prefixes[i].prefix);
 		if (r)
 			return r;
 
@@ -376,19 +791,9 @@ int loc_network_list_summarize(struct loc_ctx* ctx,
 
 		// Push network on the list
 		r = loc_network_list_push(*list, network);
-		if (r) {
-			loc_network_unref(network);
+		loc_network_unref(network);
+		if (r)
 			return r;
-		}
-
-		// The next network starts right after this one
-		start = *loc_network_get_last_address(network);
-
-		// If we have reached the end of possible IP addresses, we stop
-		if (loc_address_all_ones(&start))
-			break;
-
-		loc_address_increment(&start);
 	}
 
 	return 0;
@@ -424,3 +829,299 @@ void loc_network_list_remove_with_prefix_smaller_than(
 
 	return;
 }
+
+/*
+	Lists of network values
+*/
+
+void loc_network_value_list_free(struct loc_network_value_list* list) {
+	if (list->buffer)
+		free(list->buffer);
+
+	memset(list, 0, sizeof(*list));
+}
+
+void loc_network_value_list_clear(struct loc_network_value_list* list) {
+	list->head = 0;
+	list->size = 0;
+}
+
+/*
+	Inserts value at the right place unless it is already on the list
+*/
+int loc_network_value_list_push(struct loc_network_value_list* list,
+		const struct loc_network_value* value) {
+	struct loc_network_value* elements = list->buffer + list->head;
+	size_t lo = 0;
+	size_t hi = list->size;
+	int r;
+
+	// Networks are often pushed in order, so check the end first
+	if (list->size) {
+		r = loc_network_value_cmp(value, &elements[list->size - 1]);
+		if (r == 0)
+			return 0;
+
+		else if (r > 0)
+			lo = list->size;
+	}
+
+	// Find the first element that is not smaller than value
+	while (lo < hi) {
+		size_t i = lo + (hi - lo) / 2;
+
+		r = loc_network_value_cmp(value, &elements[i]);
+		if (r == 0)
+			return 0;
+
+		else if (r > 0)
+			lo = i + 1;
+		else
+			hi = i;
+	}
+
+	// Move the first elements forward if that is less work
+	if (list->head && lo < list->size / 2) {
+		memmove(elements - 1, elements, lo * sizeof(*elements));
+
+		list->head--;
+		list->size++;
+
+		elements[lo - 1] = *value;
+
+		return 0;
+	}
+
+	// Make space
+	if (list->head + list->size >= list->buffer_size) {
+		// Reclaim any space at the front first
+		if (list->head) {
+			memmove(list->buffer, elements, list->size * sizeof(*elements));
+			list->head = 0;
+
+		} else {
+			size_t size = (list->buffer_size) ? list->buffer_size * 2 : 64;
+
+			elements = reallocarray(list->buffer, size, sizeof(*list->buffer));
+			if (!elements)
+				return -ENOMEM;
+
+			list->buffer = elements;
+			list->buffer_size = size;
+		}
+
+		elements = list->buffer;
+	}
+
+	// Move all following elements out of the way
+	memmove(elements + lo + 1, elements + lo, (list->size - lo) * sizeof(*elements));
+
+	elements[lo] = *value;
+	list->size++;
+
+	return 0;
+}
+
+/*
+	Removes the smallest network from the list. Returns 1 if a network
+	has been removed and 0 if the list was empty.
+*/
+int loc_network_value_list_pop_first(struct loc_network_value_list* list,
+		struct loc_network_value* value) {
+	if (!list->size)
+		return 0;
+
+	*value = list->buffer[list->head++];
+
+	// Start from the beginning of the buffer again
+	if (!--list->size)
+		list->head = 0;
+
+	return 1;
+}
+
+/*
+	Makes sure that count networks can be put in front of the first one
+*/
+static int loc_network_value_list_reserve_front(struct loc_network_value_list* list, size_t count) {
+	struct loc_network_value* buffer = NULL;
+
+	// Nothing to do if there is enough space left
+	if (list->head >= count)
+		return 0;
+
+	// Leave some space in front and at the end
+	const size_t front = count + list->size + 64;
+	const size_t size  = front + list->size * 2 + 64;
+
+	buffer = reallocarray(NULL, size, sizeof(*buffer));
+	if (!buffer)
+		return -ENOMEM;
+
+	memcpy(buffer + front, list->buffer + list->head, list->size * sizeof(*buffer));
+
+	free(list->buffer);
+
+	list->buffer = buffer;
+	list->buffer_size = size;
+	list->head = front;
+
+	return 0;
+}
+
+/*
+	Merges all networks from other into self
+*/
+int loc_network_value_list_merge(struct loc_network_value_list* self,
+		const struct loc_network_value_list* other) {
+	const struct loc_network_value* a = self->buffer + self->head;
+	const struct loc_network_value* b = other->buffer + other->head;
+	struct loc_network_value* buffer = NULL;
+	size_t i = 0;
+	size_t j = 0;
+	size_t k = 0;
+	int r;
+
+	// Nothing to do if other is empty
+	if (!other->size)
+		return 0;
+
+	// If all networks go after the last network, we simply push them
+	if (!self->size || loc_network_value_cmp(&a[self->size - 1], &b[0]) < 0) {
+		for (j = 0; j < other->size; j++) {
+			r = loc_network_value_list_push(self, &b[j]);
+			if (r)
+				return r;
+		}
+
+		return 0;
+	}
+
+	/*
+		If all networks go before the first network, we put them in front.
+		This is what happens when a network is broken into smaller parts
+		after it has been popped from the front.
+	*/
+	if (loc_network_value_cmp(&b[other->size - 1], &a[0]) < 0) {
+		r = loc_network_value_list_reserve_front(self, other->size);
+		if (r)
+			return r;
+
+		self->head -= other->size;
+		self->size += other->size;
+
+		memcpy(self->buffer + self->head, b, other->size * sizeof(*b));
+
+		return 0;
+	}
+
+	// Otherwise merge both lists into a new buffer
+	buffer = reallocarray(NULL, self->size + other->size, sizeof(*buffer));
+	if (!buffer)
+		return -ENOMEM;
+
+	while (i < self->size && j < other->size) {
+		r = loc_network_value_cmp(&a[i], &b[j]);
+
+		if (r < 0) {
+			buffer[k++] = a[i++];
+
+		} else if (r > 0) {
+			buffer[k++] = b[j++];
+
+		// Skip any networks that are on both lists
+		} else {
+			buffer[k++] = a[i++];
+			j++;
+		}
+	}
+
+	while (i < self->size)
+		buffer[k++] = a[i++];
+
+	while (j < other->size)
+		buffer[k++] = b[j++];
+
+	free(self->buffer);
+
+	self->buffer = buffer;
+	self->buffer_size = self->size + other->size;
+	self->head = 0;
+	self->size = k;
+
+	return 0;
+}
+
+/*
+	Pushes the smallest set of networks that covers all addresses from first
+	to last. All networks will inherit the properties of value.
+*/
+static int loc_network_value_list_push_range(struct loc_network_value_list* list,
+		const struct loc_network_value* value, const struct in6_addr* first, const struct in6_addr* last) {
+	struct loc_address_prefix prefixes[LOC_ADDRESS_MAX_PREFIXES];
+	struct loc_network_value subnet = *value;
+	int count;
+	int r;
+
+	count = loc_address_summarize(first, last, prefixes, LOC_ADDRESS_MAX_PREFIXES);
+	if (count < 0)
+		return count;
+
+	// The value stores the prefix in IPv6 space
+	const unsigned int offset = 128 - loc_address_family_bit_length(loc_address_family(first));
+
+	for (int i = 0; i < count; i++) {
+		subnet.address = prefixes[i].address;
+		subnet.prefix  = prefixes[i].prefix + offset;
+
+		r = loc_network_value_list_push(list, &subnet);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
+/*
+	Pushes all parts of value to list that are not covered by any network on excluded
+*/
+int loc_network_value_list_append_excluded(struct loc_network_value_list* list,
+		const struct loc_network_value* value, const struct loc_network_value_list* excluded) {
+	const struct in6_addr last = loc_network_value_last_address(value);
+	struct in6_addr start = value->address;
+	struct in6_addr end;
+	int r;
+
+	for (size_t i = 0; i < excluded->size; i++) {
+		const struct loc_network_value* e = &excluded->buffer[excluded->head + i];
+		const struct in6_addr e_last = loc_network_value_last_address(e);
+
+		// Skip anything that has already been covered
+		if (loc_address_cmp(&e_last, &start) < 0)
+			continue;
+
+		// Stop if the network starts after value
+		if (loc_address_cmp(&e->address, &last) > 0)
+			break;
+
+		// Add the gap before this network
+		if (loc_address_cmp(&e->address, &start) > 0) {
+			end = e->address;
+			loc_address_decrement(&end);
+
+			r = loc_network_value_list_push_range(list, value, &start, &end);
+			if (r)
+				return r;
+		}
+
+		// We are done if this network covers the rest
+		if (loc_address_cmp(&e_last, &last) >= 0)
+			return 0;
+
+		start = e_last;
+		loc_address_increment(&start);
+	}
+
+	// Add whatever is left
+	return loc_network_value_list_push_range(list, value, &start, &last);
+}
@@ -14,9 +14,10 @@
 	Lesser General Public License for more details.
 */
 
+#include <errno.h>
 #include <stddef.h>
 #include <stdlib.h>
-#include <errno.h>
+#include <string.h>
 
 #include <libloc/libloc.h>
 #include <libloc/address.h>
@@ -42,9 +43,49 @@ struct loc_network_tree_node {
 	// Flags
 	enum loc_network_tree_node_flags {
 		NETWORK_TREE_NODE_DELETED = (1 << 0),
+		NETWORK_TREE_NODE_SHARD   = (1 << 1),
 	} flags;
 };
 
+/*
+	For the cleanup, the tree is split into shards which can be processed
+	independently from each other. IPv6 is split into /16s and IPv4 into /8s.
+*/
+#define LOC_NETWORK_TREE_SHARD_DEPTH6	16
+#define LOC_NETWORK_TREE_SHARD_DEPTH4	(96 + 8)
+
+struct loc_network_tree_shard {
+	// The pointer in the parent node that holds the root of the shard
+	struct loc_network_tree_node** node;
+
+	// The path to the root node
+	struct in6_addr address;
+	unsigned int depth;
+
+	// The state of each deduplication pass when the walk enters the shard
+	struct loc_network_tree_shard_dedup {
+		// The closest network above the shard
+		struct loc_network* ancestor;
+
+		// Set if the walk does not enter the shard at all
+		int skip;
+	} dedup[2];
+
+	// The number of networks that have been removed
+	unsigned int removed;
+};
+
+// The order in which networks are being deduplicated
+static const int loc_network_tree_dedup_families[] = { AF_INET6, AF_INET };
+
+enum loc_network_tree_walk_flags {
+	// Don't walk into any shards at all
+	LOC_NETWORK_TREE_WALK_SKIP_SHARDS    = (1 << 0),
+
+	// Visit the root of each shard, but don't walk any further
+	LOC_NETWORK_TREE_WALK_STOP_AT_SHARDS = (1 << 1),
+};
+
 int loc_network_tree_new(struct loc_ctx* ctx, struct loc_network_tree** tree) {
 	struct loc_network_tree* t = calloc(1, sizeof(*t));
 	if (!t)
@@ -105,10 +146,12 @@ static struct loc_network_tree_node* loc_network_tree_get_node(struct loc_networ
 	return *n;
 }
 
-static struct loc_network_tree_node* loc_network_tree_get_path(struct loc_network_tree* tree, const struct in6_addr* address, unsigned int prefix) {
-	struct loc_network_tree_node* node = tree->root;
-
-	for (unsigned int i = 0; i < prefix; i++) {
+/*
+	Follows the path from node (which is at depth) down to prefix
+*/
+static struct loc_network_tree_node* loc_network_tree_get_path(struct loc_network_tree_node* node,
+		unsigned int depth, const struct in6_addr* address, unsigned int prefix) {
+	for (unsigned int i = depth; i < prefix && node; i++) {
 		// Check if the ith bit is one or zero
 		node = loc_network_tree_get_node(node, loc_address_get_bit(address, i));
 	}
@@ -118,13 +161,18 @@ static struct loc_network_tree_node* loc_network_tree_get_path(struct loc_networ
 
 static int __loc_network_tree_walk(struct loc_ctx* ctx, struct loc_network_tree_node* node,
 		int(*filter_callback)(struct loc_network* network, void* data),
-		int(*callback)(struct loc_network* network, void* data), void* data) {
+		int(*callback)(struct loc_network* network, void* data), void* data, int flags) {
 	int r;
 
 	// If the node has been deleted, don't process it
 	if (loc_network_tree_node_has_flag(node, NETWORK_TREE_NODE_DELETED))
 		return 0;
 
+	// Skip shards if requested
+	if ((flags & LOC_NETWORK_TREE_WALK_SKIP_SHARDS)
+			&& loc_network_tree_node_has_flag(node, NETWORK_TREE_NODE_SHARD))
+		return 0;
+
 	// Finding a network ends the walk here
 	if (node->network) {
 		if (filter_callback) {
@@ -142,16 +190,21 @@ static int __loc_network_tree_walk(struct loc_ctx* ctx, struct loc_network_tree_
 			return r;
 	}
 
+	// Don't walk any further into a shard if requested
+	if ((flags & LOC_NETWORK_TREE_WALK_STOP_AT_SHARDS)
+			&& loc_network_tree_node_has_flag(node, NETWORK_TREE_NODE_SHARD))
+		return 0;
+
 	// Walk down on the left side of the tree first
 	if (node->zero) {
-		r = __loc_network_tree_walk(ctx, node->zero, filter_callback, callback, data);
+		r = __loc_network_tree_walk(ctx, node->zero, filter_callback, callback, data, flags);
 		if (r)
 			return r;
 	}
 
 	// Then walk on the other side
 	if (node->one) {
-		r = __loc_network_tree_walk(ctx, node->one, filter_callback, callback, data);
+		r = __loc_network_tree_walk(ctx, node->one, filter_callback, callback, data, flags);
 		if (r)
 			return r;
 	}
@@ -162,7 +215,7 @@ static int __loc_network_tree_walk(struct loc_ctx* ctx, struct loc_network_tree_
 int loc_network_tree_walk(struct loc_network_tree* tree,
 		int(*filter_callback)(struct loc_network* network, void* data),
 		int(*callback)(struct loc_network* network, void* data), void* data) {
-	return __loc_network_tree_walk(tree->ctx, tree->root, filter_callback, callback, data);
+	return __loc_network_tree_walk(tree->ctx, tree->root, filter_callback, callback, data, 0);
 }
 
 static void loc_network_tree_free(struct loc_network_tree* tree) {
@@ -202,13 +255,14 @@ int loc_network_tree_dump(struct loc_network_tree* tree) {
 	return loc_network_tree_walk(tree, NULL, __loc_network_tree_dump, tree->ctx);
 }
 
-int loc_network_tree_add_network(struct loc_network_tree* tree, struct loc_network* network) {
+static int __loc_network_tree_add_network(struct loc_network_tree* tree,
+		struct loc_network_tree_node* root, unsigned int depth, struct loc_network* network) {
 	DEBUG(tree->ctx, "Adding network %p to tree %p\n", network, tree);
 
 	const struct in6_addr* first_address = loc_network_get_first_address(network);
 	const unsigned int prefix = loc_network_raw_prefix(network);
 
-	struct loc_network_tree_node* node = loc_network_tree_get_path(tree, first_address, prefix);
+	struct loc_network_tree_node* node = loc_network_tree_get_path(root, depth, first_address, prefix);
 	if (!node) {
 		ERROR(tree->ctx, "Could not find a node\n");
 		return -ENOMEM;
@@ -227,16 +281,20 @@ int loc_network_tree_add_network(struct loc_network_tree* tree, struct loc_netwo
 	return 0;
 }
 
-static int loc_network_tree_delete_network(
-		struct loc_network_tree* tree, struct loc_network* network) {
+int loc_network_tree_add_network(struct loc_network_tree* tree, struct loc_network* network) {
+	return __loc_network_tree_add_network(tree, tree->root, 0, network);
+}
+
+static int loc_network_tree_delete_network(struct loc_network_tree* tree,
+		struct loc_network_tree_node* root, unsigned int depth, struct loc_network* network) {
 	struct loc_network_tree_node* node = NULL;
 
 	DEBUG(tree->ctx, "Deleting network %s from tree...\n", loc_network_str(network));
 
 	const struct in6_addr* first_address = loc_network_get_first_address(network);
-		const unsigned int prefix = loc_network_raw_prefix(network);
+	const unsigned int prefix = loc_network_raw_prefix(network);
 
-	node = loc_network_tree_get_path(tree, first_address, prefix);
+	node = loc_network_tree_get_path(root, depth, first_address, prefix);
 	if (!node) {
 		ERROR(tree->ctx, "Network was not found in tree %s\n", loc_network_str(network));
 		return 1;
@@ -275,6 +333,29 @@ size_t loc_network_tree_count_nodes(struct loc_network_tree* tree) {
 	return __loc_network_tree_count_nodes(tree->root);
 }
 
+static size_t __loc_network_tree_count_networks(struct loc_network_tree_node* node) {
+	size_t counter = 0;
+
+	// Don't count deleted nodes
+	if (loc_network_tree_node_has_flag(node, NETWORK_TREE_NODE_DELETED))
+		return 0;
+
+	if (node->network)
+		counter++;
+
+	if (node->zero)
+		counter += __loc_network_tree_count_networks(node->zero);
+
+	if (node->one)
+		counter += __loc_network_tree_count_networks(node->one);
+
+	return counter;
+}
+
+size_t loc_network_tree_count_networks(struct loc_network_tree* tree) {
+	return __loc_network_tree_count_networks(tree->root);
+}
+
 int loc_network_tree_node_new(struct loc_ctx* ctx, struct loc_network_tree_node** node) {
 	struct loc_network_tree_node* n = calloc(1, sizeof(*n));
 	if (!n)
@@ -349,6 +430,10 @@ struct loc_network_tree_merge_ctx {
 	struct loc_network_tree* tree;
 	struct loc_network_list* networks;
 	unsigned int merged;
+
+	// The part of the tree we are working on
+	struct loc_network_tree_node* root;
+	unsigned int depth;
 };
 
 static int loc_network_tree_merge_step(struct loc_network* network, void* data) {
@@ -357,6 +442,9 @@ static int loc_network_tree_merge_step(struct loc_network* network, void* data)
 	struct loc_network* m = NULL;
 	int r;
 
+	// Fetch the prefix now because network might be freed after it has been merged
+	const unsigned int prefix = loc_network_prefix(network);
+
 	// How many networks do we have?
 	size_t i = loc_network_list_size(ctx->networks);
 
@@ -379,7 +467,7 @@ static int loc_network_tree_merge_step(struct loc_network* network, void* data)
 				loc_network_str(n), loc_network_str(network), loc_network_str(m));
 
 			// Add the new network
-			r = loc_network_tree_add_network(ctx->tree, m);
+			r = __loc_network_tree_add_network(ctx->tree, ctx->root, ctx->depth, m);
 			switch (r) {
 				case 0:
 					break;
@@ -394,11 +482,11 @@ static int loc_network_tree_merge_step(struct loc_network* network, void* data)
 			}
 
 			// Remove the merge networks
-			r = loc_network_tree_delete_network(ctx->tree, network);
+			r = loc_network_tree_delete_network(ctx->tree, ctx->root, ctx->depth, network);
 			if (r)
 				goto ERROR;
 
-			r = loc_network_tree_delete_network(ctx->tree, n);
+			r = loc_network_tree_delete_network(ctx->tree, ctx->root, ctx->depth, n);
 			if (r)
 				goto ERROR;
 
@@ -437,8 +525,6 @@ static int loc_network_tree_merge_step(struct loc_network* network, void* data)
 		n = NULL;
 	}
 
-	const unsigned int prefix = loc_network_prefix(network);
-
 	// Remove any networks that we cannot merge
 	loc_network_list_remove_with_prefix_smaller_than(ctx->networks, prefix);
 
@@ -451,11 +537,14 @@ ERROR:
 	return r;
 }
 
-static int loc_network_tree_merge(struct loc_network_tree* tree) {
+static int loc_network_tree_merge(struct loc_network_tree* tree,
+		struct loc_network_tree_node* root, unsigned int depth, int flags, unsigned int* merged) {
 	struct loc_network_tree_merge_ctx ctx = {
 		.tree     = tree,
 		.networks = NULL,
 		.merged   = 0,
+		.root     = root,
+		.depth    = depth,
 	};
 	unsigned int total_merged = 0;
 	int r;
@@ -473,7 +562,8 @@ static int loc_network_tree_merge(struct loc_network_tree* tree) {
 		ctx.merged = 0;
 
 		// Walk through the entire tree
-		r = loc_network_tree_walk(tree, NULL, loc_network_tree_merge_step, &ctx);
+		r = __loc_network_tree_walk(tree->ctx, root, NULL,
+			loc_network_tree_merge_step, &ctx, flags);
 		if (r)
 			goto ERROR;
 
@@ -483,6 +573,9 @@ static int loc_network_tree_merge(struct loc_network_tree* tree) {
 
 	DEBUG(tree->ctx, "%u network(s) have been merged\n", total_merged);
 
+	if (merged)
+		*merged = total_merged;
+
 ERROR:
 	if (ctx.networks)
 		loc_network_list_unref(ctx.networks);
@@ -499,6 +592,10 @@ struct loc_network_tree_dedup_ctx {
 	struct loc_network_list* stack;
 	unsigned int* removed;
 	int family;
+
+	// The part of the tree we are working on
+	struct loc_network_tree_node* root;
+	unsigned int depth;
 };
 
 static int loc_network_tree_dedup_step(struct loc_network* network, void* data) {
@@ -514,7 +611,7 @@ static int loc_network_tree_dedup_step(struct loc_network* network, void* data)
 		if (loc_network_is_subnet(n, network)) {
 			// Do all properties match?
 			if (loc_network_properties_cmp(n, network) == 0) {
-				r = loc_network_tree_delete_network(ctx->tree, network);
+				r = loc_network_tree_delete_network(ctx->tree, ctx->root, ctx->depth, network);
 				if (r)
 					goto END;
 
@@ -558,13 +655,21 @@ static int loc_network_tree_dedup_filter(struct loc_network* network, void* data
 	return ctx->family == loc_network_address_family(network);
 }
 
+/*
+	Removes all subnets of the given family that have the same properties as their
+	parent network. The parent of the first network can be passed as ancestor if
+	the walk does not start at the root of the tree.
+*/
 static int loc_network_tree_dedup_one(struct loc_network_tree* tree,
-		const int family, unsigned int* removed) {
+		struct loc_network_tree_node* root, unsigned int depth, int flags,
+		struct loc_network* ancestor, const int family, unsigned int* removed) {
 	struct loc_network_tree_dedup_ctx ctx = {
 		.tree    = tree,
 		.stack   = NULL,
 		.removed = removed,
 		.family  = family,
+		.root    = root,
+		.depth   = depth,
 	};
 	int r;
 
@@ -572,9 +677,16 @@ static int loc_network_tree_dedup_one(struct loc_network_tree* tree,
 	if (r)
 		return r;
 
+	// Start with the ancestor
+	if (ancestor) {
+		r = loc_network_list_push(ctx.stack, ancestor);
+		if (r)
+			goto ERROR;
+	}
+
 	// Walk through the entire tree
-	r = loc_network_tree_walk(tree,
-		loc_network_tree_dedup_filter, loc_network_tree_dedup_step, &ctx);
+	r = __loc_network_tree_walk(tree->ctx, root,
+		loc_network_tree_dedup_filter, loc_network_tree_dedup_step, &ctx, flags);
 	if (r)
 		goto ERROR;
 
@@ -585,25 +697,8 @@ ERROR:
 	return r;
 }
 
-static int loc_network_tree_dedup(struct loc_network_tree* tree) {
-	unsigned int removed = 0;
-	int r;
-
-	r = loc_network_tree_dedup_one(tree, AF_INET6, &removed);
-	if (r)
-		return r;
-
-	r = loc_network_tree_dedup_one(tree, AF_INET, &removed);
-	if (r)
-		return r;
-
-	DEBUG(tree->ctx, "%u network(s) have been removed\n", removed);
-
-	return 0;
-}
-
 static int loc_network_tree_delete_node(struct loc_network_tree* tree,
-		struct loc_network_tree_node** node) {
+		struct loc_network_tree_node** node, int flags) {
 	struct loc_network_tree_node* n = *node;
 	int r0 = 1;
 	int r1 = 1;
@@ -614,14 +709,23 @@ static int loc_network_tree_delete_node(struct loc_network_tree* tree,
 
 	// Delete zero
 	if (n->zero) {
-		r0 = loc_network_tree_delete_node(tree, &n->zero);
+		// Shards have been cleaned up before and are still needed
+		if ((flags & LOC_NETWORK_TREE_WALK_SKIP_SHARDS)
+				&& loc_network_tree_node_has_flag(n->zero, NETWORK_TREE_NODE_SHARD))
+			r0 = 0;
+		else
+			r0 = loc_network_tree_delete_node(tree, &n->zero, flags);
 		if (r0 < 0)
 			return r0;
 	}
 
 	// Delete one
 	if (n->one) {
-		r1 = loc_network_tree_delete_node(tree, &n->one);
+		if ((flags & LOC_NETWORK_TREE_WALK_SKIP_SHARDS)
+				&& loc_network_tree_node_has_flag(n->one, NETWORK_TREE_NODE_SHARD))
+			r1 = 0;
+		else
+			r1 = loc_network_tree_delete_node(tree, &n->one, flags);
 		if (r1 < 0)
 			return r1;
 	}
@@ -646,35 +750,716 @@ DELETE:
 	return 1;
 }
 
-static int loc_network_tree_delete_nodes(struct loc_network_tree* tree) {
+static int loc_network_tree_delete_nodes(struct loc_network_tree* tree, int flags) {
+	int r;
+
+	r = loc_network_tree_delete_node(tree, &tree->root, flags);
+	if (r < 0)
+		return r;
+
+	return 0;
+}
+
+/*
+	Shards
+*/
+
+struct loc_network_tree_shards {
+	struct loc_network_tree* tree;
+
+	struct loc_network_tree_shard* shards;
+	size_t num_shards;
+	size_t size;
+};
+
+static int loc_network_tree_is_shard(const struct in6_addr* address, unsigned int depth) {
+	const struct in6_addr v4mapped = {
+		.s6_addr = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 0, 0, 0, 0 },
+	};
+
+	// IPv6 is split at /16
+	if (depth < LOC_NETWORK_TREE_SHARD_DEPTH6)
+		return 0;
+
+	// Anything that is not on the path to ::ffff:0:0/96 is an IPv6 shard
+	for (unsigned int i = 0; i < depth && i < 96; i++) {
+		if (loc_address_get_bit(address, i) != loc_address_get_bit(&v4mapped, i))
+			return 1;
+	}
+
+	// IPv4 is split at /8
+	return (depth >= LOC_NETWORK_TREE_SHARD_DEPTH4);
+}
+
+static int loc_network_tree_add_shard(struct loc_network_tree_shards* shards,
+		struct loc_network_tree_node** node, const struct in6_addr* address, unsigned int depth) {
+	struct loc_network_tree_shard* s = NULL;
+
+	// Make space
+	if (shards->num_shards >= shards->size) {
+		size_t size = (shards->size) ? shards->size * 2 : 1024;
+
+		s = reallocarray(shards->shards, size, sizeof(*shards->shards));
+		if (!s)
+			return -ENOMEM;
+
+		shards->shards = s;
+		shards->size = size;
+	}
+
+	s = &shards->shards[shards->num_shards++];
+
+	*s = (struct loc_network_tree_shard){
+		.node    = node,
+		.address = *address,
+		.depth   = depth,
+	};
+
+	// Mark the node
+	(*node)->flags |= NETWORK_TREE_NODE_SHARD;
+
+	return 0;
+}
+
+static int __loc_network_tree_find_shards(struct loc_network_tree_shards* shards,
+		struct loc_network_tree_node** node, struct in6_addr* address, unsigned int depth) {
+	int r;
+
+	// Is this the root of a shard?
+	if (loc_network_tree_is_shard(address, depth))
+		return loc_network_tree_add_shard(shards, node, address, depth);
+
+	// Otherwise walk further down the tree
+	if ((*node)->zero) {
+		loc_address_set_bit(address, depth, 0);
+
+		r = __loc_network_tree_find_shards(shards, &(*node)->zero, address, depth + 1);
+		if (r)
+			return r;
+	}
+
+	if ((*node)->one) {
+		loc_address_set_bit(address, depth, 1);
+
+		r = __loc_network_tree_find_shards(shards, &(*node)->one, address, depth + 1);
+		if (r)
+			return r;
+
+		loc_address_set_bit(address, depth, 0);
+	}
+
+	return 0;
+}
+
+static int loc_network_tree_find_shards(struct loc_network_tree* tree,
+		struct loc_network_tree_shards* shards) {
+	struct in6_addr address = IN6ADDR_ANY_INIT;
+
+	return __loc_network_tree_find_shards(shards, &tree->root, &address, 0);
+}
+
+static void loc_network_tree_free_shards(struct loc_network_tree_shards* shards) {
+	// Remove the mark from all remaining shards
+	for (unsigned int i = 0; i < shards->num_shards; i++) {
+		if (*shards->shards[i].node)
+			(*shards->shards[i].node)->flags &= ~NETWORK_TREE_NODE_SHARD;
+	}
+
+	if (shards->shards)
+		free(shards->shards);
+}
+
+/*
+	Follows the path down to the shard and records what the walk of the given
+	deduplication pass would have on its stack when it arrives at the shard.
+*/
+static void loc_network_tree_shard_dedup_prepare(struct loc_network_tree* tree,
+		struct loc_network_tree_shard* shard, unsigned int pass) {
+	struct loc_network_tree_shard_dedup* dedup = &shard->dedup[pass];
+	struct loc_network_tree_node* node = tree->root;
+
+	struct loc_network_tree_dedup_ctx ctx = {
+		.tree   = tree,
+		.family = loc_network_tree_dedup_families[pass],
+	};
+
+	dedup->ancestor = NULL;
+	dedup->skip = 0;
+
+	for (unsigned int i = 0; i < shard->depth; i++) {
+		if (!node || loc_network_tree_node_has_flag(node, NETWORK_TREE_NODE_DELETED)) {
+			dedup->skip = 1;
+			return;
+		}
+
+		if (node->network) {
+			// The walk does not continue below any filtered networks
+			if (loc_network_tree_dedup_filter(node->network, &ctx)) {
+				dedup->skip = 1;
+				return;
+			}
+
+			dedup->ancestor = node->network;
+		}
+
+		if (loc_address_get_bit(&shard->address, i))
+			node = node->one;
+		else
+			node = node->zero;
+	}
+}
+
+/*
+	Deduplicates everything above the shards and prepares the shards
+*/
+static int loc_network_tree_dedup(struct loc_network_tree* tree,
+		struct loc_network_tree_shards* shards) {
+	unsigned int removed = 0;
 	int r;
 
-	r = loc_network_tree_delete_node(tree, &tree->root);
+	for (unsigned int pass = 0; pass < 2; pass++) {
+		r = loc_network_tree_dedup_one(tree, tree->root, 0, LOC_NETWORK_TREE_WALK_SKIP_SHARDS,
+			NULL, loc_network_tree_dedup_families[pass], &removed);
+		if (r)
+			return r;
+
+		for (unsigned int i = 0; i < shards->num_shards; i++)
+			loc_network_tree_shard_dedup_prepare(tree, &shards->shards[i], pass);
+	}
+
+	DEBUG(tree->ctx, "%u network(s) have been removed\n", removed);
+
+	return 0;
+}
+
+static int loc_network_tree_cleanup_shard(struct loc_network_tree* tree,
+		struct loc_network_tree_shard* shard) {
+	int r;
+
+	// Deduplicate
+	for (unsigned int pass = 0; pass < 2; pass++) {
+		if (shard->dedup[pass].skip)
+			continue;
+
+		r = loc_network_tree_dedup_one(tree, *shard->node, shard->depth, 0,
+			shard->dedup[pass].ancestor, loc_network_tree_dedup_families[pass], &shard->removed);
+		if (r)
+			return r;
+	}
+
+	// Merge
+	return loc_network_tree_merge(tree, *shard->node, shard->depth, 0, NULL);
+}
+
+static int loc_network_tree_merge_shard(struct loc_network_tree* tree,
+		struct loc_network_tree_shard* shard) {
+	// Skip any shards that have been deleted
+	if (!*shard->node)
+		return 0;
+
+	return loc_network_tree_merge(tree, *shard->node, shard->depth, 0, NULL);
+}
+
+static int loc_network_tree_delete_shard(struct loc_network_tree* tree,
+		struct loc_network_tree_shard* shard) {
+	int r;
+
+	r = loc_network_tree_delete_node(tree, shard->node, 0);
 	if (r < 0)
 		return r;
 
 	return 0;
 }
 
-int loc_network_tree_cleanup(struct loc_network_tree* tree) {
+struct loc_network_tree_shards_job {
+	struct loc_network_tree_shards* shards;
+
+	int (*callback)(struct loc_network_tree* tree, struct loc_network_tree_shard* shard);
+};
+
+static int loc_network_tree_process_shard(void* data, size_t i) {
+	struct loc_network_tree_shards_job* job = data;
+
+	return job->callback(job->shards->tree, &job->shards->shards[i]);
+}
+
+/*
+	Calls callback for each shard using the given number of threads
+*/
+static int loc_network_tree_process_shards(struct loc_network_tree_shards* shards,
+		unsigned int threads, int (*callback)(struct loc_network_tree* tree,
+			struct loc_network_tree_shard* shard)) {
+	struct loc_network_tree_shards_job job = {
+		.shards   = shards,
+		.callback = callback,
+	};
+
+	return loc_run_parallel(shards->tree->ctx, threads, shards->num_shards,
+		loc_network_tree_process_shard, &job);
+}
+
+int loc_network_tree_cleanup(struct loc_network_tree* tree, unsigned int threads) {
+	struct loc_network_tree_shards shards = {
+		.tree = tree,
+	};
+	unsigned int merged = 0;
 	int r;
 
-	// Deduplicate the tree
-	r = loc_network_tree_dedup(tree);
+	// Split the tree into shards
+	r = loc_network_tree_find_shards(tree, &shards);
 	if (r)
-		return r;
+		goto ERROR;
 
-	// Merge networks
-	r = loc_network_tree_merge(tree);
+	DEBUG(tree->ctx, "Cleaning up %zu shard(s) using %u thread(s)\n",
+		shards.num_shards, threads);
+
+	// Deduplicate everything above the shards
+	r = loc_network_tree_dedup(tree, &shards);
+	if (r)
+		goto ERROR;
+
+	// Deduplicate and merge all shards
+	r = loc_network_tree_process_shards(&shards, threads, loc_network_tree_cleanup_shard);
 	if (r) {
-		ERROR(tree->ctx, "Could not merge networks: %m\n");
-		return r;
+		ERROR(tree->ctx, "Could not clean up networks: %m\n");
+		goto ERROR;
+	}
+
+	for (;;) {
+		// Merge everything above the shards
+		r = loc_network_tree_merge(tree, tree->root, 0,
+			LOC_NETWORK_TREE_WALK_STOP_AT_SHARDS, &merged);
+		if (r) {
+			ERROR(tree->ctx, "Could not merge networks: %m\n");
+			goto ERROR;
+		}
+
+		// We are done if nothing has changed
+		if (!merged)
+			break;
+
+		// Merges above might have freed the roots of some shards
+		r = loc_network_tree_process_shards(&shards, threads, loc_network_tree_merge_shard);
+		if (r) {
+			ERROR(tree->ctx, "Could not merge networks: %m\n");
+			goto ERROR;
+		}
 	}
 
 	// Delete any unneeded nodes
-	r = loc_network_tree_delete_nodes(tree);
+	r = loc_network_tree_process_shards(&shards, threads, loc_network_tree_delete_shard);
 	if (r)
-		return r;
+		goto ERROR;
+
+	r = loc_network_tree_delete_nodes(tree, LOC_NETWORK_TREE_WALK_SKIP_SHARDS);
+	if (r)
+		goto ERROR;
+
+ERROR:
+	loc_network_tree_free_shards(&shards);
+
+	return r;
+}
+
+/*
+	Aggregation
+
+	This rewrites the tree into the smallest set of networks that returns the same
+	properties for every single address. It follows the Optimal Routing Table
+	Constructor (ORTC) which walks the tree twice:
+
+	First, we walk bottom-up and collect the set of properties that a network at
+	each node could have. For leaves, this is whatever a lookup would find. For
+	any other node, this is the intersection of the sets of both children, or
+	their union if the intersection is empty.
+
+	Second, we walk top-down and only add a network to the new tree if the
+	properties inherited from above are not in the set of the node.
+
+	A network cannot express that nothing should be found, so no network may be
+	placed above any space that has no network. Networks may also not be placed
+	above ::ffff:0:0/96 because they would cover IPv4 and IPv6 at the same time.
+*/
+
+struct loc_network_tree_aggregate_node {
+	struct loc_network_tree_aggregate_node* children[2];
+
+	// What a lookup would find at this node in the original tree
+	struct loc_network* network;
+
+	// The set of possible properties sorted by loc_network_properties_cmp()
+	// where NULL stands for no network at all and always comes first
+	struct loc_network** set;
+	size_t length;
+};
+
+static int loc_network_tree_aggregate_cmp(struct loc_network* n1, struct loc_network* n2) {
+	if (n1 == n2)
+		return 0;
+
+	// NULL comes first
+	if (!n1)
+		return -1;
+	else if (!n2)
+		return 1;
+
+	return loc_network_properties_cmp(n1, n2);
+}
+
+static int loc_network_tree_aggregate_set_contains(
+		struct loc_network** set, size_t length, struct loc_network* network) {
+	for (unsigned int i = 0; i < length; i++) {
+		if (loc_network_tree_aggregate_cmp(set[i], network) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+	Computes the intersection of both sets or their union if the intersection is empty
+*/
+static int loc_network_tree_aggregate_set_combine(struct loc_network_tree_aggregate_node* node,
+		struct loc_network** set1, size_t length1, struct loc_network** set2, size_t length2) {
+	size_t i1 = 0;
+	size_t i2 = 0;
+	int r;
+
+	// Allocate enough space for the union
+	node->set = calloc(length1 + length2, sizeof(*node->set));
+	if (!node->set)
+		return -ENOMEM;
+
+	node->length = 0;
+
+	// Intersection
+	while (i1 < length1 && i2 < length2) {
+		r = loc_network_tree_aggregate_cmp(set1[i1], set2[i2]);
+
+		if (r < 0) {
+			i1++;
+		} else if (r > 0) {
+			i2++;
+		} else {
+			node->set[node->length++] = set1[i1++];
+			i2++;
+		}
+	}
+
+	if (node->length)
+		return 0;
+
+	// Union
+	i1 = i2 = 0;
+
+	while (i1 < length1 || i2 < length2) {
+		if (i1 == length1)
+			r = 1;
+		else if (i2 == length2)
+			r = -1;
+		else
+			r = loc_network_tree_aggregate_cmp(set1[i1], set2[i2]);
+
+		if (r < 0) {
+			node->set[node->length++] = set1[i1++];
+		} else if (r > 0) {
+			node->set[node->length++] = set2[i2++];
+		} else {
+			node->set[node->length++] = set1[i1++];
+			i2++;
+		}
+	}
 
 	return 0;
 }
+
+static void loc_network_tree_aggregate_node_free(struct loc_network_tree_aggregate_node* node) {
+	for (unsigned int i = 0; i < 2; i++) {
+		if (node->children[i])
+			loc_network_tree_aggregate_node_free(node->children[i]);
+	}
+
+	if (node->set)
+		free(node->set);
+
+	free(node);
+}
+
+/*
+	Returns true if the node is above ::ffff:0:0/96
+*/
+static int loc_network_tree_aggregate_covers_ipv4(const struct in6_addr* address, unsigned int depth) {
+	const struct in6_addr v4mapped = {
+		.s6_addr = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 0, 0, 0, 0 },
+	};
+
+	if (depth >= 96)
+		return 0;
+
+	for (unsigned int i = 0; i < depth; i++) {
+		if (loc_address_get_bit(address, i) != loc_address_get_bit(&v4mapped, i))
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+	The bottom-up pass
+*/
+static int loc_network_tree_aggregate_collect(struct loc_network_tree_node* node,
+		struct loc_network* inherited, struct in6_addr* address, unsigned int depth,
+		struct loc_network_tree_aggregate_node** result) {
+	struct loc_network_tree_aggregate_node* n = NULL;
+	struct loc_network_tree_node* child = NULL;
+	struct loc_network** sets[2];
+	size_t lengths[2];
+	int r;
+
+	n = calloc(1, sizeof(*n));
+	if (!n)
+		return -ENOMEM;
+
+	// What would a lookup find here?
+	n->network = (node->network) ? node->network : inherited;
+
+	for (unsigned int i = 0; i < 2; i++) {
+		child = (i) ? node->one : node->zero;
+
+		// Ignore any deleted nodes
+		if (child && loc_network_tree_node_has_flag(child, NETWORK_TREE_NODE_DELETED))
+			child = NULL;
+
+		if (child) {
+			loc_address_set_bit(address, depth, i);
+
+			r = loc_network_tree_aggregate_collect(child, n->network,
+				address, depth + 1, &n->children[i]);
+
+			loc_address_set_bit(address, depth, 0);
+
+			if (r)
+				goto ERROR;
+
+			sets[i]    = n->children[i]->set;
+			lengths[i] = n->children[i]->length;
+
+		// Any missing children inherit from this node
+		} else {
+			sets[i]    = &n->network;
+			lengths[i] = 1;
+		}
+	}
+
+	// Leaves can only be what they are
+	if (!n->children[0] && !n->children[1]) {
+		r = loc_network_tree_aggregate_set_combine(n, &n->network, 1, NULL, 0);
+
+	// Nodes above IPv4 or above any empty space cannot have a network
+	} else if (loc_network_tree_aggregate_covers_ipv4(address, depth)
+			|| loc_network_tree_aggregate_set_contains(sets[0], lengths[0], NULL)
+			|| loc_network_tree_aggregate_set_contains(sets[1], lengths[1], NULL)) {
+		r = loc_network_tree_aggregate_set_combine(n, &n->network, 1, NULL, 0);
+
+	} else {
+		r = loc_network_tree_aggregate_set_combine(n, sets[0], lengths[0], sets[1], lengths[1]);
+	}
+
+	if (r)
+		goto ERROR;
+
+	*result = n;
+	return 0;
+
+ERROR:
+	loc_network_tree_aggregate_node_free(n);
+
+	return r;
+}
+
+/*
+	The top-down pass
+*/
+static int loc_network_tree_aggregate_select(struct loc_network_tree* tree,
+		struct loc_network_tree_aggregate_node* node, struct loc_network* parent,
+		struct loc_network* inherited, struct in6_addr* address, unsigned int depth) {
+	struct loc_network* network = NULL;
+	struct loc_network** set = NULL;
+	size_t length = 0;
+	unsigned int prefix = depth;
+	int r;
+
+	// Nodes that did not exist in the original tree inherit from their parent
+	if (node) {
+		set    = node->set;
+		length = node->length;
+	} else {
+		set    = &parent;
+		length = 1;
+	}
+
+	if (IN6_IS_ADDR_V4MAPPED(address) && depth >= 96)
+		prefix -= 96;
+
+	// We need a new network if we cannot inherit from above
+	if (!loc_network_tree_aggregate_set_contains(set, length, inherited)) {
+		inherited = set[0];
+
+		// We cannot add a network that does not exist
+		if (!inherited) {
+			ERROR(tree->ctx, "Cannot aggregate %s/%u\n", loc_address_str(address), prefix);
+			return -EINVAL;
+		}
+
+		r = loc_network_new(tree->ctx, &network, address, prefix);
+		if (r)
+			return r;
+
+		// Copy all properties
+		r = loc_network_copy_properties(network, inherited);
+		if (r)
+			goto ERROR;
+
+		r = loc_network_tree_add_network(tree, network);
+		if (r)
+			goto ERROR;
+
+		loc_network_unref(network);
+		network = NULL;
+	}
+
+	if (!node)
+		return 0;
+
+	// Walk through both sides if this node had any children
+	if (node->children[0] || node->children[1]) {
+		for (unsigned int i = 0; i < 2; i++) {
+			loc_address_set_bit(address, depth, i);
+
+			r = loc_network_tree_aggregate_select(tree, node->children[i],
+				node->network, inherited, address, depth + 1);
+
+			loc_address_set_bit(address, depth, 0);
+
+			if (r)
+				return r;
+		}
+	}
+
+	return 0;
+
+ERROR:
+	if (network)
+		loc_network_unref(network);
+
+	return r;
+}
+
+int loc_network_tree_aggregate(struct loc_network_tree* tree, struct loc_network_tree** aggregated) {
+	struct loc_network_tree_aggregate_node* root = NULL;
+	struct loc_network_tree* t = NULL;
+	struct in6_addr address = IN6ADDR_ANY_INIT;
+	int r;
+
+	// Collect all sets
+	r = loc_network_tree_aggregate_collect(tree->root, NULL, &address, 0, &root);
+	if (r)
+		goto ERROR;
+
+	// Create a new tree
+	r = loc_network_tree_new(tree->ctx, &t);
+	if (r)
+		goto ERROR;
+
+	// Fill the new tree
+	r = loc_network_tree_aggregate_select(t, root, NULL, NULL, &address, 0);
+	if (r)
+		goto ERROR;
+
+	DEBUG(tree->ctx, "Aggregated %zu node(s) into %zu node(s)\n",
+		loc_network_tree_count_nodes(tree), loc_network_tree_count_nodes(t));
+
+	*aggregated = t;
+	t = NULL;
+
+ERROR:
+	if (root)
+		loc_network_tree_aggregate_node_free(root);
+	if (t)
+		loc_network_tree_unref(t);
+
+	return r;
+}
+
+/*
+	Verification
+
+	Walks through both trees at the same time and compares the results of a lookup
+	for every part of the address space.
+*/
+static int __loc_network_tree_cmp_lookups(struct loc_network_tree* tree,
+		struct loc_network_tree_node* node1, struct loc_network* network1,
+		struct loc_network_tree_node* node2, struct loc_network* network2,
+		struct in6_addr* address, unsigned int depth) {
+	struct loc_network_tree_node* children1[2] = { NULL, NULL };
+	struct loc_network_tree_node* children2[2] = { NULL, NULL };
+	int leaf = 1;
+	int r = 0;
+
+	// Ignore any deleted nodes
+	if (node1 && loc_network_tree_node_has_flag(node1, NETWORK_TREE_NODE_DELETED))
+		node1 = NULL;
+
+	if (node2 && loc_network_tree_node_has_flag(node2, NETWORK_TREE_NODE_DELETED))
+		node2 = NULL;
+
+	// Update what a lookup would find
+	if (node1 && node1->network)
+		network1 = node1->network;
+
+	if (node2 && node2->network)
+		network2 = node2->network;
+
+	for (unsigned int i = 0; i < 2; i++) {
+		if (node1)
+			children1[i] = (i) ? node1->one : node1->zero;
+
+		if (node2)
+			children2[i] = (i) ? node2->one : node2->zero;
+
+		if (children1[i] || children2[i])
+			leaf = 0;
+	}
+
+	// Compare the results once there is nothing more specific in either tree
+	if (leaf) {
+		r = loc_network_tree_aggregate_cmp(network1, network2);
+		if (r) {
+			ERROR(tree->ctx, "Lookups for %s/%u differ\n", loc_address_str(address),
+				(IN6_IS_ADDR_V4MAPPED(address) && depth >= 96) ? depth - 96 : depth);
+			return 1;
+		}
+
+		return 0;
+	}
+
+	for (unsigned int i = 0; i < 2; i++) {
+		loc_address_set_bit(address, depth, i);
+
+		r = __loc_network_tree_cmp_lookups(tree, children1[i], network1,
+			children2[i], network2, address, depth + 1);
+
+		loc_address_set_bit(address, depth, 0);
+
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
+int loc_network_tree_cmp_lookups(struct loc_network_tree* tree, struct loc_network_tree* other) {
+	struct in6_addr address = IN6ADDR_ANY_INIT;
+
+	return __loc_network_tree_cmp_lookups(tree, tree->root, NULL, other->root, NULL, &address, 0);
+}
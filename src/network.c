@@ -37,7 +37,6 @@ struct loc_network {
 	struct loc_ctx* ctx;
 	int refcount;
 
-	int family;
 	struct in6_addr first_address;
 	struct in6_addr last_address;
 	unsigned int prefix;
@@ -46,7 +45,8 @@ struct loc_network {
 	uint32_t asn;
 	enum loc_network_flags flags;
 
-	char string[INET6_ADDRSTRLEN + 4];
+	// The formatted network (only allocated when needed)
+	char* string;
 };
 
 LOC_EXPORT int loc_network_new(struct loc_ctx* ctx, struct loc_network** network,
@@ -81,9 +81,6 @@ LOC_EXPORT int loc_network_new(struct loc_ctx* ctx, struct loc_network** network
 	n->first_address = loc_address_and(address, &bitmask);
 	n->last_address  = loc_address_or(&n->first_address, &bitmask);
 
-	// Set family
-	n->family = loc_address_family(&n->first_address);
-
 	DEBUG(n->ctx, "Network allocated at %p\n", n);
 	*network = n;
 	return 0;
@@ -106,7 +103,7 @@ LOC_EXPORT int loc_network_new_from_string(struct loc_ctx* ctx,
 }
 
 LOC_EXPORT struct loc_network* loc_network_ref(struct loc_network* network) {
-	network->refcount++;
+	__atomic_add_fetch(&network->refcount, 1, __ATOMIC_RELAXED);
 
 	return network;
 }
@@ -114,12 +111,15 @@ LOC_EXPORT struct loc_network* loc_network_ref(struct loc_network* network) {
 static void loc_network_free(struct loc_network* network) {
 	DEBUG(network->ctx, "Releasing network at %p\n", network);
 
+	if (network->string)
+		free(network->string);
+
 	loc_unref(network->ctx);
 	free(network);
 }
 
 LOC_EXPORT struct loc_network* loc_network_unref(struct loc_network* network) {
-	if (--network->refcount > 0)
+	if (__atomic_sub_fetch(&network->refcount, 1, __ATOMIC_ACQ_REL) > 0)
 		return network;
 
 	loc_network_free(network);
@@ -127,34 +127,46 @@ LOC_EXPORT struct loc_network* loc_network_unref(struct loc_network* network) {
 }
 
 LOC_EXPORT const char* loc_network_str(struct loc_network* network) {
-	if (!*network->string) {
-		// Format the address
-		const char* address = loc_address_str(&network->first_address);
-		if (!address)
-			return NULL;
+	struct loc_network_value value;
+	char* expected = NULL;
+	char* string = NULL;
+	int r;
 
-		// Fetch the prefix
-		unsigned int prefix = loc_network_prefix(network);
+	// Return the string if it has been formatted before
+	string = __atomic_load_n(&network->string, __ATOMIC_ACQUIRE);
+	if (string)
+		return string;
 
-		// Format the string
-		int r = snprintf(network->string, sizeof(network->string) - 1,
-			"%s/%u", address, prefix);
-		if (r < 0) {
-			ERROR(network->ctx, "Could not format network string: %m\n");
-			*network->string = '\0';
-			return NULL;
-		}
+	string = malloc(LOC_NETWORK_STRING_LENGTH);
+	if (!string)
+		return NULL;
+
+	loc_network_to_value(network, &value);
+
+	// Format the string
+	r = loc_network_value_format(&value, string, LOC_NETWORK_STRING_LENGTH);
+	if (r) {
+		ERROR(network->ctx, "Could not format network string: %m\n");
+		free(string);
+		return NULL;
+	}
+
+	// Publish the string unless another thread has been faster
+	if (!__atomic_compare_exchange_n(&network->string, &expected, string, 0,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		free(string);
+		return expected;
 	}
 
-	return network->string;
+	return string;
 }
 
 LOC_EXPORT int loc_network_address_family(struct loc_network* network) {
-	return network->family;
+	return loc_address_family(&network->first_address);
 }
 
 LOC_EXPORT unsigned int loc_network_prefix(struct loc_network* network) {
-	switch (network->family) {
+	switch (loc_network_address_family(network)) {
 		case AF_INET6:
 			return network->prefix;
 
@@ -249,6 +261,10 @@ LOC_EXPORT int loc_network_has_flag(struct loc_network* network, uint32_t flag)
 	return network->flags & flag;
 }
 
+LOC_EXPORT uint32_t loc_network_get_flags(struct loc_network* network) {
+	return network->flags;
+}
+
 LOC_EXPORT int loc_network_set_flag(struct loc_network* network, uint32_t flag) {
 	network->flags |= flag;
 
@@ -294,6 +310,38 @@ int loc_network_properties_cmp(struct loc_network* self, struct loc_network* oth
 	return 0;
 }
 
+int loc_network_value_properties_cmp(const struct loc_network_value* self,
+		const struct loc_network_value* other) {
+	int r;
+
+	// Check country code
+	r = loc_country_code_cmp(self->country_code, other->country_code);
+	if (r)
+		return r;
+
+	// Check ASN
+	if (self->asn > other->asn)
+		return 1;
+	else if (self->asn < other->asn)
+		return -1;
+
+	// Check flags
+	if (self->flags > other->flags)
+		return 1;
+	else if (self->flags < other->flags)
+		return -1;
+
+	return 0;
+}
+
+int loc_network_copy_properties(struct loc_network* self, struct loc_network* other) {
+	loc_country_code_copy(self->country_code, other->country_code);
+	self->asn = other->asn;
+	self->flags = other->flags;
+
+	return 0;
+}
+
 LOC_EXPORT int loc_network_overlaps(struct loc_network* self, struct loc_network* other) {
 	// Either of the start addresses must be in the other subnet
 	if (loc_network_matches_address(self, &other->first_address))
@@ -381,62 +429,6 @@ LOC_EXPORT int loc_network_subnets(struct loc_network* network,
 	return 0;
 }
 
-static int __loc_network_exclude(struct loc_network* network,
-		struct loc_network* other, struct loc_network_list* list) {
-	struct loc_network* subnet1 = NULL;
-	struct loc_network* subnet2 = NULL;
-
-	int r = loc_network_subnets(network, &subnet1, &subnet2);
-	if (r)
-		goto ERROR;
-
-	if (loc_network_cmp(other, subnet1) == 0) {
-		r = loc_network_list_push(list, subnet2);
-		if (r)
-			goto ERROR;
-
-	} else if (loc_network_cmp(other, subnet2) == 0) {
-		r = loc_network_list_push(list, subnet1);
-		if (r)
-			goto ERROR;
-
-	} else  if (loc_network_is_subnet(subnet1, other)) {
-		r = loc_network_list_push(list, subnet2);
-		if (r)
-			goto ERROR;
-
-		r = __loc_network_exclude(subnet1, other, list);
-		if (r)
-			goto ERROR;
-
-	} else if (loc_network_is_subnet(subnet2, other)) {
-		r = loc_network_list_push(list, subnet1);
-		if (r)
-			goto ERROR;
-
-		r = __loc_network_exclude(subnet2, other, list);
-		if (r)
-			goto ERROR;
-
-	} else {
-		ERROR(network->ctx, "We should never get here\n");
-		r = 1;
-		goto ERROR;
-	}
-
-ERROR:
-	if (subnet1)
-		loc_network_unref(subnet1);
-
-	if (subnet2)
-		loc_network_unref(subnet2);
-
-	if (r)
-		DEBUG(network->ctx, "%s has failed with %d\n", __FUNCTION__, r);
-
-	return r;
-}
-
 static int __loc_network_exclude_to_list(struct loc_network* self,
 		struct loc_network* other, struct loc_network_list* list) {
 	// Other must be a subnet of self
@@ -455,7 +447,12 @@ static int __loc_network_exclude_to_list(struct loc_network* self,
 		return 0;
 	}
 
-	return __loc_network_exclude(self, other, list);
+	const struct loc_network_range range = {
+		.first = other->first_address,
+		.last  = other->last_address,
+	};
+
+	return loc_network_list_append_excluded(list, self, &range, 1);
 }
 
 LOC_EXPORT struct loc_network_list* loc_network_exclude(
@@ -486,98 +483,50 @@ LOC_EXPORT struct loc_network_list* loc_network_exclude(
 
 LOC_EXPORT struct loc_network_list* loc_network_exclude_list(
 		struct loc_network* network, struct loc_network_list* list) {
-	struct loc_network_list* to_check;
+	struct loc_network_list* subnets = NULL;
+	struct loc_network_range* ranges = NULL;
+	struct loc_network* subnet = NULL;
+	size_t count = 0;
+	int overlaps = 0;
+	int r;
 
-	// Create a new list with all networks to look at
-	int r = loc_network_list_new(network->ctx, &to_check);
+	r = loc_network_list_new(network->ctx, &subnets);
 	if (r)
 		return NULL;
 
-	struct loc_network* subnet = NULL;
-	struct loc_network_list* subnets = NULL;
-
+	// Return an empty list if nothing overlaps with the network
 	for (unsigned int i = 0; i < loc_network_list_size(list); i++) {
 		subnet = loc_network_list_get(list, i);
 
-		// Find all excluded networks
-		if (!loc_network_list_contains(to_check, subnet)) {
-			r = __loc_network_exclude_to_list(network, subnet, to_check);
-			if (r) {
-				loc_network_list_unref(to_check);
-				loc_network_unref(subnet);
-
-				return NULL;
-			}
-		}
-
-		// Cleanup
+		overlaps = loc_network_overlaps(network, subnet);
 		loc_network_unref(subnet);
-	}
 
-	r = loc_network_list_new(network->ctx, &subnets);
-	if (r) {
-		loc_network_list_unref(to_check);
-		return NULL;
+		if (overlaps)
+			break;
 	}
 
-	off_t smallest_subnet = 0;
-
-	while (!loc_network_list_empty(to_check)) {
-		struct loc_network* subnet_to_check = loc_network_list_pop_first(to_check);
-
-		// Check whether the subnet to check is part of the input list
-		if (loc_network_list_contains(list, subnet_to_check)) {
-			loc_network_unref(subnet_to_check);
-			continue;
-		}
-
-		// Marks whether this subnet passed all checks
-		int passed = 1;
-
-		for (unsigned int i = smallest_subnet; i < loc_network_list_size(list); i++) {
-			subnet = loc_network_list_get(list, i);
-
-			// Drop this subnet if is a subnet of another subnet
-			if (loc_network_is_subnet(subnet, subnet_to_check)) {
-				passed = 0;
-				loc_network_unref(subnet);
-				break;
-			}
-
-			// Break it down if it overlaps
-			if (loc_network_overlaps(subnet, subnet_to_check)) {
-				passed = 0;
-
-				__loc_network_exclude_to_list(subnet_to_check, subnet, to_check);
-
-				loc_network_unref(subnet);
-				break;
-			}
-
-			// If the subnet is strictly greater, we do not need to continue the search
-			r = loc_network_cmp(subnet, subnet_to_check);
-			if (r > 0) {
-				loc_network_unref(subnet);
-				break;
+	if (!overlaps)
+		return subnets;
 
-			// If it is strictly smaller, we can continue the search from here next
-			// time because all networks that are to be checked can only be larger
-			// than this one.
-			} else if (r < 0) {
-				smallest_subnet = i;
-			}
+	// Convert the list into ranges
+	r = loc_network_list_ranges(list, &ranges, &count);
+	if (r)
+		goto ERROR;
 
-			loc_network_unref(subnet);
-		}
+	// Collect everything that remains
+	r = loc_network_list_append_excluded(subnets, network, ranges, count);
+	if (r)
+		goto ERROR;
 
-		if (passed)
-			loc_network_list_push(subnets, subnet_to_check);
+ERROR:
+	if (ranges)
+		free(ranges);
 
-		loc_network_unref(subnet_to_check);
+	if (r) {
+		loc_network_list_unref(subnets);
+		return NULL;
 	}
 
-	loc_network_list_unref(to_check);
-
 	return subnets;
 }
 
@@ -593,7 +542,7 @@ int loc_network_merge(struct loc_network** n,
 	DEBUG(n1->ctx, "Attempting to merge %s and %s\n", loc_network_str(n1), loc_network_str(n2));
 
 	// Family must match
-	if (n1->family != n2->family)
+	if (loc_network_address_family(n1) != loc_network_address_family(n2))
 		return 0;
 
 	// The prefix must match, too
@@ -658,45 +607,167 @@ int loc_network_to_database_v1(struct loc_network* network, struct loc_database_
 	return 0;
 }
 
-int loc_network_new_from_database_v1(struct loc_ctx* ctx, struct loc_network** network,
-		struct in6_addr* address, unsigned int prefix, const struct loc_database_network_v1* dbobj) {
+int loc_network_value_from_database_v1(struct loc_network_value* value,
+		const struct in6_addr* address, unsigned int prefix, const struct loc_database_network_v1* dbobj) {
 	char country_code[3] = "\0\0";
 
-	// Adjust prefix for IPv4
-	if (IN6_IS_ADDR_V4MAPPED(address))
-		prefix -= 96;
-
-	int r = loc_network_new(ctx, network, address, prefix);
-	if (r) {
-		ERROR(ctx, "Could not allocate a new network: %m\n");
-		return r;
+	// Validate the prefix
+	if (!loc_address_valid_prefix(address, IN6_IS_ADDR_V4MAPPED(address) ? prefix - 96 : prefix)) {
+		errno = EINVAL;
+		return -EINVAL;
 	}
 
+	loc_network_value_init(value, address, prefix);
+
 	// Import country code
 	loc_country_code_copy(country_code, dbobj->country_code);
 
-	r = loc_network_set_country_code(*network, country_code);
-	if (r) {
-		ERROR(ctx, "Could not set country code: %s\n", country_code);
-		return r;
+	if (*country_code) {
+		if (!loc_country_code_is_valid(country_code)) {
+			errno = EINVAL;
+			return -EINVAL;
+		}
+
+		loc_country_code_copy(value->country_code, country_code);
 	}
 
 	// Import ASN
-	uint32_t asn = be32toh(dbobj->asn);
-	r = loc_network_set_asn(*network, asn);
-	if (r) {
-		ERROR(ctx, "Could not set ASN: %u\n", asn);
+	value->asn = be32toh(dbobj->asn);
+
+	// Import flags
+	value->flags = be16toh(dbobj->flags);
+
+	return 0;
+}
+
+void loc_network_value_init(struct loc_network_value* value,
+		const struct in6_addr* address, unsigned int prefix) {
+	const struct in6_addr bitmask = loc_prefix_to_bitmask(prefix);
+
+	memset(value, 0, sizeof(*value));
+
+	value->address = loc_address_and(address, &bitmask);
+	value->prefix  = prefix;
+}
+
+void loc_network_to_value(struct loc_network* network, struct loc_network_value* value) {
+	value->address = network->first_address;
+	value->prefix  = network->prefix;
+	value->asn     = network->asn;
+	value->flags   = network->flags;
+
+	loc_country_code_copy(value->country_code, network->country_code);
+}
+
+int loc_network_new_from_value(struct loc_ctx* ctx, struct loc_network** network,
+		const struct loc_network_value* value) {
+	struct in6_addr address = value->address;
+	struct loc_network* n = NULL;
+	unsigned int prefix = value->prefix;
+	int r;
+
+	// loc_network_new() expects the prefix of IPv4 networks without the mapping
+	if (IN6_IS_ADDR_V4MAPPED(&address))
+		prefix -= 96;
+
+	r = loc_network_new(ctx, &n, &address, prefix);
+	if (r)
 		return r;
+
+	loc_country_code_copy(n->country_code, value->country_code);
+	n->asn   = value->asn;
+	n->flags = value->flags;
+
+	*network = n;
+
+	return 0;
+}
+
+struct in6_addr loc_network_value_last_address(const struct loc_network_value* value) {
+	const struct in6_addr bitmask = loc_prefix_to_bitmask(value->prefix);
+
+	return loc_address_or(&value->address, &bitmask);
+}
+
+/*
+	Formats the network into the given buffer
+*/
+int loc_network_value_format(const struct loc_network_value* value, char* buffer, size_t length) {
+	unsigned int prefix = value->prefix;
+	int r;
+
+	// The buffer is too short for the address
+	if (!loc_address_format(&value->address, buffer, length)) {
+		errno = ENOBUFS;
+		return -ENOBUFS;
 	}
 
-	// Import flags
-	int flags = be16toh(dbobj->flags);
-	r = loc_network_set_flag(*network, flags);
-	if (r) {
-		ERROR(ctx, "Could not set flags: %d\n", flags);
+	if (IN6_IS_ADDR_V4MAPPED(&value->address))
+		prefix -= 96;
+
+	const size_t l = strlen(buffer);
+
+	r = snprintf(buffer + l, length - l, "/%u", prefix);
+	if (r < 0)
+		return -errno;
+
+	// Did the string fit?
+	if ((size_t)r >= length - l) {
+		errno = ENOBUFS;
+		return -ENOBUFS;
+	}
+
+	return 0;
+}
+
+int loc_network_value_cmp(const struct loc_network_value* self, const struct loc_network_value* other) {
+	// Compare address
+	int r = loc_address_cmp(&self->address, &other->address);
+	if (r)
 		return r;
+
+	// Compare prefix
+	if (self->prefix > other->prefix)
+		return 1;
+	else if (self->prefix < other->prefix)
+		return -1;
+
+	return 0;
+}
+
+int loc_network_value_is_subnet(const struct loc_network_value* self,
+		const struct loc_network_value* other) {
+	// The subnet cannot be larger
+	if (self->prefix > other->prefix)
+		return 0;
+
+	// The subnet must start with the same bits
+	const struct in6_addr bitmask = loc_prefix_to_bitmask(self->prefix);
+	const struct in6_addr address = loc_address_and(&other->address, &bitmask);
+
+	return loc_address_cmp(&self->address, &address) == 0;
+}
+
+/*
+	Splits the network into two halves which inherit all properties
+*/
+int loc_network_value_subnets(const struct loc_network_value* value,
+		struct loc_network_value* subnet1, struct loc_network_value* subnet2) {
+	// Check if the new prefix is valid
+	if (value->prefix >= 128) {
+		errno = EINVAL;
+		return -EINVAL;
 	}
 
+	*subnet1 = *value;
+	*subnet2 = *value;
+
+	subnet1->prefix++;
+	subnet2->prefix++;
+
+	// The second half has the next bit set
+	loc_address_set_bit(&subnet2->address, value->prefix, 1);
+
 	return 0;
 }
 
@@ -805,7 +876,7 @@ static char* loc_network_reverse_pointer4(struct loc_network* network, const cha
 }
 
 LOC_EXPORT char* loc_network_reverse_pointer(struct loc_network* network, const char* suffix) {
-	switch (network->family) {
+	switch (loc_network_address_family(network)) {
 		case AF_INET6:
 			return loc_network_reverse_pointer6(network, suffix);
 
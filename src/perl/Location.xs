@@ -5,12 +5,66 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <arpa/inet.h>
 
 #include <libloc/libloc.h>
+#include <libloc/address.h>
 #include <libloc/database.h>
 #include <libloc/network.h>
 #include <libloc/country.h>
 
+/*
+	Looks up an address and returns a reference to a hash with all attributes
+	of the network it belongs to, or NULL if it could not be found
+*/
+static SV* lookup_record(pTHX_ struct loc_database* db, const char* string) {
+	struct loc_database_record record;
+	struct in6_addr address;
+	char buffer[INET6_ADDRSTRLEN];
+	const char* network = NULL;
+
+	if (loc_address_parse_fast(&address, string))
+		return NULL;
+
+	// Lookup network
+	if (loc_database_lookup_record(db, &address, &record))
+		return NULL;
+
+	// Format the network
+	if (IN6_IS_ADDR_V4MAPPED(&record.address))
+		network = inet_ntop(AF_INET, &record.address.s6_addr[12], buffer, sizeof(buffer));
+	else
+		network = inet_ntop(AF_INET6, &record.address, buffer, sizeof(buffer));
+
+	if (!network)
+		return NULL;
+
+	HV* hv = newHV();
+
+	(void)hv_stores(hv, "network", newSVpvf("%s/%u", network, record.prefix));
+
+	if (*record.country_code)
+		(void)hv_stores(hv, "country_code", newSVpv(record.country_code, 2));
+
+	if (record.asn)
+		(void)hv_stores(hv, "asn", newSVuv(record.asn));
+
+	// Flags are only stored if they are set
+	if (record.flags & LOC_NETWORK_FLAG_ANONYMOUS_PROXY)
+		(void)hv_stores(hv, "anonymous_proxy", newSViv(1));
+
+	if (record.flags & LOC_NETWORK_FLAG_SATELLITE_PROVIDER)
+		(void)hv_stores(hv, "satellite_provider", newSViv(1));
+
+	if (record.flags & LOC_NETWORK_FLAG_ANYCAST)
+		(void)hv_stores(hv, "anycast", newSViv(1));
+
+	if (record.flags & LOC_NETWORK_FLAG_DROP)
+		(void)hv_stores(hv, "drop", newSViv(1));
+
+	return newRV_noinc((SV*)hv);
+}
+
 MODULE = Location		PACKAGE = Location
 
 struct loc_database *
@@ -231,6 +285,48 @@ lookup_network_has_flag(db, address, flag)
 	OUTPUT:
 		RETVAL
 
+SV*
+lookup(db, address)
+	struct loc_database* db;
+	char* address;
+
+	CODE:
+		// Lookup all attributes at once
+		RETVAL = lookup_record(aTHX_ db, address);
+		if (!RETVAL)
+			RETVAL = &PL_sv_undef;
+	OUTPUT:
+		RETVAL
+
+SV*
+lookup_many(db, addresses)
+	struct loc_database* db;
+	SV* addresses;
+
+	CODE:
+		if (!SvROK(addresses) || SvTYPE(SvRV(addresses)) != SVt_PVAV)
+			croak("Addresses must be an array reference\n");
+
+		AV* input = (AV*)SvRV(addresses);
+		const SSize_t length = av_len(input) + 1;
+
+		AV* output = newAV();
+		av_extend(output, length);
+
+		for (SSize_t i = 0; i < length; i++) {
+			SV** address = av_fetch(input, i, 0);
+			SV* record = NULL;
+
+			if (address && SvOK(*address))
+				record = lookup_record(aTHX_ db, SvPV_nolen(*address));
+
+			av_push(output, (record) ? record : newSV(0));
+		}
+
+		RETVAL = newRV_noinc((SV*)output);
+	OUTPUT:
+		RETVAL
+
 SV*
 lookup_asn(db, address)
 	struct loc_database* db;
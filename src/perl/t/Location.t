@@ -12,7 +12,7 @@ use warnings;
 my $testdb = $ENV{'database'};
 my $keyfile = $ENV{'keyfile'};
 
-use Test::More tests => 12;
+use Test::More tests => 19;
 BEGIN { use_ok('Location') };
 
 #########################
@@ -71,3 +71,16 @@ ok($country_name eq "Germany", "Test 13 - Got country name: $country_name");
 
 my $continent_code = &Location::get_continent_code($db, "DE");
 ok($continent_code eq "EU", "Test 14 - Got continent code $continent_code for country code 'DE'");
+
+my $network = &Location::lookup($db, $address);
+ok($network->{country_code} eq "DE", "Test 15 - Lookup all attributes for $address.");
+ok($network->{asn} eq "204867", "Test 16 - Lookup ASN with all attributes for $address.");
+ok($network->{anycast}, "Test 17 - Lookup flags with all attributes for $address.");
+
+$network = &Location::lookup($db, "a.b.c.d");
+ok(!defined($network), "Test 18 - Lookup all attributes for invalid address.");
+
+my $networks = &Location::lookup_many($db, [ $address, "1.1.1.1", "a.b.c.d" ]);
+ok(@$networks == 3, "Test 19 - Lookup many addresses at once.");
+ok($networks->[0]{country_code} eq "DE", "Test 20 - Lookup many addresses returns all attributes.");
+ok(!defined($networks->[2]), "Test 21 - Lookup many addresses returns undef for invalid addresses.");
@@ -0,0 +1,46 @@
+#!/usr/bin/perl
+#
+# This benchmark compares looking up all attributes of an address with the
+# functions that only return one attribute each, with lookup() and with
+# lookup_many().
+#
+# Usage: perl -Mblib t/bench-lookup.pl DATABASE [ADDRESSES]
+
+use strict;
+use warnings;
+
+use Benchmark qw(cmpthese);
+use Location;
+
+my $testdb = shift || $ENV{'database'}
+	or die "Usage: $0 DATABASE [ADDRESSES]\n";
+my $count = shift || 100000;
+
+my $db = &Location::init("$testdb");
+
+# Always generate the same addresses
+srand(1);
+
+my @addresses = map {
+	join(".", map { int(rand(256)) } 1..4)
+} 1..$count;
+
+cmpthese(-5, {
+	"separate" => sub {
+		foreach my $address (@addresses) {
+			my $country_code = &Location::lookup_country_code($db, $address);
+			my $asn = &Location::lookup_asn($db, $address);
+			my $anycast = &Location::lookup_network_has_flag($db, $address, "LOC_NETWORK_FLAG_ANYCAST");
+		}
+	},
+
+	"lookup" => sub {
+		foreach my $address (@addresses) {
+			my $network = &Location::lookup($db, $address);
+		}
+	},
+
+	"lookup_many" => sub {
+		my $networks = &Location::lookup_many($db, \@addresses);
+	},
+});
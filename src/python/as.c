@@ -21,6 +21,7 @@
 
 #include "locationmodule.h"
 #include "as.h"
+#include "writer.h"
 
 PyObject* new_as(PyTypeObject* type, struct loc_as* as) {
 	ASObject* self = (ASObject*)type->tp_alloc(type, 0);
@@ -41,6 +42,8 @@ static void AS_dealloc(ASObject* self) {
 	if (self->as)
 		loc_as_unref(self->as);
 
+	Py_XDECREF(self->writer);
+
 	Py_TYPE(self)->tp_free((PyObject* )self);
 }
 
@@ -93,7 +96,10 @@ static PyObject* AS_get_name(ASObject* self) {
 static int AS_set_name(ASObject* self, PyObject* value) {
 	const char* name = PyUnicode_AsUTF8(value);
 
+	writer_lock(self->writer);
 	int r = loc_as_set_name(self->as, name);
+	writer_unlock(self->writer);
+
 	if (r) {
 		PyErr_Format(PyExc_ValueError, "Could not set name: %s", name);
 		return r;
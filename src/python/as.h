@@ -25,6 +25,9 @@
 typedef struct {
 	PyObject_HEAD
 	struct loc_as* as;
+
+	// The writer this object belongs to (if any)
+	PyObject* writer;
 } ASObject;
 
 extern PyTypeObject ASType;
@@ -21,6 +21,7 @@
 
 #include "locationmodule.h"
 #include "country.h"
+#include "writer.h"
 
 PyObject* new_country(PyTypeObject* type, struct loc_country* country) {
 	CountryObject* self = (CountryObject*)type->tp_alloc(type, 0);
@@ -41,6 +42,8 @@ static void Country_dealloc(CountryObject* self) {
 	if (self->country)
 		loc_country_unref(self->country);
 
+	Py_XDECREF(self->writer);
+
 	Py_TYPE(self)->tp_free((PyObject* )self);
 }
 
@@ -91,7 +94,10 @@ static PyObject* Country_get_name(CountryObject* self) {
 static int Country_set_name(CountryObject* self, PyObject* value) {
 	const char* name = PyUnicode_AsUTF8(value);
 
+	writer_lock(self->writer);
 	int r = loc_country_set_name(self->country, name);
+	writer_unlock(self->writer);
+
 	if (r) {
 		PyErr_Format(PyExc_ValueError, "Could not set name: %s", name);
 		return r;
@@ -112,7 +118,10 @@ static PyObject* Country_get_continent_code(CountryObject* self) {
 static int Country_set_continent_code(CountryObject* self, PyObject* value) {
 	const char* code = PyUnicode_AsUTF8(value);
 
+	writer_lock(self->writer);
 	int r = loc_country_set_continent_code(self->country, code);
+	writer_unlock(self->writer);
+
 	if (r) {
 		PyErr_Format(PyExc_ValueError, "Could not set continent code: %s", code);
 		return r;
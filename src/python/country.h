@@ -24,6 +24,9 @@
 typedef struct {
 	PyObject_HEAD
 	struct loc_country* country;
+
+	// The writer this object belongs to (if any)
+	PyObject* writer;
 } CountryObject;
 
 extern PyTypeObject CountryType;
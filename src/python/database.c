@@ -16,10 +16,14 @@
 
 #include <Python.h>
 
+#include <arpa/inet.h>
+
 #include <libloc/libloc.h>
+#include <libloc/address.h>
 #include <libloc/as.h>
 #include <libloc/as-list.h>
 #include <libloc/database.h>
+#include <libloc/exporter.h>
 
 #include "locationmodule.h"
 #include "as.h"
@@ -101,7 +105,11 @@ static PyObject* Database_verify(DatabaseObject* self, PyObject* args) {
 		return NULL;
 	}
 
-	int r = loc_database_verify(self->db, f);
+	int r;
+
+	Py_BEGIN_ALLOW_THREADS
+	r = loc_database_verify(self->db, f);
+	Py_END_ALLOW_THREADS
 
 	if (r == 0)
 		Py_RETURN_TRUE;
@@ -207,7 +215,10 @@ static PyObject* Database_lookup(DatabaseObject* self, PyObject* args) {
 		return NULL;
 
 	// Try to retrieve a matching network
+	Py_BEGIN_ALLOW_THREADS
 	r = loc_database_lookup_from_string(self->db, address, &network);
+	Py_END_ALLOW_THREADS
+
 	if (r) {
 		// Handle any errors
 		switch (errno) {
@@ -234,12 +245,222 @@ static PyObject* Database_lookup(DatabaseObject* self, PyObject* args) {
 	return obj;
 }
 
+/*
+	Opens a writable output buffer for count elements of size bytes each
+*/
+static int Database_get_output_buffer(PyObject* obj, Py_buffer* view,
+		const char* name, Py_ssize_t count, Py_ssize_t size) {
+	if (!obj || obj == Py_None)
+		return 0;
+
+	if (PyObject_GetBuffer(obj, view, PyBUF_WRITABLE|PyBUF_C_CONTIGUOUS) < 0)
+		return -1;
+
+	if (view->len != count * size) {
+		PyErr_Format(PyExc_ValueError, "%s must have %zd bytes for %zd addresses",
+			name, count * size, count);
+		PyBuffer_Release(view);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int Database_parse_address(struct in6_addr* address, PyObject* obj) {
+	const char* string = PyUnicode_AsUTF8(obj);
+	if (!string)
+		return -1;
+
+	if (loc_address_parse_fast(address, string)) {
+		PyErr_Format(PyExc_ValueError, "Invalid IP address: %s", string);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+	Looks up many addresses at once and writes the ASN, country code and flags
+	of each of them into the given output buffers, for example numpy arrays of
+	dtype uint32, S2 and uint16.
+
+	Addresses are either a sequence of strings, or a buffer of packed addresses
+	in network byte order which are 4 or 16 bytes long, depending on family or
+	the item size of the buffer.
+
+	The GIL is released while the addresses are being looked up.
+
+	Returns the number of addresses that were found.
+*/
+static PyObject* Database_lookup_many(DatabaseObject* self, PyObject* args, PyObject* kwargs) {
+	const char* kwlist[] = { "addresses", "asns", "country_codes", "flags", "family", NULL };
+	PyObject* addresses = NULL;
+	PyObject* asns = NULL;
+	PyObject* country_codes = NULL;
+	PyObject* flags = NULL;
+	PyObject* sequence = NULL;
+	PyObject* ret = NULL;
+	int family = AF_UNSPEC;
+
+	struct loc_database_record record;
+	struct in6_addr* parsed = NULL;
+	struct in6_addr address;
+	Py_buffer input = { 0 };
+	Py_buffer output_asns = { 0 };
+	Py_buffer output_country_codes = { 0 };
+	Py_buffer output_flags = { 0 };
+	const unsigned char* packed = NULL;
+	Py_ssize_t length = 0;
+	Py_ssize_t count = 0;
+	Py_ssize_t found = 0;
+	int r = 0;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|OOOi", (char**)kwlist,
+			&addresses, &asns, &country_codes, &flags, &family))
+		return NULL;
+
+	// Packed addresses
+	if (PyObject_CheckBuffer(addresses)) {
+		if (PyObject_GetBuffer(addresses, &input, PyBUF_C_CONTIGUOUS) < 0)
+			return NULL;
+
+		switch (family) {
+			case AF_INET:
+				length = 4;
+				break;
+
+			case AF_INET6:
+				length = 16;
+				break;
+
+			// Use the size of each item
+			case AF_UNSPEC:
+				length = input.itemsize;
+				break;
+		}
+
+		if (length != 4 && length != 16) {
+			PyErr_SetString(PyExc_ValueError,
+				"Packed addresses must be 4 or 16 bytes long; set family for plain bytes");
+			goto ERROR;
+		}
+
+		if (input.len % length) {
+			PyErr_Format(PyExc_ValueError,
+				"The length of the addresses is not a multiple of %zd", length);
+			goto ERROR;
+		}
+
+		packed = input.buf;
+		count  = input.len / length;
+
+	// A sequence of strings
+	} else {
+		sequence = PySequence_Fast(addresses, "addresses must be a buffer or a sequence");
+		if (!sequence)
+			return NULL;
+
+		count = PySequence_Fast_GET_SIZE(sequence);
+
+		parsed = PyMem_RawCalloc(count ? count : 1, sizeof(*parsed));
+		if (!parsed) {
+			PyErr_NoMemory();
+			goto ERROR;
+		}
+
+		for (Py_ssize_t i = 0; i < count; i++) {
+			if (Database_parse_address(&parsed[i], PySequence_Fast_GET_ITEM(sequence, i)) < 0)
+				goto ERROR;
+		}
+	}
+
+	// Open all output buffers
+	if (Database_get_output_buffer(asns, &output_asns, "asns", count, sizeof(uint32_t)) < 0)
+		goto ERROR;
+
+	if (Database_get_output_buffer(country_codes, &output_country_codes,
+			"country_codes", count, 2) < 0)
+		goto ERROR;
+
+	if (Database_get_output_buffer(flags, &output_flags, "flags", count, sizeof(uint16_t)) < 0)
+		goto ERROR;
+
+	Py_BEGIN_ALLOW_THREADS
+
+	for (Py_ssize_t i = 0; i < count; i++) {
+		// Unpack the address
+		if (packed && length == 4) {
+			memset(&address, 0, sizeof(address));
+
+			address.s6_addr32[2] = htonl(0xffff);
+			memcpy(&address.s6_addr32[3], packed + i * 4, 4);
+
+		} else if (packed) {
+			memcpy(&address, packed + i * 16, 16);
+
+		} else {
+			address = parsed[i];
+		}
+
+		r = loc_database_lookup_record(self->db, &address, &record);
+		if (r < 0)
+			break;
+
+		// Nothing found
+		if (r)
+			memset(&record, 0, sizeof(record));
+		else
+			found++;
+
+		if (output_asns.buf)
+			((uint32_t*)output_asns.buf)[i] = record.asn;
+
+		if (output_country_codes.buf)
+			memcpy((char*)output_country_codes.buf + i * 2, record.country_code, 2);
+
+		if (output_flags.buf)
+			((uint16_t*)output_flags.buf)[i] = record.flags;
+	}
+
+	Py_END_ALLOW_THREADS
+
+	if (r < 0) {
+		errno = -r;
+		PyErr_SetFromErrno(PyExc_OSError);
+		goto ERROR;
+	}
+
+	ret = PyLong_FromSsize_t(found);
+
+ERROR:
+	if (input.obj)
+		PyBuffer_Release(&input);
+	if (output_asns.obj)
+		PyBuffer_Release(&output_asns);
+	if (output_country_codes.obj)
+		PyBuffer_Release(&output_country_codes);
+	if (output_flags.obj)
+		PyBuffer_Release(&output_flags);
+	if (parsed)
+		PyMem_RawFree(parsed);
+	Py_XDECREF(sequence);
+
+	return ret;
+}
+
 static PyObject* new_database_enumerator(PyTypeObject* type, struct loc_database_enumerator* enumerator) {
 	DatabaseEnumeratorObject* self = (DatabaseEnumeratorObject*)type->tp_alloc(type, 0);
-	if (self) {
-		self->enumerator = loc_database_enumerator_ref(enumerator);
+	if (!self)
+		return NULL;
+
+	self->lock = PyThread_allocate_lock();
+	if (!self->lock) {
+		Py_DECREF(self);
+		return PyErr_NoMemory();
 	}
 
+	self->enumerator = loc_database_enumerator_ref(enumerator);
+
 	return (PyObject*)self;
 }
 
@@ -300,20 +521,32 @@ static PyObject* Database_networks_flattened(DatabaseObject *self) {
 }
 
 static PyObject* Database_search_networks(DatabaseObject* self, PyObject* args, PyObject* kwargs) {
-	const char* kwlist[] = { "country_codes", "asns", "flags", "family", "flatten", NULL };
+	const char* kwlist[] = { "country_codes", "asns", "flags", "family", "flatten",
+		"aggregate", "batch_size", NULL };
 	PyObject* country_codes = NULL;
 	PyObject* asn_list = NULL;
 	int flags = 0;
 	int family = 0;
 	int flatten = 0;
+	int aggregate = 0;
+	unsigned int batch_size = 0;
 
-	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O!O!iip", (char**)kwlist,
-			&PyList_Type, &country_codes, &PyList_Type, &asn_list, &flags, &family, &flatten))
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O!O!iippI", (char**)kwlist,
+			&PyList_Type, &country_codes, &PyList_Type, &asn_list, &flags, &family,
+			&flatten, &aggregate, &batch_size))
 		return NULL;
 
+	int enumerator_flags = 0;
+
+	if (flatten)
+		enumerator_flags |= LOC_DB_ENUMERATOR_FLAGS_FLATTEN;
+
+	if (aggregate)
+		enumerator_flags |= LOC_DB_ENUMERATOR_FLAGS_AGGREGATE;
+
 	struct loc_database_enumerator* enumerator;
 	int r = loc_database_enumerator_new(&enumerator, self->db, LOC_DB_ENUMERATE_NETWORKS,
-		(flatten) ? LOC_DB_ENUMERATOR_FLAGS_FLATTEN : 0);
+		enumerator_flags);
 	if (r) {
 		PyErr_SetFromErrno(PyExc_SystemError);
 		return NULL;
@@ -453,6 +686,9 @@ static PyObject* Database_search_networks(DatabaseObject* self, PyObject* args,
 	PyObject* obj = new_database_enumerator(&DatabaseEnumeratorType, enumerator);
 	loc_database_enumerator_unref(enumerator);
 
+	if (obj)
+		((DatabaseEnumeratorObject*)obj)->batch_size = batch_size;
+
 	return obj;
 }
 
@@ -471,7 +707,134 @@ static PyObject* Database_list_bogons(DatabaseObject* self, PyObject* args, PyOb
 	return Database_iterate_all(self, LOC_DB_ENUMERATE_BOGONS, family, 0);
 }
 
+static PyObject* Database_export(DatabaseObject* self, PyObject* args, PyObject* kwargs) {
+	const char* kwlist[] = { "format", "family", "countries", "asns", "directory", NULL };
+	struct loc_exporter* exporter = NULL;
+	PyObject* country_codes = NULL;
+	PyObject* asn_list = NULL;
+	PyObject* result = NULL;
+	const char* directory = NULL;
+	char* buffer = NULL;
+	size_t length = 0;
+	FILE* f = NULL;
+	int format = 0;
+	int family = AF_UNSPEC;
+	int r;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|iO!O!z", (char**)kwlist,
+			&format, &family, &PyList_Type, &country_codes, &PyList_Type, &asn_list, &directory))
+		return NULL;
+
+	r = loc_exporter_new(loc_ctx, &exporter, self->db, format);
+	if (r) {
+		if (r == -EINVAL)
+			PyErr_Format(PyExc_ValueError, "Invalid format: %d", format);
+		else
+			PyErr_SetFromErrno(PyExc_OSError);
+
+		return NULL;
+	}
+
+	// Add all countries
+	if (country_codes) {
+		for (Py_ssize_t i = 0; i < PyList_Size(country_codes); i++) {
+			PyObject* item = PyList_GetItem(country_codes, i);
+
+			if (!PyUnicode_Check(item)) {
+				PyErr_SetString(PyExc_TypeError, "Country codes must be strings");
+				goto ERROR;
+			}
+
+			const char* country_code = PyUnicode_AsUTF8(item);
+			if (!country_code)
+				goto ERROR;
+
+			r = loc_exporter_add_country(exporter, country_code);
+			if (r) {
+				if (r == -EINVAL)
+					PyErr_Format(PyExc_ValueError, "Invalid country code: %s", country_code);
+				else
+					PyErr_SetFromErrno(PyExc_OSError);
+
+				goto ERROR;
+			}
+		}
+	}
+
+	// Add all ASNs
+	if (asn_list) {
+		for (Py_ssize_t i = 0; i < PyList_Size(asn_list); i++) {
+			PyObject* item = PyList_GetItem(asn_list, i);
+
+			if (!PyLong_Check(item)) {
+				PyErr_SetString(PyExc_TypeError, "ASNs must be numbers");
+				goto ERROR;
+			}
+
+			unsigned long number = PyLong_AsUnsignedLong(item);
+			if (PyErr_Occurred())
+				goto ERROR;
+
+			r = loc_exporter_add_asn(exporter, number);
+			if (r) {
+				PyErr_SetFromErrno(PyExc_OSError);
+				goto ERROR;
+			}
+		}
+	}
+
+	// Collect the output in memory if we don't write to a directory
+	if (!directory) {
+		f = open_memstream(&buffer, &length);
+		if (!f) {
+			PyErr_SetFromErrno(PyExc_OSError);
+			goto ERROR;
+		}
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	r = loc_exporter_export(exporter, family, directory, f);
+	Py_END_ALLOW_THREADS
+
+	if (f) {
+		fclose(f);
+		f = NULL;
+	}
+
+	if (r) {
+		if (r == -EINVAL)
+			PyErr_Format(PyExc_ValueError, "Invalid family: %d", family);
+		else
+			PyErr_SetFromErrno(PyExc_OSError);
+
+		goto ERROR;
+	}
+
+	// Return the output
+	if (buffer)
+		result = PyBytes_FromStringAndSize(buffer, length);
+	else
+		result = Py_None;
+
+	Py_XINCREF(result);
+
+ERROR:
+	if (f)
+		fclose(f);
+	if (buffer)
+		free(buffer);
+	loc_exporter_unref(exporter);
+
+	return result;
+}
+
 static struct PyMethodDef Database_methods[] = {
+	{
+		"export",
+		(PyCFunction)Database_export,
+		METH_VARARGS|METH_KEYWORDS,
+		NULL,
+	},
 	{
 		"get_as",
 		(PyCFunction)Database_get_as,
@@ -496,6 +859,12 @@ static struct PyMethodDef Database_methods[] = {
 		METH_VARARGS,
 		NULL,
 	},
+	{
+		"lookup_many",
+		(PyCFunction)Database_lookup_many,
+		METH_VARARGS|METH_KEYWORDS,
+		NULL,
+	},
 	{
 		"search_as",
 		(PyCFunction)Database_search_as,
@@ -598,16 +967,135 @@ static PyObject* DatabaseEnumerator_new(PyTypeObject* type, PyObject* args, PyOb
 }
 
 static void DatabaseEnumerator_dealloc(DatabaseEnumeratorObject* self) {
-	loc_database_enumerator_unref(self->enumerator);
+	if (self->enumerator)
+		loc_database_enumerator_unref(self->enumerator);
+
+	if (self->lock)
+		PyThread_free_lock(self->lock);
 
 	Py_TYPE(self)->tp_free((PyObject* )self);
 }
 
+/*
+	Returns a network as a tuple of (prefix, country code, ASN, flags)
+*/
+static PyObject* new_network_record(struct loc_network* network) {
+	uint32_t asn = loc_network_get_asn(network);
+	uint32_t flags = loc_network_get_flags(network);
+
+	const char* prefix = loc_network_str(network);
+	if (!prefix) {
+		PyErr_SetFromErrno(PyExc_OSError);
+		return NULL;
+	}
+
+	PyObject* number = NULL;
+
+	if (asn) {
+		number = PyLong_FromUnsignedLong(asn);
+		if (!number)
+			return NULL;
+	} else {
+		Py_INCREF(Py_None);
+		number = Py_None;
+	}
+
+	return Py_BuildValue("(ssNI)", prefix, loc_network_get_country_code(network), number, flags);
+}
+
+/*
+	Returns the next batch of networks as a list of records
+*/
+static PyObject* DatabaseEnumerator_next_batch(DatabaseEnumeratorObject* self) {
+	struct loc_network** networks = NULL;
+	PyObject* batch = NULL;
+	unsigned int length = 0;
+	int r = 0;
+
+	networks = PyMem_Calloc(self->batch_size, sizeof(*networks));
+	if (!networks)
+		return PyErr_NoMemory();
+
+	Py_BEGIN_ALLOW_THREADS
+	PyThread_acquire_lock(self->lock, WAIT_LOCK);
+
+	while (length < self->batch_size) {
+		r = loc_database_enumerator_next_network(self->enumerator, &networks[length]);
+		if (r || !networks[length])
+			break;
+
+		length++;
+	}
+
+	PyThread_release_lock(self->lock);
+	Py_END_ALLOW_THREADS
+
+	if (r) {
+		PyErr_SetFromErrno(PyExc_ValueError);
+		goto ERROR;
+	}
+
+	// Nothing found, that means the end
+	if (!length) {
+		PyErr_SetNone(PyExc_StopIteration);
+		goto ERROR;
+	}
+
+	batch = PyList_New(length);
+	if (!batch)
+		goto ERROR;
+
+	for (unsigned int i = 0; i < length; i++) {
+		PyObject* record = new_network_record(networks[i]);
+		if (!record) {
+			Py_CLEAR(batch);
+			goto ERROR;
+		}
+
+		PyList_SET_ITEM(batch, i, record);
+	}
+
+ERROR:
+	for (unsigned int i = 0; i < length; i++)
+		loc_network_unref(networks[i]);
+	PyMem_Free(networks);
+
+	return batch;
+}
+
 static PyObject* DatabaseEnumerator_next(DatabaseEnumeratorObject* self) {
 	struct loc_network* network = NULL;
+	struct loc_as* as = NULL;
+	struct loc_country* country = NULL;
+	int r;
+
+	// Nothing to enumerate
+	if (!self->enumerator) {
+		PyErr_SetNone(PyExc_StopIteration);
+		return NULL;
+	}
+
+	// Return networks in batches
+	if (self->batch_size)
+		return DatabaseEnumerator_next_batch(self);
+
+	Py_BEGIN_ALLOW_THREADS
+	PyThread_acquire_lock(self->lock, WAIT_LOCK);
 
 	// Enumerate all networks
-	int r = loc_database_enumerator_next_network(self->enumerator, &network);
+	r = loc_database_enumerator_next_network(self->enumerator, &network);
+
+	// Enumerate all ASes
+	if (!r && !network)
+		r = loc_database_enumerator_next_as(self->enumerator, &as);
+
+	// Enumerate all countries
+	if (!r && !network && !as)
+		r = loc_database_enumerator_next_country(self->enumerator, &country);
+
+	PyThread_release_lock(self->lock);
+	Py_END_ALLOW_THREADS
+
 	if (r) {
 		PyErr_SetFromErrno(PyExc_ValueError);
 		return NULL;
@@ -621,15 +1109,6 @@ static PyObject* DatabaseEnumerator_next(DatabaseEnumeratorObject* self) {
 		return obj;
 	}
 
-	// Enumerate all ASes
-	struct loc_as* as = NULL;
-
-	r = loc_database_enumerator_next_as(self->enumerator, &as);
-	if (r) {
-		PyErr_SetFromErrno(PyExc_ValueError);
-		return NULL;
-	}
-
 	if (as) {
 		PyObject* obj = new_as(&ASType, as);
 		loc_as_unref(as);
@@ -637,15 +1116,6 @@ static PyObject* DatabaseEnumerator_next(DatabaseEnumeratorObject* self) {
 		return obj;
 	}
 
-	// Enumerate all countries
-	struct loc_country* country = NULL;
-
-	r = loc_database_enumerator_next_country(self->enumerator, &country);
-	if (r) {
-		PyErr_SetFromErrno(PyExc_ValueError);
-		return NULL;
-	}
-
 	if (country) {
 		PyObject* obj = new_country(&CountryType, country);
 		loc_country_unref(country);
@@ -32,6 +32,12 @@ extern PyTypeObject DatabaseType;
 typedef struct {
 	PyObject_HEAD
 	struct loc_database_enumerator* enumerator;
+
+	// Enumerators cannot be used by multiple threads at the same time
+	PyThread_type_lock lock;
+
+	// If set, networks are returned in lists of this many records
+	unsigned int batch_size;
 } DatabaseEnumeratorObject;
 
 extern PyTypeObject DatabaseEnumeratorType;
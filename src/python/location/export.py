@@ -38,7 +38,11 @@ FLAGS = {
 	_location.NETWORK_FLAG_DROP               : "XD",
 }
 
+# Fetch this many networks from the database at a time
+BATCH_SIZE = 4096
+
 class OutputWriter(object):
+	format = _location.EXPORT_FORMAT_LIST
 	suffix = "networks"
 	mode = "w"
 
@@ -131,6 +135,7 @@ class IpsetOutputWriter(OutputWriter):
 	"""
 		For ipset
 	"""
+	format = _location.EXPORT_FORMAT_IPSET
 	suffix = "ipset"
 
 	# The value is being used if we don't know any better
@@ -199,6 +204,7 @@ class NftablesOutputWriter(OutputWriter):
 	"""
 		For nftables
 	"""
+	format = _location.EXPORT_FORMAT_NFTABLES
 	suffix = "set"
 
 	def _write_header(self):
@@ -216,10 +222,10 @@ class XTGeoIPOutputWriter(OutputWriter):
 		Formats the output in that way, that it can be loaded by
 		the xt_geoip kernel module from xtables-addons.
 	"""
+	format = _location.EXPORT_FORMAT_XT_GEOIP
 	mode = "wb"
 
-	@property
-	def tag(self):
+	def _make_tag(self):
 		return self.name
 
 	@property
@@ -227,8 +233,10 @@ class XTGeoIPOutputWriter(OutputWriter):
 		return "iv%s" % ("6" if self.family == socket.AF_INET6 else "4")
 
 	def write(self, network):
-		self.f.write(network._first_address)
-		self.f.write(network._last_address)
+		network = ipaddress.ip_network(network)
+
+		self.f.write(network.network_address.packed)
+		self.f.write(network.broadcast_address.packed)
 
 
 formats = {
@@ -243,6 +251,10 @@ class Exporter(object):
 		self.db, self.writer = db, writer
 
 	def export(self, directory, families, countries, asns):
+		# Use the exporter of the C library for all built-in formats
+		if self.writer in formats.values():
+			return self._export(directory, families, countries, asns)
+
 		for family in families:
 			log.debug("Exporting family %s" % family)
 
@@ -261,34 +273,40 @@ class Exporter(object):
 				country_code for country_code in countries if not country_code in FLAGS.values()
 			]
 
-			# Get all networks that match the family
-			networks = self.db.search_networks(family=family,
-				country_codes=country_codes, asns=asns, flatten=True)
+			# Get all networks that match the family, merging any neighbours
+			# with the same properties to keep the exported sets small
+			batches = self.db.search_networks(family=family,
+				country_codes=country_codes, asns=asns, aggregate=True,
+				batch_size=BATCH_SIZE)
 
 			# Walk through all networks
-			for network in networks:
-				# Write matching countries
-				try:
-					writers[network.country_code].write(network)
-				except KeyError:
-					pass
-
-				# Write matching ASNs
-				try:
-					writers[network.asn].write(network)
-				except KeyError:
-					pass
-
-				# Handle flags
-				for flag in FLAGS:
-					if network.has_flag(flag):
-						# Fetch the "fake" country code
-						country = FLAGS[flag]
-
-						try:
-							writers[country].write(network)
-						except KeyError:
-							pass
+			for batch in batches:
+				for network, country_code, asn, flags in batch:
+					# Write matching countries
+					try:
+						writers[country_code].write(network)
+					except KeyError:
+						pass
+
+					# Write matching ASNs
+					try:
+						writers[asn].write(network)
+					except KeyError:
+						pass
+
+					# Handle flags
+					if not flags:
+						continue
+
+					for flag in FLAGS:
+						if flags & flag:
+							# Fetch the "fake" country code
+							country = FLAGS[flag]
+
+							try:
+								writers[country].write(network)
+							except KeyError:
+								pass
 
 			# Write everything to the filesystem
 			for writer in writers.values():
@@ -298,3 +316,23 @@ class Exporter(object):
 			if not directory:
 				for writer in writers.values():
 					writer.print()
+
+	def _export(self, directory, families, countries, asns):
+		if not directory and "b" in self.writer.mode:
+			raise TypeError(_("Won't write binary output to stdout"))
+
+		# Export all families in one pass through the database. IPv6 will
+		# be written first which only matters when printing to stdout.
+		if set(families) == { socket.AF_INET6, socket.AF_INET } \
+				and (directory or families[0] == socket.AF_INET6):
+			families = [socket.AF_UNSPEC]
+
+		for family in families:
+			log.debug("Exporting family %s" % family)
+
+			output = self.db.export(self.writer.format, family,
+				countries=countries, asns=asns, directory=directory)
+
+			# Print to stdout
+			if output:
+				sys.stdout.write(output.decode())
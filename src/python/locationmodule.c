@@ -17,6 +17,7 @@
 #include <Python.h>
 #include <syslog.h>
 
+#include <libloc/exporter.h>
 #include <libloc/format.h>
 #include <libloc/resolv.h>
 
@@ -180,6 +181,19 @@ PyMODINIT_FUNC PyInit__location(void) {
 	if (PyModule_AddIntConstant(m, "NETWORK_FLAG_DROP", LOC_NETWORK_FLAG_DROP))
 		return NULL;
 
+	// Add export formats
+	if (PyModule_AddIntConstant(m, "EXPORT_FORMAT_LIST", LOC_EXPORTER_FORMAT_LIST))
+		return NULL;
+
+	if (PyModule_AddIntConstant(m, "EXPORT_FORMAT_IPSET", LOC_EXPORTER_FORMAT_IPSET))
+		return NULL;
+
+	if (PyModule_AddIntConstant(m, "EXPORT_FORMAT_NFTABLES", LOC_EXPORTER_FORMAT_NFTABLES))
+		return NULL;
+
+	if (PyModule_AddIntConstant(m, "EXPORT_FORMAT_XT_GEOIP", LOC_EXPORTER_FORMAT_XT_GEOIP))
+		return NULL;
+
 	// Add latest database version
 	if (PyModule_AddIntConstant(m, "DATABASE_VERSION_LATEST", LOC_DATABASE_VERSION_LATEST))
 		return NULL;
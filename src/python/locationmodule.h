@@ -17,8 +17,23 @@
 #ifndef PYTHON_LOCATION_MODULE_H
 #define PYTHON_LOCATION_MODULE_H
 
+#include <Python.h>
+
 #include <libloc/libloc.h>
 
 extern struct loc_ctx* loc_ctx;
 
+/*
+	Acquires lock, but releases the GIL while waiting for it,
+	so that whoever is holding the lock can finish
+*/
+static inline void location_lock(PyThread_type_lock lock) {
+	if (PyThread_acquire_lock(lock, NOWAIT_LOCK))
+		return;
+
+	Py_BEGIN_ALLOW_THREADS
+	PyThread_acquire_lock(lock, WAIT_LOCK);
+	Py_END_ALLOW_THREADS
+}
+
 #endif /* PYTHON_LOCATION_MODULE_H */
@@ -26,6 +26,7 @@
 
 #include "locationmodule.h"
 #include "network.h"
+#include "writer.h"
 
 static PyObject* PyList_FromNetworkList(struct loc_network_list* networks) {
 	PyObject* list = PyList_New(0);
@@ -64,6 +65,8 @@ static void Network_dealloc(NetworkObject* self) {
 	if (self->network)
 		loc_network_unref(self->network);
 
+	Py_XDECREF(self->writer);
+
 	Py_TYPE(self)->tp_free((PyObject* )self);
 }
 
@@ -104,7 +107,10 @@ static PyObject* Network_get_country_code(NetworkObject* self) {
 static int Network_set_country_code(NetworkObject* self, PyObject* value) {
 	const char* country_code = PyUnicode_AsUTF8(value);
 
+	writer_lock(self->writer);
 	int r = loc_network_set_country_code(self->network, country_code);
+	writer_unlock(self->writer);
+
 	if (r) {
 		if (r == -EINVAL)
 			PyErr_Format(PyExc_ValueError,
@@ -142,7 +148,10 @@ static int Network_set_asn(NetworkObject* self, PyObject* value) {
 	}
 #endif
 
+	writer_lock(self->writer);
 	int r = loc_network_set_asn(self->network, asn);
+	writer_unlock(self->writer);
+
 	if (r)
 		return -1;
 
@@ -167,7 +176,9 @@ static PyObject* Network_set_flag(NetworkObject* self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "i", &flag))
 		return NULL;
 
+	writer_lock(self->writer);
 	int r = loc_network_set_flag(self->network, flag);
+	writer_unlock(self->writer);
 
 	if (r) {
 		// What exception to throw here?
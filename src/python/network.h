@@ -24,6 +24,9 @@
 typedef struct {
 	PyObject_HEAD
 	struct loc_network* network;
+
+	// The writer this object belongs to (if any)
+	PyObject* writer;
 } NetworkObject;
 
 extern PyTypeObject NetworkType;
@@ -25,8 +25,26 @@
 #include "network.h"
 #include "writer.h"
 
+void writer_lock(PyObject* writer) {
+	if (writer)
+		location_lock(((WriterObject*)writer)->lock);
+}
+
+void writer_unlock(PyObject* writer) {
+	if (writer)
+		PyThread_release_lock(((WriterObject*)writer)->lock);
+}
+
 static PyObject* Writer_new(PyTypeObject* type, PyObject* args, PyObject* kwds) {
 	WriterObject* self = (WriterObject*)type->tp_alloc(type, 0);
+	if (!self)
+		return NULL;
+
+	self->lock = PyThread_allocate_lock();
+	if (!self->lock) {
+		Py_DECREF(self);
+		return PyErr_NoMemory();
+	}
 
 	return (PyObject*)self;
 }
@@ -35,6 +53,9 @@ static void Writer_dealloc(WriterObject* self) {
 	if (self->writer)
 		loc_writer_unref(self->writer);
 
+	if (self->lock)
+		PyThread_free_lock(self->lock);
+
 	Py_TYPE(self)->tp_free((PyObject* )self);
 }
 
@@ -92,15 +113,22 @@ static int Writer_init(WriterObject* self, PyObject* args, PyObject* kwargs) {
 }
 
 static PyObject* Writer_get_vendor(WriterObject* self) {
-	const char* vendor = loc_writer_get_vendor(self->writer);
+	location_lock(self->lock);
+
+	PyObject* vendor = PyUnicode_FromString(loc_writer_get_vendor(self->writer));
+
+	PyThread_release_lock(self->lock);
 
-	return PyUnicode_FromString(vendor);
+	return vendor;
 }
 
 static int Writer_set_vendor(WriterObject* self, PyObject* value) {
 	const char* vendor = PyUnicode_AsUTF8(value);
 
+	location_lock(self->lock);
 	int r = loc_writer_set_vendor(self->writer, vendor);
+	PyThread_release_lock(self->lock);
+
 	if (r) {
 		PyErr_Format(PyExc_ValueError, "Could not set vendor: %s", vendor);
 		return r;
@@ -110,15 +138,22 @@ static int Writer_set_vendor(WriterObject* self, PyObject* value) {
 }
 
 static PyObject* Writer_get_description(WriterObject* self) {
-	const char* description = loc_writer_get_description(self->writer);
+	location_lock(self->lock);
+
+	PyObject* description = PyUnicode_FromString(loc_writer_get_description(self->writer));
+
+	PyThread_release_lock(self->lock);
 
-	return PyUnicode_FromString(description);
+	return description;
 }
 
 static int Writer_set_description(WriterObject* self, PyObject* value) {
 	const char* description = PyUnicode_AsUTF8(value);
 
+	location_lock(self->lock);
 	int r = loc_writer_set_description(self->writer, description);
+	PyThread_release_lock(self->lock);
+
 	if (r) {
 		PyErr_Format(PyExc_ValueError, "Could not set description: %s", description);
 		return r;
@@ -128,15 +163,22 @@ static int Writer_set_description(WriterObject* self, PyObject* value) {
 }
 
 static PyObject* Writer_get_license(WriterObject* self) {
-	const char* license = loc_writer_get_license(self->writer);
+	location_lock(self->lock);
+
+	PyObject* license = PyUnicode_FromString(loc_writer_get_license(self->writer));
 
-	return PyUnicode_FromString(license);
+	PyThread_release_lock(self->lock);
+
+	return license;
 }
 
 static int Writer_set_license(WriterObject* self, PyObject* value) {
 	const char* license = PyUnicode_AsUTF8(value);
 
+	location_lock(self->lock);
 	int r = loc_writer_set_license(self->writer, license);
+	PyThread_release_lock(self->lock);
+
 	if (r) {
 		PyErr_Format(PyExc_ValueError, "Could not set license: %s", license);
 		return r;
@@ -145,6 +187,40 @@ static int Writer_set_license(WriterObject* self, PyObject* value) {
 	return 0;
 }
 
+static PyObject* Writer_get_aggregate(WriterObject* self) {
+	location_lock(self->lock);
+	int flags = loc_writer_get_flags(self->writer);
+	PyThread_release_lock(self->lock);
+
+	return PyBool_FromLong(flags & LOC_WRITER_FLAGS_AGGREGATE);
+}
+
+static int Writer_set_aggregate(WriterObject* self, PyObject* value) {
+	int aggregate = PyObject_IsTrue(value);
+	if (aggregate < 0)
+		return aggregate;
+
+	location_lock(self->lock);
+
+	int flags = loc_writer_get_flags(self->writer);
+
+	if (aggregate)
+		flags |= LOC_WRITER_FLAGS_AGGREGATE;
+	else
+		flags &= ~LOC_WRITER_FLAGS_AGGREGATE;
+
+	int r = loc_writer_set_flags(self->writer, flags);
+
+	PyThread_release_lock(self->lock);
+
+	if (r) {
+		PyErr_SetFromErrno(PyExc_OSError);
+		return r;
+	}
+
+	return 0;
+}
+
 static PyObject* Writer_add_as(WriterObject* self, PyObject* args) {
 	struct loc_as* as;
 	uint32_t number = 0;
@@ -153,13 +229,22 @@ static PyObject* Writer_add_as(WriterObject* self, PyObject* args) {
 		return NULL;
 
 	// Create AS object
+	location_lock(self->lock);
 	int r = loc_writer_add_as(self->writer, &as, number);
+	PyThread_release_lock(self->lock);
+
 	if (r)
 		return NULL;
 
 	PyObject* obj = new_as(&ASType, as);
 	loc_as_unref(as);
 
+	// The object belongs to this writer
+	if (obj) {
+		Py_INCREF(self);
+		((ASObject*)obj)->writer = (PyObject*)self;
+	}
+
 	return obj;
 }
 
@@ -171,7 +256,10 @@ static PyObject* Writer_add_country(WriterObject* self, PyObject* args) {
 		return NULL;
 
 	// Create country object
+	location_lock(self->lock);
 	int r = loc_writer_add_country(self->writer, &country, country_code);
+	PyThread_release_lock(self->lock);
+
 	if (r) {
 		switch (r) {
 			case -EINVAL:
@@ -186,6 +274,12 @@ static PyObject* Writer_add_country(WriterObject* self, PyObject* args) {
 	PyObject* obj = new_country(&CountryType, country);
 	loc_country_unref(country);
 
+	// The object belongs to this writer
+	if (obj) {
+		Py_INCREF(self);
+		((CountryObject*)obj)->writer = (PyObject*)self;
+	}
+
 	return obj;
 }
 
@@ -197,7 +291,10 @@ static PyObject* Writer_add_network(WriterObject* self, PyObject* args) {
 		return NULL;
 
 	// Create network object
+	location_lock(self->lock);
 	int r = loc_writer_add_network(self->writer, &network, string);
+	PyThread_release_lock(self->lock);
+
 	if (r) {
 		switch (r) {
 			case -EINVAL:
@@ -215,6 +312,12 @@ static PyObject* Writer_add_network(WriterObject* self, PyObject* args) {
 	PyObject* obj = new_network(&NetworkType, network);
 	loc_network_unref(network);
 
+	// The object belongs to this writer
+	if (obj) {
+		Py_INCREF(self);
+		((NetworkObject*)obj)->writer = (PyObject*)self;
+	}
+
 	return obj;
 }
 
@@ -231,7 +334,16 @@ static PyObject* Writer_write(WriterObject* self, PyObject* args) {
 		return NULL;
 	}
 
-	int r = loc_writer_write(self->writer, f, (enum loc_database_version)version);
+	int r;
+
+	Py_BEGIN_ALLOW_THREADS
+	PyThread_acquire_lock(self->lock, WAIT_LOCK);
+
+	r = loc_writer_write(self->writer, f, (enum loc_database_version)version);
+
+	PyThread_release_lock(self->lock);
+	Py_END_ALLOW_THREADS
+
 	fclose(f);
 
 	// Raise any errors
@@ -272,6 +384,13 @@ static struct PyMethodDef Writer_methods[] = {
 };
 
 static struct PyGetSetDef Writer_getsetters[] = {
+	{
+		"aggregate",
+		(getter)Writer_get_aggregate,
+		(setter)Writer_set_aggregate,
+		NULL,
+		NULL,
+	},
 	{
 		"description",
 		(getter)Writer_get_description,
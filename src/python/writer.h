@@ -24,8 +24,18 @@
 typedef struct {
 	PyObject_HEAD
 	struct loc_writer* writer;
+
+	// Protects the writer while the GIL is released
+	PyThread_type_lock lock;
 } WriterObject;
 
 extern PyTypeObject WriterType;
 
+/*
+	Objects that have been handed out by a writer must hold its lock
+	while they are being changed, because it might be writing them
+*/
+void writer_lock(PyObject* writer);
+void writer_unlock(PyObject* writer);
+
 #endif /* PYTHON_LOCATION_WRITER_H */
@@ -15,6 +15,7 @@
 */
 
 #include <stdlib.h>
+#include <arpa/inet.h>
 #include <string.h>
 #include <syslog.h>
 
@@ -110,6 +111,628 @@ static int perform_tests(struct loc_ctx* ctx, const int family) {
 	return 0;
 }
 
+/*
+	These are the original byte-wise implementations which the word-level
+	functions in address.h are being compared against.
+*/
+#define foreach_octet_in_address(octet, address) \
+	for (octet = (IN6_IS_ADDR_V4MAPPED(address) ? 12 : 0); octet <= 15; octet++)
+
+#define foreach_octet_in_address_reverse(octet, address) \
+	for (octet = 15; octet >= (IN6_IS_ADDR_V4MAPPED(address) ? 12 : 0); octet--)
+
+static int reference_cmp(const struct in6_addr* a1, const struct in6_addr* a2) {
+	for (unsigned int i = 0; i < 16; i++) {
+		if (a1->s6_addr[i] > a2->s6_addr[i])
+			return 1;
+
+		else if (a1->s6_addr[i] < a2->s6_addr[i])
+			return -1;
+	}
+
+	return 0;
+}
+
+static int reference_all_zeroes(const struct in6_addr* address) {
+	int octet = 0;
+
+	foreach_octet_in_address(octet, address) {
+		if (address->s6_addr[octet])
+			return 0;
+	}
+
+	return 1;
+}
+
+static int reference_all_ones(const struct in6_addr* address) {
+	int octet = 0;
+
+	foreach_octet_in_address(octet, address) {
+		if (address->s6_addr[octet] < 255)
+			return 0;
+	}
+
+	return 1;
+}
+
+static struct in6_addr reference_prefix_to_bitmask(const unsigned int prefix) {
+	struct in6_addr bitmask;
+
+	for (unsigned int i = 0; i < 16; i++)
+		bitmask.s6_addr[i] = 0;
+
+	for (int i = prefix, j = 0; i > 0; i -= 8, j++) {
+		if (i >= 8)
+			bitmask.s6_addr[j] = 0xff;
+		else
+			bitmask.s6_addr[j] = 0xff << (8 - i);
+	}
+
+	return bitmask;
+}
+
+static unsigned int reference_bit_length(const struct in6_addr* address) {
+	unsigned int bitlength = 0;
+	int trailing_zeroes;
+	int octet = 0;
+
+	if (IN6_IS_ADDR_V4MAPPED(address))
+		bitlength = 32;
+	else
+		bitlength = 128;
+
+	foreach_octet_in_address_reverse(octet, address) {
+		if (!address->s6_addr[octet]) {
+			bitlength -= 8;
+			continue;
+		}
+
+		trailing_zeroes = __builtin_ctz(address->s6_addr[octet]);
+
+		bitlength -= trailing_zeroes;
+
+		if (trailing_zeroes < 8)
+			return bitlength;
+	}
+
+	return 0;
+}
+
+static int reference_common_bits(const struct in6_addr* a1, const struct in6_addr* a2) {
+	int bits = 0;
+
+	if (IN6_IS_ADDR_V4MAPPED(a1) != IN6_IS_ADDR_V4MAPPED(a2))
+		return -EINVAL;
+
+	for (unsigned int i = (IN6_IS_ADDR_V4MAPPED(a1) ? 12 : 0); i <= 15; i++) {
+		if (a1->s6_addr[i] == a2->s6_addr[i]) {
+			bits += 8;
+		} else {
+			bits += __builtin_clz(a1->s6_addr[i] ^ a2->s6_addr[i]) - 24;
+			break;
+		}
+	}
+
+	return bits;
+}
+
+static int reference_sub(struct in6_addr* result,
+		const struct in6_addr* address1, const struct in6_addr* address2) {
+	int family1 = loc_address_family(address1);
+	int family2 = loc_address_family(address2);
+
+	if (family1 != family2)
+		return 1;
+
+	int r = loc_address_reset(result, family1);
+	if (r)
+		return r;
+
+	int octet = 0;
+	int remainder = 0;
+
+	foreach_octet_in_address_reverse(octet, address1) {
+		int x = address1->s6_addr[octet] - address2->s6_addr[octet] + remainder;
+
+		remainder = (x >> 8);
+
+		result->s6_addr[octet] = x & 0xff;
+	}
+
+	return 0;
+}
+
+static void reference_increment(struct in6_addr* address) {
+	if (reference_all_ones(address))
+		return;
+
+	int octet = 0;
+	foreach_octet_in_address_reverse(octet, address) {
+		if (address->s6_addr[octet] < 255) {
+			address->s6_addr[octet]++;
+			break;
+		} else {
+			address->s6_addr[octet] = 0;
+		}
+	}
+}
+
+static void reference_decrement(struct in6_addr* address) {
+	if (reference_all_zeroes(address))
+		return;
+
+	int octet = 0;
+	foreach_octet_in_address_reverse(octet, address) {
+		if (address->s6_addr[octet] > 0) {
+			address->s6_addr[octet]--;
+			break;
+		} else {
+			address->s6_addr[octet] = 255;
+		}
+	}
+}
+
+static int compare_unary(const struct in6_addr* address) {
+	struct in6_addr a1 = *address;
+	struct in6_addr a2 = *address;
+
+	if (loc_address_all_zeroes(address) != reference_all_zeroes(address)) {
+		fprintf(stderr, "loc_address_all_zeroes() differs for %s\n", loc_address_str(address));
+		return 1;
+	}
+
+	if (loc_address_all_ones(address) != reference_all_ones(address)) {
+		fprintf(stderr, "loc_address_all_ones() differs for %s\n", loc_address_str(address));
+		return 1;
+	}
+
+	if (loc_address_bit_length(address) != reference_bit_length(address)) {
+		fprintf(stderr, "loc_address_bit_length() differs for %s\n", loc_address_str(address));
+		return 1;
+	}
+
+	loc_address_increment(&a1);
+	reference_increment(&a2);
+
+	if (memcmp(&a1, &a2, sizeof(a1)) != 0) {
+		fprintf(stderr, "loc_address_increment() differs for %s\n", loc_address_str(address));
+		return 1;
+	}
+
+	a1 = a2 = *address;
+
+	loc_address_decrement(&a1);
+	reference_decrement(&a2);
+
+	if (memcmp(&a1, &a2, sizeof(a1)) != 0) {
+		fprintf(stderr, "loc_address_decrement() differs for %s\n", loc_address_str(address));
+		return 1;
+	}
+
+	return 0;
+}
+
+static int compare_binary(const struct in6_addr* a1, const struct in6_addr* a2) {
+	struct in6_addr result1;
+	struct in6_addr result2;
+	int r1, r2;
+
+	if (loc_address_cmp(a1, a2) != reference_cmp(a1, a2)) {
+		fprintf(stderr, "loc_address_cmp() differs for %s", loc_address_str(a1));
+		fprintf(stderr, " and %s\n", loc_address_str(a2));
+		return 1;
+	}
+
+	if (loc_address_common_bits(a1, a2) != reference_common_bits(a1, a2)) {
+		fprintf(stderr, "loc_address_common_bits() differs for %s", loc_address_str(a1));
+		fprintf(stderr, " and %s\n", loc_address_str(a2));
+		return 1;
+	}
+
+	memset(&result1, 0xaa, sizeof(result1));
+	memset(&result2, 0xaa, sizeof(result2));
+
+	r1 = loc_address_sub(&result1, a1, a2);
+	r2 = reference_sub(&result2, a1, a2);
+
+	if (r1 != r2 || memcmp(&result1, &result2, sizeof(result1)) != 0) {
+		fprintf(stderr, "loc_address_sub() differs for %s", loc_address_str(a1));
+		fprintf(stderr, " and %s\n", loc_address_str(a2));
+		return 1;
+	}
+
+	return 0;
+}
+
+static void random_address(struct in6_addr* address) {
+	struct in6_addr bitmask;
+
+	for (unsigned int i = 0; i < 16; i++)
+		address->s6_addr[i] = random();
+
+	// Make every other address an IPv4 address
+	if (random() % 2) {
+		loc_address_reset(address, AF_INET);
+		address->s6_addr32[3] = random();
+	}
+
+	// Clear a random number of trailing bits
+	if (random() % 2) {
+		bitmask = loc_prefix_to_bitmask(
+			128 - random() % (loc_address_family_bit_length(loc_address_family(address)) + 1));
+
+		*address = loc_address_and(address, &bitmask);
+	}
+}
+
+static int test_differential(void) {
+	struct in6_addr addresses[(128 + 32) * 4 + 4];
+	struct in6_addr bitmask;
+	struct in6_addr a1;
+	struct in6_addr a2;
+	unsigned int count = 0;
+	int r;
+
+	// Compare all bitmasks
+	for (unsigned int prefix = 0; prefix <= 128; prefix++) {
+		bitmask = loc_prefix_to_bitmask(prefix);
+		a1 = reference_prefix_to_bitmask(prefix);
+
+		if (memcmp(&bitmask, &a1, sizeof(bitmask)) != 0) {
+			fprintf(stderr, "loc_prefix_to_bitmask() differs for /%u\n", prefix);
+			return 1;
+		}
+	}
+
+	// Generate addresses around every bit boundary in both families
+	for (unsigned int family = AF_INET; family; family = (family == AF_INET) ? AF_INET6 : 0) {
+		const unsigned int length = loc_address_family_bit_length(family);
+		const unsigned int offset = 128 - length;
+
+		loc_address_reset(&addresses[count++], family);
+		loc_address_reset_last(&addresses[count++], family);
+
+		for (unsigned int bit = 0; bit < length; bit++) {
+			bitmask = loc_prefix_to_bitmask(offset + bit);
+
+			// Only this bit is set
+			loc_address_reset(&a1, family);
+			loc_address_set_bit(&a1, offset + bit, 1);
+			addresses[count++] = a1;
+
+			// All bits after this bit are set
+			loc_address_reset(&a1, family);
+			addresses[count++] = loc_address_or(&a1, &bitmask);
+
+			// All bits up to this bit are set
+			loc_address_reset_last(&a1, family);
+			addresses[count++] = loc_address_and(&a1, &bitmask);
+
+			// Everything but this bit is set
+			loc_address_reset_last(&a1, family);
+			loc_address_set_bit(&a1, offset + bit, 0);
+			addresses[count++] = a1;
+		}
+	}
+
+	// Compare all addresses against each other
+	for (unsigned int i = 0; i < count; i++) {
+		r = compare_unary(&addresses[i]);
+		if (r)
+			return r;
+
+		for (unsigned int j = 0; j < count; j++) {
+			r = compare_binary(&addresses[i], &addresses[j]);
+			if (r)
+				return r;
+		}
+	}
+
+	// Compare lots of random addresses
+	srandom(1);
+
+	for (unsigned int i = 0; i < 1000000; i++) {
+		random_address(&a1);
+		random_address(&a2);
+
+		// Make both addresses share a random number of leading bits
+		if (i % 2 && loc_address_family(&a1) == loc_address_family(&a2)) {
+			bitmask = loc_prefix_to_bitmask(random() % 129);
+
+			for (unsigned int j = 0; j < 4; j++)
+				a2.s6_addr32[j] = (a1.s6_addr32[j] & bitmask.s6_addr32[j])
+					| (a2.s6_addr32[j] & ~bitmask.s6_addr32[j]);
+		}
+
+		r = compare_unary(&a1);
+		if (r)
+			return r;
+
+		r = compare_binary(&a1, &a2);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
+/*
+	Parses string with inet_pton() the way loc_address_parse() used to
+*/
+static int reference_parse(struct in6_addr* address, const char* string) {
+	struct in_addr address4;
+
+	if (inet_pton(AF_INET6, string, address) == 1)
+		return 0;
+
+	if (inet_pton(AF_INET, string, &address4) == 1) {
+		loc_address_reset(address, AF_INET);
+		address->s6_addr32[3] = address4.s_addr;
+		return 0;
+	}
+
+	return 1;
+}
+
+static int compare_parse(const char* string) {
+	struct in6_addr address1;
+	struct in6_addr address2;
+	int r1, r2;
+
+	r1 = loc_address_parse(&address1, NULL, string);
+	r2 = reference_parse(&address2, string);
+
+	if (r1 != r2) {
+		fprintf(stderr, "Parsing '%s' returned %d, but inet_pton() returned %d\n", string, r1, r2);
+		return 1;
+	}
+
+	if (!r1 && memcmp(&address1, &address2, sizeof(address1)) != 0) {
+		fprintf(stderr, "Parsing '%s' returned %s", string, loc_address_str(&address1));
+		fprintf(stderr, " instead of %s\n", loc_address_str(&address2));
+		return 1;
+	}
+
+	return 0;
+}
+
+static int test_parse(void) {
+	const char alphabet[] = "0123456789abcdefABCDEFx:.";
+	struct in6_addr address;
+	char string[64];
+	int r;
+
+	const char* strings[] = {
+		"", ":", "::", ":::", "::1", "1::", "1:", ":1", "1::2::3",
+		"1:2:3:4:5:6:7:8", "1:2:3:4:5:6:7:8:9", "1:2:3:4:5:6:7::", "::2:3:4:5:6:7:8",
+		"1:2:3:4:5:6:7::8", "12345::", "ffff::", "FFFF::", "fffg::",
+		"::ffff:1.2.3.4", "::1.2.3.4", "1:2:3:4:5:6:1.2.3.4", "1:2:3:4:5:6:7:1.2.3.4",
+		"::1.2.3", "::1.2.3.4.5", "1.2.3.4::",
+		"0.0.0.0", "1.2.3.4", "255.255.255.255", "256.0.0.0", "01.2.3.4", "1.2.3.04",
+		"1.2.3", "1.2.3.4.", ".1.2.3.4", "1..2.3", "1.2.3.4 ", " 1.2.3.4", "1,2,3,4",
+		NULL,
+	};
+
+	for (const char** s = strings; *s; s++) {
+		r = compare_parse(*s);
+		if (r)
+			return r;
+	}
+
+	srandom(1);
+
+	for (unsigned int i = 0; i < 1000000; i++) {
+		// Format a random address and mutate it
+		if (i % 2) {
+			for (unsigned int j = 0; j < 16; j++)
+				address.s6_addr[j] = (random() % 4) ? 0 : random();
+
+			if (i % 3 == 0) {
+				loc_address_reset(&address, AF_INET);
+				address.s6_addr32[3] = random();
+			}
+
+			loc_address_format(&address, string, sizeof(string));
+
+			const size_t length = strlen(string);
+
+			switch (random() % 4) {
+				// Replace one character
+				case 0:
+					string[random() % length] = alphabet[random() % (sizeof(alphabet) - 1)];
+					break;
+
+				// Truncate
+				case 1:
+					string[random() % length] = '\0';
+					break;
+			}
+
+		// Make up a random string
+		} else {
+			const size_t length = random() % 24;
+
+			for (unsigned int j = 0; j < length; j++)
+				string[j] = alphabet[random() % (sizeof(alphabet) - 1)];
+
+			string[length] = '\0';
+		}
+
+		r = compare_parse(string);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
+/*
+	Increments an address without stopping at the end of the IPv4 address space
+*/
+static void next_address(struct in6_addr* address) {
+	uint64_t hi, lo;
+
+	loc_address_to_words(address, &hi, &lo);
+
+	if (!++lo)
+		hi++;
+
+	loc_address_from_words(address, hi, lo);
+}
+
+/*
+	Checks that the networks cover first - last exactly and that every network
+	is as large as possible, which means that there cannot be any fewer networks
+*/
+static int check_summarize(const struct in6_addr* first, const struct in6_addr* last) {
+	struct loc_address_prefix prefixes[LOC_ADDRESS_MAX_PREFIXES];
+	struct in6_addr bitmask;
+	struct in6_addr start = *first;
+	struct in6_addr end;
+
+	const unsigned int offset = 128 - loc_address_family_bit_length(loc_address_family(first));
+
+	int count = loc_address_summarize(first, last, prefixes, LOC_ADDRESS_MAX_PREFIXES);
+	if (count <= 0) {
+		fprintf(stderr, "Could not summarize %s", loc_address_str(first));
+		fprintf(stderr, " - %s: %d\n", loc_address_str(last), count);
+		return 1;
+	}
+
+	for (int i = 0; i < count; i++) {
+		bitmask = loc_prefix_to_bitmask(offset + prefixes[i].prefix);
+
+		// Each network must start right after the previous one
+		if (loc_address_cmp(&prefixes[i].address, &start) != 0)
+			goto ERROR;
+
+		// The address must be the first address of the network
+		end = loc_address_and(&prefixes[i].address, &bitmask);
+		if (loc_address_cmp(&end, &prefixes[i].address) != 0)
+			goto ERROR;
+
+		end = loc_address_or(&prefixes[i].address, &bitmask);
+
+		// The network must not extend beyond last
+		if (loc_address_cmp(&end, last) > 0)
+			goto ERROR;
+
+		// The next larger network must either not be aligned or extend beyond last
+		if (prefixes[i].prefix > 0) {
+			bitmask = loc_prefix_to_bitmask(offset + prefixes[i].prefix - 1);
+
+			const struct in6_addr larger = loc_address_or(&prefixes[i].address, &bitmask);
+			const struct in6_addr aligned = loc_address_and(&prefixes[i].address, &bitmask);
+
+			if (loc_address_cmp(&aligned, &prefixes[i].address) == 0
+					&& loc_address_cmp(&larger, last) <= 0)
+				goto ERROR;
+		}
+
+		start = end;
+		next_address(&start);
+	}
+
+	// The last network must end at last
+	if (loc_address_cmp(&end, last) == 0)
+		return 0;
+
+ERROR:
+	fprintf(stderr, "Wrong summary of %s", loc_address_str(first));
+	fprintf(stderr, " - %s:\n", loc_address_str(last));
+
+	for (int i = 0; i < count; i++)
+		fprintf(stderr, "  %s/%u\n", loc_address_str(&prefixes[i].address), prefixes[i].prefix);
+
+	return 1;
+}
+
+static int test_summarize(void) {
+	struct loc_address_prefix prefixes[LOC_ADDRESS_MAX_PREFIXES];
+	struct in6_addr first;
+	struct in6_addr last;
+	int r;
+
+	for (unsigned int family = AF_INET; family; family = (family == AF_INET) ? AF_INET6 : 0) {
+		const unsigned int length = loc_address_family_bit_length(family);
+
+		// The entire address space is one network
+		loc_address_reset(&first, family);
+		loc_address_reset_last(&last, family);
+
+		r = loc_address_summarize(&first, &last, prefixes, LOC_ADDRESS_MAX_PREFIXES);
+		if (r != 1 || prefixes[0].prefix != 0) {
+			fprintf(stderr, "Could not summarize the entire address space: %d\n", r);
+			return 1;
+		}
+
+		// A single address
+		r = loc_address_summarize(&last, &last, prefixes, LOC_ADDRESS_MAX_PREFIXES);
+		if (r != 1 || prefixes[0].prefix != length) {
+			fprintf(stderr, "Could not summarize a single address: %d\n", r);
+			return 1;
+		}
+
+		// Everything but the first and last address needs the most networks
+		loc_address_increment(&first);
+		loc_address_decrement(&last);
+
+		r = loc_address_summarize(&first, &last, prefixes, LOC_ADDRESS_MAX_PREFIXES);
+		if (r != (int)(2 * length - 2)) {
+			fprintf(stderr, "Unexpected number of networks: %d\n", r);
+			return 1;
+		}
+
+		r = check_summarize(&first, &last);
+		if (r)
+			return r;
+
+		// The buffer is too small
+		r = loc_address_summarize(&first, &last, prefixes, length);
+		if (r != -ENOBUFS) {
+			fprintf(stderr, "Summarizing into a small buffer did not fail: %d\n", r);
+			return 1;
+		}
+
+		// The range is empty
+		r = loc_address_summarize(&last, &first, prefixes, LOC_ADDRESS_MAX_PREFIXES);
+		if (r != -EINVAL) {
+			fprintf(stderr, "Summarizing an empty range did not fail: %d\n", r);
+			return 1;
+		}
+	}
+
+	// Families must not be mixed
+	loc_address_reset(&first, AF_INET);
+	loc_address_reset_last(&last, AF_INET6);
+
+	r = loc_address_summarize(&first, &last, prefixes, LOC_ADDRESS_MAX_PREFIXES);
+	if (r != -EINVAL) {
+		fprintf(stderr, "Summarizing a range of mixed families did not fail: %d\n", r);
+		return 1;
+	}
+
+	// Summarize lots of random ranges
+	srandom(1);
+
+	for (unsigned int i = 0; i < 100000; i++) {
+		random_address(&first);
+		random_address(&last);
+
+		if (loc_address_family(&first) != loc_address_family(&last))
+			continue;
+
+		if (loc_address_cmp(&first, &last) > 0)
+			r = check_summarize(&last, &first);
+		else
+			r = check_summarize(&first, &last);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
 int main(int argc, char** argv) {
 	struct loc_ctx* ctx = NULL;
 	int r = EXIT_FAILURE;
@@ -131,6 +754,21 @@ int main(int argc, char** argv) {
 	if (r)
 		goto ERROR;
 
+	// Compare against the original implementations
+	r = test_differential();
+	if (r)
+		goto ERROR;
+
+	// Compare the parser against inet_pton()
+	r = test_parse();
+	if (r)
+		goto ERROR;
+
+	// Summarize ranges into networks
+	r = test_summarize();
+	if (r)
+		goto ERROR;
+
 ERROR:
 	loc_unref(ctx);
 
@@ -23,6 +23,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <syslog.h>
+#include <arpa/inet.h>
 
 #include <libloc/libloc.h>
 #include <libloc/database.h>
@@ -46,6 +47,1108 @@ const char* networks[] = {
 	NULL,
 };
 
+static int write_random_database(struct loc_ctx* ctx, FILE* f, unsigned int threads) {
+	struct loc_writer* writer = NULL;
+	struct loc_network* network = NULL;
+	const char* country_codes[] = { "DE", "XX", };
+	char address[INET6_ADDRSTRLEN];
+	char string[INET6_ADDRSTRLEN + 4];
+	struct in6_addr a;
+	int r;
+
+	// Always generate the same networks
+	srandom(1);
+
+	r = loc_writer_new(ctx, &writer, NULL, NULL);
+	if (r)
+		return r;
+
+	r = loc_writer_set_threads(writer, threads);
+	if (r)
+		goto ERROR;
+
+	for (unsigned int i = 0; i < 10000; i++) {
+		// Generate a random IPv4 or IPv6 network in a small range
+		if (i % 2) {
+			snprintf(string, sizeof(string), "%ld.%ld.%ld.0/%ld",
+				random() % 4, random() % 256, random() % 256, 6 + random() % 18);
+		} else {
+			memset(&a, 0, sizeof(a));
+
+			a.s6_addr[0] = 0x20;
+			a.s6_addr[1] = random() % 4;
+			a.s6_addr[2] = random() % 256;
+			a.s6_addr[3] = random() % 256;
+
+			inet_ntop(AF_INET6, &a, address, sizeof(address));
+
+			snprintf(string, sizeof(string), "%s/%ld", address, 14 + random() % 18);
+		}
+
+		r = loc_writer_add_network(writer, &network, string);
+		switch (r) {
+			case 0:
+				break;
+
+			// Skip any duplicates
+			case -EBUSY:
+				continue;
+
+			default:
+				goto ERROR;
+		}
+
+		loc_network_set_country_code(network, country_codes[random() % 2]);
+
+		loc_network_set_asn(network, 1 + random() % 4);
+
+		if (random() % 4 == 0)
+			loc_network_set_flag(network, LOC_NETWORK_FLAG_ANYCAST);
+
+		loc_network_unref(network);
+	}
+
+	r = loc_writer_write(writer, f, LOC_DATABASE_VERSION_UNSET);
+	if (r)
+		goto ERROR;
+
+ERROR:
+	loc_writer_unref(writer);
+
+	return r;
+}
+
+static int test_threads(struct loc_ctx* ctx) {
+	FILE* f[2] = { NULL, NULL };
+	char buffer[2][4096];
+	size_t bytes[2];
+	int r = 1;
+
+	// Don't log every single network
+	loc_set_log_priority(ctx, LOG_INFO);
+
+	for (unsigned int i = 0; i < 2; i++) {
+		f[i] = tmpfile();
+		if (!f[i])
+			goto ERROR;
+
+		// Write the database once with one thread and once with many
+		r = write_random_database(ctx, f[i], (i) ? 8 : 1);
+		if (r) {
+			fprintf(stderr, "Could not write database: %m\n");
+			goto ERROR;
+		}
+
+		rewind(f[i]);
+	}
+
+	// Both databases must be the same
+	for (off_t offset = 0;; offset += bytes[0]) {
+		bytes[0] = fread(buffer[0], 1, sizeof(buffer[0]), f[0]);
+		bytes[1] = fread(buffer[1], 1, sizeof(buffer[1]), f[1]);
+
+		// Ignore the creation timestamp
+		if (offset == 0 && bytes[0] >= 16 && bytes[1] >= 16) {
+			memset(buffer[0] + 8, 0, 8);
+			memset(buffer[1] + 8, 0, 8);
+		}
+
+		if (bytes[0] != bytes[1] || memcmp(buffer[0], buffer[1], bytes[0]) != 0) {
+			fprintf(stderr, "Databases written with different numbers of threads differ\n");
+			r = 1;
+			goto ERROR;
+		}
+
+		if (!bytes[0])
+			break;
+	}
+
+	r = 0;
+
+ERROR:
+	for (unsigned int i = 0; i < 2; i++) {
+		if (f[i])
+			fclose(f[i]);
+	}
+
+	return r;
+}
+
+/*
+	Enumerates all networks of one partition and checks them against expected
+*/
+static int check_partition(struct loc_database* db, int flags, unsigned int partition,
+		unsigned int partitions, char** expected, size_t* count) {
+	struct loc_database_enumerator* enumerator = NULL;
+	struct loc_network* network = NULL;
+	int r;
+
+	r = loc_database_enumerator_new(&enumerator, db, LOC_DB_ENUMERATE_NETWORKS, flags);
+	if (r)
+		return r;
+
+	r = loc_database_enumerator_set_partition(enumerator, partition, partitions);
+	if (r)
+		goto ERROR;
+
+	for (;;) {
+		r = loc_database_enumerator_next_network(enumerator, &network);
+		if (r || !network)
+			break;
+
+		const char* s = loc_network_str(network);
+
+		if (!expected[*count] || strcmp(s, expected[*count]) != 0) {
+			fprintf(stderr, "Partition %u/%u returned %s, expected %s\n",
+				partition, partitions, s, expected[*count] ? expected[*count] : "(null)");
+			r = 1;
+		}
+
+		loc_network_unref(network);
+		(*count)++;
+
+		if (r)
+			break;
+	}
+
+ERROR:
+	loc_database_enumerator_unref(enumerator);
+
+	return r;
+}
+
+static int test_partitions(struct loc_ctx* ctx) {
+	struct loc_database_enumerator* enumerator = NULL;
+	struct loc_database* db = NULL;
+	struct loc_network* network = NULL;
+	char** expected = NULL;
+	size_t count = 0;
+	size_t length = 0;
+	FILE* f = NULL;
+	int r = 1;
+
+	const int flags[] = { 0, LOC_DB_ENUMERATOR_FLAGS_FLATTEN, -1 };
+	const unsigned int partitions[] = { 1, 2, 3, 7, 16, 0 };
+
+	f = tmpfile();
+	if (!f)
+		goto ERROR;
+
+	r = write_random_database(ctx, f, 1);
+	if (r)
+		goto ERROR;
+
+	r = loc_database_new(ctx, &db, f);
+	if (r)
+		goto ERROR;
+
+	for (const int* flag = flags; *flag >= 0; flag++) {
+		r = loc_database_enumerator_new(&enumerator, db, LOC_DB_ENUMERATE_NETWORKS, *flag);
+		if (r)
+			goto ERROR;
+
+		// Enumerate everything at once
+		for (length = 0;; length++) {
+			r = loc_database_enumerator_next_network(enumerator, &network);
+			if (r)
+				goto ERROR;
+
+			if (!network)
+				break;
+
+			char** e = reallocarray(expected, length + 2, sizeof(*expected));
+			if (!e) {
+				loc_network_unref(network);
+				r = 1;
+				goto ERROR;
+			}
+
+			expected = e;
+			expected[length] = strdup(loc_network_str(network));
+			expected[length + 1] = NULL;
+
+			loc_network_unref(network);
+		}
+
+		loc_database_enumerator_unref(enumerator);
+		enumerator = NULL;
+
+		// All partitions together must return the same networks in the same order
+		for (const unsigned int* p = partitions; *p; p++) {
+			count = 0;
+
+			for (unsigned int i = 0; i < *p; i++) {
+				r = check_partition(db, *flag, i, *p, expected, &count);
+				if (r)
+					goto ERROR;
+			}
+
+			if (count != length) {
+				fprintf(stderr, "%u partitions returned %zu of %zu networks\n", *p, count, length);
+				r = 1;
+				goto ERROR;
+			}
+		}
+
+		for (size_t i = 0; i < length; i++)
+			free(expected[i]);
+		free(expected);
+		expected = NULL;
+	}
+
+	// Bogons cannot be partitioned
+	r = loc_database_enumerator_new(&enumerator, db, LOC_DB_ENUMERATE_BOGONS, 0);
+	if (r)
+		goto ERROR;
+
+	if (loc_database_enumerator_set_partition(enumerator, 0, 2) != -ENOTSUP) {
+		fprintf(stderr, "Bogons could be partitioned\n");
+		r = 1;
+		goto ERROR;
+	}
+
+	r = 0;
+
+ERROR:
+	if (expected) {
+		for (char** e = expected; *e; e++)
+			free(*e);
+		free(expected);
+	}
+	if (enumerator)
+		loc_database_enumerator_unref(enumerator);
+	if (db)
+		loc_database_unref(db);
+	if (f)
+		fclose(f);
+
+	return r;
+}
+
+static int test_lookup_record(struct loc_ctx* ctx) {
+	struct loc_database_record record;
+	struct loc_database* db = NULL;
+	struct loc_network* network = NULL;
+	struct in6_addr address;
+	unsigned int found = 0;
+	FILE* f = NULL;
+	int r = 1;
+
+	f = tmpfile();
+	if (!f)
+		goto ERROR;
+
+	r = write_random_database(ctx, f, 1);
+	if (r)
+		goto ERROR;
+
+	r = loc_database_new(ctx, &db, f);
+	if (r)
+		goto ERROR;
+
+	for (unsigned int i = 0; i < 10000; i++) {
+		memset(&address, 0, sizeof(address));
+
+		// Pick random addresses in the same ranges as the networks
+		if (i % 2) {
+			address.s6_addr32[2] = htonl(0xffff);
+			address.s6_addr32[3] = htonl(random() % (4 << 24));
+		} else {
+			address.s6_addr[0] = 0x20;
+			address.s6_addr[1] = random() % 4;
+
+			for (unsigned int j = 2; j < 16; j++)
+				address.s6_addr[j] = random();
+		}
+
+		r = loc_database_lookup(db, &address, &network);
+		if (r)
+			goto ERROR;
+
+		r = loc_database_lookup_record(db, &address, &record);
+		if (r < 0)
+			goto ERROR;
+
+		if (!network != (r == 1)) {
+			fprintf(stderr, "Lookup and record lookup disagree on whether there is a network\n");
+			r = 1;
+			goto ERROR;
+		}
+
+		if (network) {
+			if (memcmp(&record.address, loc_network_get_first_address(network), sizeof(record.address)) != 0
+					|| record.prefix != loc_network_prefix(network)
+					|| strcmp(record.country_code, loc_network_get_country_code(network)) != 0
+					|| record.asn != loc_network_get_asn(network)) {
+				fprintf(stderr, "Record lookup returned a different network than %s\n",
+					loc_network_str(network));
+				r = 1;
+				goto ERROR;
+			}
+
+			loc_network_unref(network);
+			network = NULL;
+			found++;
+		}
+	}
+
+	// Most addresses should have been found
+	if (!found) {
+		fprintf(stderr, "Record lookup did not find anything\n");
+		r = 1;
+		goto ERROR;
+	}
+
+	r = 0;
+
+ERROR:
+	if (network)
+		loc_network_unref(network);
+	if (db)
+		loc_database_unref(db);
+	if (f)
+		fclose(f);
+
+	return r;
+}
+
+static int test_lookup_result(struct loc_ctx* ctx) {
+	struct loc_database_record record;
+	struct loc_database_result result;
+	struct loc_database* db = NULL;
+	struct in6_addr address;
+	char path[] = "/tmp/test-database.XXXXXX";
+	char string[INET6_ADDRSTRLEN];
+	FILE* f = NULL;
+	int fd;
+	int r = 1;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return 1;
+
+	f = fdopen(fd, "w+");
+	if (!f)
+		goto ERROR;
+
+	r = write_random_database(ctx, f, 1);
+	if (r)
+		goto ERROR;
+
+	fflush(f);
+
+	// Open the database by its path
+	db = loc_database_open_path(path);
+	if (!db) {
+		fprintf(stderr, "Could not open %s: %m\n", path);
+		r = 1;
+		goto ERROR;
+	}
+
+	for (unsigned int i = 0; i < 10000; i++) {
+		memset(&address, 0, sizeof(address));
+
+		// Pick random addresses in the same ranges as the networks
+		if (i % 2) {
+			address.s6_addr32[2] = htonl(0xffff);
+			address.s6_addr32[3] = htonl(random() % (4 << 24));
+
+			inet_ntop(AF_INET, &address.s6_addr32[3], string, sizeof(string));
+		} else {
+			address.s6_addr[0] = 0x20;
+			address.s6_addr[1] = random() % 4;
+
+			for (unsigned int j = 2; j < 16; j++)
+				address.s6_addr[j] = random();
+
+			inet_ntop(AF_INET6, &address, string, sizeof(string));
+		}
+
+		r = loc_database_lookup_record(db, &address, &record);
+		if (r < 0)
+			goto ERROR;
+
+		// Results must be cleared if nothing was found
+		memset(&result, 0xff, sizeof(result));
+
+		if (loc_database_lookup_result(db, string, &result) != r) {
+			fprintf(stderr, "Lookup of %s returned something different\n", string);
+			r = 1;
+			goto ERROR;
+		}
+
+		if (r) {
+			record.asn = 0;
+			record.flags = 0;
+			record.prefix = 0;
+			*record.country_code = '\0';
+		}
+
+		if (result.asn != record.asn || result.flags != record.flags || result.prefix != record.prefix
+				|| result.country_code != ((*record.country_code)
+					? (record.country_code[0] << 8 | record.country_code[1]) : 0)) {
+			fprintf(stderr, "Lookup of %s returned a different result\n", string);
+			r = 1;
+			goto ERROR;
+		}
+	}
+
+	// Invalid addresses
+	r = loc_database_lookup_result(db, "XXX", &result);
+	if (r != -EINVAL) {
+		fprintf(stderr, "Invalid address was not rejected: %d\n", r);
+		r = 1;
+		goto ERROR;
+	}
+
+	r = 0;
+
+ERROR:
+	if (db)
+		loc_database_unref(db);
+	if (f)
+		fclose(f);
+	unlink(path);
+
+	return r;
+}
+
+struct walk_state {
+	struct loc_database_enumerator* enumerator;
+	unsigned int count;
+};
+
+/*
+	Compares each record with the next network of an enumerator with the same filters
+*/
+static int walk_callback(const struct loc_database_record* record, void* data) {
+	struct walk_state* state = data;
+	struct loc_network* network = NULL;
+	char address[INET6_ADDRSTRLEN];
+	char string[INET6_ADDRSTRLEN + 4];
+	int r;
+
+	if (IN6_IS_ADDR_V4MAPPED(&record->address))
+		inet_ntop(AF_INET, &record->address.s6_addr[12], address, sizeof(address));
+	else
+		inet_ntop(AF_INET6, &record->address, address, sizeof(address));
+
+	snprintf(string, sizeof(string), "%s/%u", address, record->prefix);
+
+	r = loc_database_enumerator_next_network(state->enumerator, &network);
+	if (r)
+		return r;
+
+	if (!network) {
+		fprintf(stderr, "Walk returned %s after the last network\n", string);
+		return 1;
+	}
+
+	if (strcmp(string, loc_network_str(network)) != 0
+			|| strcmp(record->country_code, loc_network_get_country_code(network)) != 0
+			|| record->asn != loc_network_get_asn(network)
+			|| !loc_network_has_flag(network, record->flags) != !record->flags) {
+		fprintf(stderr, "Walk returned %s (%s, AS%u), expected %s (%s, AS%u)\n",
+			string, record->country_code, record->asn, loc_network_str(network),
+			loc_network_get_country_code(network), loc_network_get_asn(network));
+		r = 1;
+	}
+
+	loc_network_unref(network);
+	state->count++;
+
+	return r;
+}
+
+static int check_walk(struct loc_database* db, int family,
+		struct loc_country_list* countries, struct loc_as_list* asns, uint32_t flags) {
+	struct walk_state state = { NULL, 0 };
+	struct loc_network* network = NULL;
+	int r;
+
+	r = loc_database_enumerator_new(&state.enumerator, db, LOC_DB_ENUMERATE_NETWORKS, 0);
+	if (r)
+		return r;
+
+	if (family)
+		loc_database_enumerator_set_family(state.enumerator, family);
+	if (countries)
+		loc_database_enumerator_set_countries(state.enumerator, countries);
+	if (asns)
+		loc_database_enumerator_set_asns(state.enumerator, asns);
+	if (flags)
+		loc_database_enumerator_set_flag(state.enumerator, flags);
+
+	r = loc_database_walk(db, family, countries, asns, flags, walk_callback, &state);
+	if (r)
+		goto ERROR;
+
+	// The enumerator must not have any more networks
+	r = loc_database_enumerator_next_network(state.enumerator, &network);
+	if (r)
+		goto ERROR;
+
+	if (network) {
+		fprintf(stderr, "Walk did not return %s\n", loc_network_str(network));
+		loc_network_unref(network);
+		r = 1;
+		goto ERROR;
+	}
+
+	// Something should have matched
+	if (!state.count) {
+		fprintf(stderr, "Walk did not return any networks\n");
+		r = 1;
+	}
+
+ERROR:
+	loc_database_enumerator_unref(state.enumerator);
+
+	return r;
+}
+
+static int walk_stop(const struct loc_database_record* record, void* data) {
+	unsigned int* count = data;
+
+	return (++(*count) == 10) ? 42 : 0;
+}
+
+static int test_walk(struct loc_ctx* ctx) {
+	struct loc_database_enumerator* enumerator = NULL;
+	struct loc_country_list* countries = NULL;
+	struct loc_network* network = NULL;
+	struct loc_country* country = NULL;
+	struct loc_as_list* asns = NULL;
+	struct loc_as* as = NULL;
+	struct loc_database* db = NULL;
+	unsigned int count = 0;
+	FILE* f = NULL;
+	int r = 1;
+
+	const int families[] = { AF_UNSPEC, AF_INET6, AF_INET, -1 };
+
+	f = tmpfile();
+	if (!f)
+		goto ERROR;
+
+	r = write_random_database(ctx, f, 1);
+	if (r)
+		goto ERROR;
+
+	r = loc_database_new(ctx, &db, f);
+	if (r)
+		goto ERROR;
+
+	r = loc_country_list_new(ctx, &countries);
+	if (r)
+		goto ERROR;
+
+	r = loc_country_new(ctx, &country, "DE");
+	if (r)
+		goto ERROR;
+
+	r = loc_country_list_append(countries, country);
+	if (r)
+		goto ERROR;
+
+	r = loc_as_list_new(ctx, &asns);
+	if (r)
+		goto ERROR;
+
+	for (unsigned int i = 3; i > 1; i--) {
+		r = loc_as_new(ctx, &as, i);
+		if (r)
+			goto ERROR;
+
+		r = loc_as_list_append(asns, as);
+		loc_as_unref(as);
+		if (r)
+			goto ERROR;
+	}
+
+	for (const int* family = families; *family >= 0; family++) {
+		r = check_walk(db, *family, NULL, NULL, 0);
+		if (r)
+			goto ERROR;
+
+		r = check_walk(db, *family, countries, NULL, 0);
+		if (r)
+			goto ERROR;
+
+		r = check_walk(db, *family, NULL, asns, 0);
+		if (r)
+			goto ERROR;
+
+		r = check_walk(db, *family, NULL, NULL, LOC_NETWORK_FLAG_ANYCAST);
+		if (r)
+			goto ERROR;
+
+		r = check_walk(db, *family, countries, asns, LOC_NETWORK_FLAG_ANYCAST);
+		if (r)
+			goto ERROR;
+	}
+
+	// Empty lists are filters that never match
+	loc_country_list_clear(countries);
+
+	r = check_walk(db, AF_UNSPEC, countries, asns, 0);
+	if (r)
+		goto ERROR;
+
+	r = check_walk(db, AF_UNSPEC, countries, NULL, LOC_NETWORK_FLAG_ANYCAST);
+	if (r)
+		goto ERROR;
+
+	r = loc_database_walk(db, AF_UNSPEC, countries, NULL, 0, walk_stop, &count);
+	if (r || count) {
+		fprintf(stderr, "Walk with an empty list returned %u network(s)\n", count);
+		r = 1;
+		goto ERROR;
+	}
+
+	r = loc_database_enumerator_new(&enumerator, db, LOC_DB_ENUMERATE_NETWORKS, 0);
+	if (r)
+		goto ERROR;
+
+	loc_database_enumerator_set_countries(enumerator, countries);
+
+	r = loc_database_enumerator_next_network(enumerator, &network);
+	if (r)
+		goto ERROR;
+
+	if (network) {
+		fprintf(stderr, "Enumerator with an empty list returned %s\n", loc_network_str(network));
+		loc_network_unref(network);
+		r = 1;
+		goto ERROR;
+	}
+
+	// The walk must stop when the callback returns non-zero
+	r = loc_database_walk(db, AF_UNSPEC, NULL, NULL, 0, walk_stop, &count);
+	if (r != 42 || count != 10) {
+		fprintf(stderr, "Walk did not stop: %d, %u\n", r, count);
+		r = 1;
+		goto ERROR;
+	}
+
+	r = 0;
+
+ERROR:
+	if (enumerator)
+		loc_database_enumerator_unref(enumerator);
+	if (countries)
+		loc_country_list_unref(countries);
+	if (country)
+		loc_country_unref(country);
+	if (asns)
+		loc_as_list_unref(asns);
+	if (db)
+		loc_database_unref(db);
+	if (f)
+		fclose(f);
+
+	return r;
+}
+
+struct lookup_results {
+	const char** expected;
+	unsigned int count;
+};
+
+static int lookup_callback(const char* string, size_t length,
+		struct loc_network* network, void* data) {
+	struct lookup_results* results = data;
+
+	const char* expected = results->expected[results->count++];
+
+	printf("Looked up %.*s: %s\n", (int)length, string,
+		(network) ? loc_network_str(network) : "(none)");
+
+	if (!expected && !network)
+		return 0;
+
+	if (!expected || !network || strcmp(expected, loc_network_str(network)) != 0) {
+		fprintf(stderr, "Unexpected result for %.*s\n", (int)length, string);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int test_lookup_from_buffer(struct loc_database* db) {
+	const char buffer[] =
+		"2001:db8:1000::1\n"
+		"  2001:db8:2020:ffff::\r\n"
+		"\n"
+		"not-an-address\n"
+		"10.0.0.1\n"
+		"2001:db8::1";
+
+	// All subnets have been merged into their parent network
+	const char* expected[] = {
+		"2001:db8::/32",
+		"2001:db8::/32",
+		NULL,
+		NULL,
+		"2001:db8::/32",
+	};
+
+	struct lookup_results results = {
+		.expected = expected,
+	};
+
+	int r = loc_database_lookup_from_buffer(db, buffer, sizeof(buffer) - 1,
+		lookup_callback, &results);
+	if (r)
+		return r;
+
+	// Check if we have seen all addresses
+	if (results.count != sizeof(expected) / sizeof(*expected)) {
+		fprintf(stderr, "Only %u addresses have been looked up\n", results.count);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+	Checks whether the first and last address of network are bogons
+*/
+static int check_bogon(struct loc_database* db, struct loc_ctx* ctx, const char* string, int expected) {
+	struct loc_network* network = NULL;
+	int r;
+
+	r = loc_network_new_from_string(ctx, &network, string);
+	if (r)
+		return r;
+
+	const struct in6_addr* addresses[] = {
+		loc_network_get_first_address(network),
+		loc_network_get_last_address(network),
+	};
+
+	for (unsigned int i = 0; i < 2; i++) {
+		r = loc_database_is_bogon(db, addresses[i]);
+		if (r != expected) {
+			fprintf(stderr, "%s: loc_database_is_bogon() returned %d, expected %d\n",
+				string, r, expected);
+			r = 1;
+			goto ERROR;
+		}
+	}
+
+	r = 0;
+
+ERROR:
+	loc_network_unref(network);
+
+	return r;
+}
+
+static int test_bogons(struct loc_ctx* ctx) {
+	struct loc_database_enumerator* enumerator = NULL;
+	struct loc_database* db = NULL;
+	struct loc_writer* writer = NULL;
+	struct loc_network* network = NULL;
+	unsigned int count = 0;
+	FILE* f = NULL;
+	int r;
+
+	// The gaps start at the beginning, in the middle of a block and at the end
+	const char* covered[] = {
+		"0.0.0.0/8",
+		"10.0.0.0/25",
+		"10.0.2.0/24",
+		"128.0.0.0/1",
+		NULL,
+	};
+
+	const char* expected[] = {
+		"1.0.0.0/8",
+		"2.0.0.0/7",
+		"4.0.0.0/6",
+		"8.0.0.0/7",
+		"10.0.0.128/25",
+		"10.0.1.0/24",
+		"10.0.3.0/24",
+		"10.0.4.0/22",
+		"10.0.8.0/21",
+		"10.0.16.0/20",
+		"10.0.32.0/19",
+		"10.0.64.0/18",
+		"10.0.128.0/17",
+		"10.1.0.0/16",
+		"10.2.0.0/15",
+		"10.4.0.0/14",
+		"10.8.0.0/13",
+		"10.16.0.0/12",
+		"10.32.0.0/11",
+		"10.64.0.0/10",
+		"10.128.0.0/9",
+		"11.0.0.0/8",
+		"12.0.0.0/6",
+		"16.0.0.0/4",
+		"32.0.0.0/3",
+		"64.0.0.0/2",
+		NULL,
+	};
+
+	r = loc_writer_new(ctx, &writer, NULL, NULL);
+	if (r)
+		return r;
+
+	for (const char** n = covered; *n; n++) {
+		r = loc_writer_add_network(writer, &network, *n);
+		if (r)
+			goto ERROR;
+
+		// Give every network a different country so that nothing will be merged
+		loc_network_set_country_code(network, (n - covered) % 2 ? "DE" : "FR");
+		loc_network_unref(network);
+	}
+
+	// Networks without a country code are bogons, too
+	r = loc_writer_add_network(writer, &network, "10.0.1.128/25");
+	if (r)
+		goto ERROR;
+
+	loc_network_unref(network);
+
+	f = tmpfile();
+	if (!f) {
+		r = 1;
+		goto ERROR;
+	}
+
+	r = loc_writer_write(writer, f, LOC_DATABASE_VERSION_UNSET);
+	if (r)
+		goto ERROR;
+
+	r = loc_database_new(ctx, &db, f);
+	if (r)
+		goto ERROR;
+
+	r = loc_database_enumerator_new(&enumerator, db, LOC_DB_ENUMERATE_BOGONS, 0);
+	if (r)
+		goto ERROR;
+
+	for (;;) {
+		r = loc_database_enumerator_next_network(enumerator, &network);
+		if (r) {
+			fprintf(stderr, "Error fetching the next bogon: %m\n");
+			goto ERROR;
+		}
+
+		if (!network)
+			break;
+
+		const char* s = loc_network_str(network);
+
+		if (!expected[count] || strcmp(s, expected[count]) != 0) {
+			fprintf(stderr, "Unexpected bogon %s, expected %s\n",
+				s, expected[count] ? expected[count] : "(null)");
+			loc_network_unref(network);
+			r = 1;
+			goto ERROR;
+		}
+
+		loc_network_unref(network);
+		count++;
+	}
+
+	// Check if we have seen all bogons
+	if (expected[count]) {
+		fprintf(stderr, "Missing bogon %s\n", expected[count]);
+		r = 1;
+		goto ERROR;
+	}
+
+	// Check single addresses
+	for (const char** n = expected; *n; n++) {
+		r = check_bogon(db, ctx, *n, 1);
+		if (r)
+			goto ERROR;
+	}
+
+	for (const char** n = covered; *n; n++) {
+		r = check_bogon(db, ctx, *n, 0);
+		if (r)
+			goto ERROR;
+	}
+
+	// There are no IPv6 networks at all
+	r = check_bogon(db, ctx, "2001:db8::/32", 1);
+	if (r)
+		goto ERROR;
+
+ERROR:
+	if (enumerator)
+		loc_database_enumerator_unref(enumerator);
+	if (db)
+		loc_database_unref(db);
+	if (writer)
+		loc_writer_unref(writer);
+	if (f)
+		fclose(f);
+
+	return r;
+}
+
+struct aggregate_test_network {
+	const char* network;
+	const char* country_code;
+	uint32_t asn;
+};
+
+static const struct aggregate_test_network aggregate_input[] = {
+	// Adjacent networks are merged
+	{ "10.0.0.0/24", "DE", 0 },
+	{ "10.0.1.0/24", "DE", 0 },
+
+	// Nothing is merged with a different ASN
+	{ "10.0.2.0/24", "DE", 1 },
+
+	// The remainder of a flattened network is merged with its neighbour
+	{ "10.1.0.0/16", "DE", 0 },
+	{ "10.1.128.0/17", "FR", 0 },
+	{ "10.2.0.0/16", "FR", 0 },
+
+	// Subnets with the same properties disappear
+	{ "10.4.0.0/16", "DE", 0 },
+	{ "10.4.1.0/24", "DE", 0 },
+
+	// Networks with a gap between them cannot be merged
+	{ "10.6.0.0/24", "DE", 0 },
+	{ "10.6.2.0/24", "DE", 0 },
+
+	// Ranges that are not aligned are split into as few networks as possible
+	{ "10.8.1.0/24", "DE", 0 },
+	{ "10.8.2.0/23", "DE", 0 },
+	{ "10.8.4.0/24", "DE", 0 },
+
+	{ "2001:db8::/33", "US", 0 },
+	{ "2001:db8:8000::/33", "US", 0 },
+	{ NULL },
+};
+
+static const char* aggregate_expected[] = {
+	"10.0.0.0/23",
+	"10.0.2.0/24",
+	"10.1.0.0/17",
+	"10.1.128.0/17",
+	"10.2.0.0/16",
+	"10.4.0.0/16",
+	"10.6.0.0/24",
+	"10.6.2.0/24",
+	"10.8.1.0/24",
+	"10.8.2.0/23",
+	"10.8.4.0/24",
+	"2001:db8::/32",
+	NULL,
+};
+
+// ::fffe:ffff:ffff is immediately followed by ::ffff:0.0.0.0
+static const struct aggregate_test_network aggregate_mapped_input[] = {
+	{ "::fffe:0:0/96", "DE", 0 },
+	{ "0.0.0.0/1", "DE", 0 },
+	{ "128.0.0.0/1", "DE", 0 },
+	{ NULL },
+};
+
+// Ranges are never merged across IPv6 and IPv4-mapped networks
+static const char* aggregate_mapped_expected[] = {
+	"::fffe:0:0/96",
+	"0.0.0.0/0",
+	NULL,
+};
+
+static int test_aggregate(struct loc_ctx* ctx,
+		const struct aggregate_test_network* input, const char** expected) {
+	struct loc_database_enumerator* enumerator = NULL;
+	struct loc_database* db = NULL;
+	struct loc_writer* writer = NULL;
+	struct loc_network* network = NULL;
+	unsigned int count = 0;
+	FILE* f = NULL;
+	int r;
+
+	r = loc_writer_new(ctx, &writer, NULL, NULL);
+	if (r)
+		return r;
+
+	for (unsigned int i = 0; input[i].network; i++) {
+		r = loc_writer_add_network(writer, &network, input[i].network);
+		if (r)
+			goto ERROR;
+
+		loc_network_set_country_code(network, input[i].country_code);
+		loc_network_set_asn(network, input[i].asn);
+		loc_network_unref(network);
+	}
+
+	f = tmpfile();
+	if (!f) {
+		r = 1;
+		goto ERROR;
+	}
+
+	r = loc_writer_write(writer, f, LOC_DATABASE_VERSION_UNSET);
+	if (r)
+		goto ERROR;
+
+	r = loc_database_new(ctx, &db, f);
+	if (r)
+		goto ERROR;
+
+	r = loc_database_enumerator_new(&enumerator, db,
+		LOC_DB_ENUMERATE_NETWORKS, LOC_DB_ENUMERATOR_FLAGS_AGGREGATE);
+	if (r)
+		goto ERROR;
+
+	for (;;) {
+		r = loc_database_enumerator_next_network(enumerator, &network);
+		if (r) {
+			fprintf(stderr, "Error fetching the next network: %m\n");
+			goto ERROR;
+		}
+
+		if (!network)
+			break;
+
+		const char* s = loc_network_str(network);
+
+		if (!expected[count] || strcmp(s, expected[count]) != 0) {
+			fprintf(stderr, "Unexpected network %s, expected %s\n",
+				s, expected[count] ? expected[count] : "(null)");
+			loc_network_unref(network);
+			r = 1;
+			goto ERROR;
+		}
+
+		loc_network_unref(network);
+		count++;
+	}
+
+	if (expected[count]) {
+		fprintf(stderr, "Missing network %s\n", expected[count]);
+		r = 1;
+		goto ERROR;
+	}
+
+	r = 0;
+
+ERROR:
+	if (enumerator)
+		loc_database_enumerator_unref(enumerator);
+	if (db)
+		loc_database_unref(db);
+	if (f)
+		fclose(f);
+	loc_writer_unref(writer);
+
+	return r;
+}
+
 static int attempt_to_open(struct loc_ctx* ctx, const char* path) {
 	FILE* f = fopen(path, "r");
 	if (!f)
@@ -196,6 +1299,11 @@ int main(int argc, char** argv) {
 		exit(EXIT_FAILURE);
 	}
 
+	// Lookup multiple addresses at once
+	err = test_lookup_from_buffer(db);
+	if (err)
+		exit(EXIT_FAILURE);
+
 	// Enumerator
 	struct loc_database_enumerator* enumerator;
 	err = loc_database_enumerator_new(&enumerator, db, LOC_DB_ENUMERATE_NETWORKS, 0);
@@ -224,8 +1332,42 @@ int main(int argc, char** argv) {
 
 	// Close the database
 	loc_database_unref(db);
-	loc_unref(ctx);
 	fclose(f);
 
+	// Check that the output does not depend on the number of threads
+	err = test_threads(ctx);
+	if (err)
+		exit(EXIT_FAILURE);
+
+	err = test_bogons(ctx);
+	if (err)
+		exit(EXIT_FAILURE);
+
+	err = test_partitions(ctx);
+	if (err)
+		exit(EXIT_FAILURE);
+
+	err = test_lookup_record(ctx);
+	if (err)
+		exit(EXIT_FAILURE);
+
+	err = test_lookup_result(ctx);
+	if (err)
+		exit(EXIT_FAILURE);
+
+	err = test_walk(ctx);
+	if (err)
+		exit(EXIT_FAILURE);
+
+	err = test_aggregate(ctx, aggregate_input, aggregate_expected);
+	if (err)
+		exit(EXIT_FAILURE);
+
+	err = test_aggregate(ctx, aggregate_mapped_input, aggregate_mapped_expected);
+	if (err)
+		exit(EXIT_FAILURE);
+
+	loc_unref(ctx);
+
 	return EXIT_SUCCESS;
 }
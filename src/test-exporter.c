@@ -0,0 +1,472 @@
+/*
+	libloc - A library to determine the location of someone on the Internet
+
+	Copyright (C) 2024 IPFire Development Team <info@ipfire.org>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include <libloc/libloc.h>
+#include <libloc/database.h>
+#include <libloc/exporter.h>
+#include <libloc/network.h>
+#include <libloc/writer.h>
+
+static const struct test_network {
+	const char* network;
+	const char* country_code;
+	uint32_t asn;
+	enum loc_network_flags flags;
+} test_networks[] = {
+	{ "10.0.0.0/24",   "DE", 100, 0 },
+	{ "10.0.1.0/24",   "DE", 100, 0 },
+	{ "10.1.0.0/16",   "FR", 200, LOC_NETWORK_FLAG_ANYCAST },
+	{ "2001:db8::/32", "DE", 200, 0 },
+	{ NULL },
+};
+
+static int create_database(struct loc_ctx* ctx, struct loc_database** db) {
+	struct loc_writer* writer = NULL;
+	struct loc_network* network = NULL;
+	FILE* f = NULL;
+	int r;
+
+	r = loc_writer_new(ctx, &writer, NULL, NULL);
+	if (r)
+		goto ERROR;
+
+	for (const struct test_network* n = test_networks; n->network; n++) {
+		r = loc_writer_add_network(writer, &network, n->network);
+		if (r)
+			goto ERROR;
+
+		loc_network_set_country_code(network, n->country_code);
+		loc_network_set_asn(network, n->asn);
+
+		if (n->flags)
+			loc_network_set_flag(network, n->flags);
+
+		loc_network_unref(network);
+	}
+
+	f = tmpfile();
+	if (!f) {
+		r = 1;
+		goto ERROR;
+	}
+
+	r = loc_writer_write(writer, f, LOC_DATABASE_VERSION_UNSET);
+	if (r)
+		goto ERROR;
+
+	r = loc_database_new(ctx, db, f);
+
+ERROR:
+	if (writer)
+		loc_writer_unref(writer);
+	if (f)
+		fclose(f);
+
+	return r;
+}
+
+static int test_export(struct loc_ctx* ctx, struct loc_database* db,
+		enum loc_exporter_format format, int family, const char** objects,
+		const char* expected, size_t expected_length) {
+	struct loc_exporter* exporter = NULL;
+	char* buffer = NULL;
+	size_t length = 0;
+	FILE* f = NULL;
+	int r;
+
+	r = loc_exporter_new(ctx, &exporter, db, format);
+	if (r) {
+		fprintf(stderr, "Could not create exporter: %s\n", strerror(-r));
+		goto ERROR;
+	}
+
+	for (const char** object = objects; *object; object++) {
+		if (strncmp(*object, "AS", 2) == 0)
+			r = loc_exporter_add_asn(exporter, strtoul(*object + 2, NULL, 10));
+		else
+			r = loc_exporter_add_country(exporter, *object);
+		if (r) {
+			fprintf(stderr, "Could not add %s: %s\n", *object, strerror(-r));
+			goto ERROR;
+		}
+	}
+
+	f = open_memstream(&buffer, &length);
+	if (!f) {
+		r = 1;
+		goto ERROR;
+	}
+
+	r = loc_exporter_export(exporter, family, NULL, f);
+	if (r) {
+		fprintf(stderr, "Could not export: %s\n", strerror(-r));
+		goto ERROR;
+	}
+
+	fclose(f);
+	f = NULL;
+
+	if (length != expected_length || memcmp(buffer, expected, length) != 0) {
+		fprintf(stderr, "Unexpected output:\n");
+		fwrite(buffer, length, 1, stderr);
+
+		r = 1;
+		goto ERROR;
+	}
+
+ERROR:
+	if (exporter)
+		loc_exporter_unref(exporter);
+	if (f)
+		fclose(f);
+	if (buffer)
+		free(buffer);
+
+	return r;
+}
+
+static int test_directory(struct loc_ctx* ctx, struct loc_database* db) {
+	struct loc_exporter* exporter = NULL;
+	char directory[] = "/tmp/libloc-test-exporter-XXXXXX";
+	char path[PATH_MAX];
+	char line[128];
+	FILE* f = NULL;
+	int r;
+
+	if (!mkdtemp(directory))
+		return 1;
+
+	r = loc_exporter_new(ctx, &exporter, db, LOC_EXPORTER_FORMAT_LIST);
+	if (r)
+		goto ERROR;
+
+	r = loc_exporter_add_country(exporter, "DE");
+	if (r)
+		goto ERROR;
+
+	r = loc_exporter_export(exporter, AF_INET, directory, NULL);
+	if (r) {
+		fprintf(stderr, "Could not export to %s: %s\n", directory, strerror(-r));
+		goto ERROR;
+	}
+
+	snprintf(path, sizeof(path), "%s/DEv4.networks", directory);
+
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "Could not open %s: %m\n", path);
+		r = 1;
+		goto ERROR;
+	}
+
+	if (!fgets(line, sizeof(line), f) || strcmp(line, "10.0.0.0/23\n") != 0) {
+		fprintf(stderr, "Unexpected content in %s\n", path);
+		r = 1;
+		goto ERROR;
+	}
+
+ERROR:
+	if (exporter)
+		loc_exporter_unref(exporter);
+	if (f)
+		fclose(f);
+
+	unlink(path);
+	rmdir(directory);
+
+	return r;
+}
+
+static int test_many_targets(struct loc_ctx* ctx, struct loc_database* db) {
+	struct loc_exporter* exporter = NULL;
+	char directory[] = "/tmp/libloc-test-exporter-XXXXXX";
+	struct rlimit limit;
+	struct rlimit saved;
+	struct dirent* entry;
+	char path[PATH_MAX];
+	char line[128];
+	unsigned int files = 0;
+	DIR* d = NULL;
+	FILE* f = NULL;
+	int r;
+
+	if (!mkdtemp(directory))
+		return 1;
+
+	r = getrlimit(RLIMIT_NOFILE, &saved);
+	if (r)
+		goto ERROR;
+
+	r = loc_exporter_new(ctx, &exporter, db, LOC_EXPORTER_FORMAT_LIST);
+	if (r)
+		goto ERROR;
+
+	// Export many more sets than we may have open files
+	for (uint32_t asn = 1; asn <= 200; asn++) {
+		r = loc_exporter_add_asn(exporter, asn);
+		if (r)
+			goto ERROR;
+	}
+
+	limit.rlim_cur = 32;
+	limit.rlim_max = saved.rlim_max;
+
+	r = setrlimit(RLIMIT_NOFILE, &limit);
+	if (r)
+		goto ERROR;
+
+	r = loc_exporter_export(exporter, AF_UNSPEC, directory, NULL);
+
+	// Restore the limit
+	setrlimit(RLIMIT_NOFILE, &saved);
+
+	if (r) {
+		fprintf(stderr, "Could not export to %s: %s\n", directory, strerror(-r));
+		goto ERROR;
+	}
+
+	// There must be one file for each set and family
+	d = opendir(directory);
+	if (!d) {
+		r = 1;
+		goto ERROR;
+	}
+
+	while ((entry = readdir(d))) {
+		if (*entry->d_name != '.')
+			files++;
+	}
+
+	if (files != 400) {
+		fprintf(stderr, "Exported %u file(s) instead of 400\n", files);
+		r = 1;
+		goto ERROR;
+	}
+
+	snprintf(path, sizeof(path), "%s/AS200v6.networks", directory);
+
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "Could not open %s: %m\n", path);
+		r = 1;
+		goto ERROR;
+	}
+
+	if (!fgets(line, sizeof(line), f) || strcmp(line, "2001:db8::/32\n") != 0) {
+		fprintf(stderr, "Unexpected content in %s\n", path);
+		r = 1;
+		goto ERROR;
+	}
+
+ERROR:
+	if (exporter)
+		loc_exporter_unref(exporter);
+	if (f)
+		fclose(f);
+
+	// Cleanup
+	if (d)
+		rewinddir(d);
+	else
+		d = opendir(directory);
+
+	if (d) {
+
+		while ((entry = readdir(d))) {
+			if (*entry->d_name == '.')
+				continue;
+
+			snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+			unlink(path);
+		}
+
+		closedir(d);
+	}
+
+	rmdir(directory);
+
+	return r;
+}
+
+static int test_invalid(struct loc_ctx* ctx, struct loc_database* db) {
+	struct loc_exporter* exporter = NULL;
+	int r;
+
+	// Invalid format
+	r = loc_exporter_new(ctx, &exporter, db, 0);
+	if (r != -EINVAL) {
+		fprintf(stderr, "Created an exporter with an invalid format\n");
+		return 1;
+	}
+
+	r = loc_exporter_new(ctx, &exporter, db, LOC_EXPORTER_FORMAT_LIST);
+	if (r)
+		return r;
+
+	// Invalid country code
+	r = loc_exporter_add_country(exporter, "XXX");
+	if (r != -EINVAL) {
+		fprintf(stderr, "Added an invalid country code\n");
+		r = 1;
+		goto ERROR;
+	}
+
+	// Invalid family
+	r = loc_exporter_export(exporter, AF_UNIX, NULL, stdout);
+	if (r != -EINVAL) {
+		fprintf(stderr, "Exported an invalid family\n");
+		r = 1;
+		goto ERROR;
+	}
+
+	// Nowhere to write to
+	r = loc_exporter_export(exporter, AF_INET, NULL, NULL);
+	if (r != -EINVAL) {
+		fprintf(stderr, "Exported to nowhere\n");
+		r = 1;
+		goto ERROR;
+	}
+
+	r = 0;
+
+ERROR:
+	loc_exporter_unref(exporter);
+
+	return r;
+}
+
+#define TEST_EXPORT(ctx, db, format, family, expected, ...) \
+	test_export(ctx, db, format, family, (const char*[]){ __VA_ARGS__, NULL }, \
+		expected, sizeof(expected) - 1)
+
+int main(int argc, char** argv) {
+	struct loc_database* db = NULL;
+	struct loc_ctx* ctx = NULL;
+	int r;
+
+	r = loc_new(&ctx);
+	if (r)
+		exit(EXIT_FAILURE);
+
+	// Enable debug logging
+	loc_set_log_priority(ctx, LOG_DEBUG);
+
+	r = create_database(ctx, &db);
+	if (r) {
+		fprintf(stderr, "Could not create database\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// List
+	r = TEST_EXPORT(ctx, db, LOC_EXPORTER_FORMAT_LIST, AF_INET,
+		"10.0.0.0/23\n"
+		"10.1.0.0/16\n",
+		"DE", "FR");
+	if (r)
+		exit(EXIT_FAILURE);
+
+	// ipset with a special country and an AS
+	r = TEST_EXPORT(ctx, db, LOC_EXPORTER_FORMAT_IPSET, AF_INET,
+		"create DEv4 hash:net family inet hashsize       64 maxelem 1048576 -exist\n"
+		"flush DEv4\n"
+		"add DEv4 10.0.0.0/23\n"
+		"create A3v4 hash:net family inet hashsize       64 maxelem 1048576 -exist\n"
+		"flush A3v4\n"
+		"add A3v4 10.1.0.0/16\n"
+		"create AS200v4 hash:net family inet hashsize       64 maxelem 1048576 -exist\n"
+		"flush AS200v4\n"
+		"add AS200v4 10.1.0.0/16\n",
+		"DE", "A3", "AS200");
+	if (r)
+		exit(EXIT_FAILURE);
+
+	// Duplicates are exported once, in the order they have been added first
+	r = TEST_EXPORT(ctx, db, LOC_EXPORTER_FORMAT_IPSET, AF_INET,
+		"create FRv4 hash:net family inet hashsize       64 maxelem 1048576 -exist\n"
+		"flush FRv4\n"
+		"add FRv4 10.1.0.0/16\n"
+		"create AS100v4 hash:net family inet hashsize       64 maxelem 1048576 -exist\n"
+		"flush AS100v4\n"
+		"add AS100v4 10.0.0.0/23\n"
+		"create DEv4 hash:net family inet hashsize       64 maxelem 1048576 -exist\n"
+		"flush DEv4\n"
+		"add DEv4 10.0.0.0/23\n",
+		"FR", "AS100", "DE", "FR", "DE", "AS100");
+	if (r)
+		exit(EXIT_FAILURE);
+
+	// nftables
+	r = TEST_EXPORT(ctx, db, LOC_EXPORTER_FORMAT_NFTABLES, AF_INET6,
+		"define DEv6 = {\n"
+		"\t2001:db8::/32,\n"
+		"}\n"
+		"define FRv6 = {\n"
+		"}\n",
+		"DE", "FR");
+	if (r)
+		exit(EXIT_FAILURE);
+
+	// All families at once
+	r = TEST_EXPORT(ctx, db, LOC_EXPORTER_FORMAT_LIST, AF_UNSPEC,
+		"2001:db8::/32\n"
+		"10.0.0.0/23\n"
+		"10.1.0.0/16\n",
+		"DE", "FR");
+	if (r)
+		exit(EXIT_FAILURE);
+
+	// xt_geoip stores the first and last address
+	r = TEST_EXPORT(ctx, db, LOC_EXPORTER_FORMAT_XT_GEOIP, AF_INET,
+		"\x0a\x00\x00\x00\x0a\x00\x01\xff",
+		"DE");
+	if (r)
+		exit(EXIT_FAILURE);
+
+	// Only special countries
+	r = TEST_EXPORT(ctx, db, LOC_EXPORTER_FORMAT_LIST, AF_INET,
+		"10.1.0.0/16\n",
+		"A3");
+	if (r)
+		exit(EXIT_FAILURE);
+
+	r = test_directory(ctx, db);
+	if (r)
+		exit(EXIT_FAILURE);
+
+	r = test_many_targets(ctx, db);
+	if (r)
+		exit(EXIT_FAILURE);
+
+	r = test_invalid(ctx, db);
+	if (r)
+		exit(EXIT_FAILURE);
+
+	loc_database_unref(db);
+	loc_unref(ctx);
+
+	return EXIT_SUCCESS;
+}
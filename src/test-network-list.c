@@ -20,11 +20,422 @@
 #include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
+#include <arpa/inet.h>
 
+#include <libloc/address.h>
 #include <libloc/libloc.h>
 #include <libloc/network.h>
 #include <libloc/network-list.h>
 
+static int test_bulk(struct loc_ctx* ctx) {
+	struct loc_network_list* list1 = NULL;
+	struct loc_network_list* list2 = NULL;
+	struct loc_network* network = NULL;
+	char string[INET6_ADDRSTRLEN + 4];
+	int r;
+
+	const char* expected[] = {
+		"10.0.0.0/24",
+		"10.0.1.0/24",
+		"10.0.2.0/24",
+		"10.0.3.0/24",
+		"10.0.4.0/24",
+		"10.0.5.0/24",
+		NULL,
+	};
+
+	r = loc_network_list_new(ctx, &list1);
+	if (r)
+		return r;
+
+	r = loc_network_list_new(ctx, &list2);
+	if (r)
+		return r;
+
+	// Append networks out of order and with a duplicate
+	for (const char* n = "4203542"; *n; n++) {
+		snprintf(string, sizeof(string), "10.0.%c.0/24", *n);
+
+		r = loc_network_new_from_string(ctx, &network, string);
+		if (r)
+			return r;
+
+		r = loc_network_list_append((*n % 2) ? list1 : list2, network);
+		loc_network_unref(network);
+		if (r)
+			return r;
+	}
+
+	// The list should still be in the order in which networks have been appended
+	network = loc_network_list_get(list2, 0);
+	if (strcmp(loc_network_str(network), "10.0.4.0/24") != 0) {
+		fprintf(stderr, "Unexpected first network %s\n", loc_network_str(network));
+		return 1;
+	}
+	loc_network_unref(network);
+
+	// Sort the list
+	r = loc_network_list_sort(list2);
+	if (r)
+		return r;
+
+	// The duplicate should have been dropped
+	if (loc_network_list_size(list2) != 3) {
+		fprintf(stderr, "Unexpected size after sorting: %zu\n",
+			loc_network_list_size(list2));
+		return 1;
+	}
+
+	// Add one more network to both lists
+	r = loc_network_new_from_string(ctx, &network, "10.0.1.0/24");
+	if (r)
+		return r;
+
+	r = loc_network_list_push(list1, network);
+	if (r)
+		return r;
+
+	r = loc_network_list_push(list2, network);
+	if (r)
+		return r;
+
+	loc_network_unref(network);
+
+	// Merge both lists
+	r = loc_network_list_merge(list1, list2);
+	if (r)
+		return r;
+
+	loc_network_list_dump(list1);
+
+	// Pop everything from the front
+	for (const char** e = expected; *e; e++) {
+		network = loc_network_list_pop_first(list1);
+		if (!network) {
+			fprintf(stderr, "List ended early, expected %s\n", *e);
+			return 1;
+		}
+
+		if (strcmp(loc_network_str(network), *e) != 0) {
+			fprintf(stderr, "Got %s, expected %s\n", loc_network_str(network), *e);
+			return 1;
+		}
+
+		loc_network_unref(network);
+	}
+
+	if (!loc_network_list_empty(list1)) {
+		fprintf(stderr, "The list should be empty\n");
+		return 1;
+	}
+
+	// Push again after the list has been drained from the front
+	r = loc_network_list_merge(list1, list2);
+	if (r)
+		return r;
+
+	if (loc_network_list_size(list1) != 4) {
+		fprintf(stderr, "Unexpected size after merging again: %zu\n",
+			loc_network_list_size(list1));
+		return 1;
+	}
+
+	loc_network_list_unref(list1);
+	loc_network_list_unref(list2);
+
+	return 0;
+}
+
+static int make_list(struct loc_ctx* ctx, struct loc_network_list** list, const char** networks) {
+	struct loc_network* network = NULL;
+	int r;
+
+	r = loc_network_list_new(ctx, list);
+	if (r)
+		return r;
+
+	for (const char** n = networks; *n; n++) {
+		r = loc_network_new_from_string(ctx, &network, *n);
+		if (r)
+			return r;
+
+		r = loc_network_list_append(*list, network);
+		loc_network_unref(network);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
+static int test_exclude(struct loc_ctx* ctx) {
+	struct loc_network_list* excluded = NULL;
+	struct loc_network_list* result = NULL;
+	struct loc_network_list* list = NULL;
+	struct loc_network* network = NULL;
+	struct loc_network* next = NULL;
+	unsigned long ipv4 = 0;
+	unsigned int ipv6 = 0;
+	int r;
+
+	const char* networks[] = {
+		"10.0.0.0/8",
+		"192.168.0.0/16",
+		"2001:db8::/32",
+		NULL,
+	};
+
+	// Overlapping, adjacent and unrelated networks in random order
+	const char* exclude[] = {
+		"10.2.0.0/16",
+		"10.1.2.0/24",
+		"10.1.0.0/16",
+		"10.255.255.255/32",
+		"2001:db8::/48",
+		"172.16.0.0/12",
+		NULL,
+	};
+
+	r = make_list(ctx, &list, networks);
+	if (r)
+		return r;
+
+	r = make_list(ctx, &excluded, exclude);
+	if (r)
+		return r;
+
+	result = loc_network_list_exclude(list, excluded);
+	if (!result) {
+		fprintf(stderr, "Could not exclude networks: %m\n");
+		return 1;
+	}
+
+	for (unsigned int i = 0; i < loc_network_list_size(result); i++) {
+		network = loc_network_list_get(result, i);
+
+		// Nothing must overlap with any excluded network
+		for (unsigned int j = 0; j < loc_network_list_size(excluded); j++) {
+			next = loc_network_list_get(excluded, j);
+
+			if (loc_network_overlaps(network, next)) {
+				fprintf(stderr, "%s overlaps with %s\n",
+					loc_network_str(network), loc_network_str(next));
+				return 1;
+			}
+
+			loc_network_unref(next);
+		}
+
+		// Networks must be in order and must not overlap
+		next = loc_network_list_get(result, i + 1);
+		if (next && loc_address_cmp(loc_network_get_last_address(network),
+				loc_network_get_first_address(next)) >= 0) {
+			fprintf(stderr, "%s and %s are out of order\n",
+				loc_network_str(network), loc_network_str(next));
+			return 1;
+		}
+
+		// Count all addresses
+		if (loc_network_address_family(network) == AF_INET)
+			ipv4 += 1ul << (32 - loc_network_prefix(network));
+		else
+			ipv6++;
+
+		if (next)
+			loc_network_unref(next);
+		loc_network_unref(network);
+	}
+
+	// Nothing but the excluded addresses must be missing
+	if (ipv4 != (1ul << 24) - 2 * (1ul << 16) - 1 + (1ul << 16)) {
+		fprintf(stderr, "Unexpected number of IPv4 addresses: %lu\n", ipv4);
+		return 1;
+	}
+
+	// 2001:db8::/32 without 2001:db8::/48 should be split into 16 networks
+	if (ipv6 != 16) {
+		fprintf(stderr, "Unexpected number of IPv6 networks: %u\n", ipv6);
+		return 1;
+	}
+
+	loc_network_list_unref(result);
+
+	// Excluding a single network should return the same result as before
+	network = loc_network_list_get(list, 0);
+	next = loc_network_list_get(excluded, 0);
+
+	result = loc_network_exclude(network, next);
+	if (!result) {
+		fprintf(stderr, "Could not exclude %s\n", loc_network_str(next));
+		return 1;
+	}
+
+	loc_network_list_dump(result);
+
+	if (loc_network_list_size(result) != 8) {
+		fprintf(stderr, "Unexpected result when excluding %s from %s\n",
+			loc_network_str(next), loc_network_str(network));
+		return 1;
+	}
+
+	loc_network_list_unref(result);
+	loc_network_unref(network);
+	loc_network_unref(next);
+
+	loc_network_list_unref(excluded);
+	loc_network_list_unref(list);
+
+	return 0;
+}
+
+static int make_value(struct loc_ctx* ctx, struct loc_network_value* value, const char* string) {
+	struct loc_network* network = NULL;
+	int r;
+
+	r = loc_network_new_from_string(ctx, &network, string);
+	if (r)
+		return r;
+
+	loc_network_to_value(network, value);
+	loc_network_unref(network);
+
+	return 0;
+}
+
+static int check_value_list(struct loc_network_value_list* list, const char** expected) {
+	char buffer[LOC_NETWORK_STRING_LENGTH];
+	struct loc_network_value value;
+	int r;
+
+	for (const char** e = expected; *e; e++) {
+		if (!loc_network_value_list_pop_first(list, &value)) {
+			fprintf(stderr, "List ended before %s\n", *e);
+			return 1;
+		}
+
+		r = loc_network_value_format(&value, buffer, sizeof(buffer));
+		if (r)
+			return r;
+
+		if (strcmp(buffer, *e) != 0) {
+			fprintf(stderr, "Expected %s, got %s\n", *e, buffer);
+			return 1;
+		}
+	}
+
+	if (loc_network_value_list_pop_first(list, &value)) {
+		fprintf(stderr, "List has more elements than expected\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+static int test_value_list(struct loc_ctx* ctx) {
+	struct loc_network_value_list list = {};
+	struct loc_network_value_list other = {};
+	struct loc_network_value_list excluded = {};
+	struct loc_network_value value;
+	int r;
+
+	// Networks in random order with duplicates
+	const char* networks[] = {
+		"10.2.0.0/16", "10.0.0.0/16", "10.1.0.0/16", "10.0.0.0/16", "10.3.0.0/16", NULL,
+	};
+
+	const char* sorted[] = {
+		"10.0.0.0/16", "10.1.0.0/16", "10.2.0.0/16", "10.3.0.0/16", NULL,
+	};
+
+	for (const char** n = networks; *n; n++) {
+		r = make_value(ctx, &value, *n);
+		if (r)
+			goto ERROR;
+
+		r = loc_network_value_list_push(&list, &value);
+		if (r)
+			goto ERROR;
+	}
+
+	r = check_value_list(&list, sorted);
+	if (r)
+		goto ERROR;
+
+	// Merge lists that follow, precede and interleave each other
+	const char* first[] = { "10.2.0.0/16", "10.6.0.0/16", NULL };
+	const char* second[] = { "10.7.0.0/16", "10.8.0.0/16", NULL };
+	const char* third[] = { "10.0.0.0/16", "10.1.0.0/16", NULL };
+	const char* fourth[] = { "10.1.0.0/16", "10.4.0.0/16", "10.9.0.0/16", NULL };
+
+	const char** merges[] = { first, second, third, fourth, NULL };
+
+	for (const char*** m = merges; *m; m++) {
+		loc_network_value_list_clear(&other);
+
+		for (const char** n = *m; *n; n++) {
+			r = make_value(ctx, &value, *n);
+			if (r)
+				goto ERROR;
+
+			r = loc_network_value_list_push(&other, &value);
+			if (r)
+				goto ERROR;
+		}
+
+		r = loc_network_value_list_merge(&list, &other);
+		if (r)
+			goto ERROR;
+	}
+
+	const char* merged[] = {
+		"10.0.0.0/16", "10.1.0.0/16", "10.2.0.0/16", "10.4.0.0/16",
+		"10.6.0.0/16", "10.7.0.0/16", "10.8.0.0/16", "10.9.0.0/16", NULL,
+	};
+
+	r = check_value_list(&list, merged);
+	if (r)
+		goto ERROR;
+
+	// Exclude some subnets
+	const char* exclude[] = { "10.0.0.0/9", "10.128.0.0/10", "10.255.255.255/32", NULL };
+
+	for (const char** n = exclude; *n; n++) {
+		r = make_value(ctx, &value, *n);
+		if (r)
+			goto ERROR;
+
+		r = loc_network_value_list_push(&excluded, &value);
+		if (r)
+			goto ERROR;
+	}
+
+	r = make_value(ctx, &value, "10.0.0.0/8");
+	if (r)
+		goto ERROR;
+
+	r = loc_network_value_list_append_excluded(&list, &value, &excluded);
+	if (r)
+		goto ERROR;
+
+	const char* remaining[] = {
+		"10.192.0.0/11", "10.224.0.0/12", "10.240.0.0/13", "10.248.0.0/14",
+		"10.252.0.0/15", "10.254.0.0/16", "10.255.0.0/17", "10.255.128.0/18",
+		"10.255.192.0/19", "10.255.224.0/20", "10.255.240.0/21", "10.255.248.0/22",
+		"10.255.252.0/23", "10.255.254.0/24", "10.255.255.0/25", "10.255.255.128/26",
+		"10.255.255.192/27", "10.255.255.224/28", "10.255.255.240/29", "10.255.255.248/30",
+		"10.255.255.252/31", "10.255.255.254/32", NULL,
+	};
+
+	r = check_value_list(&list, remaining);
+
+ERROR:
+	loc_network_value_list_free(&list);
+	loc_network_value_list_free(&other);
+	loc_network_value_list_free(&excluded);
+
+	return r;
+}
+
 int main(int argc, char** argv) {
 	int err;
 
@@ -173,6 +584,24 @@ int main(int argc, char** argv) {
 	if (excluded)
 		loc_network_list_unref(excluded);
 
+	err = test_bulk(ctx);
+	if (err) {
+		fprintf(stderr, "Bulk operations failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	err = test_exclude(ctx);
+	if (err) {
+		fprintf(stderr, "Excluding networks failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	err = test_value_list(ctx);
+	if (err) {
+		fprintf(stderr, "Value lists failed\n");
+		exit(EXIT_FAILURE);
+	}
+
 	loc_network_list_unref(subnets);
 	loc_network_unref(network1);
 	loc_network_unref(subnet1);
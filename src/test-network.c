@@ -26,6 +26,7 @@
 #include <libloc/address.h>
 #include <libloc/database.h>
 #include <libloc/network.h>
+#include <libloc/network-tree.h>
 #include <libloc/private.h>
 #include <libloc/writer.h>
 
@@ -90,6 +91,203 @@ static int test_reverse_pointers(struct loc_ctx* ctx) {
 	return 0;
 }
 
+static int count_networks(struct loc_network* network, void* data) {
+	unsigned int* counter = data;
+
+	(*counter)++;
+
+	return 0;
+}
+
+static int make_tree(struct loc_ctx* ctx, struct loc_network_tree** tree,
+		const char** networks, const char** country_codes) {
+	struct loc_network* network = NULL;
+	int r;
+
+	r = loc_network_tree_new(ctx, tree);
+	if (r)
+		return r;
+
+	for (unsigned int i = 0; networks[i]; i++) {
+		r = loc_network_new_from_string(ctx, &network, networks[i]);
+		if (r)
+			return r;
+
+		loc_network_set_country_code(network, country_codes[i]);
+
+		r = loc_network_tree_add_network(*tree, network);
+		loc_network_unref(network);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
+static int test_aggregate(struct loc_ctx* ctx) {
+	struct loc_network_tree* tree = NULL;
+	struct loc_network_tree* aggregated = NULL;
+	struct loc_network_tree* other = NULL;
+	unsigned int counter = 0;
+	int r;
+
+	const char* networks[] = {
+		"10.0.0.0/9",
+		"10.128.0.0/10",
+		"10.192.0.0/10",
+		"2001:db8::/48",
+		"2001:db8:1::/48",
+		"2001:db8:2::/48",
+		"2001:db8:3::/48",
+		NULL,
+	};
+
+	const char* country_codes[] = {
+		"US", "US", "DE", "DE", "DE", "DE", "US",
+	};
+
+	r = make_tree(ctx, &tree, networks, country_codes);
+	if (r)
+		goto ERROR;
+
+	r = loc_network_tree_aggregate(tree, &aggregated);
+	if (r) {
+		fprintf(stderr, "Could not aggregate the tree\n");
+		goto ERROR;
+	}
+
+	// 10.0.0.0/8, 10.192.0.0/10, 2001:db8::/46 and 2001:db8:3::/48 should remain
+	r = loc_network_tree_walk(aggregated, NULL, count_networks, &counter);
+	if (r)
+		goto ERROR;
+
+	if (counter != 4) {
+		fprintf(stderr, "Aggregated tree has %u networks, expected 4\n", counter);
+		r = 1;
+		goto ERROR;
+	}
+
+	// Both trees must return the same results
+	r = loc_network_tree_cmp_lookups(tree, aggregated);
+	if (r) {
+		fprintf(stderr, "Aggregated tree is not equivalent\n");
+		goto ERROR;
+	}
+
+	// Change the country of one network
+	country_codes[2] = "US";
+
+	r = make_tree(ctx, &other, networks, country_codes);
+	if (r)
+		goto ERROR;
+
+	// The verification must notice
+	if (!loc_network_tree_cmp_lookups(tree, other)) {
+		fprintf(stderr, "Different trees are equivalent\n");
+		r = 1;
+		goto ERROR;
+	}
+
+ERROR:
+	if (tree)
+		loc_network_tree_unref(tree);
+	if (aggregated)
+		loc_network_tree_unref(aggregated);
+	if (other)
+		loc_network_tree_unref(other);
+
+	return r;
+}
+
+static int test_values(struct loc_ctx* ctx) {
+	struct loc_network_value value;
+	struct loc_network_value subnet1;
+	struct loc_network_value subnet2;
+	struct loc_network* network = NULL;
+	struct loc_network* other = NULL;
+	struct loc_network_list* excluded = NULL;
+	char buffer[LOC_NETWORK_STRING_LENGTH];
+	int r;
+
+	r = loc_network_new_from_string(ctx, &network, "10.0.0.0/8");
+	if (r)
+		goto ERROR;
+
+	loc_network_set_country_code(network, "DE");
+
+	// Convert into a value and format it
+	loc_network_to_value(network, &value);
+
+	r = loc_network_value_format(&value, buffer, sizeof(buffer));
+	if (r || strcmp(buffer, "10.0.0.0/8") != 0) {
+		fprintf(stderr, "Could not format value: %s\n", buffer);
+		r = 1;
+		goto ERROR;
+	}
+
+	// Formatting into a short buffer must fail
+	r = loc_network_value_format(&value, buffer, 8);
+	if (r != -ENOBUFS) {
+		fprintf(stderr, "Formatting into a short buffer did not fail\n");
+		r = 1;
+		goto ERROR;
+	}
+
+	// Split into halves
+	r = loc_network_value_subnets(&value, &subnet1, &subnet2);
+	if (r)
+		goto ERROR;
+
+	r = loc_network_value_format(&subnet2, buffer, sizeof(buffer));
+	if (r || strcmp(buffer, "10.128.0.0/9") != 0) {
+		fprintf(stderr, "Unexpected second half: %s\n", buffer);
+		r = 1;
+		goto ERROR;
+	}
+
+	if (!loc_network_value_is_subnet(&value, &subnet2) || loc_network_value_is_subnet(&subnet1, &subnet2)) {
+		fprintf(stderr, "Subnet check failed\n");
+		r = 1;
+		goto ERROR;
+	}
+
+	// Convert back into a network
+	r = loc_network_new_from_value(ctx, &other, &subnet2);
+	if (r)
+		goto ERROR;
+
+	if (strcmp(loc_network_str(other), "10.128.0.0/9") != 0
+			|| strcmp(loc_network_get_country_code(other), "DE") != 0) {
+		fprintf(stderr, "Could not convert value into network: %s\n", loc_network_str(other));
+		r = 1;
+		goto ERROR;
+	}
+
+	loc_network_unref(other);
+
+	// Exclude a /16 which must leave eight networks behind
+	r = loc_network_new_from_string(ctx, &other, "10.1.0.0/16");
+	if (r)
+		goto ERROR;
+
+	excluded = loc_network_exclude(network, other);
+	if (!excluded || loc_network_list_size(excluded) != 8) {
+		fprintf(stderr, "Unexpected result after excluding a network\n");
+		r = 1;
+		goto ERROR;
+	}
+
+ERROR:
+	if (excluded)
+		loc_network_list_unref(excluded);
+	if (network)
+		loc_network_unref(network);
+	if (other)
+		loc_network_unref(other);
+
+	return r;
+}
+
 int main(int argc, char** argv) {
 	int err;
 
@@ -402,6 +600,15 @@ int main(int argc, char** argv) {
 	if (err)
 		exit(err);
 
+	// Test aggregation
+	err = test_aggregate(ctx);
+	if (err)
+		exit(EXIT_FAILURE);
+
+	err = test_values(ctx);
+	if (err)
+		exit(EXIT_FAILURE);
+
 	loc_unref(ctx);
 	fclose(f);
 
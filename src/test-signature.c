@@ -20,14 +20,277 @@
 #include <string.h>
 #include <fcntl.h>
 #include <ctype.h>
+#include <endian.h>
 #include <errno.h>
+#include <dirent.h>
+#include <limits.h>
 #include <unistd.h>
 #include <syslog.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #include <libloc/libloc.h>
 #include <libloc/database.h>
+#include <libloc/format.h>
 #include <libloc/writer.h>
 
+static FILE* write_database(struct loc_ctx* ctx, FILE* private_key) {
+	struct loc_writer* writer = NULL;
+	struct loc_network* network = NULL;
+	int err;
+
+	rewind(private_key);
+
+	err = loc_writer_new(ctx, &writer, private_key, NULL);
+	if (err < 0)
+		exit(EXIT_FAILURE);
+
+	// Add a network
+	err = loc_writer_add_network(writer, &network, "2001:db8::/32");
+	if (err) {
+		fprintf(stderr, "Could not add network\n");
+		exit(EXIT_FAILURE);
+	}
+
+	loc_network_set_country_code(network, "DE");
+	loc_network_unref(network);
+
+	FILE* f = tmpfile();
+	if (!f) {
+		fprintf(stderr, "Could not open file for writing: %m\n");
+		exit(EXIT_FAILURE);
+	}
+
+	err = loc_writer_write(writer, f, LOC_DATABASE_VERSION_UNSET);
+	if (err) {
+		fprintf(stderr, "Could not write database: %m\n");
+		exit(EXIT_FAILURE);
+	}
+	loc_writer_unref(writer);
+
+	return f;
+}
+
+static void modify_database(FILE* f) {
+	struct loc_database_header_v1 header;
+
+	// Read the header
+	if (fseek(f, LOC_DATABASE_MAGIC_SIZE, SEEK_SET)
+			|| fread(&header, 1, sizeof(header), f) < sizeof(header)) {
+		fprintf(stderr, "Could not read the header: %m\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Change the country of the network
+	if (fseek(f, be32toh(header.network_data_offset), SEEK_SET)
+			|| fwrite("XX", 1, 2, f) < 2 || fflush(f)) {
+		fprintf(stderr, "Could not modify the database: %m\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static int test_verify_on_demand(struct loc_ctx* ctx, FILE* private_key, FILE* public_key) {
+	struct loc_database* db = NULL;
+	struct loc_network* network = NULL;
+	int err;
+
+	FILE* f = write_database(ctx, private_key);
+
+	err = loc_database_new(ctx, &db, f);
+	if (err) {
+		fprintf(stderr, "Could not open database: %m\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Verify the signature of the page hashes
+	rewind(public_key);
+
+	err = loc_database_verify_on_demand(db, public_key);
+	if (err) {
+		fprintf(stderr, "Could not verify the database on demand: %d\n", err);
+		exit(EXIT_FAILURE);
+	}
+
+	// Lookup the network
+	err = loc_database_lookup_from_string(db, "2001:db8::1", &network);
+	if (err || !network) {
+		fprintf(stderr, "Could not lookup a verified network: %d\n", err);
+		exit(EXIT_FAILURE);
+	}
+	loc_network_unref(network);
+	loc_database_unref(db);
+
+	modify_database(f);
+
+	err = loc_database_new(ctx, &db, f);
+	if (err) {
+		fprintf(stderr, "Could not open database: %m\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// The database must no longer be valid
+	rewind(public_key);
+
+	err = loc_database_verify(db, public_key);
+	if (err == 0) {
+		fprintf(stderr, "Modified database was verified\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// The page hashes are still valid
+	rewind(public_key);
+
+	err = loc_database_verify_on_demand(db, public_key);
+	if (err) {
+		fprintf(stderr, "Could not verify the database on demand: %d\n", err);
+		exit(EXIT_FAILURE);
+	}
+
+	// But we must not be able to read the modified network
+	err = loc_database_lookup_from_string(db, "2001:db8::1", &network);
+	if (err == 0) {
+		fprintf(stderr, "Could lookup a modified network\n");
+		exit(EXIT_FAILURE);
+	}
+
+	loc_database_unref(db);
+	fclose(f);
+
+	return 0;
+}
+
+static unsigned int count_cache_records(const char* directory) {
+	unsigned int records = 0;
+	struct dirent* entry;
+
+	DIR* d = opendir(directory);
+	if (!d) {
+		fprintf(stderr, "Could not open %s: %m\n", directory);
+		exit(EXIT_FAILURE);
+	}
+
+	while ((entry = readdir(d))) {
+		if (strncmp(entry->d_name, "verified-", strlen("verified-")) == 0)
+			records++;
+	}
+
+	closedir(d);
+
+	return records;
+}
+
+static int verify_database(struct loc_ctx* ctx, FILE* f, FILE* public_key, int flags) {
+	struct loc_database* db = NULL;
+	int err;
+
+	err = loc_database_new(ctx, &db, f);
+	if (err) {
+		fprintf(stderr, "Could not open database: %m\n");
+		exit(EXIT_FAILURE);
+	}
+
+	loc_database_set_flags(db, flags);
+
+	rewind(public_key);
+
+	err = loc_database_verify(db, public_key);
+	loc_database_unref(db);
+
+	return err;
+}
+
+static int test_verify_cache(struct loc_ctx* ctx, FILE* private_key, FILE* public_key) {
+	char directory[] = "/tmp/libloc-test-signature-XXXXXX";
+	struct dirent* entry;
+	struct stat st;
+	char path[PATH_MAX];
+	int err;
+
+	if (!mkdtemp(directory)) {
+		fprintf(stderr, "Could not create a cache directory: %m\n");
+		exit(EXIT_FAILURE);
+	}
+
+	setenv("LOC_CACHE_DIR", directory, 1);
+
+	FILE* f = write_database(ctx, private_key);
+
+	// Results are only cached for files that have not been changed recently
+	sleep(3);
+
+	// The cache must not be used unless asked for
+	err = verify_database(ctx, f, public_key, 0);
+	if (err) {
+		fprintf(stderr, "Could not verify the database: %d\n", err);
+		exit(EXIT_FAILURE);
+	}
+
+	if (count_cache_records(directory)) {
+		fprintf(stderr, "Verification was cached without being enabled\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Verify the database twice
+	for (unsigned int i = 0; i < 2; i++) {
+		err = verify_database(ctx, f, public_key, LOC_DATABASE_FLAGS_CACHE_VERIFICATION);
+		if (err) {
+			fprintf(stderr, "Could not verify the database: %d\n", err);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (count_cache_records(directory) != 1) {
+		fprintf(stderr, "Verification was not cached\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (fstat(fileno(f), &st)) {
+		fprintf(stderr, "Could not stat the database: %m\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Modify the database and restore its timestamps
+	modify_database(f);
+
+	const struct timespec times[] = { st.st_atim, st.st_mtim };
+
+	if (futimens(fileno(f), times)) {
+		fprintf(stderr, "Could not change timestamps: %m\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Wait until the change could be cached again
+	sleep(3);
+
+	// The database must no longer be valid
+	err = verify_database(ctx, f, public_key, LOC_DATABASE_FLAGS_CACHE_VERIFICATION);
+	if (err == 0) {
+		fprintf(stderr, "Modified database was verified from cache\n");
+		exit(EXIT_FAILURE);
+	}
+
+	fclose(f);
+
+	// Cleanup
+	DIR* d = opendir(directory);
+	if (d) {
+		while ((entry = readdir(d))) {
+			if (*entry->d_name == '.')
+				continue;
+
+			snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+			unlink(path);
+		}
+
+		closedir(d);
+	}
+
+	rmdir(directory);
+	unsetenv("LOC_CACHE_DIR");
+
+	return 0;
+}
+
 int main(int argc, char** argv) {
 	int err;
 
@@ -93,6 +356,16 @@ int main(int argc, char** argv) {
 		exit(EXIT_FAILURE);
 	}
 
+	// Verify the database again only reading what we need
+	err = test_verify_on_demand(ctx, private_key1, public_key);
+	if (err)
+		exit(EXIT_FAILURE);
+
+	// Verify a database that has been verified before
+	err = test_verify_cache(ctx, private_key1, public_key);
+	if (err)
+		exit(EXIT_FAILURE);
+
 	// Open another public key
 	public_key = freopen(ABS_SRCDIR "/data/signing-key.pem", "r", public_key);
 	if (!public_key) {
@@ -67,6 +67,11 @@ struct loc_writer {
 
 	struct loc_as_list* as_list;
 	struct loc_country_list* country_list;
+
+	// The number of threads used to write the database
+	unsigned int threads;
+
+	enum loc_writer_flags flags;
 };
 
 static int parse_private_key(struct loc_writer* writer, EVP_PKEY** private_key, FILE* f) {
@@ -97,6 +102,9 @@ LOC_EXPORT int loc_writer_new(struct loc_ctx* ctx, struct loc_writer** writer,
 	w->ctx = loc_ref(ctx);
 	w->refcount = 1;
 
+	// Write in the calling thread unless told otherwise
+	w->threads = 1;
+
 	int r = loc_stringpool_new(ctx, &w->pool);
 	if (r) {
 		loc_writer_unref(w);
@@ -153,7 +161,7 @@ LOC_EXPORT int loc_writer_new(struct loc_ctx* ctx, struct loc_writer** writer,
 }
 
 LOC_EXPORT struct loc_writer* loc_writer_ref(struct loc_writer* writer) {
-	writer->refcount++;
+	__atomic_add_fetch(&writer->refcount, 1, __ATOMIC_RELAXED);
 
 	return writer;
 }
@@ -188,7 +196,7 @@ static void loc_writer_free(struct loc_writer* writer) {
 }
 
 LOC_EXPORT struct loc_writer* loc_writer_unref(struct loc_writer* writer) {
-	if (--writer->refcount > 0)
+	if (__atomic_sub_fetch(&writer->refcount, 1, __ATOMIC_ACQ_REL) > 0)
 		return writer;
 
 	loc_writer_free(writer);
@@ -196,6 +204,30 @@ LOC_EXPORT struct loc_writer* loc_writer_unref(struct loc_writer* writer) {
 	return NULL;
 }
 
+LOC_EXPORT unsigned int loc_writer_get_threads(struct loc_writer* writer) {
+	return writer->threads;
+}
+
+LOC_EXPORT int loc_writer_set_threads(struct loc_writer* writer, unsigned int threads) {
+	if (!threads) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+
+	writer->threads = threads;
+	return 0;
+}
+
+LOC_EXPORT int loc_writer_get_flags(struct loc_writer* writer) {
+	return writer->flags;
+}
+
+LOC_EXPORT int loc_writer_set_flags(struct loc_writer* writer, int flags) {
+	writer->flags = flags;
+
+	return 0;
+}
+
 LOC_EXPORT const char* loc_writer_get_vendor(struct loc_writer* writer) {
 	return loc_stringpool_get(writer->pool, writer->vendor);
 }
@@ -280,61 +312,302 @@ static void make_magic(struct loc_writer* writer, struct loc_database_magic* mag
 	magic->version = version;
 }
 
-static void align_page_boundary(off_t* offset, FILE* f) {
-	// Move to next page boundary
-	while (*offset % LOC_DATABASE_PAGE_SIZE > 0)
-		*offset += fwrite("", 1, 1, f);
+static off_t page_boundary(off_t offset) {
+	return (offset + LOC_DATABASE_PAGE_SIZE - 1) / LOC_DATABASE_PAGE_SIZE * LOC_DATABASE_PAGE_SIZE;
 }
 
-static int loc_database_write_pool(struct loc_writer* writer,
-		struct loc_database_header_v1* header, off_t* offset, FILE* f) {
-	// Save the offset of the pool section
-	DEBUG(writer->ctx, "Pool starts at %jd bytes\n", (intmax_t)*offset);
-	header->pool_offset = htobe32(*offset);
+/*
+	The database is signed while it is being written which is why all data
+	goes through this struct. It keeps track of the current offset and
+	feeds everything that is written into the signature contexts.
+*/
+struct loc_writer_output {
+	struct loc_writer* writer;
+	FILE* f;
 
-	// Write the pool
-	size_t pool_length = loc_stringpool_write(writer->pool, f);
-	*offset += pool_length;
+	// The current position in the file
+	off_t offset;
 
-	DEBUG(writer->ctx, "Pool has a length of %zu bytes\n", pool_length);
-	header->pool_length = htobe32(pool_length);
+	// Signature contexts (one for each private key)
+	EVP_MD_CTX* signatures[2];
+
+	// Pages between start and end are being hashed
+	off_t pages_start;
+	off_t pages_end;
+
+	EVP_MD_CTX* page;
+	unsigned char* page_hashes;
+};
+
+static void loc_writer_output_free(struct loc_writer_output* output) {
+	for (unsigned int i = 0; i < 2; i++) {
+		if (output->signatures[i])
+			EVP_MD_CTX_free(output->signatures[i]);
+	}
+
+	if (output->page)
+		EVP_MD_CTX_free(output->page);
+	if (output->page_hashes)
+		free(output->page_hashes);
+}
+
+static int loc_writer_output_init(struct loc_writer_output* output,
+		struct loc_writer* writer, FILE* f, const struct loc_database_header_v1* header) {
+	EVP_PKEY* private_keys[] = {
+		writer->private_key1,
+		writer->private_key2,
+	};
+	int r;
+
+	output->writer = writer;
+	output->f      = f;
+	output->offset = 0;
+
+	for (unsigned int i = 0; i < 2; i++) {
+		output->signatures[i] = NULL;
+
+		if (!private_keys[i])
+			continue;
+
+		DEBUG(writer->ctx, "Creating signature with private key %u\n", i + 1);
+
+		// Create a new context for signing
+		output->signatures[i] = EVP_MD_CTX_new();
+		if (!output->signatures[i])
+			return -ENOMEM;
+
+		// Initialise the context
+		r = EVP_DigestSignInit(output->signatures[i], NULL, NULL, NULL, private_keys[i]);
+		if (r != 1) {
+			ERROR(writer->ctx, "%s\n", ERR_error_string(ERR_get_error(), NULL));
+			return -1;
+		}
+	}
+
+	// We only need to hash pages if we are signing the database
+	if (!header->page_hashes_offset)
+		return 0;
+
+	output->pages_start = page_boundary(LOC_DATABASE_MAGIC_SIZE + sizeof(*header));
+	output->pages_end   = be32toh(header->page_hashes_offset);
+
+	output->page = EVP_MD_CTX_new();
+	if (!output->page)
+		return -ENOMEM;
+
+	output->page_hashes = malloc(be32toh(header->page_hashes_length));
+	if (!output->page_hashes)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/*
+	Feeds any data that has been written at offset into the page hashes
+*/
+static int loc_writer_output_hash_pages(struct loc_writer_output* output,
+		const char* data, size_t length, off_t offset) {
+	size_t bytes;
+	off_t page;
+	int r;
+
+	while (length) {
+		// Skip anything before the first page
+		if (offset < output->pages_start) {
+			bytes = output->pages_start - offset;
+			if (bytes > length)
+				bytes = length;
+
+			data   += bytes;
+			length -= bytes;
+			offset += bytes;
+			continue;
+		}
+
+		// Stop after the last page
+		if (offset >= output->pages_end)
+			break;
+
+		// Start a new page
+		if (offset % LOC_DATABASE_PAGE_SIZE == 0) {
+			r = EVP_DigestInit_ex(output->page, EVP_sha256(), NULL);
+			if (r != 1)
+				goto ERROR;
+		}
+
+		// Don't cross any page boundaries
+		bytes = LOC_DATABASE_PAGE_SIZE - offset % LOC_DATABASE_PAGE_SIZE;
+		if (bytes > length)
+			bytes = length;
+
+		r = EVP_DigestUpdate(output->page, data, bytes);
+		if (r != 1)
+			goto ERROR;
+
+		data   += bytes;
+		length -= bytes;
+		offset += bytes;
+
+		// Store the hash when the page is complete
+		if (offset % LOC_DATABASE_PAGE_SIZE == 0) {
+			page = (offset - output->pages_start) / LOC_DATABASE_PAGE_SIZE - 1;
+
+			r = EVP_DigestFinal_ex(output->page,
+				output->page_hashes + page * LOC_DATABASE_PAGE_HASH_LENGTH, NULL);
+			if (r != 1)
+				goto ERROR;
+		}
+	}
+
+	return 0;
+
+ERROR:
+	ERROR(output->writer->ctx, "Could not hash page: %s\n",
+		ERR_error_string(ERR_get_error(), NULL));
+	return -1;
+}
+
+static int loc_writer_output_write(struct loc_writer_output* output,
+		const void* data, size_t length) {
+	size_t bytes_written;
+	int r;
+
+	if (!length)
+		return 0;
+
+	bytes_written = fwrite(data, 1, length, output->f);
+	if (bytes_written < length) {
+		ERROR(output->writer->ctx, "Could not write to file: %m\n");
+		return -EIO;
+	}
+
+	hexdump(output->writer->ctx, data, length);
+
+	// Hash any pages
+	if (output->page) {
+		r = loc_writer_output_hash_pages(output, data, length, output->offset);
+		if (r)
+			return r;
+	}
+
+	output->offset += bytes_written;
+
+	// Feed the data into the signatures
+	for (unsigned int i = 0; i < 2; i++) {
+		if (!output->signatures[i])
+			continue;
+
+		r = EVP_DigestSignUpdate(output->signatures[i], data, length);
+		if (r != 1) {
+			ERROR(output->writer->ctx, "%s\n", ERR_error_string(ERR_get_error(), NULL));
+			return -1;
+		}
+	}
 
 	return 0;
 }
 
-static int loc_database_write_as_section(struct loc_writer* writer,
-		struct loc_database_header_v1* header, off_t* offset, FILE* f) {
-	DEBUG(writer->ctx, "AS section starts at %jd bytes\n", (intmax_t)*offset);
-	header->as_offset = htobe32(*offset);
+static int loc_writer_output_sign(struct loc_writer_output* output,
+		unsigned int i, char* signature, size_t* length) {
+	int r;
+
+	// Compute the signature
+	r = EVP_DigestSignFinal(output->signatures[i], (unsigned char*)signature, length);
+	if (r != 1) {
+		ERROR(output->writer->ctx, "%s\n", ERR_error_string(ERR_get_error(), NULL));
+		return -1;
+	}
+
+	DEBUG(output->writer->ctx, "Successfully generated signature of %zu bytes\n", *length);
+
+	// Dump signature
+	hexdump(output->writer->ctx, signature, *length);
+
+	return 0;
+}
+
+static int align_page_boundary(struct loc_writer_output* output) {
+	static const char zeroes[LOC_DATABASE_PAGE_SIZE] = { 0 };
+
+	// Move to next page boundary
+	return loc_writer_output_write(output, zeroes,
+		page_boundary(output->offset) - output->offset);
+}
+
+/*
+	Checks that a section starts at the offset that has been announced in the header
+*/
+static int loc_writer_check_offset(struct loc_writer_output* output,
+		const char* section, uint32_t offset) {
+	DEBUG(output->writer->ctx, "%s starts at %jd bytes\n", section, (intmax_t)output->offset);
+
+	if (output->offset != be32toh(offset)) {
+		ERROR(output->writer->ctx, "%s starts at %jd bytes, but should start at %u\n",
+			section, (intmax_t)output->offset, be32toh(offset));
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+	ASes and countries are encoded before anything is being written, because
+	they add their strings to the pool and we need to know its final size
+	to write the header.
+*/
+static int loc_writer_encode_ases(struct loc_writer* writer,
+		struct loc_database_as_v1** blocks, size_t* count) {
+	int r;
 
 	// Sort the AS list first
 	loc_as_list_sort(writer->as_list);
 
-	const size_t as_count = loc_as_list_size(writer->as_list);
+	*count = loc_as_list_size(writer->as_list);
+	if (!*count)
+		return 0;
 
-	struct loc_database_as_v1 block;
-	size_t block_length = 0;
+	*blocks = calloc(*count, sizeof(**blocks));
+	if (!*blocks)
+		return -ENOMEM;
 
-	for (unsigned int i = 0; i < as_count; i++) {
+	for (unsigned int i = 0; i < *count; i++) {
 		struct loc_as* as = loc_as_list_get(writer->as_list, i);
 		if (!as)
 			return 1;
 
 		// Convert AS into database format
-		loc_as_to_database_v1(as, writer->pool, &block);
-
-		// Write to disk
-		*offset += fwrite(&block, 1, sizeof(block), f);
-		block_length += sizeof(block);
-
-		// Unref AS
+		r = loc_as_to_database_v1(as, writer->pool, &(*blocks)[i]);
 		loc_as_unref(as);
+		if (r)
+			return r;
 	}
 
-	DEBUG(writer->ctx, "AS section has a length of %zu bytes\n", block_length);
-	header->as_length = htobe32(block_length);
+	return 0;
+}
+
+static int loc_writer_encode_countries(struct loc_writer* writer,
+		struct loc_database_country_v1** blocks, size_t* count) {
+	int r;
+
+	*count = loc_country_list_size(writer->country_list);
+	if (!*count)
+		return 0;
 
-	align_page_boundary(offset, f);
+	*blocks = calloc(*count, sizeof(**blocks));
+	if (!*blocks)
+		return -ENOMEM;
+
+	for (unsigned int i = 0; i < *count; i++) {
+		struct loc_country* country = loc_country_list_get(writer->country_list, i);
+		if (!country)
+			return 1;
+
+		// Convert country into database format
+		r = loc_country_to_database_v1(country, writer->pool, &(*blocks)[i]);
+		loc_country_unref(country);
+		if (r)
+			return r;
+	}
 
 	return 0;
 }
@@ -388,16 +661,78 @@ static void free_network(struct network* network) {
 	free(network);
 }
 
-static int loc_database_write_networks(struct loc_writer* writer,
-		struct loc_database_header_v1* header, off_t* offset, FILE* f) {
+static int loc_writer_aggregate_networks(struct loc_writer* writer) {
+	struct loc_network_tree* tree = NULL;
 	int r;
 
-	// Write the network tree
-	DEBUG(writer->ctx, "Network tree starts at %jd bytes\n", (intmax_t)*offset);
-	header->network_tree_offset = htobe32(*offset);
+	r = loc_network_tree_aggregate(writer->networks, &tree);
+	if (r) {
+		ERROR(writer->ctx, "Could not aggregate networks: %m\n");
+		return r;
+	}
+
+	// Make sure that every lookup still returns the same result
+	r = loc_network_tree_cmp_lookups(writer->networks, tree);
+	if (r) {
+		ERROR(writer->ctx, "The aggregated network tree is not equivalent\n");
+		loc_network_tree_unref(tree);
+		return -EINVAL;
+	}
+
+	// Replace the tree
+	loc_network_tree_unref(writer->networks);
+	writer->networks = tree;
+
+	return 0;
+}
+
+static int loc_writer_prepare_networks(struct loc_writer* writer) {
+	int r;
+
+	// Cleanup the tree before writing it
+	r = loc_network_tree_cleanup(writer->networks, writer->threads);
+	if (r)
+		return r;
+
+	// Aggregate the tree
+	if (writer->flags & LOC_WRITER_FLAGS_AGGREGATE) {
+		r = loc_writer_aggregate_networks(writer);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
 
-	size_t network_tree_length = 0;
-	size_t network_data_length = 0;
+static int loc_database_write_as_section(struct loc_writer_output* output,
+		struct loc_database_header_v1* header,
+		const struct loc_database_as_v1* blocks, size_t count) {
+	int r;
+
+	r = loc_writer_check_offset(output, "AS section", header->as_offset);
+	if (r)
+		return r;
+
+	// Write to disk
+	r = loc_writer_output_write(output, blocks, sizeof(*blocks) * count);
+	if (r)
+		return r;
+
+	DEBUG(output->writer->ctx, "AS section has a length of %zu bytes\n",
+		sizeof(*blocks) * count);
+
+	return align_page_boundary(output);
+}
+
+static int loc_database_write_networks(struct loc_writer_output* output,
+		struct loc_database_header_v1* header) {
+	struct loc_writer* writer = output->writer;
+	int r;
+
+	// Write the network tree
+	r = loc_writer_check_offset(output, "Network tree", header->network_tree_offset);
+	if (r)
+		return r;
 
 	struct node* node;
 	struct node* child_node;
@@ -416,11 +751,6 @@ static int loc_database_write_networks(struct loc_writer* writer,
 	TAILQ_HEAD(network_t, network) networks;
 	TAILQ_INIT(&networks);
 
-	// Cleanup the tree before writing it
-	r = loc_network_tree_cleanup(writer->networks);
-	if (r)
-		return r;
-
 	// Add root
 	struct loc_network_tree_node* root = loc_network_tree_get_root(writer->networks);
 	node = make_node(root);
@@ -482,20 +812,22 @@ static int loc_database_write_networks(struct loc_writer* writer,
 		DEBUG(writer->ctx, "Writing node %p (0 = %u, 1 = %u)\n",
 			node, node->index_zero, node->index_one);
 
-		*offset += fwrite(&db_node, 1, sizeof(db_node), f);
-		network_tree_length += sizeof(db_node);
+		r = loc_writer_output_write(output, &db_node, sizeof(db_node));
+		if (r)
+			return r;
 
 		free_node(node);
 	}
 
 	loc_network_tree_node_unref(root);
 
-	header->network_tree_length = htobe32(network_tree_length);
-
-	align_page_boundary(offset, f);
+	r = align_page_boundary(output);
+	if (r)
+		return r;
 
-	DEBUG(writer->ctx, "Networks data section starts at %jd bytes\n", (intmax_t)*offset);
-	header->network_data_offset = htobe32(*offset);
+	r = loc_writer_check_offset(output, "Networks data section", header->network_data_offset);
+	if (r)
+		return r;
 
 	// We have now written the entire tree and have all networks
 	// in a queue in order as they are indexed
@@ -508,142 +840,226 @@ static int loc_database_write_networks(struct loc_writer* writer,
 		if (r)
 			return r;
 
-		*offset += fwrite(&db_network, 1, sizeof(db_network), f);
-		network_data_length += sizeof(db_network);
+		r = loc_writer_output_write(output, &db_network, sizeof(db_network));
+		if (r)
+			return r;
 
 		free_network(nw);
 	}
 
-	header->network_data_length = htobe32(network_data_length);
+	return align_page_boundary(output);
+}
 
-	align_page_boundary(offset, f);
+static int loc_database_write_countries(struct loc_writer_output* output,
+		struct loc_database_header_v1* header,
+		const struct loc_database_country_v1* blocks, size_t count) {
+	int r;
 
-	return 0;
-}
+	r = loc_writer_check_offset(output, "Countries section", header->countries_offset);
+	if (r)
+		return r;
 
-static int loc_database_write_countries(struct loc_writer* writer,
-		struct loc_database_header_v1* header, off_t* offset, FILE* f) {
-	DEBUG(writer->ctx, "Countries section starts at %jd bytes\n", (intmax_t)*offset);
-	header->countries_offset = htobe32(*offset);
+	// Write to disk
+	r = loc_writer_output_write(output, blocks, sizeof(*blocks) * count);
+	if (r)
+		return r;
 
-	const size_t countries_count = loc_country_list_size(writer->country_list);
+	DEBUG(output->writer->ctx, "Countries section has a length of %zu bytes\n",
+		sizeof(*blocks) * count);
 
-	struct loc_database_country_v1 block;
-	size_t block_length = 0;
+	return align_page_boundary(output);
+}
 
-	for (unsigned int i = 0; i < countries_count; i++) {
-		struct loc_country* country = loc_country_list_get(writer->country_list, i);
+static int loc_database_write_pool(struct loc_writer_output* output,
+		struct loc_database_header_v1* header) {
+	struct loc_writer* writer = output->writer;
+	int r;
 
-		// Convert country into database format
-		loc_country_to_database_v1(country, writer->pool, &block);
+	r = loc_writer_check_offset(output, "Pool", header->pool_offset);
+	if (r)
+		return r;
 
-		// Write to disk
-		*offset += fwrite(&block, 1, sizeof(block), f);
-		block_length += sizeof(block);
-	}
+	// Write the pool (which always starts with the empty string)
+	size_t pool_length = loc_stringpool_get_size(writer->pool);
 
-	DEBUG(writer->ctx, "Countries section has a length of %zu bytes\n", block_length);
-	header->countries_length = htobe32(block_length);
+	r = loc_writer_output_write(output, loc_stringpool_get(writer->pool, 0), pool_length);
+	if (r)
+		return r;
 
-	align_page_boundary(offset, f);
+	DEBUG(writer->ctx, "Pool has a length of %zu bytes\n", pool_length);
 
 	return 0;
 }
 
-static int loc_writer_create_signature(struct loc_writer* writer,
-		struct loc_database_header_v1* header, FILE* f, EVP_PKEY* private_key,
-		char* signature, size_t* length) {
-	size_t bytes_read = 0;
+static int loc_database_write_page_hashes(struct loc_writer_output* output,
+		struct loc_database_header_v1* header) {
+	int r;
 
-	DEBUG(writer->ctx, "Creating signature...\n");
+	r = loc_writer_check_offset(output, "Page hashes", header->page_hashes_offset);
+	if (r)
+		return r;
 
-	// Read file from the beginning
-	rewind(f);
+	// All pages must have been hashed by now
+	if (output->offset != output->pages_end) {
+		ERROR(output->writer->ctx, "Not all pages have been hashed\n");
+		return -EINVAL;
+	}
 
-	// Create a new context for signing
-	EVP_MD_CTX* mdctx = EVP_MD_CTX_new();
+	r = loc_writer_output_write(output, output->page_hashes,
+		be32toh(header->page_hashes_length));
+	if (r)
+		return r;
 
-	// Initialise the context
-	int r = EVP_DigestSignInit(mdctx, NULL, NULL, NULL, private_key);
-	if (r != 1) {
-		ERROR(writer->ctx, "%s\n", ERR_error_string(ERR_get_error(), NULL));
-		goto END;
-	}
+	return align_page_boundary(output);
+}
 
-	// Read magic
-	struct loc_database_magic magic;
-	bytes_read = fread(&magic, 1, sizeof(magic), f);
-	if (bytes_read < sizeof(magic)) {
-		ERROR(writer->ctx, "Could not read header: %m\n");
-		r = 1;
-		goto END;
-	}
+/*
+	Signs the magic, the header and all page hashes
+*/
+static int loc_writer_sign_page_hashes(struct loc_writer_output* output,
+		const struct loc_database_magic* magic, const struct loc_database_header_v1* header,
+		EVP_PKEY* private_key, char* signature, uint16_t* length) {
+	size_t signature_length = LOC_SIGNATURE_MAX_LENGTH;
+	int r;
 
-	hexdump(writer->ctx, &magic, sizeof(magic));
+	EVP_MD_CTX* mdctx = EVP_MD_CTX_new();
+	if (!mdctx)
+		return -ENOMEM;
 
-	// Feed magic into the signature
-	r = EVP_DigestSignUpdate(mdctx, &magic, sizeof(magic));
-	if (r != 1) {
-		ERROR(writer->ctx, "%s\n", ERR_error_string(ERR_get_error(), NULL));
-		goto END;
-	}
+	r = EVP_DigestSignInit(mdctx, NULL, NULL, NULL, private_key);
+	if (r != 1)
+		goto ERROR;
 
-	hexdump(writer->ctx, header, sizeof(*header));
+	r = EVP_DigestSignUpdate(mdctx, magic, sizeof(*magic));
+	if (r != 1)
+		goto ERROR;
 
-	// Feed the header into the signature
 	r = EVP_DigestSignUpdate(mdctx, header, sizeof(*header));
-	if (r != 1) {
-		ERROR(writer->ctx, "%s\n", ERR_error_string(ERR_get_error(), NULL));
-		goto END;
-	}
+	if (r != 1)
+		goto ERROR;
 
-	// Skip header
-	fseek(f, sizeof(*header), SEEK_CUR);
+	r = EVP_DigestSignUpdate(mdctx, output->page_hashes, be32toh(header->page_hashes_length));
+	if (r != 1)
+		goto ERROR;
 
-	// Walk through the file in chunks of 64kB
-	char buffer[64 * 1024];
-	while (!feof(f)) {
-		bytes_read = fread(buffer, 1, sizeof(buffer), f);
+	r = EVP_DigestSignFinal(mdctx, (unsigned char*)signature, &signature_length);
+	if (r != 1)
+		goto ERROR;
 
-		if (ferror(f)) {
-			ERROR(writer->ctx, "Error reading from file: %m\n");
-			r = 1;
-			goto END;
-		}
+	DEBUG(output->writer->ctx, "Signed page hashes with %zu byte(s)\n", signature_length);
+
+	*length = htobe16(signature_length);
+	r = 0;
 
-		hexdump(writer->ctx, buffer, bytes_read);
+	EVP_MD_CTX_free(mdctx);
+	return r;
 
-		r = EVP_DigestSignUpdate(mdctx, buffer, bytes_read);
-		if (r != 1) {
-			ERROR(writer->ctx, "%s\n", ERR_error_string(ERR_get_error(), NULL));
-			r = -1;
-			goto END;
-		}
+ERROR:
+	ERROR(output->writer->ctx, "%s\n", ERR_error_string(ERR_get_error(), NULL));
+	EVP_MD_CTX_free(mdctx);
+
+	return -1;
+}
+
+static int loc_database_write_page_signatures(struct loc_writer_output* output,
+		const struct loc_database_magic* magic, struct loc_database_header_v1* header) {
+	struct loc_writer* writer = output->writer;
+	struct loc_database_page_signatures_v1 signatures = { 0 };
+	int r;
+
+	r = loc_writer_check_offset(output, "Page signatures", header->page_signatures_offset);
+	if (r)
+		return r;
+
+	if (writer->private_key1) {
+		r = loc_writer_sign_page_hashes(output, magic, header, writer->private_key1,
+			signatures.signature1, &signatures.signature1_length);
+		if (r)
+			return r;
 	}
 
-	// Compute the signature
-	r = EVP_DigestSignFinal(mdctx,
-		(unsigned char*)signature, length);
-	if (r != 1) {
-		ERROR(writer->ctx, "%s\n", ERR_error_string(ERR_get_error(), NULL));
-		r = -1;
-		goto END;
+	if (writer->private_key2) {
+		r = loc_writer_sign_page_hashes(output, magic, header, writer->private_key2,
+			signatures.signature2, &signatures.signature2_length);
+		if (r)
+			return r;
 	}
 
-	DEBUG(writer->ctx, "Successfully generated signature of %zu bytes\n", *length);
-	r = 0;
+	return loc_writer_output_write(output, &signatures, sizeof(signatures));
+}
 
-	// Dump signature
-	hexdump(writer->ctx, signature, *length);
+/*
+	Computes where all sections will be placed in the file
+*/
+static void loc_writer_layout(struct loc_writer* writer,
+		struct loc_database_header_v1* header, size_t as_count, size_t countries_count) {
+	off_t offset = sizeof(struct loc_database_magic) + sizeof(*header);
+
+	const size_t nodes    = loc_network_tree_count_nodes(writer->networks);
+	const size_t networks = loc_network_tree_count_networks(writer->networks);
+
+	// ASes
+	offset = page_boundary(offset);
+	header->as_offset = htobe32(offset);
+	header->as_length = htobe32(as_count * sizeof(struct loc_database_as_v1));
+	offset += be32toh(header->as_length);
+
+	// Network Tree
+	offset = page_boundary(offset);
+	header->network_tree_offset = htobe32(offset);
+	header->network_tree_length = htobe32(nodes * sizeof(struct loc_database_network_node_v1));
+	offset += be32toh(header->network_tree_length);
+
+	// Networks
+	offset = page_boundary(offset);
+	header->network_data_offset = htobe32(offset);
+	header->network_data_length = htobe32(networks * sizeof(struct loc_database_network_v1));
+	offset += be32toh(header->network_data_length);
+
+	// Countries
+	offset = page_boundary(offset);
+	header->countries_offset = htobe32(offset);
+	header->countries_length = htobe32(countries_count * sizeof(struct loc_database_country_v1));
+	offset += be32toh(header->countries_length);
+
+	// Pool
+	offset = page_boundary(offset);
+	header->pool_offset = htobe32(offset);
+	header->pool_length = htobe32(loc_stringpool_get_size(writer->pool));
+	offset += be32toh(header->pool_length);
+
+	// There is nothing to sign without any keys
+	if (!writer->private_key1 && !writer->private_key2) {
+		header->page_hashes_offset = header->page_hashes_length = 0;
+		header->page_signatures_offset = header->page_signatures_length = 0;
+		return;
+	}
 
-END:
-	EVP_MD_CTX_free(mdctx);
+	const off_t pages_start = page_boundary(sizeof(struct loc_database_magic) + sizeof(*header));
 
-	return r;
+	// Page Hashes
+	offset = page_boundary(offset);
+	header->page_hashes_offset = htobe32(offset);
+	header->page_hashes_length = htobe32(
+		(offset - pages_start) / LOC_DATABASE_PAGE_SIZE * LOC_DATABASE_PAGE_HASH_LENGTH);
+	offset += be32toh(header->page_hashes_length);
+
+	// Page Signatures
+	offset = page_boundary(offset);
+	header->page_signatures_offset = htobe32(offset);
+	header->page_signatures_length = htobe32(sizeof(struct loc_database_page_signatures_v1));
 }
 
 LOC_EXPORT int loc_writer_write(struct loc_writer* writer, FILE* f, enum loc_database_version version) {
+	struct loc_writer_output output = { 0 };
+	struct loc_database_magic magic;
+	struct loc_database_header_v1 header;
+	struct loc_database_as_v1* ases = NULL;
+	struct loc_database_country_v1* countries = NULL;
+	size_t as_count = 0;
+	size_t countries_count = 0;
 	size_t bytes_written = 0;
+	int r;
 
 	// Check version
 	switch (version) {
@@ -661,11 +1077,22 @@ LOC_EXPORT int loc_writer_write(struct loc_writer* writer, FILE* f, enum loc_dat
 
 	DEBUG(writer->ctx, "Writing database in version %u\n", version);
 
-	struct loc_database_magic magic;
+	// Prepare all data so that we know the size of every section
+	r = loc_writer_prepare_networks(writer);
+	if (r)
+		goto ERROR;
+
+	r = loc_writer_encode_ases(writer, &ases, &as_count);
+	if (r)
+		goto ERROR;
+
+	r = loc_writer_encode_countries(writer, &countries, &countries_count);
+	if (r)
+		goto ERROR;
+
 	make_magic(writer, &magic, version);
 
 	// Make the header
-	struct loc_database_header_v1 header;
 	header.vendor      = htobe32(writer->vendor);
 	header.description = htobe32(writer->description);
 	header.license     = htobe32(writer->license);
@@ -682,68 +1109,84 @@ LOC_EXPORT int loc_writer_write(struct loc_writer* writer, FILE* f, enum loc_dat
 	// Clear the padding
 	memset(header.padding, '\0', sizeof(header.padding));
 
-	int r;
-	off_t offset = 0;
+	// Place all sections
+	loc_writer_layout(writer, &header, as_count, countries_count);
 
 	// Start writing at the beginning of the file
 	r = fseek(f, 0, SEEK_SET);
 	if (r)
-		return r;
+		goto ERROR;
+
+	r = loc_writer_output_init(&output, writer, f, &header);
+	if (r)
+		goto ERROR;
 
 	// Write the magic
-	offset += fwrite(&magic, 1, sizeof(magic), f);
+	r = loc_writer_output_write(&output, &magic, sizeof(magic));
+	if (r)
+		goto ERROR;
 
-	// Skip the space we need to write the header later
-	r = fseek(f, sizeof(header), SEEK_CUR);
-	if (r) {
-		DEBUG(writer->ctx, "Could not seek to position after header\n");
-		return r;
-	}
-	offset += sizeof(header);
+	// Write the header (without any signatures)
+	r = loc_writer_output_write(&output, &header, sizeof(header));
+	if (r)
+		goto ERROR;
 
-	align_page_boundary(&offset, f);
+	r = align_page_boundary(&output);
+	if (r)
+		goto ERROR;
 
 	// Write all ASes
-	r = loc_database_write_as_section(writer, &header, &offset, f);
+	r = loc_database_write_as_section(&output, &header, ases, as_count);
 	if (r)
-		return r;
+		goto ERROR;
 
 	// Write all networks
-	r = loc_database_write_networks(writer, &header, &offset, f);
+	r = loc_database_write_networks(&output, &header);
 	if (r)
-		return r;
+		goto ERROR;
 
 	// Write countries
-	r = loc_database_write_countries(writer, &header, &offset, f);
+	r = loc_database_write_countries(&output, &header, countries, countries_count);
 	if (r)
-		return r;
+		goto ERROR;
 
 	// Write pool
-	r = loc_database_write_pool(writer, &header, &offset, f);
+	r = loc_database_write_pool(&output, &header);
 	if (r)
-		return r;
+		goto ERROR;
 
-	// Create the signatures
-	if (writer->private_key1) {
-		DEBUG(writer->ctx, "Creating signature with first private key\n");
+	// Write the page hashes and sign them
+	if (header.page_hashes_offset) {
+		r = align_page_boundary(&output);
+		if (r)
+			goto ERROR;
 
-		writer->signature1_length = sizeof(writer->signature1);
+		r = loc_database_write_page_hashes(&output, &header);
+		if (r)
+			goto ERROR;
 
-		r = loc_writer_create_signature(writer, &header, f,
-			writer->private_key1, writer->signature1, &writer->signature1_length);
+		r = loc_database_write_page_signatures(&output, &magic, &header);
 		if (r)
-			return r;
+			goto ERROR;
 	}
 
-	if (writer->private_key2) {
-		DEBUG(writer->ctx, "Creating signature with second private key\n");
+	// Create the signatures
+	if (output.signatures[0]) {
+		writer->signature1_length = sizeof(writer->signature1);
 
+		r = loc_writer_output_sign(&output, 0,
+			writer->signature1, &writer->signature1_length);
+		if (r)
+			goto ERROR;
+	}
+
+	if (output.signatures[1]) {
 		writer->signature2_length = sizeof(writer->signature2);
 
-		r = loc_writer_create_signature(writer, &header, f,
-			writer->private_key2, writer->signature2, &writer->signature2_length);
+		r = loc_writer_output_sign(&output, 1,
+			writer->signature2, &writer->signature2_length);
 		if (r)
-			return r;
+			goto ERROR;
 	}
 
 	// Copy the signatures into the header
@@ -763,24 +1206,32 @@ LOC_EXPORT int loc_writer_write(struct loc_writer* writer, FILE* f, enum loc_dat
 		header.signature2_length = htobe16(writer->signature2_length);
 	}
 
-	// Write the header
+	// Write the header again with the signatures
 	r = fseek(f, sizeof(magic), SEEK_SET);
 	if (r)
-		return r;
+		goto ERROR;
 
 	bytes_written = fwrite(&header, 1, sizeof(header), f);
 	if (bytes_written < sizeof(header)) {
 		ERROR(writer->ctx, "Could not write header: %s\n", strerror(errno));
-		return r;
+		r = -EIO;
+		goto ERROR;
 	}
 
 	// Seek back to the end
 	r = fseek(f, 0, SEEK_END);
 	if (r)
-		return r;
+		goto ERROR;
 
 	// Flush everything
 	fflush(f);
 
+ERROR:
+	loc_writer_output_free(&output);
+	if (ases)
+		free(ases);
+	if (countries)
+		free(countries);
+
 	return r;
 }
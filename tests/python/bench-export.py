@@ -0,0 +1,86 @@
+#!/usr/bin/python3
+###############################################################################
+#                                                                             #
+# libloc - A library to determine the location of someone on the Internet     #
+#                                                                             #
+# Copyright (C) 2024 IPFire Development Team <info@ipfire.org>                #
+#                                                                             #
+# This library is free software; you can redistribute it and/or               #
+# modify it under the terms of the GNU Lesser General Public                  #
+# License as published by the Free Software Foundation; either                #
+# version 2.1 of the License, or (at your option) any later version.          #
+#                                                                             #
+# This library is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU           #
+# Lesser General Public License for more details.                             #
+#                                                                             #
+###############################################################################
+
+"""
+	This benchmark measures exporting all countries for IPv6 and IPv4 like
+	"location export" does. It compares the output writers in Python with
+	the exporter of the library running once per family and running only
+	once for all families.
+
+	Usage: bench-export.py [DATABASE] [FORMAT]
+"""
+
+import location
+import location.export
+import os
+import socket
+import sys
+import tempfile
+import time
+
+FAMILIES = [socket.AF_INET6, socket.AF_INET]
+
+def report(operation, files, t):
+	print("%-32s %10d %11.3fs" % (operation, files, t))
+
+def main():
+	path = os.environ.get("TEST_DATABASE")
+	format = "ipset"
+
+	if len(sys.argv) > 1:
+		path = sys.argv[1]
+
+	if len(sys.argv) > 2:
+		format = sys.argv[2]
+
+	if not path:
+		sys.stderr.write("Usage: %s DATABASE [FORMAT]\n" % sys.argv[0])
+		sys.exit(2)
+
+	db = location.Database(path)
+
+	# Export all countries like "location export" does by default
+	countries = ["A1", "A2", "A3", "XD"] + [country.code for country in db.countries]
+
+	# Force using the output writers
+	cls = location.export.formats[format]
+	writer = type("Python%s" % cls.__name__, (cls,), {})
+
+	print("%-32s %10s %12s" % ("OPERATION", "FILES", "TIME"))
+
+	with tempfile.TemporaryDirectory() as directory:
+		# Python
+		t = time.monotonic()
+		location.export.Exporter(db, writer).export(directory,
+			families=FAMILIES, countries=countries, asns=[])
+		report("Output writers", len(os.listdir(directory)), time.monotonic() - t)
+
+		# One pass per family
+		t = time.monotonic()
+		for family in FAMILIES:
+			db.export(cls.format, family, countries=countries, directory=directory)
+		report("Exporter, one pass per family", len(os.listdir(directory)), time.monotonic() - t)
+
+		# One pass for all families
+		t = time.monotonic()
+		db.export(cls.format, countries=countries, directory=directory)
+		report("Exporter, one pass", len(os.listdir(directory)), time.monotonic() - t)
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,100 @@
+#!/usr/bin/python3
+###############################################################################
+#                                                                             #
+# libloc - A library to determine the location of someone on the Internet     #
+#                                                                             #
+# Copyright (C) 2024 IPFire Development Team <info@ipfire.org>                #
+#                                                                             #
+# This library is free software; you can redistribute it and/or               #
+# modify it under the terms of the GNU Lesser General Public                  #
+# License as published by the Free Software Foundation; either                #
+# version 2.1 of the License, or (at your option) any later version.          #
+#                                                                             #
+# This library is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU           #
+# Lesser General Public License for more details.                             #
+#                                                                             #
+###############################################################################
+
+"""
+	This benchmark compares looking up addresses one by one with looking
+	them up all at once using lookup_many().
+
+	Packed addresses are looked up at full size, strings only use a tenth
+	of them, because creating that many Python objects needs a lot of memory.
+
+	Usage: bench-lookup.py [DATABASE] [ADDRESSES]
+"""
+
+import array
+import location
+import os
+import random
+import socket
+import sys
+import time
+
+# Look up ten million addresses by default
+COUNT = 10 ** 7
+
+def report(operation, count, t):
+	print("%-32s %10d %11.3fs %10.0fns" % (operation, count, t, t * 1e9 / count))
+
+def main():
+	path = os.environ.get("TEST_DATABASE")
+	count = COUNT
+
+	if len(sys.argv) > 1:
+		path = sys.argv[1]
+
+	if len(sys.argv) > 2:
+		count = int(sys.argv[2])
+
+	if not path:
+		sys.stderr.write("Usage: %s DATABASE [ADDRESSES]\n" % sys.argv[0])
+		sys.exit(2)
+
+	db = location.Database(path)
+
+	# Always generate the same addresses
+	rng = random.Random(1)
+
+	# Generate packed addresses
+	packed4 = rng.randbytes(count * 4)
+	packed6 = b"".join(
+		b"\x20" + rng.randbytes(15) for i in range(count)
+	)
+
+	# Format some of them as strings
+	strings = [
+		socket.inet_ntop(socket.AF_INET, packed4[i * 4:i * 4 + 4]) for i in range(count // 10)
+	]
+
+	asns = array.array("I", bytes(4 * count))
+	country_codes = bytearray(2 * count)
+	flags = array.array("H", bytes(2 * count))
+
+	print("%-32s %10s %12s %12s" % ("OPERATION", "ADDRESSES", "TIME", "TIME/ADDRESS"))
+
+	# Look up every string on its own
+	t = time.monotonic()
+	for address in strings:
+		db.lookup(address)
+	report("lookup()", len(strings), time.monotonic() - t)
+
+	# Look up all strings at once
+	t = time.monotonic()
+	db.lookup_many(strings)
+	report("lookup_many() with strings", len(strings), time.monotonic() - t)
+
+	# Look up packed addresses
+	for family, packed in ((socket.AF_INET, packed4), (socket.AF_INET6, packed6)):
+		t = time.monotonic()
+		db.lookup_many(packed, family=family,
+			asns=asns, country_codes=country_codes, flags=flags)
+		report("lookup_many() with %s" % ("IPv4" if family == socket.AF_INET else "IPv6"),
+			count, time.monotonic() - t)
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,116 @@
+#!/usr/bin/python3
+###############################################################################
+#                                                                             #
+# libloc - A library to determine the location of someone on the Internet     #
+#                                                                             #
+# Copyright (C) 2024 IPFire Development Team <info@ipfire.org>                #
+#                                                                             #
+# This library is free software; you can redistribute it and/or               #
+# modify it under the terms of the GNU Lesser General Public                  #
+# License as published by the Free Software Foundation; either                #
+# version 2.1 of the License, or (at your option) any later version.          #
+#                                                                             #
+# This library is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU           #
+# Lesser General Public License for more details.                             #
+#                                                                             #
+###############################################################################
+
+"""
+	This benchmark measures the throughput of lookups and enumeration
+	when the same database is being used by a different number of threads.
+
+	Every thread does the same amount of work, so with perfect scaling the
+	throughput grows with the number of threads.
+
+	Usage: bench-threads.py [DATABASE] [ADDRESSES]
+"""
+
+import array
+import location
+import os
+import random
+import socket
+import sys
+import threading
+import time
+
+# Look up one million addresses per thread by default
+COUNT = 10 ** 6
+
+THREADS = (1, 2, 4, 8)
+
+def run(threads, target, *args):
+	workers = [threading.Thread(target=target, args=args) for i in range(threads)]
+
+	t = time.monotonic()
+
+	for worker in workers:
+		worker.start()
+
+	for worker in workers:
+		worker.join()
+
+	return time.monotonic() - t
+
+def lookup(db, addresses):
+	for address in addresses:
+		db.lookup(address)
+
+def lookup_many(db, packed):
+	asns = array.array("I", bytes(len(packed)))
+
+	db.lookup_many(packed, family=socket.AF_INET, asns=asns)
+
+def enumerate_networks(db):
+	for network in db.search_networks(flatten=True):
+		pass
+
+def main():
+	path = os.environ.get("TEST_DATABASE")
+	count = COUNT
+
+	if len(sys.argv) > 1:
+		path = sys.argv[1]
+
+	if len(sys.argv) > 2:
+		count = int(sys.argv[2])
+
+	if not path:
+		sys.stderr.write("Usage: %s DATABASE [ADDRESSES]\n" % sys.argv[0])
+		sys.exit(2)
+
+	db = location.Database(path)
+
+	# Always generate the same addresses
+	rng = random.Random(1)
+
+	packed = rng.randbytes(count * 4)
+
+	# Format some of them as strings
+	strings = [
+		socket.inet_ntop(socket.AF_INET, packed[i * 4:i * 4 + 4]) for i in range(count // 10)
+	]
+
+	benchmarks = (
+		("lookup()",          lookup,             (db, strings)),
+		("lookup_many()",     lookup_many,        (db, packed)),
+		("search_networks()", enumerate_networks, (db,)),
+	)
+
+	print("%-24s %8s %12s %12s" % ("OPERATION", "THREADS", "TIME", "THROUGHPUT"))
+
+	for operation, target, args in benchmarks:
+		t1 = None
+
+		for threads in THREADS:
+			t = run(threads, target, *args)
+
+			if t1 is None:
+				t1 = t
+
+			print("%-24s %8d %11.3fs %11.2fx" % (operation, threads, t, threads * t1 / t))
+
+if __name__ == "__main__":
+	main()
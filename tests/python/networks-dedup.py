@@ -20,6 +20,7 @@
 import location
 import os
 import tempfile
+import threading
 import unittest
 
 class Test(unittest.TestCase):
@@ -160,6 +161,48 @@ class Test(unittest.TestCase):
 			),
 		)
 
+	def test_write_threads(self):
+		"""
+			Changes networks and ASes from other threads while writing
+		"""
+		w = location.Writer()
+
+		networks = [w.add_network("10.%s.%s.0/24" % (i // 256, i % 256)) for i in range(4096)]
+		ases = [w.add_as(i) for i in range(1, 257)]
+
+		def change(*iterations):
+			for i in iterations:
+				for network in networks:
+					network.asn = 64512 + i
+					network.country_code = "DE"
+
+				for a in ases:
+					a.name = "AS %s" % i
+
+		# Set some initial values
+		change(0)
+
+		threads = [threading.Thread(target=change, args=range(10)) for i in range(4)]
+
+		with tempfile.NamedTemporaryFile() as f:
+			for thread in threads:
+				thread.start()
+
+			w.write(f.name)
+
+			for thread in threads:
+				thread.join()
+
+			db = location.Database(f.name)
+
+			# Every network must have been written with one of the values
+			for network in db.networks:
+				self.assertIn(network.asn, range(64512, 64522))
+				self.assertEqual(network.country_code, "DE")
+
+			for a in db.ases:
+				self.assertIn(a.name, ["AS %s" % i for i in range(10)])
+
 
 if __name__ == "__main__":
 	unittest.main()
@@ -17,8 +17,11 @@
 #                                                                             #
 ###############################################################################
 
+import array
 import location
 import os
+import socket
+import threading
 import unittest
 
 TEST_DATA_DIR = os.environ["TEST_DATA_DIR"]
@@ -77,6 +80,124 @@ class Test(unittest.TestCase):
 		with self.assertRaises(ValueError):
 			self.db.lookup("455.455.455.455")
 
+	def test_lookup_many(self):
+		"""
+			Look up many addresses at once
+		"""
+		addresses = ["81.3.27.38", "1.1.1.1", "8.8.8.8", "255.255.255.255"]
+
+		asns = array.array("I", [0] * len(addresses))
+		country_codes = bytearray(2 * len(addresses))
+		flags = array.array("H", [0] * len(addresses))
+
+		# Look up all strings
+		found = self.db.lookup_many(addresses,
+			asns=asns, country_codes=country_codes, flags=flags)
+		self.assertEqual(found, 3)
+
+		for i, address in enumerate(addresses):
+			network = self.db.lookup(address)
+
+			if network:
+				self.assertEqual(asns[i], network.asn or 0)
+				self.assertEqual(country_codes[i * 2:i * 2 + 2].decode(), network.country_code)
+			else:
+				self.assertEqual(asns[i], 0)
+				self.assertEqual(country_codes[i * 2:i * 2 + 2], b"\0\0")
+
+		# Look up the same addresses packed into a buffer
+		packed = b"".join(socket.inet_aton(address) for address in addresses)
+
+		packed_asns = array.array("I", [0] * len(addresses))
+
+		found = self.db.lookup_many(packed, asns=packed_asns, family=socket.AF_INET)
+		self.assertEqual(found, 3)
+		self.assertEqual(packed_asns, asns)
+
+		# Plain bytes need a family
+		with self.assertRaises(ValueError):
+			self.db.lookup_many(packed)
+
+		# Output buffers must fit
+		with self.assertRaises(ValueError):
+			self.db.lookup_many(addresses, asns=bytearray(1))
+
+		# Invalid addresses
+		with self.assertRaises(ValueError):
+			self.db.lookup_many(["XXX"])
+
+	def test_search_networks_batches(self):
+		"""
+			Fetch networks in batches
+		"""
+		networks = list(self.db.search_networks(flatten=True))
+
+		for batch_size in (1, 2, 1024):
+			records = []
+
+			for batch in self.db.search_networks(flatten=True, batch_size=batch_size):
+				self.assertLessEqual(len(batch), batch_size)
+
+				records += batch
+
+			self.assertEqual(len(records), len(networks))
+
+			for network, (prefix, country_code, asn, flags) in zip(networks, records):
+				self.assertEqual(prefix, str(network))
+				self.assertEqual(country_code, network.country_code)
+				self.assertEqual(asn, network.asn)
+
+				for flag in (location.NETWORK_FLAG_ANONYMOUS_PROXY,
+						location.NETWORK_FLAG_SATELLITE_PROVIDER, location.NETWORK_FLAG_ANYCAST,
+						location.NETWORK_FLAG_DROP):
+					self.assertEqual(bool(flags & flag), network.has_flag(flag))
+
+	def test_threads(self):
+		"""
+			Use the database from multiple threads at the same time
+		"""
+		addresses = ["81.3.27.38", "1.1.1.1", "8.8.8.8", "255.255.255.255"] * 1000
+
+		expected = [self.db.lookup(address) for address in addresses]
+		results = {}
+
+		def lookup(thread):
+			results[thread] = [self.db.lookup(address) for address in addresses]
+
+		threads = [threading.Thread(target=lookup, args=(i,)) for i in range(8)]
+
+		for thread in threads:
+			thread.start()
+
+		for thread in threads:
+			thread.join()
+
+		# All threads must have found the same networks
+		for networks in results.values():
+			self.assertEqual(networks, expected)
+
+		# Share one enumerator between all threads
+		networks = self.db.search_networks(flatten=True)
+		found = []
+
+		def consume():
+			for network in networks:
+				found.append(network)
+
+		threads = [threading.Thread(target=consume) for i in range(8)]
+
+		for thread in threads:
+			thread.start()
+
+		for thread in threads:
+			thread.join()
+
+		# Every network must have been returned exactly once
+		self.assertEqual(
+			sorted(found, key=str),
+			sorted(self.db.search_networks(flatten=True), key=str),
+		)
+
 	def test_verify(self):
 		"""
 			Verify the database
@@ -17,8 +17,12 @@
 #                                                                             #
 ###############################################################################
 
+import filecmp
 import location
+import location.export
 import os
+import socket
+import tempfile
 import unittest
 
 TEST_DATA_DIR = os.environ["TEST_DATA_DIR"]
@@ -48,6 +52,33 @@ class Test(unittest.TestCase):
 
 			print(network)
 
+	def test_export(self):
+		"""
+			Checks that the exporter of the C library writes the same
+			files as the output writers
+		"""
+		countries = ["A1", "A2", "A3", "XD", "DE", "FR", "US"]
+		asns = [204867, 15169]
+
+		families = [socket.AF_INET6, socket.AF_INET]
+
+		for format, cls in location.export.formats.items():
+			# Force using the output writers
+			writer = type("Python%s" % cls.__name__, (cls,), {})
+
+			with tempfile.TemporaryDirectory() as d1, tempfile.TemporaryDirectory() as d2:
+				location.export.Exporter(self.db, writer).export(d1,
+					families=families, countries=countries, asns=asns)
+
+				location.export.Exporter(self.db, cls).export(d2,
+					families=families, countries=countries, asns=asns)
+
+				files = sorted(os.listdir(d1))
+				self.assertEqual(files, sorted(os.listdir(d2)))
+
+				match, mismatch, errors = filecmp.cmpfiles(d1, d2, files, shallow=False)
+				self.assertEqual(mismatch + errors, [], format)
+
 
 if __name__ == "__main__":
 	unittest.main()